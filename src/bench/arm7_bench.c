@@ -0,0 +1,253 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * microbenchmark for the ARM7 interpreter's decoded-instruction cache.  It
+ * runs a wave-memory image (such as an AICA driver dumped out of a game) for
+ * the given number of ARM7 cycles, once with the icache disabled (so every
+ * instruction goes through arm7_decode, like before the icache existed) and
+ * once with it enabled, and reports instructions per second for both.
+ *
+ * usage: arm7_bench [image] [millions of cycles]
+ *
+ * The image gets loaded at the start of wave memory and execution starts at
+ * the reset vector.  If no image is given (or the image is "-"), a small
+ * synthetic driver loop is used instead.  AICA's registers are replaced by a
+ * stub that reads as zero and ignores writes.
+ *
+ * Both runs have to end with the same registers and the same wave memory,
+ * otherwise this returns non-zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "washdc/MemoryMap.h"
+#include "mem_areas.h"
+#include "hw/arm7/arm7.h"
+#include "hw/aica/aica_wave_mem.h"
+#include "log.h"
+
+#define DEFAULT_MCYCLES 20
+
+static struct aica_wave_mem wave_mem;
+static struct arm7 arm7;
+static struct memory_map map;
+static struct dc_clock clk;
+
+static uint8_t *image;
+static size_t image_len;
+
+/*
+ * 0x00: mov r0, #0
+ * 0x04: mov r1, #0x1000
+ * 0x08: ldr r2, [r1]
+ * 0x0c: add r2, r2, #1
+ * 0x10: str r2, [r1]
+ * 0x14: add r0, r0, #1
+ * 0x18: and r3, r0, #0xff
+ * 0x1c: cmp r3, #0
+ * 0x20: eor r4, r4, r0
+ * 0x24: orr r5, r4, r3
+ * 0x28: bic r5, r5, #0xf
+ * 0x2c: sub r6, r0, r3
+ * 0x30: tst r5, #1
+ * 0x34: movne r7, r5
+ * 0x38: mul r8, r0, r3
+ * 0x3c: b 0x08
+ */
+static uint32_t const synth_image[] = {
+    0xe3a00000, 0xe3a01a01, 0xe5912000, 0xe2822001,
+    0xe5812000, 0xe2800001, 0xe20030ff, 0xe3530000,
+    0xe0244000, 0xe1845003, 0xe3c5500f, 0xe0406003,
+    0xe3150001, 0x11a07005, 0xe0080390, 0xeafffff1
+};
+
+static uint32_t stub_read_32(uint32_t addr, void *ctxt) {
+    return 0;
+}
+
+static uint16_t stub_read_16(uint32_t addr, void *ctxt) {
+    return 0;
+}
+
+static uint8_t stub_read_8(uint32_t addr, void *ctxt) {
+    return 0;
+}
+
+static void stub_write_32(uint32_t addr, uint32_t val, void *ctxt) {
+}
+
+static void stub_write_16(uint32_t addr, uint16_t val, void *ctxt) {
+}
+
+static void stub_write_8(uint32_t addr, uint8_t val, void *ctxt) {
+}
+
+static struct memory_interface stub_aica_sys_intf = {
+    .read32 = stub_read_32,
+    .read16 = stub_read_16,
+    .read8 = stub_read_8,
+    .write32 = stub_write_32,
+    .write16 = stub_write_16,
+    .write8 = stub_write_8
+};
+
+static int load_image(char const *path) {
+    if (!path || strcmp(path, "-") == 0) {
+        image_len = sizeof(synth_image);
+        image = malloc(image_len);
+        if (!image)
+            return -1;
+        memcpy(image, synth_image, image_len);
+        return 0;
+    }
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "unable to open \"%s\"\n", path);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len <= 0 || len > AICA_WAVE_MEM_LEN) {
+        fprintf(stderr, "\"%s\" is not a valid wave memory image\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    image_len = len;
+    image = malloc(image_len);
+    if (!image || fread(image, image_len, 1, fp) != 1) {
+        fprintf(stderr, "unable to read \"%s\"\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static double seconds_since(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+        (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+/*
+ * run the image from reset for the given number of cycles.  Returns the
+ * number of instructions executed and the number of seconds it took.
+ */
+static unsigned long run(bool icache, unsigned long long n_cycles,
+                         double *secs_out) {
+    aica_wave_mem_init(&wave_mem);
+    memcpy(wave_mem.mem, image, image_len);
+
+    arm7_init(&arm7, &clk, &wave_mem);
+    arm7_set_mem_map(&arm7, &map);
+    arm7.icache_enable = icache;
+    arm7_reset(&arm7, true);
+
+    unsigned long n_insts = 0;
+    unsigned long long cycles = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (cycles < n_cycles) {
+        struct arm7_decoded_inst decoded;
+        arm7_fetch_inst(&arm7, &decoded);
+        cycles += arm7_exec(&arm7, &decoded);
+        n_insts++;
+    }
+    *secs_out = seconds_since(&start);
+
+    return n_insts;
+}
+
+static int run_bench(int argc, char **argv) {
+    char const *path = argc > 1 ? argv[1] : NULL;
+    unsigned long long n_cycles = DEFAULT_MCYCLES;
+    if (argc > 2)
+        n_cycles = strtoull(argv[2], NULL, 0);
+    if (!n_cycles) {
+        fprintf(stderr, "usage: %s [image] [millions of cycles]\n", argv[0]);
+        return 1;
+    }
+    n_cycles *= 1000000;
+
+    if (load_image(path) != 0)
+        return 1;
+
+    memory_map_init(&map);
+    memory_map_add(&map, 0x00000000, 0x007fffff,
+                   0xffffffff, ADDR_AICA_WAVE_MASK, MEMORY_MAP_REGION_UNKNOWN,
+                   &aica_wave_mem_intf, &wave_mem);
+    memory_map_add(&map, 0x00800000, 0x00807fff,
+                   0xffffffff, 0xffffffff, MEMORY_MAP_REGION_UNKNOWN,
+                   &stub_aica_sys_intf, NULL);
+
+    double decode_secs, icache_secs;
+    uint32_t decode_regs[ARM7_REGISTER_COUNT];
+
+    unsigned long decode_insts = run(false, n_cycles, &decode_secs);
+    memcpy(decode_regs, arm7.reg, sizeof(decode_regs));
+    uint8_t *decode_mem = malloc(AICA_WAVE_MEM_LEN);
+    if (!decode_mem)
+        return 1;
+    memcpy(decode_mem, wave_mem.mem, AICA_WAVE_MEM_LEN);
+    arm7_cleanup(&arm7);
+
+    unsigned long icache_insts = run(true, n_cycles, &icache_secs);
+
+    int ret_code = 0;
+    if (decode_insts != icache_insts ||
+        memcmp(decode_regs, arm7.reg, sizeof(decode_regs)) != 0 ||
+        memcmp(decode_mem, wave_mem.mem, AICA_WAVE_MEM_LEN) != 0) {
+        fprintf(stderr, "the icache changed the result of the program\n");
+        ret_code = 1;
+    }
+    arm7_cleanup(&arm7);
+
+    printf("%llu cycles, %lu instructions\n", n_cycles, icache_insts);
+    printf("arm7_decode %7.2f M inst/s, icache %7.2f M inst/s (%.2fx)\n",
+           decode_insts / decode_secs / 1e6, icache_insts / icache_secs / 1e6,
+           decode_secs / icache_secs);
+
+    free(decode_mem);
+    memory_map_cleanup(&map);
+    free(image);
+
+    return ret_code;
+}
+
+int main(int argc, char **argv) {
+    // the emulator code being benchmarked logs through log.c
+    log_init(false, false);
+    int ret_code = run_bench(argc, argv);
+    log_cleanup();
+    return ret_code;
+}
@@ -0,0 +1,305 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+/*
+ * benchmark for the jit front end's compile-time cost, mostly so that the
+ * memory usage of jit_determ_pass can be kept in check.  It runs a wave-memory
+ * image (such as an AICA driver dumped out of a game) on the ARM7 jit for the
+ * given number of cycles, and every block the jit compiled while doing that
+ * becomes the set of hot blocks.  Then each of those blocks is translated into
+ * jit_il and put through jit_opt_run (which ends with jit_determ_pass) over
+ * and over, and this reports the average microseconds spent per block, the
+ * average and worst-case peak heap usage of the determ pass per block, and
+ * how many IL instructions there are per guest instruction before and after
+ * the optimization passes.
+ *
+ * usage: jit_compile_bench [image] [millions of cycles] [reps]
+ *
+ * If no image is given (or the image is "-"), the same synthetic driver loop
+ * as arm7_bench is used.  AICA's registers are replaced by a stub that reads
+ * as zero and ignores writes.
+ *
+ * This is only built with -DJIT_OPTIMIZE since that's the only time
+ * jit_opt and jit_determ_pass get used.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "washdc/MemoryMap.h"
+#include "mem_areas.h"
+#include "hw/arm7/arm7.h"
+#include "hw/arm7/arm7_jit.h"
+#include "hw/aica/aica_wave_mem.h"
+#include "jit/code_block.h"
+#include "jit/jit_determ.h"
+#include "jit/jit_opt.h"
+#include "log.h"
+
+#define DEFAULT_MCYCLES 4
+#define DEFAULT_REPS 100
+
+static struct aica_wave_mem wave_mem;
+static struct arm7 arm7;
+static struct arm7_jit jit;
+static struct memory_map map;
+static struct dc_clock clk;
+
+static uint8_t *image;
+static size_t image_len;
+
+// see arm7_bench.c
+static uint32_t const synth_image[] = {
+    0xe3a00000, 0xe3a01a01, 0xe5912000, 0xe2822001,
+    0xe5812000, 0xe2800001, 0xe20030ff, 0xe3530000,
+    0xe0244000, 0xe1845003, 0xe3c5500f, 0xe0406003,
+    0xe3150001, 0x11a07005, 0xe0080390, 0xeafffff1
+};
+
+static uint32_t stub_read_32(uint32_t addr, void *ctxt) {
+    return 0;
+}
+
+static uint16_t stub_read_16(uint32_t addr, void *ctxt) {
+    return 0;
+}
+
+static uint8_t stub_read_8(uint32_t addr, void *ctxt) {
+    return 0;
+}
+
+static void stub_write_32(uint32_t addr, uint32_t val, void *ctxt) {
+}
+
+static void stub_write_16(uint32_t addr, uint16_t val, void *ctxt) {
+}
+
+static void stub_write_8(uint32_t addr, uint8_t val, void *ctxt) {
+}
+
+static struct memory_interface stub_aica_sys_intf = {
+    .read32 = stub_read_32,
+    .read16 = stub_read_16,
+    .read8 = stub_read_8,
+    .write32 = stub_write_32,
+    .write16 = stub_write_16,
+    .write8 = stub_write_8
+};
+
+static int load_image(char const *path) {
+    if (!path || strcmp(path, "-") == 0) {
+        image_len = sizeof(synth_image);
+        image = malloc(image_len);
+        if (!image)
+            return -1;
+        memcpy(image, synth_image, image_len);
+        return 0;
+    }
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "unable to open \"%s\"\n", path);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (len <= 0 || len > AICA_WAVE_MEM_LEN) {
+        fprintf(stderr, "\"%s\" is not a valid wave memory image\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    image_len = len;
+    image = malloc(image_len);
+    if (!image || fread(image, image_len, 1, fp) != 1) {
+        fprintf(stderr, "unable to read \"%s\"\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static double seconds_since(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+        (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static struct arm7_jit_block *hot_blocks;
+static unsigned n_hot_blocks;
+
+/*
+ * run the image from reset on the jit and record every block it compiled.
+ */
+static int record_hot_blocks(unsigned long long n_cycles) {
+    unsigned long long cycles = 0;
+    unsigned idx;
+    struct arm7_jit_block *blk;
+
+    while (cycles < n_cycles)
+        cycles += arm7_jit_run(&jit);
+
+    for (idx = 0; idx < ARM7_JIT_HASH_LEN; idx++)
+        for (blk = jit.tbl[idx]; blk; blk = blk->next)
+            n_hot_blocks++;
+
+    hot_blocks = calloc(n_hot_blocks, sizeof(struct arm7_jit_block));
+    if (!hot_blocks)
+        return -1;
+
+    n_hot_blocks = 0;
+    for (idx = 0; idx < ARM7_JIT_HASH_LEN; idx++) {
+        for (blk = jit.tbl[idx]; blk; blk = blk->next) {
+            hot_blocks[n_hot_blocks].pc = blk->pc;
+            hot_blocks[n_hot_blocks].mode = blk->mode;
+            n_hot_blocks++;
+        }
+    }
+
+    return 0;
+}
+
+static int run_bench(int argc, char **argv) {
+    char const *path = argc > 1 ? argv[1] : NULL;
+    unsigned long long n_cycles = DEFAULT_MCYCLES;
+    unsigned reps = DEFAULT_REPS;
+    if (argc > 2)
+        n_cycles = strtoull(argv[2], NULL, 0);
+    if (argc > 3)
+        reps = atoi(argv[3]);
+    if (!n_cycles || !reps) {
+        fprintf(stderr, "usage: %s [image] [millions of cycles] [reps]\n",
+                argv[0]);
+        return 1;
+    }
+    n_cycles *= 1000000;
+
+    if (load_image(path) != 0)
+        return 1;
+
+    memory_map_init(&map);
+    memory_map_add(&map, 0x00000000, 0x007fffff,
+                   0xffffffff, ADDR_AICA_WAVE_MASK, MEMORY_MAP_REGION_UNKNOWN,
+                   &aica_wave_mem_intf, &wave_mem);
+    memory_map_add(&map, 0x00800000, 0x00807fff,
+                   0xffffffff, 0xffffffff, MEMORY_MAP_REGION_UNKNOWN,
+                   &stub_aica_sys_intf, NULL);
+
+    aica_wave_mem_init(&wave_mem);
+    memcpy(wave_mem.mem, image, image_len);
+
+    arm7_init(&arm7, &clk, &wave_mem);
+    arm7_set_mem_map(&arm7, &map);
+    arm7_reset(&arm7, true);
+    arm7_jit_init(&jit, &arm7, false, false);
+
+    if (record_hot_blocks(n_cycles) != 0 || !n_hot_blocks) {
+        fprintf(stderr, "no blocks were compiled\n");
+        return 1;
+    }
+
+    struct il_code_block *il_blks =
+        calloc(n_hot_blocks, sizeof(struct il_code_block));
+    if (!il_blks)
+        return 1;
+
+    double translate_secs = 0.0, opt_secs = 0.0;
+    struct jit_opt_stats opt_stats;
+    memset(&opt_stats, 0, sizeof(opt_stats));
+    unsigned long long n_insts = 0, n_il_insts = 0;
+    unsigned long long peak_total = 0, dense_total = 0;
+    size_t peak_max = 0;
+    unsigned rep, blk_no;
+
+    for (rep = 0; rep < reps; rep++) {
+        struct timespec start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (blk_no = 0; blk_no < n_hot_blocks; blk_no++) {
+            il_code_block_init(il_blks + blk_no);
+            arm7_jit_translate(&jit, hot_blocks + blk_no, il_blks + blk_no);
+        }
+        translate_secs += seconds_since(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (blk_no = 0; blk_no < n_hot_blocks; blk_no++) {
+            jit_opt_run(il_blks + blk_no, hot_blocks[blk_no].n_insts,
+                        rep == 0 ? &opt_stats : NULL);
+        }
+        opt_secs += seconds_since(&start);
+
+        for (blk_no = 0; blk_no < n_hot_blocks; blk_no++) {
+            struct il_code_block *il = il_blks + blk_no;
+            size_t peak = il->determ->peak_bytes;
+            if (rep == 0) {
+                n_insts += hot_blocks[blk_no].n_insts;
+                n_il_insts += il->inst_count;
+                peak_total += peak;
+                // what the old table of inst_count * MAX_SLOTS slots needed
+                dense_total += (unsigned long long)il->inst_count *
+                    MAX_SLOTS * sizeof(struct jit_determ_slot);
+                if (peak > peak_max)
+                    peak_max = peak;
+            }
+            il_code_block_cleanup(il);
+        }
+    }
+
+    double n_compiles = (double)n_hot_blocks * reps;
+    printf("%u hot blocks, %.1f ARM7 instructions and %.1f IL instructions "
+           "per block after optimization\n", n_hot_blocks,
+           (double)n_insts / n_hot_blocks, (double)n_il_insts / n_hot_blocks);
+    printf("translate %8.2f us/block, jit_opt and determ pass %8.2f "
+           "us/block\n", translate_secs / n_compiles * 1e6,
+           opt_secs / n_compiles * 1e6);
+    jit_opt_print_stats("ARM7", &opt_stats);
+    printf("determ pass peak %.0f bytes/block on average, %zu bytes worst "
+           "case (a dense table would need %.0f bytes/block)\n",
+           (double)peak_total / n_hot_blocks, peak_max,
+           (double)dense_total / n_hot_blocks);
+
+    free(il_blks);
+    free(hot_blocks);
+    arm7_jit_cleanup(&jit);
+    arm7_cleanup(&arm7);
+    memory_map_cleanup(&map);
+    free(image);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    /*
+     * the emulator code being benchmarked logs through log.c, and so does
+     * jit_opt_print_stats, which is why this one goes to stdout too.
+     */
+    log_init(true, false);
+    int ret_code = run_bench(argc, argv);
+    log_cleanup();
+    return ret_code;
+}
@@ -0,0 +1,239 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * microbenchmark comparing the old linear-scan memory_map dispatch against the
+ * page-table dispatch.  The map is laid out the same way as the SH4's map in
+ * dreamcast.c, but the texture memory and MMIO regions are replaced by stubs
+ * so that this doesn't need to bring up the rest of the emulator.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "washdc/MemoryMap.h"
+#include "memory.h"
+#include "mem_areas.h"
+#include "log.h"
+
+#define N_ACCESSES (1 << 24)
+#define N_ADDRS 4096
+
+static struct Memory ram;
+static struct memory_map map;
+
+static uint32_t tex_mem[(ADDR_TEX32_LAST - ADDR_TEX32_FIRST + 1) / 4];
+
+static uint32_t stub_tex_read_32(uint32_t addr, void *ctxt) {
+    return tex_mem[((addr & 0x1fffffff) - ADDR_TEX32_FIRST) / 4];
+}
+
+static void stub_tex_write_32(uint32_t addr, uint32_t val, void *ctxt) {
+    tex_mem[((addr & 0x1fffffff) - ADDR_TEX32_FIRST) / 4] = val;
+}
+
+static uint32_t mmio_regs[0x1000 / 4];
+
+static uint32_t stub_mmio_read_32(uint32_t addr, void *ctxt) {
+    return mmio_regs[(addr / 4) % (sizeof(mmio_regs) / sizeof(mmio_regs[0]))];
+}
+
+static void stub_mmio_write_32(uint32_t addr, uint32_t val, void *ctxt) {
+    mmio_regs[(addr / 4) % (sizeof(mmio_regs) / sizeof(mmio_regs[0]))] = val;
+}
+
+static struct memory_interface stub_tex_intf = {
+    .read32 = stub_tex_read_32,
+    .write32 = stub_tex_write_32
+};
+
+static struct memory_interface stub_mmio_intf = {
+    .read32 = stub_mmio_read_32,
+    .write32 = stub_mmio_write_32
+};
+
+static void construct_bench_map(struct memory_map *map) {
+    memory_map_add(map, 0xe0000000, 0xffffffff,
+                   0xffffffff, 0xffffffff, MEMORY_MAP_REGION_UNKNOWN,
+                   &stub_mmio_intf, NULL);
+
+    memory_map_add(map, 0x0c000000, 0x0cffffff,
+                   0x1fffffff, ADDR_AREA3_MASK, MEMORY_MAP_REGION_RAM,
+                   &ram_intf, &ram);
+    memory_map_add(map, 0x0d000000, 0x0dffffff,
+                   0x1fffffff, ADDR_AREA3_MASK, MEMORY_MAP_REGION_RAM,
+                   &ram_intf, &ram);
+    memory_map_add(map, 0x0e000000, 0x0effffff,
+                   0x1fffffff, ADDR_AREA3_MASK, MEMORY_MAP_REGION_RAM,
+                   &ram_intf, &ram);
+    memory_map_add(map, 0x0f000000, 0x0fffffff,
+                   0x1fffffff, ADDR_AREA3_MASK, MEMORY_MAP_REGION_RAM,
+                   &ram_intf, &ram);
+
+    memory_map_add(map, ADDR_TEX64_FIRST, ADDR_TEX64_LAST,
+                   0x1fffffff, 0x1fffffff, MEMORY_MAP_REGION_UNKNOWN,
+                   &stub_tex_intf, NULL);
+    memory_map_add(map, ADDR_TEX32_FIRST, ADDR_TEX32_LAST,
+                   0x1fffffff, 0x1fffffff, MEMORY_MAP_REGION_UNKNOWN,
+                   &stub_tex_intf, NULL);
+    memory_map_add(map, ADDR_TA_FIFO_POLY_FIRST, ADDR_TA_FIFO_POLY_LAST,
+                   0x1fffffff, 0x1fffffff, MEMORY_MAP_REGION_UNKNOWN,
+                   &stub_mmio_intf, NULL);
+    memory_map_add(map, 0x7c000000, 0x7fffffff,
+                   0xffffffff, 0xffffffff, MEMORY_MAP_REGION_UNKNOWN,
+                   &stub_mmio_intf, NULL);
+
+    /*
+     * all of the area 0 registers go after the RAM, same as in dreamcast.c.
+     * This is the worst case for the linear scan.
+     */
+    static uint32_t const area0[][2] = {
+        { ADDR_BIOS_FIRST, ADDR_BIOS_LAST },
+        { ADDR_FLASH_FIRST, ADDR_FLASH_LAST },
+        { ADDR_G1_FIRST, ADDR_G1_LAST },
+        { ADDR_SYS_FIRST, ADDR_SYS_LAST },
+        { ADDR_MAPLE_FIRST, ADDR_MAPLE_LAST },
+        { ADDR_G2_FIRST, ADDR_G2_LAST },
+        { ADDR_PVR2_FIRST, ADDR_PVR2_LAST },
+        { ADDR_MODEM_FIRST, ADDR_MODEM_LAST },
+        { ADDR_AICA_WAVE_FIRST, ADDR_AICA_WAVE_LAST },
+        { ADDR_AICA_SYS_FIRST, ADDR_AICA_SYS_LAST },
+        { ADDR_AICA_RTC_FIRST, ADDR_AICA_RTC_LAST },
+        { ADDR_GDROM_FIRST, ADDR_GDROM_LAST },
+        { ADDR_EXT_DEV_FIRST, ADDR_EXT_DEV_LAST }
+    };
+    unsigned mirror, idx;
+    for (mirror = 0; mirror < 2; mirror++) {
+        for (idx = 0; idx < sizeof(area0) / sizeof(area0[0]); idx++) {
+            memory_map_add(map, area0[idx][0] + mirror * 0x02000000,
+                           area0[idx][1] + mirror * 0x02000000,
+                           0x1fffffff, ADDR_AREA0_MASK,
+                           MEMORY_MAP_REGION_UNKNOWN, &stub_mmio_intf, NULL);
+        }
+    }
+}
+
+/*
+ * this is what memory_map_read_32 looked like before it had a page table;
+ * memory_map_get_region is still the same linear scan.
+ */
+static inline uint32_t old_read_32(struct memory_map *map, uint32_t addr) {
+    struct memory_map_region *reg = memory_map_get_region(map, addr, 4);
+    return reg->intf->read32(addr & reg->mask, reg->ctxt);
+}
+
+static inline void old_write_32(struct memory_map *map,
+                                uint32_t addr, uint32_t val) {
+    struct memory_map_region *reg = memory_map_get_region(map, addr, 4);
+    reg->intf->write32(addr & reg->mask, val, reg->ctxt);
+}
+
+static double seconds_since(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+        (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static void fill_addrs(uint32_t *addrs, uint32_t first, uint32_t len) {
+    unsigned idx;
+    for (idx = 0; idx < N_ADDRS; idx++)
+        addrs[idx] = first + ((uint32_t)rand() % len & ~3);
+}
+
+static int run_bench(char const *name, uint32_t const *addrs) {
+    struct timespec start;
+    unsigned idx;
+    uint32_t sum_old = 0, sum_new = 0;
+    double old_read_secs, new_read_secs, old_write_secs, new_write_secs;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (idx = 0; idx < N_ACCESSES; idx++)
+        old_write_32(&map, addrs[idx % N_ADDRS], idx);
+    old_write_secs = seconds_since(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (idx = 0; idx < N_ACCESSES; idx++)
+        sum_old += old_read_32(&map, addrs[idx % N_ADDRS]);
+    old_read_secs = seconds_since(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (idx = 0; idx < N_ACCESSES; idx++)
+        memory_map_write_32(&map, addrs[idx % N_ADDRS], idx);
+    new_write_secs = seconds_since(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (idx = 0; idx < N_ACCESSES; idx++)
+        sum_new += memory_map_read_32(&map, addrs[idx % N_ADDRS]);
+    new_read_secs = seconds_since(&start);
+
+    printf("%-8s read:  linear scan %7.2f ns/access, page table %7.2f "
+           "ns/access (%.2fx)\n", name,
+           old_read_secs * 1e9 / N_ACCESSES, new_read_secs * 1e9 / N_ACCESSES,
+           old_read_secs / new_read_secs);
+    printf("%-8s write: linear scan %7.2f ns/access, page table %7.2f "
+           "ns/access (%.2fx)\n", name,
+           old_write_secs * 1e9 / N_ACCESSES, new_write_secs * 1e9 / N_ACCESSES,
+           old_write_secs / new_write_secs);
+
+    if (sum_old != sum_new) {
+        fprintf(stderr, "%s: old and new dispatch disagree (0x%08x vs "
+                "0x%08x)\n", name, (unsigned)sum_old, (unsigned)sum_new);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    static uint32_t addrs[N_ADDRS];
+    int ret = 0;
+
+    // memory_init logs through log.c
+    log_init(false, false);
+
+    memory_init(&ram);
+    memory_map_init(&map);
+    construct_bench_map(&map);
+
+    // main RAM, through the cached P1 mirror
+    fill_addrs(addrs, 0x8c000000, ADDR_AREA3_MASK + 1);
+    ret |= run_bench("RAM", addrs);
+
+    // 32-bit texture memory, through the uncached P2 mirror
+    fill_addrs(addrs, 0xa0000000 | ADDR_TEX32_FIRST,
+               ADDR_TEX32_LAST - ADDR_TEX32_FIRST + 1);
+    ret |= run_bench("texture", addrs);
+
+    // holly registers, through the uncached P2 mirror
+    fill_addrs(addrs, 0xa0000000 | ADDR_PVR2_FIRST,
+               ADDR_PVR2_LAST - ADDR_PVR2_FIRST + 1);
+    ret |= run_bench("MMIO", addrs);
+
+    memory_map_cleanup(&map);
+    memory_cleanup(&ram);
+
+    log_cleanup();
+
+    return ret;
+}
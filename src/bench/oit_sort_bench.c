@@ -0,0 +1,326 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+
+/*
+ * determinism test and microbenchmark for the translucent polygon depth sort
+ * in gfx/gfx_oit_sort.c.  A synthetic scene of 50k translucent triangles is
+ * built out of sprites (two triangles that share a depth, like particles and
+ * fog) and longer triangle strips.  Then:
+ *
+ *   - the scene is sorted per-group and per-triangle several times over, with
+ *     the scratch buffers scribbled on in between, and every run has to come
+ *     out in exactly the same order.
+ *   - that order has to match qsort on the same keys, and has to be
+ *     back-to-front with ties in submission order.
+ *   - the radix sort is timed against the swap sort the OpenGL renderer used
+ *     to use, which sorted groups by average depth in O(n^2).
+ *
+ * If any check fails this returns non-zero.
+ *
+ * usage: oit_sort_bench [n_triangles] [reps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "gfx/gfx.h"
+#include "gfx/gfx_oit_sort.h"
+
+#define DEFAULT_TRIS (50 * 1000)
+#define DEFAULT_REPS 16
+#define DETERMINISM_RUNS 8
+
+// one in this many groups is a strip of STRIP_TRIS, the rest are sprites
+#define STRIP_RATIO 8
+#define STRIP_TRIS 16
+
+struct group {
+    float const *verts;
+    unsigned n_verts;
+    float avg_depth;
+};
+
+static float *scene_verts;
+static struct group *scene_groups;
+static unsigned n_groups, n_tris;
+
+static uint32_t rng_state = 0x1badb002;
+
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static float rng_depth(void) {
+    // coarse on purpose so that there are plenty of ties
+    return (rng() % 4096) / 4096.0f;
+}
+
+static void build_scene(unsigned tris_wanted) {
+    scene_verts = (float*)calloc((size_t)(tris_wanted + STRIP_TRIS) * 3,
+                                 GFX_VERT_LEN * sizeof(float));
+    scene_groups = (struct group*)calloc(tris_wanted + 1, sizeof(struct group));
+    if (!scene_verts || !scene_groups) {
+        fprintf(stderr, "failed to allocate the scene\n");
+        exit(1);
+    }
+
+    float *outp = scene_verts;
+    n_tris = n_groups = 0;
+    while (n_tris < tris_wanted) {
+        struct group *grp = scene_groups + n_groups;
+        unsigned grp_tris, tri, vert;
+        bool sprite = (n_groups % STRIP_RATIO) != 0;
+        float depth = rng_depth();
+
+        grp_tris = sprite ? 2 : STRIP_TRIS;
+        grp->verts = outp;
+        grp->n_verts = grp_tris * 3;
+
+        for (tri = 0; tri < grp_tris; tri++) {
+            for (vert = 0; vert < 3; vert++) {
+                outp[0] = (float)(rng() % 640);
+                outp[1] = (float)(rng() % 480);
+                outp[2] = sprite ? depth : rng_depth();
+                outp += GFX_VERT_LEN;
+            }
+        }
+
+        grp->avg_depth = gfx_oit_avg_depth(grp->verts, grp->n_verts);
+        n_tris += grp_tris;
+        n_groups++;
+    }
+}
+
+static void fill_sort(struct gfx_oit_sort *sort, bool per_tri) {
+    unsigned grp_no, tri;
+    gfx_oit_sort_clear(sort);
+    for (grp_no = 0; grp_no < n_groups; grp_no++) {
+        struct group const *grp = scene_groups + grp_no;
+        if (per_tri) {
+            for (tri = 0; tri < grp->n_verts / 3; tri++) {
+                gfx_oit_sort_add(sort, gfx_oit_avg_depth(grp->verts +
+                                                         tri * 3 * GFX_VERT_LEN,
+                                                         3));
+            }
+        } else {
+            gfx_oit_sort_add(sort, grp->avg_depth);
+        }
+    }
+}
+
+static int key_cmp(void const *lhs_p, void const *rhs_p) {
+    uint64_t lhs = *(uint64_t const*)lhs_p, rhs = *(uint64_t const*)rhs_p;
+    return lhs < rhs ? -1 : (lhs > rhs ? 1 : 0);
+}
+
+static float key_depth(uint64_t key) {
+    uint32_t bits = ~(uint32_t)(key >> 32);
+    float depth;
+    if (bits & 0x80000000)
+        bits &= ~0x80000000;
+    else
+        bits = ~bits;
+    memcpy(&depth, &bits, sizeof(depth));
+    return depth;
+}
+
+static bool check_sort(bool per_tri) {
+    struct gfx_oit_sort sort;
+    uint64_t *first_run, *ref;
+    unsigned run, idx, n_keys;
+    bool success = true;
+
+    gfx_oit_sort_init(&sort);
+
+    fill_sort(&sort, per_tri);
+    n_keys = sort.n_keys;
+    first_run = (uint64_t*)malloc(n_keys * sizeof(uint64_t));
+    ref = (uint64_t*)malloc(n_keys * sizeof(uint64_t));
+    if (!first_run || !ref) {
+        fprintf(stderr, "failed to allocate keys\n");
+        exit(1);
+    }
+
+    memcpy(ref, sort.keys, n_keys * sizeof(uint64_t));
+    qsort(ref, n_keys, sizeof(uint64_t), key_cmp);
+
+    for (run = 0; run < DETERMINISM_RUNS; run++) {
+        fill_sort(&sort, per_tri);
+        memset(sort.tmp, run * 0x11, sort.cap * sizeof(uint64_t));
+        gfx_oit_sort_exec(&sort);
+
+        if (run == 0)
+            memcpy(first_run, sort.keys, n_keys * sizeof(uint64_t));
+        else if (memcmp(first_run, sort.keys, n_keys * sizeof(uint64_t)) != 0) {
+            printf("%s: run %u came out in a different order\n",
+                   per_tri ? "per-triangle" : "per-group", run);
+            success = false;
+        }
+    }
+
+    if (memcmp(first_run, ref, n_keys * sizeof(uint64_t)) != 0) {
+        printf("%s: radix sort doesn't match qsort\n",
+               per_tri ? "per-triangle" : "per-group");
+        success = false;
+    }
+
+    for (idx = 1; idx < n_keys; idx++) {
+        float prev_depth = key_depth(first_run[idx - 1]);
+        float depth = key_depth(first_run[idx]);
+        if (depth > prev_depth ||
+            (depth == prev_depth && gfx_oit_sort_idx(first_run[idx]) <
+             gfx_oit_sort_idx(first_run[idx - 1]))) {
+            printf("%s: keys %u and %u are out of order\n",
+                   per_tri ? "per-triangle" : "per-group", idx - 1, idx);
+            success = false;
+            break;
+        }
+    }
+
+    // hash of the final order, so separate runs of this program can be compared
+    uint64_t hash = 0xcbf29ce484222325;
+    for (idx = 0; idx < n_keys; idx++) {
+        hash ^= gfx_oit_sort_idx(first_run[idx]);
+        hash *= 0x100000001b3;
+    }
+    printf("%s: %u keys, order hash %016llx\n",
+           per_tri ? "per-triangle" : "per-group", n_keys,
+           (unsigned long long)hash);
+
+    free(ref);
+    free(first_run);
+    gfx_oit_sort_cleanup(&sort);
+    return success;
+}
+
+static double seconds_since(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+        (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+// the sort opengl_renderer_end_sort_mode used to do, minus the group limit
+static void swap_sort(struct group *groups, unsigned grp_cnt) {
+    unsigned src_idx, dst_idx;
+    struct group tmp;
+    for (src_idx = 0; src_idx < grp_cnt - 1; src_idx++) {
+        struct group *grp_src = groups + src_idx;
+        for (dst_idx = src_idx + 1; dst_idx < grp_cnt; dst_idx++) {
+            struct group *grp_dst = groups + dst_idx;
+            if (grp_dst->avg_depth >= grp_src->avg_depth) {
+                tmp = *grp_src;
+                *grp_src = *grp_dst;
+                *grp_dst = tmp;
+            }
+        }
+    }
+}
+
+static double time_swap_sort(void) {
+    struct group *groups =
+        (struct group*)malloc(n_groups * sizeof(struct group));
+    struct timespec start;
+    double secs;
+
+    if (!groups) {
+        fprintf(stderr, "failed to allocate groups\n");
+        exit(1);
+    }
+
+    memcpy(groups, scene_groups, n_groups * sizeof(struct group));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    swap_sort(groups, n_groups);
+    secs = seconds_since(&start);
+
+    free(groups);
+    return secs;
+}
+
+// includes computing the depths, since the renderer does that every frame too
+static double time_radix_sort(bool per_tri, unsigned reps) {
+    struct gfx_oit_sort sort;
+    struct timespec start;
+    unsigned rep;
+
+    gfx_oit_sort_init(&sort);
+    fill_sort(&sort, per_tri); // so that the buffers are already big enough
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (rep = 0; rep < reps; rep++) {
+        fill_sort(&sort, per_tri);
+        gfx_oit_sort_exec(&sort);
+    }
+    double secs = seconds_since(&start) / reps;
+
+    gfx_oit_sort_cleanup(&sort);
+    return secs;
+}
+
+int main(int argc, char **argv) {
+    unsigned tris_wanted = DEFAULT_TRIS;
+    unsigned reps = DEFAULT_REPS;
+    bool success = true;
+
+    if (argc > 1)
+        tris_wanted = atoi(argv[1]);
+    if (argc > 2)
+        reps = atoi(argv[2]);
+    if (!tris_wanted || !reps) {
+        fprintf(stderr, "usage: %s [n_triangles] [reps]\n", argv[0]);
+        return 1;
+    }
+
+    build_scene(tris_wanted);
+    printf("%u translucent triangles in %u groups\n", n_tris, n_groups);
+
+    if (!check_sort(false))
+        success = false;
+    if (!check_sort(true))
+        success = false;
+
+    double swap_secs = time_swap_sort();
+    double group_secs = time_radix_sort(false, reps);
+    double tri_secs = time_radix_sort(true, reps);
+
+    printf("swap sort, per-group:    %10.3f ms\n", swap_secs * 1000.0);
+    printf("radix sort, per-group:   %10.3f ms\n", group_secs * 1000.0);
+    printf("radix sort, per-triangle:%10.3f ms\n", tri_secs * 1000.0);
+
+    free(scene_groups);
+    free(scene_verts);
+
+    if (!success) {
+        printf("FAILURE\n");
+        return 1;
+    }
+    printf("SUCCESS\n");
+    return 0;
+}
@@ -0,0 +1,378 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * microbenchmark comparing the old sorted-list scheduler against dc_sched.c,
+ * which keeps small queues sorted and switches to a binary heap once a clock
+ * has more than DC_SCHED_LIST_MAX events.  The workload is a trace recorded by washingtondc's -r
+ * option, so the mix of sched_event/cancel_event/pop_event calls and the
+ * number of events in flight match what a real game does.  If no trace is
+ * given (or the trace is "-"), a synthetic one is generated instead.
+ *
+ * usage: sched_bench [trace] [reps] [synthetic event count]
+ *
+ * Both implementations have to pop the same events in the same order as the
+ * emulator did when the trace was recorded, otherwise this returns non-zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dc_sched.h"
+#include "log.h"
+
+#define DEFAULT_REPS 16
+#define SYNTH_N_RECS (1 << 20)
+#define SYNTH_DEFAULT_EVENTS 24
+
+static struct dc_sched_trace_rec *recs;
+static size_t n_recs;
+static unsigned n_clocks, n_events;
+static unsigned synth_n_events = SYNTH_DEFAULT_EVENTS;
+
+/*
+ * this is what dc_sched looked like before it had a heap: every clock keeps a
+ * list of events sorted by when, and new events go in front of any events
+ * that have the same timestamp.  It also updated the clock's target stamp
+ * after every call, same as dc_sched does.
+ */
+struct old_event {
+    dc_cycle_stamp_t when;
+    struct old_event *next_event;
+    struct old_event **pprev_event;
+};
+
+struct old_clock {
+    struct old_event *ev_next;
+    dc_cycle_stamp_t now, target;
+};
+
+static void old_update_target_stamp(struct old_clock *clock) {
+    if (clock->ev_next)
+        clock->target = clock->ev_next->when;
+    else
+        clock->target = clock->now + 16;
+}
+
+static void old_sched_event(struct old_clock *clock, struct old_event *event) {
+    struct old_event *next_ptr = clock->ev_next;
+    struct old_event **pprev_ptr = &clock->ev_next;
+    while (next_ptr && next_ptr->when < event->when) {
+        pprev_ptr = &next_ptr->next_event;
+        next_ptr = next_ptr->next_event;
+    }
+    *pprev_ptr = event;
+    if (next_ptr)
+        next_ptr->pprev_event = &event->next_event;
+    event->next_event = next_ptr;
+    event->pprev_event = pprev_ptr;
+
+    old_update_target_stamp(clock);
+}
+
+static void old_cancel_event(struct old_clock *clock, struct old_event *event) {
+    if (event->next_event)
+        event->next_event->pprev_event = event->pprev_event;
+    *event->pprev_event = event->next_event;
+    event->next_event = NULL;
+    event->pprev_event = NULL;
+
+    old_update_target_stamp(clock);
+}
+
+static struct old_event *old_pop_event(struct old_clock *clock) {
+    struct old_event *ev_ret = clock->ev_next;
+    if (ev_ret) {
+        clock->ev_next = ev_ret->next_event;
+        if (clock->ev_next)
+            clock->ev_next->pprev_event = &clock->ev_next;
+        ev_ret->next_event = NULL;
+        ev_ret->pprev_event = NULL;
+    }
+
+    old_update_target_stamp(clock);
+
+    return ev_ret;
+}
+
+static double seconds_since(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+        (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static int load_trace(char const *path) {
+    FILE *fp = fopen(path, "rb");
+    long len;
+
+    if (!fp) {
+        fprintf(stderr, "unable to open \"%s\"\n", path);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    n_recs = len / sizeof(struct dc_sched_trace_rec);
+    recs = malloc(n_recs * sizeof(struct dc_sched_trace_rec));
+    if (!recs || fread(recs, sizeof(recs[0]), n_recs, fp) != n_recs) {
+        fprintf(stderr, "unable to read \"%s\"\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+/*
+ * one clock, synth_n_events periodic events with random periods, and the
+ * occasional cancel/reschedule.  This is roughly what the SH4 clock looks
+ * like with the SPG, TMU and a few DMA transfers in flight.
+ */
+static int synth_trace(void) {
+    static dc_cycle_stamp_t when[DC_SCHED_TRACE_MAX_EVENTS];
+    static int scheduled[DC_SCHED_TRACE_MAX_EVENTS];
+    dc_cycle_stamp_t now = 0;
+    unsigned idx;
+
+    recs = malloc(SYNTH_N_RECS * sizeof(struct dc_sched_trace_rec));
+    if (!recs)
+        return -1;
+    memset(recs, 0, SYNTH_N_RECS * sizeof(struct dc_sched_trace_rec));
+
+    for (idx = 0; idx < synth_n_events && n_recs < SYNTH_N_RECS; idx++) {
+        when[idx] = 1 + rand() % 4096;
+        scheduled[idx] = 1;
+        recs[n_recs++] = (struct dc_sched_trace_rec) {
+            .now = now, .when = when[idx],
+            .op = DC_SCHED_TRACE_SCHED, .event_id = idx
+        };
+    }
+
+    while (n_recs + 2 < SYNTH_N_RECS) {
+        unsigned next = synth_n_events;
+        for (idx = 0; idx < synth_n_events; idx++) {
+            if (scheduled[idx] && (next == synth_n_events ||
+                                   when[idx] <= when[next]))
+                next = idx;
+        }
+        if (next == synth_n_events)
+            break;
+
+        if (rand() % 8 == 0) {
+            // cancel something that hasn't happened yet and push it back
+            idx = rand() % synth_n_events;
+            if (scheduled[idx]) {
+                recs[n_recs++] = (struct dc_sched_trace_rec) {
+                    .now = now, .when = when[idx],
+                    .op = DC_SCHED_TRACE_CANCEL, .event_id = idx
+                };
+                when[idx] += 1 + rand() % 4096;
+                recs[n_recs++] = (struct dc_sched_trace_rec) {
+                    .now = now, .when = when[idx],
+                    .op = DC_SCHED_TRACE_SCHED, .event_id = idx
+                };
+                continue;
+            }
+        }
+
+        /*
+         * dc_sched and the list both break ties in favor of whichever event
+         * was scheduled last; recompute the winner that way so the expected
+         * pop order in the trace is correct.
+         */
+        now = when[next];
+        for (idx = n_recs; idx-- > 0;) {
+            if (recs[idx].op == DC_SCHED_TRACE_SCHED &&
+                recs[idx].when == now && scheduled[recs[idx].event_id] &&
+                when[recs[idx].event_id] == now) {
+                next = recs[idx].event_id;
+                break;
+            }
+        }
+
+        recs[n_recs++] = (struct dc_sched_trace_rec) {
+            .now = now, .when = now,
+            .op = DC_SCHED_TRACE_POP, .event_id = next
+        };
+        when[next] = now + 1 + rand() % 4096;
+        recs[n_recs++] = (struct dc_sched_trace_rec) {
+            .now = now, .when = when[next],
+            .op = DC_SCHED_TRACE_SCHED, .event_id = next
+        };
+    }
+
+    return 0;
+}
+
+static int check_pop(char const *name, size_t rec_no, unsigned expect,
+                     unsigned actual) {
+    if (expect != actual) {
+        fprintf(stderr, "%s: record %zu popped event %u instead of %u\n",
+                name, rec_no, actual, expect);
+        return 1;
+    }
+    return 0;
+}
+
+static int replay_sched(struct dc_clock *clocks, struct SchedEvent *events) {
+    size_t rec_no;
+    for (rec_no = 0; rec_no < n_recs; rec_no++) {
+        struct dc_sched_trace_rec const *rec = recs + rec_no;
+        struct dc_clock *clock = clocks + rec->clock_id;
+        struct SchedEvent *ev;
+
+        clock_set_cycle_stamp(clock, rec->now);
+        switch (rec->op) {
+        case DC_SCHED_TRACE_SCHED:
+            events[rec->event_id].when = rec->when;
+            sched_event(clock, events + rec->event_id);
+            break;
+        case DC_SCHED_TRACE_CANCEL:
+            cancel_event(clock, events + rec->event_id);
+            break;
+        case DC_SCHED_TRACE_POP:
+            ev = pop_event(clock);
+            if (check_pop("dc_sched", rec_no, rec->event_id,
+                          ev ? (unsigned)(ev - events) :
+                          DC_SCHED_TRACE_NO_EVENT))
+                return 1;
+            break;
+        }
+    }
+    return 0;
+}
+
+static int replay_list(struct old_clock *clocks, struct old_event *events) {
+    size_t rec_no;
+    for (rec_no = 0; rec_no < n_recs; rec_no++) {
+        struct dc_sched_trace_rec const *rec = recs + rec_no;
+        struct old_clock *clock = clocks + rec->clock_id;
+        struct old_event *ev;
+
+        clock->now = rec->now;
+        switch (rec->op) {
+        case DC_SCHED_TRACE_SCHED:
+            events[rec->event_id].when = rec->when;
+            old_sched_event(clock, events + rec->event_id);
+            break;
+        case DC_SCHED_TRACE_CANCEL:
+            old_cancel_event(clock, events + rec->event_id);
+            break;
+        case DC_SCHED_TRACE_POP:
+            ev = old_pop_event(clock);
+            if (check_pop("list", rec_no, rec->event_id,
+                          ev ? (unsigned)(ev - events) :
+                          DC_SCHED_TRACE_NO_EVENT))
+                return 1;
+            break;
+        }
+    }
+    return 0;
+}
+
+static int run_bench(int argc, char **argv) {
+    static struct dc_clock clocks[DC_SCHED_TRACE_MAX_CLOCKS];
+    static struct SchedEvent events[DC_SCHED_TRACE_MAX_EVENTS];
+    static struct old_clock old_clocks[DC_SCHED_TRACE_MAX_CLOCKS];
+    static struct old_event old_events[DC_SCHED_TRACE_MAX_EVENTS];
+    unsigned rep, reps = DEFAULT_REPS, idx;
+    double sched_secs = 0.0, list_secs = 0.0;
+    struct timespec start;
+    size_t rec_no;
+
+    if (argc >= 3)
+        reps = atoi(argv[2]);
+    if (argc >= 4)
+        synth_n_events = atoi(argv[3]);
+    if (!synth_n_events || synth_n_events > DC_SCHED_TRACE_MAX_EVENTS) {
+        fprintf(stderr, "the synthetic event count must be between 1 and "
+                "%d\n", DC_SCHED_TRACE_MAX_EVENTS);
+        return 1;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "-") != 0) {
+        if (load_trace(argv[1]) != 0)
+            return 1;
+    } else if (synth_trace() != 0) {
+        return 1;
+    }
+
+    for (rec_no = 0; rec_no < n_recs; rec_no++) {
+        if (recs[rec_no].clock_id >= DC_SCHED_TRACE_MAX_CLOCKS ||
+            (recs[rec_no].event_id >= DC_SCHED_TRACE_MAX_EVENTS &&
+             recs[rec_no].event_id != DC_SCHED_TRACE_NO_EVENT)) {
+            fprintf(stderr, "record %zu is corrupt\n", rec_no);
+            return 1;
+        }
+        if (recs[rec_no].clock_id >= n_clocks)
+            n_clocks = recs[rec_no].clock_id + 1;
+        if (recs[rec_no].event_id != DC_SCHED_TRACE_NO_EVENT &&
+            recs[rec_no].event_id >= n_events)
+            n_events = recs[rec_no].event_id + 1;
+    }
+
+    for (rep = 0; rep < reps; rep++) {
+        for (idx = 0; idx < n_clocks; idx++)
+            dc_clock_init(clocks + idx);
+        memset(events, 0, sizeof(events));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (replay_sched(clocks, events) != 0)
+            return 1;
+        sched_secs += seconds_since(&start);
+
+        for (idx = 0; idx < n_clocks; idx++)
+            dc_clock_cleanup(clocks + idx);
+
+        memset(old_clocks, 0, sizeof(old_clocks));
+        memset(old_events, 0, sizeof(old_events));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (replay_list(old_clocks, old_events) != 0)
+            return 1;
+        list_secs += seconds_since(&start);
+    }
+
+    printf("%zu records, %u clocks, %u events\n", n_recs, n_clocks, n_events);
+    printf("sorted list %7.2f ns/op, dc_sched %7.2f ns/op (%.2fx)\n",
+           list_secs * 1e9 / (n_recs * (double)reps),
+           sched_secs * 1e9 / (n_recs * (double)reps),
+           list_secs / sched_secs);
+
+    free(recs);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    // dc_sched logs through log.c
+    log_init(false, false);
+    int ret_code = run_bench(argc, argv);
+    log_cleanup();
+    return ret_code;
+}
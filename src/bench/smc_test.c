@@ -0,0 +1,177 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * self-modifying code test for the code cache.  A block in main RAM gets
+ * compiled for the IL interpreter and run, then its code is overwritten with a
+ * byte store and afterwards with a store-queue burst.  Each time, the new code
+ * has to be what runs next, without the cache ever getting flushed.
+ */
+
+#include <stdio.h>
+
+#include "washdc/MemoryMap.h"
+#include "memory.h"
+#include "mem_areas.h"
+#include "log.h"
+#include "dc_sched.h"
+#include "hw/sh4/sh4.h"
+#include "hw/sh4/sh4_jit.h"
+#include "hw/sh4/sh4_ocache.h"
+#include "hw/sh4/sh4_reg_flags.h"
+#include "jit/jit.h"
+#include "jit/code_cache.h"
+#include "jit/jit_intp/code_block_intp.h"
+
+// the block under test, through the cached P1 mirror
+#define CODE_ADDR 0x8c010000
+
+// the start of the page after the one CODE_ADDR is on
+#define DATA_ADDR (CODE_ADDR + (1 << CODE_CACHE_PAGE_SHIFT))
+
+#define SH4_INST_MOV_IMM_R0(imm) (0xe000 | (uint8_t)(imm))
+#define SH4_INST_RTS 0x000b
+#define SH4_INST_NOP 0x0009
+
+static Sh4 sh4;
+static struct dc_clock clk;
+static struct Memory ram;
+static struct memory_map map;
+
+// compile the block at pc if it isn't compiled already, run it and return R0
+static reg32_t run_block(addr32_t pc) {
+    struct cache_entry *ent = code_cache_find(pc);
+    struct code_block_intp *blk = &ent->blk.intp;
+    if (!ent->valid) {
+        sh4_jit_compile_intp(&sh4, blk, pc);
+        ent->valid = true;
+    }
+
+    sh4.reg[SH4_REG_R0] = 0;
+    code_block_intp_exec(&sh4, blk);
+    code_cache_gc();
+
+    return sh4.reg[SH4_REG_R0];
+}
+
+static int check_block(char const *what, unsigned expect) {
+    reg32_t r0 = run_block(CODE_ADDR);
+    if (r0 != expect) {
+        fprintf(stderr, "after %s: R0 is %u, expected %u\n",
+                what, (unsigned)r0, expect);
+        return -1;
+    }
+    return 0;
+}
+
+static int check_smc(void) {
+    struct code_cache_stats stats;
+
+    // mov #1, r0 ; rts ; nop
+    memory_map_write_16(&map, CODE_ADDR, SH4_INST_MOV_IMM_R0(1));
+    memory_map_write_16(&map, CODE_ADDR + 2, SH4_INST_RTS);
+    memory_map_write_16(&map, CODE_ADDR + 4, SH4_INST_NOP);
+    if (check_block("initial compile", 1) != 0)
+        return -1;
+
+    // run it again to make sure it stays compiled
+    if (check_block("second run", 1) != 0)
+        return -1;
+
+    // writing to a different page must not throw it out
+    memory_map_write_8(&map, DATA_ADDR, 0xff);
+    code_cache_get_stats(&stats);
+    if (stats.n_blocks_invalidated != 0) {
+        fprintf(stderr, "a store to the next page invalidated the block\n");
+        return -1;
+    }
+
+    // mov #1, r0 becomes mov #2, r0
+    memory_map_write_8(&map, CODE_ADDR, 2);
+    if (check_block("byte store", 2) != 0)
+        return -1;
+
+    // replace the entire block with mov #3, r0 ; rts ; nop
+    addr32_t sq_addr = SH4_AREA_P4_FIRST | (CODE_ADDR & SH4_SQ_ADDR_MASK);
+    sh4.reg[SH4_REG_QACR0] =
+        (((CODE_ADDR >> 26) << SH4_QACR_SHIFT) & SH4_QACR_MASK);
+    sh4_sq_write_32(&sh4, sq_addr,
+                    SH4_INST_MOV_IMM_R0(3) | (SH4_INST_RTS << 16));
+    unsigned word_no;
+    for (word_no = 1; word_no < 8; word_no++) {
+        sh4_sq_write_32(&sh4, sq_addr + 4 * word_no,
+                        SH4_INST_NOP | (SH4_INST_NOP << 16));
+    }
+    sh4_sq_pref(&sh4, sq_addr);
+    if (check_block("store-queue burst", 3) != 0)
+        return -1;
+
+    code_cache_get_stats(&stats);
+    if (stats.n_full_flush != 0) {
+        fprintf(stderr, "the code cache got flushed %llu times\n",
+                stats.n_full_flush);
+        return -1;
+    }
+    if (stats.n_blocks_invalidated != 2) {
+        fprintf(stderr, "expected 2 blocks to be invalidated, not %llu\n",
+                stats.n_blocks_invalidated);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int ret;
+
+    log_init(false, false);
+
+    dc_clock_init(&clk);
+    memory_init(&ram);
+    memory_map_init(&map);
+
+    // main RAM and its mirrors, same as in dreamcast.c
+    memory_map_add(&map, 0x0c000000, 0x0fffffff,
+                   0x1fffffff, ADDR_AREA3_MASK, MEMORY_MAP_REGION_RAM,
+                   &ram_intf, &ram);
+
+    sh4_init(&sh4, &clk);
+    sh4_set_mem_map(&sh4, &map);
+    jit_init(&clk);
+
+    if (check_smc() == 0) {
+        printf("self-modifying code test passed\n");
+        ret = 0;
+    } else {
+        printf("self-modifying code test FAILED\n");
+        ret = 1;
+    }
+
+    jit_cleanup();
+    sh4_cleanup(&sh4);
+    memory_map_cleanup(&map);
+    memory_cleanup(&ram);
+    dc_clock_cleanup(&clk);
+    log_cleanup();
+
+    return ret;
+}
@@ -0,0 +1,375 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * microbenchmark for the PVR2's TA FIFO.  It replays a stream of TA FIFO
+ * writes three ways: one byte at a time (which is how every write was handled
+ * before the FIFO took whole words), one 32-bit word at a time (a CPU store
+ * through the memory map) and in 32-byte bursts (a store-queue flush or a
+ * channel-2 DMA), and reports packets per second for each.
+ *
+ * usage: ta_fifo_bench [capture] [reps]
+ *
+ * The capture is a file recorded with the pvr2.ta-capture option in wash.cfg.
+ * If no capture is given (or the capture is "-"), a synthetic stream of
+ * triangle strips in the common vertex formats is used instead.
+ *
+ * The TA state is thrown away (outside of the timed region) whenever its
+ * vertex buffer or command list starts getting full, since there's no
+ * STARTRENDER here to do that.  All three ways of writing the stream have to
+ * produce the same packets and vertices, otherwise this returns non-zero.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "dc_sched.h"
+#include "gfx/gfx.h"
+#include "hw/pvr2/pvr2.h"
+#include "hw/pvr2/pvr2_ta.h"
+#include "log.h"
+
+#define DEFAULT_REPS 32
+
+#define SYNTH_STRIPS 4096
+#define SYNTH_STRIP_LEN 8
+
+// start over once there's this much stuff in the TA
+#define RESET_VERTS (512 * 1024)
+#define RESET_GFX_IL (128 * 1024)
+
+enum write_mode {
+    WRITE_MODE_BYTE,
+    WRITE_MODE_WORD,
+    WRITE_MODE_BURST,
+
+    WRITE_MODE_COUNT
+};
+
+static char const *mode_names[WRITE_MODE_COUNT] = {
+    [WRITE_MODE_BYTE] = "byte",
+    [WRITE_MODE_WORD] = "word",
+    [WRITE_MODE_BURST] = "burst"
+};
+
+struct replay_result {
+    unsigned long long n_pkts;
+    unsigned long long n_verts;
+    uint64_t vert_hash;
+};
+
+static uint32_t *stream;
+static size_t stream_len; // in 32-bit words
+
+static int load_capture(char const *path) {
+    FILE *fp = fopen(path, "rb");
+    long len;
+
+    if (!fp) {
+        fprintf(stderr, "unable to open \"%s\"\n", path);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    // anything after the last whole packet can't do anything anyways
+    stream_len = (len / 32) * 8;
+    stream = malloc(stream_len * sizeof(uint32_t));
+    if (!stream ||
+        fread(stream, sizeof(uint32_t), stream_len, fp) != stream_len) {
+        fprintf(stderr, "unable to read \"%s\"\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static void put_word(size_t *idx, uint32_t val) {
+    stream[(*idx)++] = val;
+}
+
+static void put_float(size_t *idx, float val) {
+    uint32_t tmp;
+    memcpy(&tmp, &val, sizeof(tmp));
+    put_word(idx, tmp);
+}
+
+/*
+ * opaque triangle strips, cycling between packed color, floating-point color,
+ * textured packed color with 16-bit texture coordinates and textured
+ * floating-point color (which has 64-byte vertices).
+ */
+static int synth_capture(void) {
+    size_t idx = 0;
+    unsigned strip, vert;
+
+    // the biggest strips are 8 words for the header and 16 per vertex
+    stream_len = SYNTH_STRIPS * (8 + 16 * SYNTH_STRIP_LEN) + 8;
+    stream = malloc(stream_len * sizeof(uint32_t));
+    if (!stream)
+        return -1;
+
+    for (strip = 0; strip < SYNTH_STRIPS; strip++) {
+        unsigned fmt = strip % 4;
+        bool tex = fmt >= 2;
+        bool float_color = fmt == 1 || fmt == 3;
+
+        // polygon header for the opaque list with gouraud shading
+        put_word(&idx, (4u << 29) | (float_color << 4) | (tex << 3) |
+                 (1 << 1) | (fmt == 2));
+        /*
+         * ISP/TSP and texture control words.  With all of these zeroed,
+         * textures are 8x8, ARGB1555 and twiddled at address 0.
+         */
+        put_word(&idx, 0);
+        put_word(&idx, 0);
+        put_word(&idx, 0);
+        put_word(&idx, 0);
+        put_word(&idx, 0);
+        put_word(&idx, 0);
+        put_word(&idx, 0);
+
+        for (vert = 0; vert < SYNTH_STRIP_LEN; vert++) {
+            bool end_of_strip = vert == SYNTH_STRIP_LEN - 1;
+            float x = (float)(strip % 64) * 10.0f + (vert / 2) * 4.0f;
+            float y = (float)(strip / 64) * 7.0f + (vert % 2) * 6.0f;
+            float z = 1.0f / (1.0f + strip * 0.01f + vert);
+            uint32_t argb = 0xff000000 | (strip * 0x010305) | vert;
+
+            put_word(&idx, (7u << 29) | (end_of_strip << 28));
+            put_float(&idx, x);
+            put_float(&idx, y);
+            put_float(&idx, z);
+
+            switch (fmt) {
+            case 0:
+                put_word(&idx, 0);
+                put_word(&idx, 0);
+                put_word(&idx, argb);
+                put_word(&idx, 0);
+                break;
+            case 1:
+                put_float(&idx, 1.0f);
+                put_float(&idx, (argb >> 16 & 0xff) / 255.0f);
+                put_float(&idx, (argb >> 8 & 0xff) / 255.0f);
+                put_float(&idx, (argb & 0xff) / 255.0f);
+                break;
+            case 2:
+                // u and v are the upper halves of single-precision floats
+                put_word(&idx, (0x3f00 + vert * 0x20) << 16 |
+                         (0x3e80 + vert * 0x10));
+                put_word(&idx, 0);
+                put_word(&idx, argb);
+                put_word(&idx, 0xff101010);
+                break;
+            case 3:
+                put_float(&idx, vert * 0.125f);
+                put_float(&idx, (vert % 2) * 1.0f);
+                put_word(&idx, 0);
+                put_word(&idx, 0);
+                put_float(&idx, 1.0f);
+                put_float(&idx, (argb >> 16 & 0xff) / 255.0f);
+                put_float(&idx, (argb >> 8 & 0xff) / 255.0f);
+                put_float(&idx, (argb & 0xff) / 255.0f);
+                put_float(&idx, 0.0f);
+                put_float(&idx, 0.0f);
+                put_float(&idx, 0.0f);
+                put_float(&idx, 0.0f);
+                break;
+            }
+        }
+    }
+
+    // end of list
+    put_word(&idx, 0);
+    put_word(&idx, 0);
+    put_word(&idx, 0);
+    put_word(&idx, 0);
+    put_word(&idx, 0);
+    put_word(&idx, 0);
+    put_word(&idx, 0);
+    put_word(&idx, 0);
+
+    stream_len = idx;
+    return 0;
+}
+
+static double seconds_since(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+        (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static bool ta_full(struct pvr2 const *pvr2) {
+    struct pvr2_ta const *ta = &pvr2->ta;
+    return ta->ta_fifo_byte_count == 0 &&
+        (ta->pvr2_ta_vert_buf_count >= RESET_VERTS ||
+         ta->gfx_il_inst_buf_count >= RESET_GFX_IL);
+}
+
+static void ta_begin(struct pvr2 *pvr2, struct dc_clock *clk) {
+    dc_clock_init(clk);
+    pvr2_init(pvr2, clk);
+}
+
+// fold everything the TA has produced into res, then tear it down
+static void ta_end(struct pvr2 *pvr2, struct dc_clock *clk,
+                   struct replay_result *res) {
+    struct pvr2_ta const *ta = &pvr2->ta;
+    size_t n_floats = (size_t)ta->pvr2_ta_vert_buf_count * GFX_VERT_LEN;
+    uint32_t const *verts = (uint32_t const*)ta->pvr2_ta_vert_buf;
+    size_t idx;
+
+    // FNV-1a over the bit patterns
+    for (idx = 0; idx < n_floats; idx++) {
+        res->vert_hash ^= verts[idx];
+        res->vert_hash *= 0x100000001b3ull;
+    }
+    res->n_verts += ta->pvr2_ta_vert_buf_count;
+    res->n_pkts += ta->pkt_count;
+
+    pvr2_cleanup(pvr2);
+    dc_clock_cleanup(clk);
+}
+
+static double replay(enum write_mode mode, struct replay_result *res) {
+    static struct pvr2 pvr2;
+    static struct dc_clock clk;
+    double secs = 0.0;
+    size_t word_no = 0;
+
+    memset(res, 0, sizeof(*res));
+    res->vert_hash = 0xcbf29ce484222325ull;
+
+    ta_begin(&pvr2, &clk);
+    while (word_no < stream_len) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        /*
+         * check the time once per batch of 32-byte chunks; clock_gettime
+         * would drown everything else out otherwise.
+         */
+        unsigned chunk;
+        for (chunk = 0; chunk < 256 && word_no < stream_len; chunk++) {
+            uint32_t const *src = stream + word_no;
+            unsigned idx;
+
+            switch (mode) {
+            case WRITE_MODE_BYTE:
+                for (idx = 0; idx < 32; idx++) {
+                    pvr2_ta_fifo_poly_write_8(0, ((uint8_t const*)src)[idx],
+                                              &pvr2);
+                }
+                break;
+            case WRITE_MODE_WORD:
+                for (idx = 0; idx < 8; idx++)
+                    pvr2_ta_fifo_poly_write_32(0, src[idx], &pvr2);
+                break;
+            case WRITE_MODE_BURST:
+                pvr2_ta_fifo_poly_write_burst32(0, src, 8, &pvr2);
+                break;
+            default:
+                abort();
+            }
+            word_no += 8;
+
+            if (ta_full(&pvr2))
+                break;
+        }
+
+        secs += seconds_since(&start);
+
+        if (ta_full(&pvr2)) {
+            ta_end(&pvr2, &clk, res);
+            ta_begin(&pvr2, &clk);
+        }
+    }
+    ta_end(&pvr2, &clk, res);
+
+    return secs;
+}
+
+static int run_bench(int argc, char **argv) {
+    unsigned rep, reps = DEFAULT_REPS;
+    double secs[WRITE_MODE_COUNT] = { 0.0 };
+    struct replay_result res[WRITE_MODE_COUNT];
+    enum write_mode mode;
+    int ret_code = 0;
+
+    if (argc >= 3)
+        reps = atoi(argv[2]);
+    if (!reps) {
+        fprintf(stderr, "usage: %s [capture] [reps]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "-") != 0) {
+        if (load_capture(argv[1]) != 0)
+            return 1;
+    } else if (synth_capture() != 0) {
+        return 1;
+    }
+
+    for (rep = 0; rep < reps; rep++)
+        for (mode = 0; mode < WRITE_MODE_COUNT; mode++)
+            secs[mode] += replay(mode, res + mode);
+
+    for (mode = 1; mode < WRITE_MODE_COUNT; mode++) {
+        if (res[mode].n_pkts != res[0].n_pkts ||
+            res[mode].n_verts != res[0].n_verts ||
+            res[mode].vert_hash != res[0].vert_hash) {
+            fprintf(stderr, "%s writes produced different output than %s "
+                    "writes\n", mode_names[mode], mode_names[0]);
+            ret_code = 1;
+        }
+    }
+
+    printf("%zu bytes, %llu packets, %llu vertices per replay\n",
+           stream_len * sizeof(uint32_t), res[0].n_pkts, res[0].n_verts);
+    for (mode = 0; mode < WRITE_MODE_COUNT; mode++) {
+        printf("%-5s %8.2f M packets/s (%.2fx)\n", mode_names[mode],
+               res[mode].n_pkts * reps / secs[mode] / 1e6,
+               secs[WRITE_MODE_BYTE] / secs[mode]);
+    }
+
+    free(stream);
+
+    return ret_code;
+}
+
+int main(int argc, char **argv) {
+    // the emulator code being benchmarked logs through log.c
+    log_init(false, false);
+    int ret_code = run_bench(argc, argv);
+    log_cleanup();
+    return ret_code;
+}
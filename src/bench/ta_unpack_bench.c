@@ -0,0 +1,531 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * golden-output test and microbenchmark for the TA's vertex unpacking kernels
+ * in hw/pvr2/pvr2_ta_unpack.c.  Every kernel the host can run is checked
+ * against the scalar reference kernel two ways:
+ *
+ *   - a display list is fed through the TA once per kernel, and the vertex
+ *     arrays it builds have to be bit-identical.
+ *   - every vertex layout is fed random vertex parameters (including NaNs,
+ *     infinities and denormals) and the unpacked vertices have to be
+ *     bit-identical.
+ *
+ * If either check fails this returns non-zero.  Afterwards the kernels are
+ * timed on their own, in vertices per second for each color type.
+ *
+ * usage: ta_unpack_bench [capture] [reps]
+ *
+ * The capture is a file recorded with the pvr2.ta-capture option in wash.cfg.
+ * If no capture is given (or the capture is "-"), a synthetic display list
+ * with triangle strips in each color type is used instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "dc_sched.h"
+#include "gfx/gfx.h"
+#include "hw/pvr2/pvr2.h"
+#include "hw/pvr2/pvr2_ta.h"
+#include "hw/pvr2/pvr2_ta_unpack.h"
+#include "log.h"
+
+#define DEFAULT_REPS 16
+
+#define SYNTH_STRIPS 4096
+#define SYNTH_STRIP_LEN 8
+#define SYNTH_FMT_COUNT 6
+
+#define FUZZ_VERTS (64 * 1024)
+#define TIME_VERTS (256 * 1024)
+
+// start over once there's this much stuff in the TA
+#define RESET_VERTS (512 * 1024)
+#define RESET_GFX_IL (128 * 1024)
+
+// everything in struct pvr2_pkt_vtx that the kernels write
+#define VTX_CMP_LEN (offsetof(struct pvr2_pkt_vtx, pos) + 3 * sizeof(float))
+
+static char const *col_names[] = {
+    [PVR2_TA_UNPACK_COL_PACKED] = "packed",
+    [PVR2_TA_UNPACK_COL_FLOAT] = "float",
+    [PVR2_TA_UNPACK_COL_INTENSITY] = "intensity"
+};
+
+struct replay_result {
+    unsigned long long n_verts;
+    uint64_t vert_hash;
+};
+
+static uint32_t *stream;
+static size_t stream_len; // in 32-bit words
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint32_t rng(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (rng_state * 0x2545f4914f6cdd1dull) >> 32;
+}
+
+// random words, with a bias towards the floats that are easy to get wrong
+static uint32_t rng_word(void) {
+    static uint32_t const special[] = {
+        0x00000000, 0x80000000, // +/- 0
+        0x7f800000, 0xff800000, // +/- infinity
+        0x7fc00000, 0x7fa00001, // quiet and signaling NaN
+        0xffffffff, 0x00000001, // NaN with every bit set, smallest denormal
+        0x807fffff, 0x3f800000  // biggest negative denormal, 1.0
+    };
+    uint32_t val = rng();
+
+    if (val % 4 == 0)
+        return special[(val >> 8) % (sizeof(special) / sizeof(special[0]))];
+    return rng();
+}
+
+static int load_capture(char const *path) {
+    FILE *fp = fopen(path, "rb");
+    long len;
+
+    if (!fp) {
+        fprintf(stderr, "unable to open \"%s\"\n", path);
+        return -1;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    // anything after the last whole packet can't do anything anyways
+    stream_len = (len / 32) * 8;
+    stream = malloc(stream_len * sizeof(uint32_t));
+    if (!stream ||
+        fread(stream, sizeof(uint32_t), stream_len, fp) != stream_len) {
+        fprintf(stderr, "unable to read \"%s\"\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    return 0;
+}
+
+static void put_word(size_t *idx, uint32_t val) {
+    stream[(*idx)++] = val;
+}
+
+static void put_float(size_t *idx, float val) {
+    uint32_t tmp;
+    memcpy(&tmp, &val, sizeof(tmp));
+    put_word(idx, tmp);
+}
+
+static void put_words(size_t *idx, unsigned count, uint32_t val) {
+    while (count--)
+        put_word(idx, val);
+}
+
+/*
+ * opaque triangle strips, cycling between:
+ *     0 - packed color
+ *     1 - floating-point color
+ *     2 - textured packed color with an offset color and 16-bit texture
+ *         coordinates
+ *     3 - textured floating-point color with an offset color (64-byte
+ *         vertices)
+ *     4 - textured intensity mode 1 with an offset color (64-byte header)
+ *     5 - intensity mode 2, which reuses the colors from the last mode 1
+ *         header
+ */
+static int synth_capture(void) {
+    size_t idx = 0;
+    unsigned strip, vert;
+
+    // the biggest strips are 16 words for the header and 16 per vertex
+    stream_len = SYNTH_STRIPS * (16 + 16 * SYNTH_STRIP_LEN) + 8;
+    stream = malloc(stream_len * sizeof(uint32_t));
+    if (!stream)
+        return -1;
+
+    for (strip = 0; strip < SYNTH_STRIPS; strip++) {
+        unsigned fmt = strip % SYNTH_FMT_COUNT;
+        static unsigned const col_tp[SYNTH_FMT_COUNT] = { 0, 1, 0, 1, 2, 3 };
+        bool tex = fmt >= 2 && fmt <= 4;
+        bool offs = fmt >= 2 && fmt <= 4;
+        bool uv16 = fmt == 2;
+
+        // polygon header for the opaque list with gouraud shading
+        put_word(&idx, (4u << 29) | (col_tp[fmt] << 4) | (tex << 3) |
+                 (offs << 2) | (1 << 1) | uv16);
+        /*
+         * ISP/TSP and texture control words.  With all of these zeroed,
+         * textures are 8x8, ARGB1555 and twiddled at address 0.
+         */
+        put_words(&idx, 7, 0);
+        if (fmt == 4) {
+            // face base color and face offset color, both ARGB
+            put_float(&idx, 1.0f);
+            put_float(&idx, (strip % 256) / 255.0f);
+            put_float(&idx, 0.5f);
+            put_float(&idx, 0.25f);
+            put_float(&idx, 0.75f);
+            put_float(&idx, 0.125f);
+            put_float(&idx, (strip % 128) / 127.0f);
+            put_float(&idx, 0.0f);
+        }
+
+        for (vert = 0; vert < SYNTH_STRIP_LEN; vert++) {
+            bool end_of_strip = vert == SYNTH_STRIP_LEN - 1;
+            float x = (float)(strip % 64) * 10.0f + (vert / 2) * 4.0f;
+            float y = (float)(strip / 64) * 7.0f + (vert % 2) * 6.0f;
+            float z = 1.0f / (1.0f + strip * 0.01f + vert);
+            uint32_t argb = 0xff000000 | (strip * 0x010305) | vert;
+            float intensity = (vert + 1) / (float)SYNTH_STRIP_LEN;
+
+            put_word(&idx, (7u << 29) | (end_of_strip << 28));
+            put_float(&idx, x);
+            put_float(&idx, y);
+            put_float(&idx, z);
+
+            switch (fmt) {
+            case 0:
+                put_words(&idx, 2, 0);
+                put_word(&idx, argb);
+                put_word(&idx, 0);
+                break;
+            case 1:
+                put_float(&idx, 1.0f);
+                put_float(&idx, (argb >> 16 & 0xff) / 255.0f);
+                put_float(&idx, (argb >> 8 & 0xff) / 255.0f);
+                put_float(&idx, (argb & 0xff) / 255.0f);
+                break;
+            case 2:
+                // u and v are the upper halves of single-precision floats
+                put_word(&idx, (0x3f00 + vert * 0x20) << 16 |
+                         (0x3e80 + vert * 0x10));
+                put_word(&idx, 0);
+                put_word(&idx, argb);
+                put_word(&idx, 0x80101010 | vert << 16);
+                break;
+            case 3:
+                put_float(&idx, vert * 0.125f);
+                put_float(&idx, (vert % 2) * 1.0f);
+                put_words(&idx, 2, 0);
+                put_float(&idx, 1.0f);
+                put_float(&idx, (argb >> 16 & 0xff) / 255.0f);
+                put_float(&idx, (argb >> 8 & 0xff) / 255.0f);
+                put_float(&idx, (argb & 0xff) / 255.0f);
+                put_float(&idx, 0.5f);
+                put_float(&idx, 0.0625f * vert);
+                put_float(&idx, 0.0f);
+                put_float(&idx, 0.25f);
+                break;
+            case 4:
+                put_float(&idx, vert * 0.125f);
+                put_float(&idx, (vert % 2) * 1.0f);
+                put_float(&idx, intensity);
+                put_float(&idx, 1.0f - intensity);
+                break;
+            case 5:
+                put_words(&idx, 2, 0);
+                put_float(&idx, intensity);
+                put_word(&idx, 0);
+                break;
+            }
+        }
+    }
+
+    // end of list
+    put_words(&idx, 8, 0);
+
+    stream_len = idx;
+    return 0;
+}
+
+static double seconds_since(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+        (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static bool ta_full(struct pvr2 const *pvr2) {
+    struct pvr2_ta const *ta = &pvr2->ta;
+    return ta->ta_fifo_byte_count == 0 &&
+        (ta->pvr2_ta_vert_buf_count >= RESET_VERTS ||
+         ta->gfx_il_inst_buf_count >= RESET_GFX_IL);
+}
+
+static void ta_begin(struct pvr2 *pvr2, struct dc_clock *clk,
+                     pvr2_ta_unpack_vtx_func unpack) {
+    dc_clock_init(clk);
+    pvr2_init(pvr2, clk);
+
+    // this has to come after pvr2_init since that picks a kernel too
+    pvr2_ta_unpack_vtx_impl = unpack;
+}
+
+// fold everything the TA has produced into res, then tear it down
+static void ta_end(struct pvr2 *pvr2, struct dc_clock *clk,
+                   struct replay_result *res) {
+    struct pvr2_ta const *ta = &pvr2->ta;
+    size_t n_floats = (size_t)ta->pvr2_ta_vert_buf_count * GFX_VERT_LEN;
+    uint32_t const *verts = (uint32_t const*)ta->pvr2_ta_vert_buf;
+    size_t idx;
+
+    // FNV-1a over the bit patterns
+    for (idx = 0; idx < n_floats; idx++) {
+        res->vert_hash ^= verts[idx];
+        res->vert_hash *= 0x100000001b3ull;
+    }
+    res->n_verts += ta->pvr2_ta_vert_buf_count;
+
+    pvr2_cleanup(pvr2);
+    dc_clock_cleanup(clk);
+}
+
+static void replay(pvr2_ta_unpack_vtx_func unpack,
+                   struct replay_result *res) {
+    static struct pvr2 pvr2;
+    static struct dc_clock clk;
+    size_t word_no;
+
+    memset(res, 0, sizeof(*res));
+    res->vert_hash = 0xcbf29ce484222325ull;
+
+    ta_begin(&pvr2, &clk, unpack);
+    for (word_no = 0; word_no < stream_len; word_no += 8) {
+        pvr2_ta_fifo_poly_write_burst32(0, stream + word_no, 8, &pvr2);
+
+        if (ta_full(&pvr2)) {
+            ta_end(&pvr2, &clk, res);
+            ta_begin(&pvr2, &clk, unpack);
+        }
+    }
+    ta_end(&pvr2, &clk, res);
+}
+
+/*
+ * every layout the TA can hand to the kernels.  intensity_color gets filled
+ * with random words before each vertex when fuzzing.
+ */
+static unsigned enum_fmts(struct pvr2_ta_unpack_fmt *fmts) {
+    static unsigned const base_idx[] = { 4, 6, 8 };
+    unsigned n_fmts = 0;
+    unsigned col_tp, uv, base, offs;
+
+    for (col_tp = 0; col_tp < 3; col_tp++)
+        for (uv = 0; uv < 3; uv++)
+            for (base = 0; base < 3; base++)
+                for (offs = 0; offs < 2; offs++) {
+                    struct pvr2_ta_unpack_fmt *fmt = fmts + n_fmts++;
+                    memset(fmt, 0, sizeof(*fmt));
+                    fmt->col_tp = col_tp;
+                    fmt->uv_idx = uv ? 4 : 0;
+                    fmt->uv16 = uv == 2;
+                    fmt->base_idx = base_idx[base];
+                    if (offs) {
+                        fmt->offs_idx = col_tp == PVR2_TA_UNPACK_COL_FLOAT ?
+                            fmt->base_idx + 4 : fmt->base_idx + 1;
+                    }
+                }
+
+    return n_fmts;
+}
+
+static int fuzz(enum pvr2_ta_unpack_impl impl) {
+    pvr2_ta_unpack_vtx_func ref = pvr2_ta_unpack_get_impl(
+        PVR2_TA_UNPACK_IMPL_SCALAR);
+    pvr2_ta_unpack_vtx_func unpack = pvr2_ta_unpack_get_impl(impl);
+    struct pvr2_ta_unpack_fmt fmts[54];
+    unsigned fmt_no, n_fmts = enum_fmts(fmts);
+    unsigned vert, word;
+
+    for (fmt_no = 0; fmt_no < n_fmts; fmt_no++) {
+        struct pvr2_ta_unpack_fmt *fmt = fmts + fmt_no;
+        for (vert = 0; vert < FUZZ_VERTS; vert++) {
+            uint32_t param[16];
+            struct pvr2_pkt_vtx expect, actual;
+
+            for (word = 0; word < 16; word++)
+                param[word] = rng_word();
+            /*
+             * which payload NaN * NaN returns depends on the order the
+             * compiler put the operands in, even for the scalar kernel, so
+             * only the intensities get NaNs.
+             */
+            for (word = 0; word < 8; word++) {
+                uint32_t val = rng_word();
+                if ((val & 0x7fffffff) > 0x7f800000)
+                    val = (val & 0x80000000) | 0x7f800000; // NaN -> inf
+                memcpy(fmt->intensity_color + word, &val, sizeof(val));
+            }
+
+            // uv is left alone when there's no texture
+            memset(&expect, 0xa5, sizeof(expect));
+            memset(&actual, 0xa5, sizeof(actual));
+
+            ref(&expect, param, fmt);
+            unpack(&actual, param, fmt);
+
+            if (memcmp(&expect, &actual, VTX_CMP_LEN) != 0) {
+                fprintf(stderr, "%s kernel differs from the scalar kernel "
+                        "(%s color, uv_idx %u, uv16 %d, base_idx %u, "
+                        "offs_idx %u)\n", pvr2_ta_unpack_impl_name(impl),
+                        col_names[fmt->col_tp], fmt->uv_idx, (int)fmt->uv16,
+                        fmt->base_idx, fmt->offs_idx);
+                for (word = 0; word < 16; word++)
+                    fprintf(stderr, "\tparam[%u] = 0x%08x\n",
+                            word, (unsigned)param[word]);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * the textured layouts with an offset color, which are the slowest ones for
+ * the scalar kernel.  Returns vertices per second.
+ */
+static double time_kernel(pvr2_ta_unpack_vtx_func unpack,
+                          enum pvr2_ta_unpack_col col_tp, unsigned reps) {
+    static uint32_t params[TIME_VERTS][16];
+    static struct pvr2_pkt_vtx verts[TIME_VERTS];
+    static bool have_params;
+    struct pvr2_ta_unpack_fmt fmt = {
+        .col_tp = col_tp,
+        .uv_idx = 4,
+        .uv16 = col_tp == PVR2_TA_UNPACK_COL_PACKED,
+        .base_idx = col_tp == PVR2_TA_UNPACK_COL_FLOAT ? 8 : 6,
+        .offs_idx = col_tp == PVR2_TA_UNPACK_COL_FLOAT ? 12 : 7,
+        .intensity_color = { 1.0f, 0.5f, 0.25f, 1.0f,
+                             0.125f, 0.25f, 0.5f, 0.0f }
+    };
+    struct timespec start;
+    unsigned rep, vert;
+
+    if (!have_params) {
+        for (vert = 0; vert < TIME_VERTS; vert++) {
+            unsigned word;
+            for (word = 0; word < 16; word++)
+                params[vert][word] = rng();
+        }
+        have_params = true;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (rep = 0; rep < reps; rep++)
+        for (vert = 0; vert < TIME_VERTS; vert++)
+            unpack(verts + vert, params[vert], &fmt);
+
+    return (double)TIME_VERTS * reps / seconds_since(&start);
+}
+
+static int run_bench(int argc, char **argv) {
+    unsigned reps = DEFAULT_REPS;
+    struct replay_result ref_res;
+    enum pvr2_ta_unpack_impl impl;
+    enum pvr2_ta_unpack_col col_tp;
+    int ret_code = 0;
+
+    if (argc >= 3)
+        reps = atoi(argv[2]);
+    if (!reps) {
+        fprintf(stderr, "usage: %s [capture] [reps]\n", argv[0]);
+        return 1;
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "-") != 0) {
+        if (load_capture(argv[1]) != 0)
+            return 1;
+    } else if (synth_capture() != 0) {
+        return 1;
+    }
+
+    replay(pvr2_ta_unpack_get_impl(PVR2_TA_UNPACK_IMPL_SCALAR), &ref_res);
+    printf("%zu bytes, %llu vertices per replay\n",
+           stream_len * sizeof(uint32_t), ref_res.n_verts);
+
+    for (impl = PVR2_TA_UNPACK_IMPL_SCALAR + 1;
+         impl < PVR2_TA_UNPACK_IMPL_COUNT; impl++) {
+        struct replay_result res;
+        pvr2_ta_unpack_vtx_func unpack = pvr2_ta_unpack_get_impl(impl);
+
+        if (!unpack) {
+            printf("%s kernel is not available on this host\n",
+                   pvr2_ta_unpack_impl_name(impl));
+            continue;
+        }
+
+        replay(unpack, &res);
+        if (res.n_verts != ref_res.n_verts ||
+            res.vert_hash != ref_res.vert_hash) {
+            fprintf(stderr, "%s kernel produced a different vertex array "
+                    "than the scalar kernel\n",
+                    pvr2_ta_unpack_impl_name(impl));
+            ret_code = 1;
+        }
+
+        if (fuzz(impl) != 0)
+            ret_code = 1;
+    }
+
+    printf("%-10s", "");
+    for (col_tp = 0; col_tp <= PVR2_TA_UNPACK_COL_INTENSITY; col_tp++)
+        printf(" %16s", col_names[col_tp]);
+    printf("\n");
+
+    for (impl = 0; impl < PVR2_TA_UNPACK_IMPL_COUNT; impl++) {
+        pvr2_ta_unpack_vtx_func unpack = pvr2_ta_unpack_get_impl(impl);
+        if (!unpack)
+            continue;
+
+        printf("%-10s", pvr2_ta_unpack_impl_name(impl));
+        for (col_tp = 0; col_tp <= PVR2_TA_UNPACK_COL_INTENSITY; col_tp++)
+            printf(" %10.2f M/s", time_kernel(unpack, col_tp, reps) / 1e6);
+        printf("\n");
+    }
+
+    free(stream);
+
+    return ret_code;
+}
+
+int main(int argc, char **argv) {
+    // the emulator code being benchmarked logs through log.c
+    log_init(false, false);
+    int ret_code = run_bench(argc, argv);
+    log_cleanup();
+    return ret_code;
+}
@@ -0,0 +1,328 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+/*
+ * microbenchmark comparing the table-driven texture decoders in
+ * hw/pvr2/pvr2_tex_decode.c against the per-pixel versions they replaced.
+ * Every size from 8x8 to 1024x1024 is decoded in each format (16bpp, 8bpp and
+ * 4bpp twiddled, and VQ-compressed) and the output of both implementations
+ * has to match, otherwise this returns non-zero.
+ *
+ * usage: tex_decode_bench [pixels per size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "hw/pvr2/pvr2_tex_decode.h"
+
+#define DEFAULT_PIXELS (1 << 20)
+#define MIN_SHIFT 3
+#define MAX_SHIFT PVR2_TEX_MAX_SHIFT
+
+enum bench_fmt {
+    BENCH_FMT_16BPP,
+    BENCH_FMT_8BPP,
+    BENCH_FMT_4BPP,
+    BENCH_FMT_VQ,
+
+    BENCH_FMT_COUNT
+};
+
+static char const *fmt_names[BENCH_FMT_COUNT] = {
+    [BENCH_FMT_16BPP] = "16bpp",
+    [BENCH_FMT_8BPP] = "8bpp",
+    [BENCH_FMT_4BPP] = "4bpp",
+    [BENCH_FMT_VQ] = "VQ"
+};
+
+/*
+ * this is what pvr2_tex_cache.c looked like before pvr2_tex_decode.c: the
+ * twiddled index is recomputed bit-by-bit for every pixel.
+ */
+static unsigned old_tex_twiddle(unsigned x, unsigned y,
+                                unsigned w_shift, unsigned h_shift) {
+    unsigned twid_idx = 0;
+
+    unsigned w = 1 << w_shift;
+    unsigned h = 1 << h_shift;
+    unsigned min_square, min_square_shift;
+    if (w < h) {
+        min_square = w;
+        min_square_shift = w_shift;
+    } else {
+        min_square = h;
+        min_square_shift = h_shift;
+    }
+
+    unsigned x_resid = x & ~(min_square - 1);
+    unsigned y_resid = y & ~(min_square - 1);
+    unsigned x_sq = x & (min_square - 1);
+    unsigned y_sq = y & (min_square - 1);
+
+    unsigned shift;
+
+    for (shift = 0; shift <= min_square_shift; shift++) {
+        unsigned mask = (1 << (shift + 1)) - 1;
+        unsigned pow = 1 << shift;
+
+        if ((x_sq & mask) >= pow)
+            twid_idx |= 1 << (shift * 2 + 1);
+        if ((y_sq & mask) >= pow)
+            twid_idx |= 1 << (shift * 2);
+    }
+
+    if (x_resid) {
+        twid_idx += (x / min_square) * min_square * min_square;
+    } else if (y_resid) {
+        twid_idx += (y / min_square) * min_square * min_square;
+    }
+
+    return twid_idx;
+}
+
+static void old_detwiddle(void *dst, void const *src,
+                          unsigned tex_w_shift, unsigned tex_h_shift,
+                          unsigned bytes_per_pix) {
+    uint8_t *dst8 = (uint8_t*)dst;
+    uint8_t const *src8 = (uint8_t const*)src;
+    unsigned tex_w = 1 << tex_w_shift, tex_h = 1 << tex_h_shift;
+    unsigned row, col;
+    for (row = 0; row < tex_h; row++) {
+        for (col = 0; col < tex_w; col++) {
+            unsigned twid_idx =
+                old_tex_twiddle(col, row, tex_w_shift, tex_h_shift);
+            memcpy(dst8 + (row * tex_w + col) * bytes_per_pix,
+                   src8 + twid_idx * bytes_per_pix,
+                   bytes_per_pix);
+        }
+    }
+}
+
+static void old_detwiddle_4bpp(void *dst, void const *src,
+                               unsigned tex_w_shift, unsigned tex_h_shift) {
+    uint8_t *dst8 = (uint8_t*)dst;
+    uint8_t const *src8 = (uint8_t*)src;
+    unsigned tex_w = 1 << tex_w_shift, tex_h = 1 << tex_h_shift;
+    unsigned row, col;
+    for (row = 0; row < tex_h; row++) {
+        for (col = 0; col < tex_w; col++) {
+            unsigned twid_idx =
+                old_tex_twiddle(col, row, tex_w_shift, tex_h_shift);
+            unsigned dst_idx = row * tex_w + col;
+
+            uint8_t in_px;
+            if (twid_idx % 2 == 0)
+                in_px = src8[twid_idx / 2] & 0xf;
+            else
+                in_px = src8[twid_idx / 2] >> 4;
+
+            if (dst_idx % 2 == 0) {
+                dst8[dst_idx / 2] &= ~0xf;
+                dst8[dst_idx / 2] |= in_px;
+            } else {
+                dst8[dst_idx / 2] &= ~0xf0;
+                dst8[dst_idx / 2] |= (in_px << 4);
+            }
+        }
+    }
+}
+
+static void old_vq_decompress(void *dst, void const *code_book,
+                              void const *src, unsigned side_shift) {
+    unsigned dst_side = 1 << side_shift;
+    unsigned src_side_shift = side_shift - 1;
+    unsigned src_side = 1 << src_side_shift;
+    unsigned row, col;
+    uint8_t const *code_book_src = (uint8_t const*)code_book;
+    uint8_t const *img_dat_src = (uint8_t const*)src;
+    uint16_t *dst_img = (uint16_t*)dst;
+
+    for (row = 0; row < src_side; row++) {
+        for (col = 0; col < src_side; col++) {
+            unsigned twid_idx = old_tex_twiddle(col, row,
+                                                src_side_shift, src_side_shift);
+
+            // code book index
+            unsigned idx = img_dat_src[twid_idx];
+            uint16_t color[4];
+            memcpy(color, code_book_src + PVR2_CODE_BOOK_ENTRY_SIZE * idx,
+                   PVR2_CODE_BOOK_ENTRY_SIZE);
+
+            unsigned dst_row = row * 2, dst_col = col * 2;
+            memcpy(dst_img + dst_row * dst_side + dst_col,
+                   color, sizeof(color[0]));
+            memcpy(dst_img + (dst_row + 1) * dst_side + dst_col,
+                   color + 1, sizeof(color[1]));
+            memcpy(dst_img + dst_row * dst_side + dst_col + 1,
+                   color + 2, sizeof(color[2]));
+            memcpy(dst_img + (dst_row + 1) * dst_side + dst_col + 1,
+                   color + 3, sizeof(color[3]));
+        }
+    }
+}
+
+static void decode(enum bench_fmt fmt, bool use_old, void *dst,
+                   uint8_t const *src, unsigned w_shift, unsigned h_shift) {
+    switch (fmt) {
+    case BENCH_FMT_16BPP:
+    case BENCH_FMT_8BPP:
+        if (use_old)
+            old_detwiddle(dst, src, w_shift, h_shift,
+                          fmt == BENCH_FMT_16BPP ? 2 : 1);
+        else
+            pvr2_tex_detwiddle(dst, src, w_shift, h_shift,
+                               fmt == BENCH_FMT_16BPP ? 2 : 1);
+        break;
+    case BENCH_FMT_4BPP:
+        if (use_old)
+            old_detwiddle_4bpp(dst, src, w_shift, h_shift);
+        else
+            pvr2_tex_detwiddle_4bpp(dst, src, w_shift, h_shift);
+        break;
+    case BENCH_FMT_VQ:
+        if (use_old)
+            old_vq_decompress(dst, src, src + PVR2_CODE_BOOK_LEN, w_shift);
+        else
+            pvr2_tex_vq_decompress(dst, src, src + PVR2_CODE_BOOK_LEN,
+                                   w_shift);
+        break;
+    default:
+        abort();
+    }
+}
+
+// size of the decoded output in bytes
+static size_t out_len(enum bench_fmt fmt, unsigned w_shift, unsigned h_shift) {
+    size_t n_pix = ((size_t)1) << (w_shift + h_shift);
+    switch (fmt) {
+    case BENCH_FMT_16BPP:
+    case BENCH_FMT_VQ:
+        return n_pix * 2;
+    case BENCH_FMT_8BPP:
+        return n_pix;
+    case BENCH_FMT_4BPP:
+        return n_pix / 2;
+    default:
+        abort();
+    }
+}
+
+static double seconds_since(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+        (end.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+int main(int argc, char **argv) {
+    unsigned long pixels_per_size = DEFAULT_PIXELS;
+    if (argc > 1)
+        pixels_per_size = strtoul(argv[1], NULL, 0);
+    if (!pixels_per_size) {
+        fprintf(stderr, "usage: %s [pixels per size]\n", argv[0]);
+        return 1;
+    }
+
+    pvr2_tex_decode_init();
+
+    size_t max_len = 2 << (2 * MAX_SHIFT);
+    size_t src_len = max_len + PVR2_CODE_BOOK_LEN;
+    uint8_t *src = malloc(src_len);
+    uint8_t *dst_old = malloc(max_len);
+    uint8_t *dst_new = malloc(max_len);
+    if (!src || !dst_old || !dst_new) {
+        fprintf(stderr, "failed allocation\n");
+        return 1;
+    }
+
+    srand(1);
+    size_t idx;
+    for (idx = 0; idx < src_len; idx++)
+        src[idx] = rand();
+
+    int ret_code = 0;
+    enum bench_fmt fmt;
+    for (fmt = 0; fmt < BENCH_FMT_COUNT; fmt++) {
+        double old_total = 0.0, new_total = 0.0;
+        unsigned w_shift, h_shift;
+        for (w_shift = MIN_SHIFT; w_shift <= MAX_SHIFT; w_shift++) {
+            for (h_shift = MIN_SHIFT; h_shift <= MAX_SHIFT; h_shift++) {
+                // VQ textures are always square
+                if (fmt == BENCH_FMT_VQ && w_shift != h_shift)
+                    continue;
+
+                size_t len = out_len(fmt, w_shift, h_shift);
+                memset(dst_old, 0, len);
+                memset(dst_new, 0xff, len);
+                decode(fmt, true, dst_old, src, w_shift, h_shift);
+                decode(fmt, false, dst_new, src, w_shift, h_shift);
+                if (memcmp(dst_old, dst_new, len) != 0) {
+                    fprintf(stderr, "%s %ux%u: output mismatch\n",
+                            fmt_names[fmt], 1 << w_shift, 1 << h_shift);
+                    ret_code = 1;
+                    continue;
+                }
+
+                unsigned long n_pix = 1ul << (w_shift + h_shift);
+                unsigned long rep, reps = pixels_per_size / n_pix;
+                if (!reps)
+                    reps = 1;
+
+                struct timespec start;
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (rep = 0; rep < reps; rep++)
+                    decode(fmt, true, dst_old, src, w_shift, h_shift);
+                double old_secs = seconds_since(&start);
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                for (rep = 0; rep < reps; rep++)
+                    decode(fmt, false, dst_new, src, w_shift, h_shift);
+                double new_secs = seconds_since(&start);
+
+                double old_ns = old_secs * 1e9 / (reps * n_pix);
+                double new_ns = new_secs * 1e9 / (reps * n_pix);
+                old_total += old_ns;
+                new_total += new_ns;
+
+                if (w_shift == h_shift) {
+                    printf("%-5s %4ux%-4u per-pixel %6.2f ns/px, "
+                           "table %6.2f ns/px (%.2fx)\n",
+                           fmt_names[fmt], 1 << w_shift, 1 << h_shift,
+                           old_ns, new_ns, old_ns / new_ns);
+                }
+            }
+        }
+        printf("%-5s all sizes: %.2fx\n", fmt_names[fmt],
+               old_total / new_total);
+    }
+
+    free(dst_new);
+    free(dst_old);
+    free(src);
+
+    return ret_code;
+}
@@ -21,18 +21,35 @@
  ******************************************************************************/
 
 #include <stddef.h>
+#include <stdlib.h>
 
 #include "dreamcast.h"
 #include "washdc/error.h"
 #include "mem_code.h"
+#include "memory.h"
+#include "jit/code_cache.h"
 
 #include "washdc/MemoryMap.h"
 
+static void memory_map_update_pages(struct memory_map *map,
+                                    struct memory_map_region const *reg);
+
 void memory_map_init(struct memory_map *map) {
     memset(map, 0, sizeof(*map));
+
+    map->pages = (struct memory_map_page*)calloc(MEMORY_MAP_N_PAGES,
+                                                 sizeof(struct memory_map_page));
+    if (!map->pages)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
 }
 
 void memory_map_cleanup(struct memory_map *map) {
+    if (map->pages) {
+        unsigned page_no;
+        for (page_no = 0; page_no < MEMORY_MAP_N_PAGES; page_no++)
+            free(map->pages[page_no].subpages);
+        free(map->pages);
+    }
     memset(map, 0, sizeof(*map));
 }
 
@@ -42,6 +59,20 @@ void memory_map_cleanup(struct memory_map *map) {
         uint32_t first_addr = addr;                                     \
         uint32_t last_addr = sizeof(type) - 1 + first_addr;             \
                                                                         \
+        struct memory_map_page const *page =                            \
+            memory_map_get_page(map, first_addr, last_addr);            \
+        if (page) {                                                     \
+            CHECK_R_WATCHPOINT(addr, type);                             \
+            if (page->host) {                                           \
+                return *(type*)(page->host +                            \
+                                (addr & MEMORY_MAP_PAGE_MASK &          \
+                                 ~(uint32_t)(sizeof(type) - 1)));       \
+            }                                                           \
+            struct memory_map_region const *reg = page->region;         \
+            return reg->intf->read##type_postfix(addr & reg->mask,      \
+                                                 reg->ctxt);            \
+        }                                                               \
+                                                                        \
         unsigned region_no;                                             \
         for (region_no = 0; region_no < map->n_regions; region_no++) {  \
             struct memory_map_region *reg = map->regions + region_no;   \
@@ -109,12 +140,36 @@ MEMORY_MAP_TRY_READ_TMPL(uint32_t, 32)
 MEMORY_MAP_TRY_READ_TMPL(float, float)
 MEMORY_MAP_TRY_READ_TMPL(double, double)
 
+/*
+ * writes to main RAM throw out any compiled code on the pages they write to
+ * (see code_cache_notify_write).  That's just a flag check unless the page has
+ * code on it.
+ */
 #define MEM_MAP_WRITE_TMPL(type, type_postfix)                          \
     void memory_map_write_##type_postfix(struct memory_map *map,        \
                                          uint32_t addr, type val) {     \
         uint32_t first_addr = addr;                                     \
         uint32_t last_addr = sizeof(type) - 1 + first_addr;             \
                                                                         \
+        struct memory_map_page const *page =                            \
+            memory_map_get_page(map, first_addr, last_addr);            \
+        if (page) {                                                     \
+            CHECK_W_WATCHPOINT(addr, type);                             \
+            if (page->host) {                                           \
+                *(type*)(page->host +                                   \
+                         (addr & MEMORY_MAP_PAGE_MASK &                 \
+                          ~(uint32_t)(sizeof(type) - 1))) = val;        \
+                code_cache_notify_write(addr, sizeof(type));            \
+            } else {                                                    \
+                struct memory_map_region const *reg = page->region;     \
+                reg->intf->write##type_postfix(addr & reg->mask, val,   \
+                                               reg->ctxt);              \
+                if (reg->id == MEMORY_MAP_REGION_RAM)                   \
+                    code_cache_notify_write(addr, sizeof(type));        \
+            }                                                           \
+            return;                                                     \
+        }                                                               \
+                                                                        \
         unsigned region_no;                                             \
         for (region_no = 0; region_no < map->n_regions; region_no++) {  \
             struct memory_map_region *reg = map->regions + region_no;   \
@@ -128,6 +183,8 @@ MEMORY_MAP_TRY_READ_TMPL(double, double)
                 CHECK_W_WATCHPOINT(addr, type);                         \
                                                                         \
                 intf->write##type_postfix(addr & mask, val, ctxt);      \
+                if (reg->id == MEMORY_MAP_REGION_RAM)                   \
+                    code_cache_notify_write(addr, sizeof(type));        \
                 return;                                                 \
             }                                                           \
         }                                                               \
@@ -165,11 +222,16 @@ MEM_MAP_WRITE_TMPL(double, double)
                 uint32_t mask = reg->mask;                              \
                 void *ctxt = reg->ctxt;                                 \
                 if (intf->try_write##type_postfix) {                    \
-                    return intf->try_write##type_postfix(addr & mask,   \
-                                                         val, ctxt);    \
+                    int err =                                           \
+                        intf->try_write##type_postfix(addr & mask, val, \
+                                                      ctxt);            \
+                    if (err)                                            \
+                        return err;                                     \
                 } else {                                                \
                     intf->write##type_postfix(addr & mask, val, ctxt);  \
                 }                                                       \
+                if (reg->id == MEMORY_MAP_REGION_RAM)                   \
+                    code_cache_notify_write(addr, sizeof(type));        \
                 return 0;                                               \
             }                                                           \
         }                                                               \
@@ -203,4 +265,120 @@ memory_map_add(struct memory_map *map,
     reg->id = id;
     reg->intf = intf;
     reg->ctxt = ctxt;
+
+    memory_map_update_pages(map, reg);
+}
+
+enum page_coverage {
+    PAGE_COVERAGE_NONE,
+    PAGE_COVERAGE_PARTIAL,
+    PAGE_COVERAGE_FULL
+};
+
+/*
+ * figure out how much of the given range of addresses is covered by the given
+ * region.  page_size must be a power of two, and first_addr must be aligned
+ * to it.
+ */
+static enum page_coverage
+page_coverage(struct memory_map_region const *reg,
+              uint32_t first_addr, uint32_t page_size) {
+    uint32_t range_mask = reg->range_mask;
+    uint32_t page_first = first_addr & range_mask;
+    uint32_t page_last = (first_addr + (page_size - 1)) & range_mask;
+
+    /*
+     * If the range_mask doesn't preserve the offset within the page then the
+     * page's addresses aren't contiguous after masking.  I don't think any of
+     * our regions actually do this, but treat it as partial coverage so that
+     * it goes down the slow path.
+     */
+    if ((range_mask & (page_size - 1)) != page_size - 1)
+        return PAGE_COVERAGE_PARTIAL;
+
+    if (page_first > reg->last_addr || page_last < reg->first_addr)
+        return PAGE_COVERAGE_NONE;
+    if (page_first >= reg->first_addr && page_last <= reg->last_addr)
+        return PAGE_COVERAGE_FULL;
+    return PAGE_COVERAGE_PARTIAL;
+}
+
+/*
+ * Find the region which owns every address in the given page.  Regions which
+ * were added first take priority over regions which were added later, just
+ * like in the linear scan.  If the page is only partially covered by its
+ * highest-priority region then it has no single owner.
+ */
+static enum page_coverage
+page_owner(struct memory_map const *map, uint32_t first_addr,
+           uint32_t page_size, struct memory_map_region const **owner) {
+    unsigned region_no;
+    for (region_no = 0; region_no < map->n_regions; region_no++) {
+        struct memory_map_region const *reg = map->regions + region_no;
+        enum page_coverage cov = page_coverage(reg, first_addr, page_size);
+        if (cov == PAGE_COVERAGE_FULL) {
+            *owner = reg;
+            return PAGE_COVERAGE_FULL;
+        } else if (cov == PAGE_COVERAGE_PARTIAL) {
+            *owner = NULL;
+            return PAGE_COVERAGE_PARTIAL;
+        }
+    }
+    *owner = NULL;
+    return PAGE_COVERAGE_NONE;
+}
+
+static void memory_map_build_page(struct memory_map *map, unsigned page_no) {
+    struct memory_map_page *page = map->pages + page_no;
+    uint32_t page_addr = (uint32_t)page_no << MEMORY_MAP_PAGE_SHIFT;
+    struct memory_map_region const *owner;
+
+    page->host = NULL;
+    page->region = NULL;
+    free(page->subpages);
+    page->subpages = NULL;
+
+    switch (page_owner(map, page_addr, MEMORY_MAP_PAGE_SIZE, &owner)) {
+    case PAGE_COVERAGE_FULL:
+        page->region = owner;
+        if (owner->id == MEMORY_MAP_REGION_RAM &&
+            (owner->mask & MEMORY_MAP_PAGE_MASK) == MEMORY_MAP_PAGE_MASK) {
+            struct Memory *mem = (struct Memory*)owner->ctxt;
+            page->host = mem->mem + (page_addr & owner->mask);
+        }
+        break;
+    case PAGE_COVERAGE_PARTIAL:
+        page->subpages = (struct memory_map_page*)
+            calloc(MEMORY_MAP_N_SUBPAGES, sizeof(struct memory_map_page));
+        if (!page->subpages)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+        unsigned subpage_no;
+        for (subpage_no = 0; subpage_no < MEMORY_MAP_N_SUBPAGES; subpage_no++) {
+            uint32_t subpage_addr =
+                page_addr + (subpage_no << MEMORY_MAP_SUBPAGE_SHIFT);
+            page_owner(map, subpage_addr, MEMORY_MAP_SUBPAGE_SIZE, &owner);
+            page->subpages[subpage_no].region = owner;
+        }
+        break;
+    default:
+    case PAGE_COVERAGE_NONE:
+        break;
+    }
+}
+
+/*
+ * rebuild every page which overlaps the given region.  Pages are rebuilt from
+ * scratch so that the priority between overlapping regions is the same as it
+ * would be for the linear scan.
+ */
+static void memory_map_update_pages(struct memory_map *map,
+                                    struct memory_map_region const *reg) {
+    unsigned page_no;
+    for (page_no = 0; page_no < MEMORY_MAP_N_PAGES; page_no++) {
+        uint32_t page_addr = (uint32_t)page_no << MEMORY_MAP_PAGE_SHIFT;
+        if (page_coverage(reg, page_addr, MEMORY_MAP_PAGE_SIZE) !=
+            PAGE_COVERAGE_NONE)
+            memory_map_build_page(map, page_no);
+    }
 }
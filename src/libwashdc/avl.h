@@ -32,7 +32,7 @@
 
 #include "washdc/error.h"
 
-typedef uint32_t avl_key_type;
+typedef uint64_t avl_key_type;
 
 #define AVL_DEREF(nodep, tp, memb)                      \
     (*((tp*)(((uint8_t*)nodep) - offsetof(tp, memb))))
@@ -351,6 +351,37 @@ avl_find(struct avl_tree *tree, avl_key_type key) {
     }
 }
 
+/*
+ * put new_node in old_node's place in the tree.  new_node takes over
+ * old_node's key, and old_node is no longer part of the tree afterwards.
+ * Neither node gets constructed or destructed.
+ */
+static inline void
+avl_replace_node(struct avl_tree *tree, struct avl_node *old_node,
+                 struct avl_node *new_node) {
+    new_node->key = old_node->key;
+    new_node->bal = old_node->bal;
+    new_node->left = old_node->left;
+    new_node->right = old_node->right;
+    new_node->parent = old_node->parent;
+
+    if (new_node->parent) {
+        if (new_node->parent->left == old_node)
+            new_node->parent->left = new_node;
+        else
+            new_node->parent->right = new_node;
+    } else {
+        tree->root = new_node;
+    }
+
+    if (new_node->left)
+        new_node->left->parent = new_node;
+    if (new_node->right)
+        new_node->right->parent = new_node;
+
+    old_node->left = old_node->right = old_node->parent = NULL;
+}
+
 /*
  * This is like avl_find except if it fails it will return NULL instead of
  * creating a new node.
@@ -79,15 +79,28 @@ CONFIG_DEF_STRING(ip_bin_path);
 
 CONFIG_DEF_STRING(exec_bin_path);
 
+CONFIG_DEF_STRING(sched_trace_path);
+
 CONFIG_DEF_BOOL(enable_cmd_tcp, false);
 
 CONFIG_DEF_BOOL(jit, false);
 
 #ifdef ENABLE_JIT_X86_64
 CONFIG_DEF_BOOL(native_jit, false);
+CONFIG_DEF_BOOL(fastmem, false);
 #endif
 
+CONFIG_DEF_BOOL(arm7_jit, false);
+CONFIG_DEF_BOOL(arm7_jit_lockstep, false);
+
 CONFIG_DEF_BOOL(inline_mem, true);
 
+CONFIG_DEF_BOOL(jit_idle_skip, true);
+
+CONFIG_DEF_BOOL(threaded_render, false);
+
+CONFIG_DEF_BOOL(arm7_thread, false);
+CONFIG_DEF_INT(arm7_skew_limit, 0);
+
 CONFIG_DEF_BOOL(log_verbose, false);
 CONFIG_DEF_BOOL(log_stdout, false);
@@ -77,6 +77,12 @@ CONFIG_DECL_STRING(ip_bin_path);
 // path to the 1st_read.bin file
 CONFIG_DECL_STRING(exec_bin_path);
 
+/*
+ * if this is non-empty, scheduler events are recorded to this path (see
+ * dc_sched_trace_open)
+ */
+CONFIG_DECL_STRING(sched_trace_path);
+
 // enable the dynamic recompiler, or disable it to use the interpreter
 CONFIG_DECL_BOOL(jit);
 
@@ -90,14 +96,51 @@ CONFIG_DECL_BOOL(jit);
  * platform-independent interpreter backend will be used.
  */
 CONFIG_DECL_BOOL(native_jit);
+
+/*
+ * if this is set (default is false) then the jit's x86_64 backend will access
+ * system memory through a host-side mirror of the guest address space, and
+ * rely on SIGSEGV to catch accesses to everything else.
+ */
+CONFIG_DECL_BOOL(fastmem);
 #endif
 
+/*
+ * run the ARM7 on the dynamic recompiler instead of the interpreter.  It uses
+ * the x86_64 backend if native_jit is enabled, and the IL interpreter if not.
+ */
+CONFIG_DECL_BOOL(arm7_jit);
+
+/*
+ * check every block the ARM7 recompiler runs against the interpreter (slow,
+ * this is only for testing the recompiler).
+ */
+CONFIG_DECL_BOOL(arm7_jit_lockstep);
+
 /*
  * if this is set (default is true) then the jit's x86_64 backend will
  * inline memory accesses.
  */
 CONFIG_DECL_BOOL(inline_mem);
 
+/*
+ * let the jit fast-forward the SH4 to the next scheduled event when it's
+ * spinning in an idle loop
+ */
+CONFIG_DECL_BOOL(jit_idle_skip);
+
+// do all the OpenGL work on a dedicated render thread
+CONFIG_DECL_BOOL(threaded_render);
+
+// run the ARM7 and the AICA on their own thread
+CONFIG_DECL_BOOL(arm7_thread);
+
+/*
+ * how far (in microseconds of emulated time) either CPU may get ahead of the
+ * other when arm7_thread is set.  0 means one timeslice.
+ */
+CONFIG_DECL_INT(arm7_skew_limit);
+
 CONFIG_DECL_BOOL(log_stdout);
 CONFIG_DECL_BOOL(log_verbose);
 
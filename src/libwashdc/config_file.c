@@ -112,15 +112,56 @@ static void cfg_create_default_config(void) {
         "; Order-Independent Transparency algorithm.  choices are:\n"
         ";     disabled - no order-independent transparency\n"
         ";     per-group - groups of transparent polygons are sorted by depth\n"
+        ";     per-triangle - every transparent triangle is sorted by depth,\n"
+        ";                    which is slower but gets triangle strips right\n"
         "; Ideally there would be a per-pixel mode, as well, but that hasn't\n"
         "; been implemented yet.  per-group is far from perfect but it does\n"
         "; seem to be a good enough approximation most of the time.\n"
         "gfx.rend.oit-mode per-group\n"
         "\n"
+        "; merge consecutive draws with the same texture, blend and depth\n"
+        "; state in the opaque and punch-through lists.  Set this to false to\n"
+        "; draw every polygon group separately.\n"
+        "gfx.rend.batch-draws true\n"
+        "\n"
+        "; let the batching also reorder opaque and punch-through draws so\n"
+        "; more of them can be merged.  This is faster, but it can change\n"
+        "; which of two coplanar polygons (like a decal) ends up on top.\n"
+        "gfx.rend.batch-reorder false\n"
+        "\n"
         "; set this to true to mute audio.  Set it to false to allow audio \n"
         "; to play\n"
         "audio.mute false\n"
         "\n"
+        "; optimization passes for the jit.  These only do anything if\n"
+        "; WashingtonDC was built with JIT_OPTIMIZE.  They're all enabled by\n"
+        "; default; uncomment a line to turn that pass off.\n"
+        "; jit.opt.redundant-load false\n"
+        "; jit.opt.const-prop false\n"
+        "; jit.opt.dead-slot false\n"
+        "\n"
+        "; save the jit's translated code to disk so it doesn't need to be\n"
+        "; translated again the next time the same game is played.  The\n"
+        "; files go in the jit_cache directory under WashingtonDC's data\n"
+        "; directory, one per game.\n"
+        "jit.disk-cache false\n"
+        "\n"
+        "; tiered compilation for the native jit.  When this is more than\n"
+        "; 0, new code runs in the IL interpreter until it has run this many\n"
+        "; times, and only then is it compiled to native code.  0 compiles\n"
+        "; everything to native code right away.\n"
+        "jit.tier-threshold 0\n"
+        "\n"
+        "; when tiered compilation is on, compile hot paths through several\n"
+        "; blocks together as one superblock, with side-exits for branches\n"
+        "; that usually go the other way.  The branch profiles come from the\n"
+        "; IL interpreter, so jit.tier-threshold needs to be at least 8.\n"
+        "jit.superblocks false\n"
+        "\n"
+        "; uncomment this to save everything written to the PVR2's TA FIFO\n"
+        "; to a file, for replaying with ta_fifo_bench.\n"
+        "; pvr2.ta-capture ta_fifo.bin\n"
+        "\n"
         "; don't change this line.  It doesn't techincally do anything yet\n"
         "; but it will in future revisions of WashingtonDC.\n"
         "wash.dc.port.0.0 dreamcast_controller\n"
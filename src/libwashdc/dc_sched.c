@@ -21,17 +21,30 @@
  ******************************************************************************/
 
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "washdc/error.h"
 #include "hw/sh4/sh4.h" // for SH4_CLOCK_SCALE
 #include "dreamcast.h"
+#include "log.h"
 
 #include "dc_sched.h"
 
+#define EV_HEAP_INITIAL_CAP 32
+
 static DEF_ERROR_U64_ATTR(current_dc_cycle_stamp)
 static DEF_ERROR_U64_ATTR(event_sched_dc_cycle_stamp)
 
+static FILE *trace_fp;
+static struct dc_clock const *trace_clocks[DC_SCHED_TRACE_MAX_CLOCKS];
+static struct SchedEvent const *trace_events[DC_SCHED_TRACE_MAX_EVENTS];
+static unsigned trace_n_clocks, trace_n_events;
+
+static void trace_op(struct dc_clock *clock, enum dc_sched_trace_op op,
+                     struct SchedEvent const *event);
+
 void dc_clock_init(struct dc_clock *clk) {
     memset(clk, 0, sizeof(*clk));
     clk->cycle_stamp_ptr_priv = &clk->cycle_stamp_priv;
@@ -39,11 +52,24 @@ void dc_clock_init(struct dc_clock *clk) {
 }
 
 void dc_clock_cleanup(struct dc_clock *clk) {
+    free(clk->ev_heap_priv);
+    clk->ev_heap_priv = NULL;
+    clk->ev_count_priv = clk->ev_heap_cap_priv = 0;
+    clk->ev_is_heap_priv = false;
+}
+
+/*
+ * While the events aren't a heap, they're sorted from last to first so that
+ * popping the next event doesn't have to move the rest of them.
+ */
+static inline unsigned ev_next_idx(struct dc_clock const *clock) {
+    return clock->ev_is_heap_priv ? 0 : clock->ev_count_priv - 1;
 }
 
 static void update_target_stamp(struct dc_clock *clock) {
-    if (clock->ev_next_priv) {
-        *clock->target_stamp_ptr_priv = clock->ev_next_priv->when;
+    if (clock->ev_count_priv) {
+        *clock->target_stamp_ptr_priv =
+            clock->ev_heap_priv[ev_next_idx(clock)].when;
     } else {
         /*
          * Somehow there are no events scheduled.
@@ -63,6 +89,150 @@ static void update_target_stamp(struct dc_clock *clock) {
     }
 }
 
+/*
+ * returns true if lhs should happen before rhs.  Ties go to whichever event was
+ * scheduled most recently.
+ */
+static inline bool
+ev_before(struct dc_sched_slot const *lhs, struct dc_sched_slot const *rhs) {
+    return lhs->when < rhs->when ||
+        (lhs->when == rhs->when && lhs->event->seq > rhs->event->seq);
+}
+
+static inline void
+ev_heap_put(struct dc_clock *clock, unsigned idx,
+            struct dc_sched_slot const *slot) {
+    clock->ev_heap_priv[idx] = *slot;
+    slot->event->heap_idx = idx;
+}
+
+static void ev_heap_sift_up(struct dc_clock *clock, unsigned idx) {
+    struct dc_sched_slot *heap = clock->ev_heap_priv;
+    struct dc_sched_slot slot = heap[idx];
+
+    while (idx) {
+        unsigned parent = (idx - 1) / 2;
+        if (!ev_before(&slot, heap + parent))
+            break;
+        ev_heap_put(clock, idx, heap + parent);
+        idx = parent;
+    }
+    ev_heap_put(clock, idx, &slot);
+}
+
+static void ev_heap_sift_down(struct dc_clock *clock, unsigned idx) {
+    struct dc_sched_slot *heap = clock->ev_heap_priv;
+    struct dc_sched_slot slot = heap[idx];
+    unsigned count = clock->ev_count_priv;
+
+    for (;;) {
+        unsigned child = 2 * idx + 1;
+        if (child >= count)
+            break;
+        if (child + 1 < count && ev_before(heap + child + 1, heap + child))
+            child++;
+        if (!ev_before(heap + child, &slot))
+            break;
+        ev_heap_put(clock, idx, heap + child);
+        idx = child;
+    }
+    ev_heap_put(clock, idx, &slot);
+}
+
+// remove the event at the given index of the heap
+static void ev_heap_remove(struct dc_clock *clock, unsigned idx) {
+    struct dc_sched_slot *heap = clock->ev_heap_priv;
+    unsigned last = --clock->ev_count_priv;
+
+    if (idx != last) {
+        ev_heap_put(clock, idx, heap + last);
+        if (idx && ev_before(heap + idx, heap + (idx - 1) / 2))
+            ev_heap_sift_up(clock, idx);
+        else
+            ev_heap_sift_down(clock, idx);
+    }
+}
+
+/*
+ * insert slot into the sorted array and return its index.  It goes in front
+ * of any events with the same timestamp since it was scheduled last.
+ */
+static unsigned
+ev_list_insert(struct dc_clock *clock, struct dc_sched_slot const *slot) {
+    struct dc_sched_slot *list = clock->ev_heap_priv;
+    unsigned idx = clock->ev_count_priv++;
+
+    while (idx && list[idx - 1].when < slot->when) {
+        list[idx] = list[idx - 1];
+        idx--;
+    }
+    list[idx] = *slot;
+
+    return idx;
+}
+
+// returns the event's index in the sorted array, or ev_count_priv
+static unsigned
+ev_list_find(struct dc_clock const *clock, struct SchedEvent const *event) {
+    unsigned idx;
+    for (idx = 0; idx < clock->ev_count_priv; idx++)
+        if (clock->ev_heap_priv[idx].event == event)
+            break;
+    return idx;
+}
+
+/*
+ * the sorted array turns into a heap by reversing it, after that this only
+ * has to fill in heap_idx.
+ */
+static void ev_make_heap(struct dc_clock *clock) {
+    struct dc_sched_slot *heap = clock->ev_heap_priv;
+    unsigned count = clock->ev_count_priv;
+    unsigned idx;
+
+    for (idx = 0; idx < count / 2; idx++) {
+        struct dc_sched_slot tmp = heap[idx];
+        heap[idx] = heap[count - 1 - idx];
+        heap[count - 1 - idx] = tmp;
+    }
+    for (idx = 0; idx < count; idx++)
+        heap[idx].event->heap_idx = idx;
+    clock->ev_is_heap_priv = true;
+}
+
+// sort the heap, there aren't many events left by the time this happens
+static void ev_make_list(struct dc_clock *clock) {
+    struct dc_sched_slot *list = clock->ev_heap_priv;
+    unsigned count = clock->ev_count_priv;
+    unsigned idx;
+
+    for (idx = 1; idx < count; idx++) {
+        struct dc_sched_slot slot = list[idx];
+        unsigned dst = idx;
+        while (dst && ev_before(list + dst - 1, &slot)) {
+            list[dst] = list[dst - 1];
+            dst--;
+        }
+        list[dst] = slot;
+    }
+    clock->ev_is_heap_priv = false;
+}
+
+// remove the event at the given index
+static void ev_remove(struct dc_clock *clock, unsigned idx) {
+    if (clock->ev_is_heap_priv) {
+        ev_heap_remove(clock, idx);
+        if (clock->ev_count_priv <= DC_SCHED_LIST_MAX / 2)
+            ev_make_list(clock);
+    } else {
+        // this is usually the last one, which doesn't need to move anything
+        struct dc_sched_slot *list = clock->ev_heap_priv;
+        unsigned count = --clock->ev_count_priv;
+        if (idx != count)
+            memmove(list + idx, list + idx + 1, (count - idx) * sizeof(*list));
+    }
+}
+
 void sched_event(struct dc_clock *clock, struct SchedEvent *event) {
 #ifdef INVARIANTS
     /*
@@ -77,19 +247,38 @@ void sched_event(struct dc_clock *clock, struct SchedEvent *event) {
     }
 #endif
 
-    struct SchedEvent *next_ptr = clock->ev_next_priv;
-    struct SchedEvent **pprev_ptr = &clock->ev_next_priv;
-    while (next_ptr && next_ptr->when < event->when) {
-        pprev_ptr = &next_ptr->next_event;
-        next_ptr = next_ptr->next_event;
+    if (trace_fp)
+        trace_op(clock, DC_SCHED_TRACE_SCHED, event);
+
+    if (clock->ev_count_priv == clock->ev_heap_cap_priv) {
+        unsigned new_cap = clock->ev_heap_cap_priv ?
+            2 * clock->ev_heap_cap_priv : EV_HEAP_INITIAL_CAP;
+        struct dc_sched_slot *new_heap =
+            realloc(clock->ev_heap_priv, new_cap * sizeof(*new_heap));
+        if (!new_heap)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        clock->ev_heap_priv = new_heap;
+        clock->ev_heap_cap_priv = new_cap;
     }
-    *pprev_ptr = event;
-    if (next_ptr)
-        next_ptr->pprev_event = &event->next_event;
-    event->next_event = next_ptr;
-    event->pprev_event = pprev_ptr;
 
-    update_target_stamp(clock);
+    struct dc_sched_slot slot = { .when = event->when, .event = event };
+    event->seq = clock->ev_seq_priv++;
+
+    if (!clock->ev_is_heap_priv && clock->ev_count_priv >= DC_SCHED_LIST_MAX)
+        ev_make_heap(clock);
+
+    unsigned idx;
+    if (clock->ev_is_heap_priv) {
+        ev_heap_put(clock, clock->ev_count_priv++, &slot);
+        ev_heap_sift_up(clock, event->heap_idx);
+        idx = event->heap_idx;
+    } else {
+        idx = ev_list_insert(clock, &slot);
+    }
+
+    // the target stamp only changes if this is the new next event
+    if (idx == ev_next_idx(clock))
+        update_target_stamp(clock);
 }
 
 void cancel_event(struct dc_clock *clock, struct SchedEvent *event) {
@@ -106,19 +295,24 @@ void cancel_event(struct dc_clock *clock, struct SchedEvent *event) {
     }
 #endif
 
-    if (event->next_event)
-        event->next_event->pprev_event = event->pprev_event;
-    *event->pprev_event = event->next_event;
+    unsigned idx = clock->ev_is_heap_priv ?
+        event->heap_idx : ev_list_find(clock, event);
+    if (idx >= clock->ev_count_priv ||
+        clock->ev_heap_priv[idx].event != event)
+        RAISE_ERROR(ERROR_INTEGRITY);
 
-    // XXX this is unnecessary, but I'm trying to be extra-safe here
-    event->next_event = NULL;
-    event->pprev_event = NULL;
+    if (trace_fp)
+        trace_op(clock, DC_SCHED_TRACE_CANCEL, event);
 
-    update_target_stamp(clock);
+    bool was_next = idx == ev_next_idx(clock);
+    ev_remove(clock, idx);
+
+    if (was_next)
+        update_target_stamp(clock);
 }
 
 struct SchedEvent *pop_event(struct dc_clock *clock) {
-    struct SchedEvent *ev_ret = clock->ev_next_priv;
+    struct SchedEvent *ev_ret = peek_event(clock);
 
 #ifdef INVARIANTS
     /*
@@ -133,17 +327,11 @@ struct SchedEvent *pop_event(struct dc_clock *clock) {
     }
 #endif
 
-    if (clock->ev_next_priv) {
-        clock->ev_next_priv = clock->ev_next_priv->next_event;
-        if (clock->ev_next_priv)
-            clock->ev_next_priv->pprev_event = &clock->ev_next_priv;
-    }
+    if (trace_fp)
+        trace_op(clock, DC_SCHED_TRACE_POP, ev_ret);
 
-    // XXX this is unnecessary, but I'm trying to be extra-safe here
-    if (ev_ret) {
-        ev_ret->next_event = NULL;
-        ev_ret->pprev_event = NULL;
-    }
+    if (ev_ret)
+        ev_remove(clock, ev_next_idx(clock));
 
     update_target_stamp(clock);
 
@@ -151,7 +339,8 @@ struct SchedEvent *pop_event(struct dc_clock *clock) {
 }
 
 struct SchedEvent *peek_event(struct dc_clock *clock) {
-    return clock->ev_next_priv;
+    return clock->ev_count_priv ?
+        clock->ev_heap_priv[ev_next_idx(clock)].event : NULL;
 }
 
 dc_cycle_stamp_t clock_target_stamp(struct dc_clock *clock) {
@@ -220,3 +409,68 @@ bool dc_clock_run_timeslice(struct dc_clock *clk) {
 
     return ret_val;
 }
+
+void dc_sched_trace_open(char const *path) {
+    dc_sched_trace_close();
+
+    trace_fp = fopen(path, "wb");
+    if (!trace_fp) {
+        LOG_ERROR("%s - failed to open \"%s\"\n", __func__, path);
+        return;
+    }
+    trace_n_clocks = trace_n_events = 0;
+    LOG_INFO("recording scheduler trace to \"%s\"\n", path);
+}
+
+void dc_sched_trace_close(void) {
+    if (trace_fp) {
+        fclose(trace_fp);
+        trace_fp = NULL;
+    }
+}
+
+static void trace_op(struct dc_clock *clock, enum dc_sched_trace_op op,
+                     struct SchedEvent const *event) {
+    struct dc_sched_trace_rec rec;
+    unsigned idx;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.now = clock_cycle_stamp(clock);
+    rec.op = op;
+
+    for (idx = 0; idx < trace_n_clocks; idx++)
+        if (trace_clocks[idx] == clock)
+            break;
+    if (idx == trace_n_clocks) {
+        if (trace_n_clocks == DC_SCHED_TRACE_MAX_CLOCKS)
+            goto on_overflow;
+        trace_clocks[trace_n_clocks++] = clock;
+    }
+    rec.clock_id = idx;
+
+    if (event) {
+        rec.when = event->when;
+        for (idx = 0; idx < trace_n_events; idx++)
+            if (trace_events[idx] == event)
+                break;
+        if (idx == trace_n_events) {
+            if (trace_n_events == DC_SCHED_TRACE_MAX_EVENTS)
+                goto on_overflow;
+            trace_events[trace_n_events++] = event;
+        }
+        rec.event_id = idx;
+    } else {
+        rec.event_id = DC_SCHED_TRACE_NO_EVENT;
+    }
+
+    if (fwrite(&rec, sizeof(rec), 1, trace_fp) != 1) {
+        LOG_ERROR("%s - failed to write to the scheduler trace\n", __func__);
+        dc_sched_trace_close();
+    }
+    return;
+
+on_overflow:
+    LOG_ERROR("%s - too many clocks or events; the scheduler trace will be "
+              "truncated here\n", __func__);
+    dc_sched_trace_close();
+}
@@ -34,7 +34,21 @@
 
 #define DC_TIMESLICE (SCHED_FREQUENCY / 400)
 
-// simple priority-queue scheduler
+/*
+ * priority-queue scheduler.  Events which are scheduled for the same time
+ * happen in the reverse of the order they were scheduled in; this is the order
+ * the scheduler has always used, and changing it would change the emulator's
+ * timing.
+ *
+ * A clock with only a few events keeps them in an array sorted by when they're
+ * scheduled to happen, which is the same thing the scheduler used to do with a
+ * linked list.  That's faster than a heap when there aren't many events to
+ * walk past (see src/bench/sched_bench.c), but it doesn't scale, so once a
+ * clock has more than DC_SCHED_LIST_MAX events the array gets treated as a
+ * binary min-heap instead.  It goes back to being sorted once the clock has
+ * DC_SCHED_LIST_MAX / 2 or fewer events left.
+ */
+#define DC_SCHED_LIST_MAX 32
 
 typedef uint64_t dc_cycle_stamp_t;
 
@@ -49,9 +63,12 @@ struct SchedEvent {
 
     void *arg_ptr;
 
-    // linked list, only the scheduler gets to touch these
-    struct SchedEvent **pprev_event;
-    struct SchedEvent *next_event;
+    /*
+     * only the scheduler gets to touch these.  heap_idx is only valid while
+     * the clock's events are a heap.
+     */
+    unsigned heap_idx;
+    uint64_t seq;
 };
 
 typedef struct SchedEvent SchedEvent;
@@ -61,6 +78,11 @@ typedef struct SchedEvent SchedEvent;
  * that timer.  Each CPU will have its own clock, and that clock will be shared
  * with any system that needs to generate events for that CPU.
  */
+struct dc_sched_slot {
+    dc_cycle_stamp_t when;
+    struct SchedEvent *event;
+};
+
 struct dc_clock {
     bool (*dispatch)(void *ctxt);
     void *dispatch_ctxt;
@@ -75,8 +97,21 @@ struct dc_clock {
     dc_cycle_stamp_t target_stamp_priv;
     dc_cycle_stamp_t *target_stamp_ptr_priv;
 
-    // the next scheduled event
-    struct SchedEvent *ev_next_priv;
+    /*
+     * scheduled events, either as a binary heap whose first slot is the next
+     * event, or sorted so that the last slot is the next event, depending on
+     * ev_is_heap_priv.  Each slot keeps a copy of the event's timestamp so that
+     * searching and sifting don't have to chase the event pointer.
+     */
+    struct dc_sched_slot *ev_heap_priv;
+    unsigned ev_count_priv, ev_heap_cap_priv;
+    bool ev_is_heap_priv;
+
+    /*
+     * incremented every time an event is scheduled; this is used to break ties
+     * between events scheduled for the same time.
+     */
+    uint64_t ev_seq_priv;
 };
 
 void dc_clock_init(struct dc_clock *clk);
@@ -113,4 +148,42 @@ void clock_set_target_pointer(struct dc_clock *clock, dc_cycle_stamp_t *ptr);
 void
 clock_set_cycle_stamp_pointer(struct dc_clock *clock, dc_cycle_stamp_t *ptr);
 
+/*
+ * Scheduler traces.  While a trace is open, every call to sched_event,
+ * cancel_event and pop_event on any clock gets appended to the trace file as a
+ * struct dc_sched_trace_rec.  src/bench/sched_bench replays these to compare
+ * scheduler implementations against the load from a real session.
+ *
+ * Clocks and events are identified by the order in which the trace first saw
+ * them; there can be at most DC_SCHED_TRACE_MAX_CLOCKS and
+ * DC_SCHED_TRACE_MAX_EVENTS of them.
+ */
+#define DC_SCHED_TRACE_MAX_CLOCKS 8
+#define DC_SCHED_TRACE_MAX_EVENTS 1024
+
+// event_id for a pop_event which returned NULL
+#define DC_SCHED_TRACE_NO_EVENT 0xffff
+
+enum dc_sched_trace_op {
+    DC_SCHED_TRACE_SCHED,
+    DC_SCHED_TRACE_CANCEL,
+    DC_SCHED_TRACE_POP
+};
+
+struct dc_sched_trace_rec {
+    // the clock's cycle stamp when the operation happened
+    dc_cycle_stamp_t now;
+
+    // the event's timestamp
+    dc_cycle_stamp_t when;
+
+    uint8_t op; // enum dc_sched_trace_op
+    uint8_t clock_id;
+    uint16_t event_id;
+    uint32_t pad;
+};
+
+void dc_sched_trace_open(char const *path);
+void dc_sched_trace_close(void);
+
 #endif
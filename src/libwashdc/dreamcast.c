@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <math.h>
+#include <ctype.h>
 
 #include "config.h"
 #include "washdc/error.h"
@@ -53,6 +54,7 @@
 #include "hw/sys/sys_block.h"
 #include "hw/aica/aica.h"
 #include "hw/aica/aica_rtc.h"
+#include "hw/aica/aica_thread.h"
 #include "hw/g1/g1.h"
 #include "hw/g1/g1_reg.h"
 #include "hw/g2/g2.h"
@@ -64,9 +66,16 @@
 #include "jit/jit_intp/code_block_intp.h"
 #include "jit/code_cache.h"
 #include "jit/jit.h"
+#include "jit/jit_disk_cache.h"
+
+#ifdef JIT_OPTIMIZE
+#include "jit/jit_opt.h"
+#endif
 #include "hw/boot_rom.h"
 #include "hw/arm7/arm7.h"
+#include "hw/arm7/arm7_jit.h"
 #include "title.h"
+#include "hostfile.h"
 #include "washdc/config_file.h"
 #include "mount.h"
 #include "gdi.h"
@@ -81,7 +90,9 @@
 #ifdef ENABLE_JIT_X86_64
 #include "jit/x86_64/native_dispatch.h"
 #include "jit/x86_64/native_mem.h"
+#include "jit/x86_64/native_fastmem.h"
 #include "jit/x86_64/exec_mem.h"
+#include "jit/x86_64/code_block_x86_64.h"
 #endif
 
 #include "dreamcast.h"
@@ -93,6 +104,7 @@ static struct boot_rom firmware;
 static struct flash_mem flash_mem;
 static struct aica_rtc rtc;
 static struct arm7 arm7;
+static struct arm7_jit arm7_jit;
 static struct memory_map arm7_mem_map;
 static struct aica aica;
 static struct gdrom_ctxt gdrom;
@@ -107,6 +119,9 @@ static bool end_of_frame;
 
 static bool using_debugger;
 
+// true if the ARM7 and AICA are running on their own thread (see aica_thread.h)
+static bool arm7_threaded;
+
 static struct timespec last_frame_realtime;
 static dc_cycle_stamp_t last_frame_virttime;
 
@@ -141,6 +156,7 @@ static bool run_to_next_sh4_event(void *ctxt);
 static bool run_to_next_sh4_event_jit(void *ctxt);
 
 static bool run_to_next_arm7_event(void *ctxt);
+static bool run_to_next_arm7_event_jit(void *ctxt);
 
 #ifdef ENABLE_JIT_X86_64
 static native_dispatch_entry_func native_dispatch_entry;
@@ -166,6 +182,10 @@ static void dreamcast_enable_serial_server(void);
 
 static void suspend_loop(void);
 
+#ifdef JIT_OPTIMIZE
+static void dc_cfg_jit_opt(void);
+#endif
+
 /*
  * XXX this used to be (SCHED_FREQUENCY / 10).  Now it's (SCHED_FREQUENCY / 100)
  * because programs that use the serial port (like KallistiOS) can timeout if
@@ -212,6 +232,60 @@ static struct washdc_gameconsole dccons = {
     }
 };
 
+#ifdef JIT_OPTIMIZE
+/*
+ * every jit_opt pass can be turned off from wash.cfg with
+ * jit.opt.<pass name> false
+ */
+static void dc_cfg_jit_opt(void) {
+    unsigned pass;
+    for (pass = 0; pass < JIT_OPT_PASS_COUNT; pass++) {
+        char key[64];
+        bool enable;
+        snprintf(key, sizeof(key), "jit.opt.%s", jit_opt_pass_name(pass));
+        if (cfg_get_bool(key, &enable) == 0) {
+            jit_opt_set_pass_enabled(pass, enable);
+            if (!enable)
+                LOG_INFO("jit_opt pass %s is disabled\n", key);
+        }
+    }
+}
+#endif
+
+/*
+ * The persistent translation cache gets one file per title, named after the
+ * disc's product id and version (or "firmware" when there's no disc).  Blocks
+ * are checked against guest memory before they're used, so the name only has
+ * to keep different titles from crowding each other out.
+ */
+static void dc_jit_cache_open(char const *name) {
+    char path[HOSTFILE_PATH_LEN];
+    char file_name[64];
+    char const *dir = hostfile_jit_cache_dir();
+    unsigned idx;
+
+    if (!dir || !name[0]) {
+        LOG_WARN("%s - unable to pick a jit cache file; blocks will not be "
+                 "saved\n", __func__);
+        return;
+    }
+    hostfile_create_jit_cache_dir();
+
+    snprintf(file_name, sizeof(file_name), "%s", name);
+    for (idx = strlen(file_name); idx && file_name[idx - 1] == ' '; idx--)
+        file_name[idx - 1] = '\0';
+    for (idx = 0; file_name[idx]; idx++)
+        if (!isalnum((unsigned char)file_name[idx]) && file_name[idx] != '-')
+            file_name[idx] = '_';
+    strncat(file_name, ".jitcache", sizeof(file_name) - strlen(file_name) - 1);
+
+    strncpy(path, dir, sizeof(path));
+    path[sizeof(path) - 1] = '\0';
+    hostfile_path_append(path, file_name, sizeof(path));
+
+    sh4_jit_cache_init(&cpu, path);
+}
+
 struct washdc_gameconsole const*
 dreamcast_init(char const *gdi_path,
                struct washdc_overlay_intf const *overlay_intf_fns,
@@ -230,6 +304,7 @@ dreamcast_init(char const *gdi_path,
 
     char const *title_content = NULL;
     struct mount_meta content_meta; // only valid if gdi_path is non-null
+    char jit_cache_name[64] = "";
 
     if (gdi_path) {
         mount_gdi(gdi_path);
@@ -249,11 +324,16 @@ dreamcast_init(char const *gdi_path,
             LOG_INFO("\tboot file: %s\n", content_meta.boot_file);
             LOG_INFO("\tcompany: %s\n", content_meta.company);
             LOG_INFO("\ttitle: %s\n", content_meta.title);
+
+            snprintf(jit_cache_name, sizeof(jit_cache_name), "%s_%s",
+                     content_meta.product_id, content_meta.product_version);
         }
     }
 
-    if (!(config_get_boot_mode() == DC_BOOT_DIRECT || gdi_path))
+    if (!(config_get_boot_mode() == DC_BOOT_DIRECT || gdi_path)) {
         title_content = "firmware";
+        snprintf(jit_cache_name, sizeof(jit_cache_name), "firmware");
+    }
 
     title_set_content(title_content);
 
@@ -319,14 +399,46 @@ dreamcast_init(char const *gdi_path,
 
     dc_clock_init(&sh4_clock);
     dc_clock_init(&arm7_clock);
+    if (strlen(config_get_sched_trace_path()))
+        dc_sched_trace_open(config_get_sched_trace_path());
     sh4_init(&cpu, &sh4_clock);
     arm7_init(&arm7, &arm7_clock, &aica.mem);
     jit_init(&sh4_clock);
+#ifdef JIT_OPTIMIZE
+    dc_cfg_jit_opt();
+#endif
+    code_cache_set_mode_src(cpu.reg + SH4_REG_FPSCR, SH4_JIT_FPSCR_MODE_MASK);
     sys_block_init();
     g1_init();
     g2_init();
     aica_init(&aica, &arm7, &arm7_clock, &sh4_clock);
+    arm7_threaded = config_get_arm7_thread();
+#ifdef ENABLE_DEBUGGER
+    if (arm7_threaded && config_get_dbg_enable()) {
+        LOG_WARN("the ARM7 can't run on its own thread while the debugger is "
+                 "enabled\n");
+        arm7_threaded = false;
+    }
+#endif
+    if (arm7_threaded && strlen(config_get_sched_trace_path())) {
+        LOG_WARN("the ARM7 can't run on its own thread while a scheduler "
+                 "trace is being recorded\n");
+        arm7_threaded = false;
+    }
+    if (arm7_threaded) {
+        dc_cycle_stamp_t skew_limit = DC_TIMESLICE;
+        if (config_get_arm7_skew_limit() > 0) {
+            skew_limit = (dc_cycle_stamp_t)config_get_arm7_skew_limit() *
+                (SCHED_FREQUENCY / 1000000);
+        }
+        aica_thread_init(&aica, &sh4_clock, &arm7_clock, skew_limit);
+    }
     pvr2_init(&dc_pvr2, &sh4_clock);
+
+    char const *ta_capture_path = cfg_get_node("pvr2.ta-capture");
+    if (ta_capture_path && strlen(ta_capture_path))
+        pvr2_ta_capture_open(ta_capture_path);
+
     gdrom_init(&gdrom, &sh4_clock);
     maple_init(&sh4_clock);
 
@@ -338,12 +450,56 @@ dreamcast_init(char const *gdi_path,
     construct_arm7_mem_map(&arm7_mem_map);
     arm7_set_mem_map(&arm7, &arm7_mem_map);
 
+    if (config_get_arm7_jit()) {
+#ifdef ENABLE_JIT_X86_64
+        /*
+         * the x86_64 emitter isn't thread-safe, and the SH4 is already using
+         * it, so a threaded ARM7 gets the IL interpreter.
+         */
+        bool arm7_native = config_get_native_jit() && !arm7_threaded;
+#else
+        bool arm7_native = false;
+#endif
+        arm7_jit_init(&arm7_jit, &arm7, arm7_native,
+                      config_get_arm7_jit_lockstep());
+    }
+
 #ifdef ENABLE_JIT_X86_64
-    native_dispatch_entry =
-        native_dispatch_entry_create(&cpu, sh4_jit_compile_native);
+    /*
+     * with tiered compilation, blocks have to run jit.tier-threshold times in
+     * the IL interpreter before they get compiled to native code.
+     */
+    int tier_threshold;
+    if (config_get_jit() && config_get_native_jit() &&
+        cfg_get_int("jit.tier-threshold", &tier_threshold) == 0 &&
+        tier_threshold > 0) {
+        LOG_INFO("tiered compilation enabled; blocks are promoted after %d "
+                 "runs\n", tier_threshold);
+        code_cache_set_tier_threshold(tier_threshold);
+
+        // superblocks need the branch profiles from the interpreter tier
+        bool superblocks;
+        if (cfg_get_bool("jit.superblocks", &superblocks) == 0 &&
+            superblocks) {
+            LOG_INFO("superblock formation enabled\n");
+            code_cache_set_trace_func(sh4_jit_trace);
+        }
+
+        native_dispatch_entry =
+            native_dispatch_entry_create(&cpu, sh4_jit_compile_tiered);
+    } else {
+        native_dispatch_entry =
+            native_dispatch_entry_create(&cpu, sh4_jit_compile_native);
+    }
     native_mem_register(cpu.mem.map);
+    native_fastmem_register(cpu.mem.map);
 #endif
 
+    bool jit_disk_cache = false;
+    if (config_get_jit() &&
+        cfg_get_bool("jit.disk-cache", &jit_disk_cache) == 0 && jit_disk_cache)
+        dc_jit_cache_open(jit_cache_name);
+
     /* set the PC to the booststrap code within IP.BIN */
     if (boot_mode == (int)DC_BOOT_DIRECT)
         cpu.reg[SH4_REG_PC] = ADDR_1ST_READ_BIN;
@@ -429,15 +585,22 @@ void dreamcast_cleanup() {
 
     maple_cleanup();
     gdrom_cleanup(&gdrom);
+    pvr2_ta_capture_close();
     pvr2_cleanup(&dc_pvr2);
+    if (arm7_threaded)
+        aica_thread_cleanup();
     aica_cleanup(&aica);
     g2_cleanup();
     g1_cleanup();
     sys_block_cleanup();
 
+    if (config_get_arm7_jit())
+        arm7_jit_cleanup(&arm7_jit);
+    sh4_jit_cache_cleanup();
     jit_cleanup();
     arm7_cleanup(&arm7);
     sh4_cleanup(&cpu);
+    dc_sched_trace_close();
     dc_clock_cleanup(&arm7_clock);
     dc_clock_cleanup(&sh4_clock);
     boot_rom_cleanup(&firmware);
@@ -459,10 +622,17 @@ static struct timespec start_time;
 
 static void run_one_frame(void) {
     while (!end_of_frame) {
-        if (dc_clock_run_timeslice(&sh4_clock))
-            return;
-        if (dc_clock_run_timeslice(&arm7_clock))
-            return;
+        if (arm7_threaded) {
+            // the ARM7's timeslices happen on the other thread
+            aica_thread_sh4_sync();
+            if (dc_clock_run_timeslice(&sh4_clock))
+                return;
+        } else {
+            if (dc_clock_run_timeslice(&sh4_clock))
+                return;
+            if (dc_clock_run_timeslice(&arm7_clock))
+                return;
+        }
         if (config_get_jit())
             code_cache_gc();
     }
@@ -477,6 +647,8 @@ static void main_loop_sched(void) {
     while (atomic_load_explicit(&is_running, memory_order_relaxed)) {
         run_one_frame();
         frame_count++;
+        if (config_get_jit())
+            sh4_jit_idle_end_frame();
         if (frame_stop) {
             frame_stop = false;
             if (dc_state == DC_STATE_RUNNING) {
@@ -526,6 +698,8 @@ static cpu_backend_func select_arm7_backend(void) {
     if (use_debugger)
         return run_to_next_arm7_event_debugger;
 #endif
+    if (config_get_arm7_jit())
+        return run_to_next_arm7_event_jit;
     return run_to_next_arm7_event;
 }
 
@@ -560,8 +734,17 @@ void dreamcast_run() {
     arm7_clock.dispatch = select_arm7_backend();
     arm7_clock.dispatch_ctxt = &arm7;
 
+    if (arm7_threaded)
+        aica_thread_start();
+
     main_loop_sched();
 
+    if (arm7_threaded)
+        aica_thread_stop();
+
+    // don't let the frontend tear anything down while it's still rendering
+    gfx_sync();
+
     dc_print_perf_stats();
 
     // tell the other threads it's time to clean up and exit
@@ -586,21 +769,28 @@ void dreamcast_run() {
 static bool run_to_next_arm7_event(void *ctxt) {
     dc_cycle_stamp_t tgt_stamp = clock_target_stamp(&arm7_clock);
 
-    if (arm7.enabled) {
-        while (tgt_stamp > clock_cycle_stamp(&arm7_clock)) {
-            struct arm7_decoded_inst decoded;
-            arm7_fetch_inst(&arm7, &decoded);
+    /*
+     * in threaded mode the SH4 can reset the ARM7 or schedule new events from
+     * inside aica_thread_poll, so the enabled flag and the target stamp both
+     * get checked again after that.
+     */
+    while (arm7.enabled && tgt_stamp > clock_cycle_stamp(&arm7_clock)) {
+        struct arm7_decoded_inst decoded;
+        arm7_fetch_inst(&arm7, &decoded);
 
-            unsigned inst_cycles = arm7_exec(&arm7, &decoded);
-            dc_cycle_stamp_t cycles_after = clock_cycle_stamp(&arm7_clock) +
-                inst_cycles * ARM7_CLOCK_SCALE;
+        unsigned inst_cycles = arm7_exec(&arm7, &decoded);
+        dc_cycle_stamp_t cycles_after = clock_cycle_stamp(&arm7_clock) +
+            inst_cycles * ARM7_CLOCK_SCALE;
 
-            tgt_stamp = clock_target_stamp(&arm7_clock);
-            if (cycles_after > tgt_stamp)
-                cycles_after = tgt_stamp;
-            clock_set_cycle_stamp(&arm7_clock, cycles_after);
-        }
-    } else {
+        aica_thread_poll();
+
+        tgt_stamp = clock_target_stamp(&arm7_clock);
+        if (cycles_after > tgt_stamp)
+            cycles_after = tgt_stamp;
+        clock_set_cycle_stamp(&arm7_clock, cycles_after);
+    }
+
+    if (!arm7.enabled) {
         /*
          * XXX When the ARM7 is disabled, the PC is supposed to continue
          * incrementing until it's enabled just as if it was executing
@@ -620,6 +810,31 @@ static bool run_to_next_arm7_event(void *ctxt) {
     return false;
 }
 
+static bool run_to_next_arm7_event_jit(void *ctxt) {
+    dc_cycle_stamp_t tgt_stamp = clock_target_stamp(&arm7_clock);
+
+    while (arm7.enabled && tgt_stamp > clock_cycle_stamp(&arm7_clock)) {
+        unsigned cycles = arm7_jit_run(&arm7_jit);
+        dc_cycle_stamp_t cycles_after = clock_cycle_stamp(&arm7_clock) +
+            cycles * ARM7_CLOCK_SCALE;
+
+        aica_thread_poll();
+
+        tgt_stamp = clock_target_stamp(&arm7_clock);
+        if (cycles_after > tgt_stamp)
+            cycles_after = tgt_stamp;
+        clock_set_cycle_stamp(&arm7_clock, cycles_after);
+    }
+
+    if (!arm7.enabled) {
+        // see run_to_next_arm7_event
+        tgt_stamp = clock_target_stamp(&arm7_clock);
+        clock_set_cycle_stamp(&arm7_clock, tgt_stamp);
+    }
+
+    return false;
+}
+
 #ifdef ENABLE_DEBUGGER
 static bool run_to_next_arm7_event_debugger(void *ctxt) {
     dc_cycle_stamp_t tgt_stamp = clock_target_stamp(&arm7_clock);
@@ -874,6 +1089,64 @@ void dc_print_perf_stats(void) {
 
         LOG_INFO("Performance is %f MHz (%f%%)\n",
                  hz / 1000000.0, hz_ratio * 100.0);
+
+        if (config_get_jit()) {
+            struct code_cache_stats cache_stats;
+            code_cache_get_stats(&cache_stats);
+            code_cache_print_stats(&cache_stats);
+
+            struct sh4_jit_idle_stats idle_stats;
+            sh4_jit_idle_get_stats(&idle_stats);
+            sh4_jit_idle_print_stats(&idle_stats);
+
+            struct sh4_jit_fallback_stats fallback_stats;
+            sh4_jit_fallback_get_stats(&fallback_stats);
+            sh4_jit_fallback_print_stats(&fallback_stats);
+
+            if (jit_disk_cache_enabled()) {
+                struct jit_disk_cache_stats disk_cache_stats;
+                jit_disk_cache_get_stats(&disk_cache_stats);
+                jit_disk_cache_print_stats(&disk_cache_stats);
+            }
+
+#ifdef JIT_OPTIMIZE
+            jit_opt_print_stats("SH4", &sh4_jit_opt_stats);
+#endif
+        }
+
+        if (config_get_arm7_jit()) {
+            struct arm7_jit_stats arm7_stats;
+            arm7_jit_get_stats(&arm7_jit, &arm7_stats);
+            arm7_jit_print_stats(&arm7_stats);
+        }
+
+        if (arm7_threaded) {
+            struct aica_thread_stats thread_stats;
+            aica_thread_get_stats(&thread_stats);
+            aica_thread_print_stats(&thread_stats);
+        }
+
+#ifdef ENABLE_JIT_X86_64
+        if (config_get_native_jit()) {
+            struct native_fastmem_stats fastmem_stats;
+            native_fastmem_get_stats(&fastmem_stats);
+            native_fastmem_print_stats(&fastmem_stats);
+
+            struct native_dispatch_stats dispatch_stats;
+            native_dispatch_get_stats(&dispatch_stats);
+            native_dispatch_print_stats(&dispatch_stats);
+
+            struct code_block_x86_64_stats alloc_stats;
+            code_block_x86_64_get_stats(&alloc_stats);
+            code_block_x86_64_print_stats(&alloc_stats);
+
+            if (code_cache_get_tier_threshold()) {
+                struct code_cache_tier_stats tier_stats;
+                code_cache_tier_get_stats(&tier_stats);
+                code_cache_tier_print_stats(&tier_stats);
+            }
+        }
+#endif
     } else {
         LOG_INFO("Program execution halted before WashingtonDC was completely "
                  "initialized.\n");
@@ -1055,6 +1328,19 @@ static void construct_arm7_mem_map(struct memory_map *map) {
 }
 
 static void construct_sh4_mem_map(struct Sh4 *sh4, struct memory_map *map) {
+    struct memory_interface const *aica_wave_intf = &aica_wave_mem_intf;
+    struct memory_interface const *aica_sys_intf_sh4 = &aica_sys_intf;
+    void *aica_wave_ctxt = &aica.mem;
+    void *aica_sys_ctxt = &aica;
+
+    // keep the ARM7 out of the AICA while the SH4 is using it
+    if (arm7_threaded) {
+        aica_wave_intf = &aica_thread_locked_intf;
+        aica_sys_intf_sh4 = &aica_thread_locked_intf;
+        aica_wave_ctxt = aica_thread_wrap_wave_mem();
+        aica_sys_ctxt = aica_thread_wrap_sys();
+    }
+
     /*
      * I don't like the idea of putting SH4_AREA_P4 ahead of AREA3 (memory),
      * but this absolutely needs to be at the front of the list because the
@@ -1153,10 +1439,10 @@ static void construct_sh4_mem_map(struct Sh4 *sh4, struct memory_map *map) {
     /*                &pvr2_core_reg_intf, NULL); */
     memory_map_add(map, ADDR_AICA_WAVE_FIRST, ADDR_AICA_WAVE_LAST,
                    0x1fffffff, ADDR_AICA_WAVE_MASK, MEMORY_MAP_REGION_UNKNOWN,
-                   &aica_wave_mem_intf, &aica.mem);
+                   aica_wave_intf, aica_wave_ctxt);
     memory_map_add(map, 0x00700000, 0x00707fff,
                    0x1fffffff, 0xffffffff, MEMORY_MAP_REGION_UNKNOWN,
-                   &aica_sys_intf, &aica);
+                   aica_sys_intf_sh4, aica_sys_ctxt);
     memory_map_add(map, ADDR_AICA_RTC_FIRST, ADDR_AICA_RTC_LAST,
                    0x1fffffff, ADDR_AREA0_MASK, MEMORY_MAP_REGION_UNKNOWN,
                    &aica_rtc_intf, &rtc);
@@ -1196,10 +1482,10 @@ static void construct_sh4_mem_map(struct Sh4 *sh4, struct memory_map *map) {
     /*                &pvr2_core_reg_intf, NULL); */
     memory_map_add(map, ADDR_AICA_WAVE_FIRST + 0x02000000, ADDR_AICA_WAVE_LAST + 0x02000000,
                    0x1fffffff, ADDR_AICA_WAVE_MASK, MEMORY_MAP_REGION_UNKNOWN,
-                   &aica_wave_mem_intf, &aica.mem);
+                   aica_wave_intf, aica_wave_ctxt);
     memory_map_add(map, 0x00700000 + 0x02000000, 0x00707fff + 0x02000000,
                    0x1fffffff, 0xffffffff, MEMORY_MAP_REGION_UNKNOWN,
-                   &aica_sys_intf, &aica);
+                   aica_sys_intf_sh4, aica_sys_ctxt);
     memory_map_add(map, ADDR_AICA_RTC_FIRST + 0x02000000, ADDR_AICA_RTC_LAST + 0x02000000,
                    0x1fffffff, ADDR_AREA0_MASK, MEMORY_MAP_REGION_UNKNOWN,
                    &aica_rtc_intf, &rtc);
@@ -1224,11 +1510,18 @@ void dc_ch2_dma_xfer(addr32_t xfer_src, addr32_t xfer_dst, unsigned n_words) {
      */
     if ((xfer_dst >= ADDR_TA_FIFO_POLY_FIRST) &&
         (xfer_dst <= ADDR_TA_FIFO_POLY_LAST)) {
-        while (n_words--) {
-            uint32_t buf = memory_map_read_32(&mem_map, xfer_src);
-            pvr2_ta_fifo_poly_write_32(xfer_dst, buf, &dc_pvr2);
-            xfer_dst += sizeof(buf);
-            xfer_src += sizeof(buf);
+        // hand the TA one 32-byte chunk at a time
+        uint32_t buf[8];
+        while (n_words) {
+            unsigned n_burst = n_words < 8 ? n_words : 8;
+            unsigned idx;
+            for (idx = 0; idx < n_burst; idx++) {
+                buf[idx] = memory_map_read_32(&mem_map, xfer_src);
+                xfer_src += sizeof(buf[0]);
+            }
+            pvr2_ta_fifo_poly_write_burst32(xfer_dst, buf, n_burst, &dc_pvr2);
+            xfer_dst += n_burst * sizeof(buf[0]);
+            n_words -= n_burst;
         }
     } else if ((xfer_dst >= ADDR_AREA4_TEX64_FIRST) &&
                (xfer_dst <= ADDR_AREA4_TEX64_LAST)) {
@@ -1271,6 +1564,18 @@ void dc_get_pvr2_stats(struct pvr2_stat *stats) {
     *stats = dc_pvr2.stat;
 }
 
+void dc_get_tex_cache_stats(struct pvr2_tex_cache_stat *stats) {
+    pvr2_tex_cache_get_stat(&dc_pvr2, stats);
+}
+
+void dc_get_ta_batch_stats(struct pvr2_ta_batch_stat *stats) {
+    pvr2_ta_get_batch_stat(&dc_pvr2, stats);
+}
+
+void dc_get_idle_stats(struct sh4_jit_idle_stats *stats) {
+    sh4_jit_idle_get_stats(stats);
+}
+
 static float sh4_unmapped_readfloat(uint32_t addr, void *ctxt) {
     error_set_feature("memory mapping");
     error_set_address(addr);
@@ -142,6 +142,15 @@ void dc_tex_cache_read(void **tex_dat_out, size_t *n_bytes_out,
 struct pvr2_stat;
 void dc_get_pvr2_stats(struct pvr2_stat *stats);
 
+struct pvr2_tex_cache_stat;
+void dc_get_tex_cache_stats(struct pvr2_tex_cache_stat *stats);
+
+struct pvr2_ta_batch_stat;
+void dc_get_ta_batch_stats(struct pvr2_ta_batch_stat *stats);
+
+struct sh4_jit_idle_stats;
+void dc_get_idle_stats(struct sh4_jit_idle_stats *stats);
+
 unsigned dc_get_frame_count(void);
 
 #endif
@@ -30,6 +30,9 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "washdc/stringlib.h"
 #include "washdc/error.h"
@@ -41,7 +44,12 @@
 
 struct gdi_mount {
     struct gdi_info meta;
-    FILE **track_streams;
+
+    /*
+     * these are read with pread so that the read-ahead thread and the
+     * emulation thread don't have to share a file position.
+     */
+    int *track_fds;
     size_t *track_lengths; // length of each track, in bytes
 };
 
@@ -50,6 +58,8 @@ static unsigned mount_gdi_session_count(struct mount *mount);
 static int mount_gdi_read_toc(struct mount *mount, struct mount_toc *toc,
                               unsigned session_no);
 static int mount_read_sector(struct mount *mount, void *buf, unsigned fad);
+static int mount_gdi_read_sectors(struct mount *mount, void *buf,
+                                  unsigned fad, unsigned count);
 
 // return true if this is a legitimate gd-rom; else return false
 static bool gdi_validate_fmt(struct gdi_info const *info);
@@ -60,6 +70,7 @@ static struct mount_ops gdi_mount_ops = {
     .session_count = mount_gdi_session_count,
     .read_toc = mount_gdi_read_toc,
     .read_sector = mount_read_sector,
+    .read_sectors = mount_gdi_read_sectors,
     .cleanup = mount_gdi_cleanup,
     .get_meta = mount_gdi_get_meta
 };
@@ -244,14 +255,14 @@ void mount_gdi(char const *path) {
     if (!gdi_validate_fmt(&mount->meta))
         RAISE_ERROR(ERROR_INVALID_PARAM);
 
-    mount->track_streams = (FILE**)calloc(mount->meta.n_tracks, sizeof(FILE*));
-    if (!mount->track_streams)
+    mount->track_fds = (int*)calloc(mount->meta.n_tracks, sizeof(int));
+    if (!mount->track_fds)
         RAISE_ERROR(ERROR_FAILED_ALLOC);
 
     mount->track_lengths = (size_t*)calloc(mount->meta.n_tracks,
                                            sizeof(size_t));
     if (!mount->track_lengths) {
-        free(mount->track_streams);
+        free(mount->track_fds);
         RAISE_ERROR(ERROR_FAILED_ALLOC);
     }
 
@@ -259,27 +270,21 @@ void mount_gdi(char const *path) {
     for (track_no = 0; track_no < mount->meta.n_tracks; track_no++) {
         struct string const *track_path =
             &mount->meta.tracks[track_no].abs_path;
-        mount->track_streams[track_no] = fopen(string_get(track_path), "rb");
-        if (!mount->track_streams[track_no]) {
-            error_set_file_path(string_get(track_path));
-            error_set_errno_val(errno);
-            RAISE_ERROR(ERROR_FILE_IO);
-        }
-
-        if (fseek(mount->track_streams[track_no], 0, SEEK_END) != 0) {
+        mount->track_fds[track_no] = open(string_get(track_path), O_RDONLY);
+        if (mount->track_fds[track_no] < 0) {
             error_set_file_path(string_get(track_path));
             error_set_errno_val(errno);
             RAISE_ERROR(ERROR_FILE_IO);
         }
 
-        long len = ftell(mount->track_streams[track_no]);
-        if (len < 0) {
+        struct stat track_stat;
+        if (fstat(mount->track_fds[track_no], &track_stat) != 0) {
             error_set_file_path(string_get(track_path));
             error_set_errno_val(errno);
             RAISE_ERROR(ERROR_FILE_IO);
         }
 
-        mount->track_lengths[track_no] = len;
+        mount->track_lengths[track_no] = track_stat.st_size;
     }
 
     mount_insert(&gdi_mount_ops, mount);
@@ -290,8 +295,9 @@ static void mount_gdi_cleanup(struct mount *mount) {
 
     unsigned track_no;
     for (track_no = 0; track_no < state->meta.n_tracks; track_no++)
-        fclose(state->track_streams[track_no]);
-    free(state->track_streams);
+        close(state->track_fds[track_no]);
+    free(state->track_fds);
+    free(state->track_lengths);
     free(state);
 }
 
@@ -361,6 +367,11 @@ static int mount_gdi_read_toc(struct mount *mount, struct mount_toc *toc,
 }
 
 static int mount_read_sector(struct mount *mount, void *buf, unsigned fad) {
+    return mount_gdi_read_sectors(mount, buf, fad, 1) == 1 ? 0 : -1;
+}
+
+static int mount_gdi_read_sectors(struct mount *mount, void *buf,
+                                  unsigned fad, unsigned count) {
     struct gdi_mount const *gdi_mount = (struct gdi_mount const*)mount->state;
     struct gdi_info const *info = &gdi_mount->meta;
 
@@ -375,27 +386,45 @@ static int mount_read_sector(struct mount *mount, void *buf, unsigned fad) {
 
             // TODO: support MODE2 FORM1, MODE2 FORM2, CDDA, etc...
             unsigned fad_relative = fad - trackp->fad_start;
-            unsigned byte_offset = CDROM_FRAME_SIZE * fad_relative +
-                CDROM_MODE1_DATA_OFFSET;
+            if (count > track_fad_count - fad_relative)
+                count = track_fad_count - fad_relative;
+
+            off_t byte_offset = (off_t)CDROM_FRAME_SIZE * fad_relative;
 
             LOG_DBG("Select track %d (%u blocks starting from %u)\n",
                      track_idx + 1, track_fad_count, (unsigned)trackp->fad_start);
-            LOG_DBG("read 1 sector starting at byte %u\n", byte_offset);
+            LOG_DBG("read %u sectors starting at byte %u\n",
+                    count, (unsigned)byte_offset);
+
+            /*
+             * read all of the frames in one go and then pick the user data
+             * out of each one.
+             */
+            size_t n_bytes = (size_t)CDROM_FRAME_SIZE * count;
+            uint8_t *frames = (uint8_t*)malloc(n_bytes);
+            if (!frames)
+                return -1;
 
             // TODO: don't ignore the offset
-            if (fseek(gdi_mount->track_streams[track_idx],
-                      byte_offset, SEEK_SET) != 0) {
-                goto return_err;
+            if (pread(gdi_mount->track_fds[track_idx], frames,
+                      n_bytes, byte_offset) != (ssize_t)n_bytes) {
+                free(frames);
+                return -1;
             }
 
-            if (fread(buf, 2048, 1, gdi_mount->track_streams[track_idx]) != 1)
-                goto return_err;
+            unsigned sector_no;
+            for (sector_no = 0; sector_no < count; sector_no++) {
+                memcpy((uint8_t*)buf + sector_no * CDROM_FRAME_DATA_SIZE,
+                       frames + sector_no * CDROM_FRAME_SIZE +
+                       CDROM_MODE1_DATA_OFFSET,
+                       CDROM_FRAME_DATA_SIZE);
+            }
 
-            return 0;
+            free(frames);
+            return count;
         }
     }
 
-return_err:
     return -1;
 }
 
@@ -407,10 +436,8 @@ static int mount_gdi_get_meta(struct mount *mount, struct mount_meta *meta) {
     if (info->n_tracks < 3)
         return -1;
 
-    if (fseek(gdi_mount->track_streams[2], 16, SEEK_SET))
-        return -1;
-
-    if (fread(buffer, sizeof(buffer), 1, gdi_mount->track_streams[2]) != 1)
+    if (pread(gdi_mount->track_fds[2], buffer,
+              sizeof(buffer), 16) != sizeof(buffer))
         return -1;
 
     memset(meta, 0, sizeof(*meta));
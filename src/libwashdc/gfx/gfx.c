@@ -22,15 +22,20 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <err.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
 
 #define GL3_PROTOTYPES 1
 #include <GL/glew.h>
 #include <GL/gl.h>
 
 #include "washdc/win.h"
+#include "washdc/error.h"
 #include "dreamcast.h"
 #include "gfx/rend_common.h"
 #include "gfx/gfx_tex_cache.h"
@@ -48,33 +53,161 @@ static unsigned frame_counter;
 
 static struct washdc_overlay_intf const *overlay_intf;
 
-// Only call gfx_thread_signal and gfx_thread_wait when you hold the lock.
+/*
+ * In threaded mode, everything that touches OpenGL happens on gfx_thread.  The
+ * emulation thread is the only producer; it pushes gfx_il commands into
+ * gfx_ring and only blocks when the ring or the payload arena is full, or when
+ * it needs the result of a command (GFX_IL_READ_OBJ and
+ * GFX_IL_GRAB_FRAMEBUFFER).
+ *
+ * Vertex arrays and gfx_obj writes point into memory the emulation code will
+ * reuse as soon as rend_exec_il returns, so those payloads get copied into
+ * gfx_arena.  The arena is a byte ring; each command remembers where its
+ * payload ends, and the render thread releases everything up to that point
+ * after it executes the command.  Payloads too big for the arena get their own
+ * heap allocation instead.  Either way the payload is gone once the command
+ * has executed, so a renderer that needs it later (like the OpenGL renderer's
+ * depth sort) has to make its own copy.
+ */
+#define GFX_RING_LEN_SHIFT 14
+#define GFX_RING_LEN (1 << GFX_RING_LEN_SHIFT)
+#define GFX_RING_MASK (GFX_RING_LEN - 1)
+
+#define GFX_ARENA_SIZE (32 << 20)
+#define GFX_ARENA_ALIGN 16
+#define GFX_ARENA_MAX_PAYLOAD (GFX_ARENA_SIZE / 4)
+
+enum gfx_ring_op {
+    GFX_RING_OP_IL,
+
+    // redraw the window (gfx_expose, gfx_redraw, gfx_resize)
+    GFX_RING_OP_REDRAW,
+
+    // shut down the render thread
+    GFX_RING_OP_EXIT
+};
+
+struct gfx_ring_ent {
+    enum gfx_ring_op op;
+    struct gfx_il_inst cmd;
+
+    // the arena can be released up to here once this command is done
+    uint64_t arena_end;
+
+    // payload that was too big for the arena; the render thread frees this
+    void *heap_dat;
+};
+
+static bool threaded;
+static pthread_t gfx_thread;
+
+static struct gfx_ring_ent *gfx_ring;
+static uint8_t *gfx_arena;
+
+/*
+ * prod_idx and cons_idx count up forever; the slot is (idx & GFX_RING_MASK).
+ * Only the emulation thread writes to prod_idx and arena_head, and only the
+ * render thread writes to cons_idx and arena_tail.
+ */
+static atomic_uint prod_idx, cons_idx;
+static uint64_t arena_head;
+static atomic_uint_least64_t arena_tail;
+
+/*
+ * The lock and condition variables are only for sleeping; neither side takes
+ * the lock unless the other side has said it's waiting.
+ */
+static pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prod_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cons_cond = PTHREAD_COND_INITIALIZER;
+static atomic_bool prod_waiting, cons_waiting;
+
+// these are written by the emulation thread and read by whoever draws the UI
+static atomic_uint ring_peak, ring_peak_last_frame;
+static atomic_ullong producer_stalls, sync_waits;
+
 static void gfx_do_init(void);
+static void gfx_do_redraw(void);
+static void gfx_do_cleanup(void);
+static void *gfx_thread_main(void *arg);
 
 void gfx_init(unsigned width, unsigned height) {
     win_width = width;
     win_height = height;
 
-    LOG_INFO("GFX: rendering graphics from within the main emulation thread\n");
-    gfx_do_init();
+    if (!config_get_threaded_render()) {
+        LOG_INFO("GFX: rendering graphics from within the main emulation "
+                 "thread\n");
+        gfx_do_init();
+        return;
+    }
+
+    gfx_ring = calloc(GFX_RING_LEN, sizeof(gfx_ring[0]));
+    gfx_arena = malloc(GFX_ARENA_SIZE);
+    if (!gfx_ring || !gfx_arena)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    atomic_init(&prod_idx, 0);
+    atomic_init(&cons_idx, 0);
+    atomic_init(&arena_tail, 0);
+    atomic_init(&prod_waiting, false);
+    atomic_init(&cons_waiting, false);
+    arena_head = 0;
+
+    LOG_INFO("GFX: rendering graphics from a dedicated render thread\n");
+    if (pthread_create(&gfx_thread, NULL, gfx_thread_main, NULL) != 0)
+        RAISE_ERROR(ERROR_EXT_FAILURE);
+    threaded = true;
 }
 
+static void gfx_ring_push(struct gfx_ring_ent const *ent);
+
 void gfx_cleanup(void) {
+    if (threaded) {
+        struct gfx_ring_ent ent = { .op = GFX_RING_OP_EXIT };
+        ent.arena_end = arena_head;
+        gfx_ring_push(&ent);
+        pthread_join(gfx_thread, NULL);
+        threaded = false;
+
+        free(gfx_arena);
+        free(gfx_ring);
+        gfx_arena = NULL;
+        gfx_ring = NULL;
+    } else {
+        gfx_do_cleanup();
+    }
+}
+
+static void gfx_do_cleanup(void) {
+    if (overlay_intf->overlay_cleanup_gfx)
+        overlay_intf->overlay_cleanup_gfx();
     rend_cleanup();
 }
 
+static void gfx_post_redraw(void) {
+    if (threaded) {
+        struct gfx_ring_ent ent = { .op = GFX_RING_OP_REDRAW };
+        ent.arena_end = arena_head;
+        gfx_ring_push(&ent);
+    } else {
+        gfx_do_redraw();
+    }
+}
+
 void gfx_expose(void) {
-    gfx_redraw();
+    gfx_post_redraw();
 }
 
 void gfx_redraw(void) {
-    gfx_rend_ifp->video_present();
-    if (overlay_intf->overlay_draw)
-        overlay_intf->overlay_draw();
-    win_update();
+    gfx_post_redraw();
 }
 
 void gfx_resize(int xres, int yres) {
+    gfx_post_redraw();
+}
+
+static void gfx_do_redraw(void) {
     gfx_rend_ifp->video_present();
     if (overlay_intf->overlay_draw)
         overlay_intf->overlay_draw();
@@ -113,3 +246,201 @@ void gfx_toggle_output_filter(void) {
 void gfx_set_overlay_intf(struct washdc_overlay_intf const *intf) {
     overlay_intf = intf;
 }
+
+/*
+ * block the emulation thread until the render thread has retired every
+ * command before target.
+ */
+static void gfx_wait_for_cons(unsigned target) {
+    pthread_mutex_lock(&ring_lock);
+    atomic_store(&prod_waiting, true);
+    while ((int)(atomic_load(&cons_idx) - target) < 0)
+        pthread_cond_wait(&prod_cond, &ring_lock);
+    atomic_store(&prod_waiting, false);
+    pthread_mutex_unlock(&ring_lock);
+}
+
+static void gfx_ring_push(struct gfx_ring_ent const *ent) {
+    unsigned idx = atomic_load_explicit(&prod_idx, memory_order_relaxed);
+
+    if (idx - atomic_load(&cons_idx) >= GFX_RING_LEN) {
+        atomic_fetch_add_explicit(&producer_stalls, 1, memory_order_relaxed);
+        gfx_wait_for_cons(idx - GFX_RING_LEN + 1);
+    }
+
+    gfx_ring[idx & GFX_RING_MASK] = *ent;
+    atomic_store(&prod_idx, idx + 1);
+
+    if (atomic_load(&cons_waiting)) {
+        pthread_mutex_lock(&ring_lock);
+        pthread_cond_signal(&cons_cond);
+        pthread_mutex_unlock(&ring_lock);
+    }
+
+    unsigned occupancy = idx + 1 - atomic_load(&cons_idx);
+    if (occupancy > atomic_load_explicit(&ring_peak, memory_order_relaxed))
+        atomic_store_explicit(&ring_peak, occupancy, memory_order_relaxed);
+}
+
+// copy a payload somewhere the render thread can get at it later
+static void const *
+gfx_arena_copy(struct gfx_ring_ent *ent, void const *src, size_t n_bytes) {
+    size_t len = (n_bytes + GFX_ARENA_ALIGN - 1) & ~(GFX_ARENA_ALIGN - 1);
+
+    if (len > GFX_ARENA_MAX_PAYLOAD) {
+        ent->heap_dat = malloc(n_bytes);
+        if (!ent->heap_dat)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        memcpy(ent->heap_dat, src, n_bytes);
+        return ent->heap_dat;
+    }
+
+    // payloads never wrap around the end of the arena
+    size_t offs = arena_head % GFX_ARENA_SIZE;
+    size_t pad = offs + len > GFX_ARENA_SIZE ? GFX_ARENA_SIZE - offs : 0;
+
+    if (arena_head + pad + len - atomic_load(&arena_tail) > GFX_ARENA_SIZE) {
+        atomic_fetch_add_explicit(&producer_stalls, 1, memory_order_relaxed);
+        do {
+            gfx_wait_for_cons(atomic_load(&cons_idx) + 1);
+        } while (arena_head + pad + len - atomic_load(&arena_tail) >
+                 GFX_ARENA_SIZE);
+    }
+
+    arena_head += pad;
+    void *dst = gfx_arena + arena_head % GFX_ARENA_SIZE;
+    memcpy(dst, src, n_bytes);
+    arena_head += len;
+
+    return dst;
+}
+
+void rend_exec_il(struct gfx_il_inst *cmd, unsigned n_cmd) {
+    if (!threaded) {
+        rend_exec_il_direct(cmd, n_cmd);
+        return;
+    }
+
+    while (n_cmd--) {
+        struct gfx_ring_ent ent = { .op = GFX_RING_OP_IL, .cmd = *cmd };
+        bool sync = false;
+
+        switch (cmd->op) {
+        case GFX_IL_DRAW_ARRAY:
+            ent.cmd.arg.draw_array.verts =
+                gfx_arena_copy(&ent, cmd->arg.draw_array.verts,
+                               cmd->arg.draw_array.n_verts *
+                               GFX_VERT_LEN * sizeof(float));
+            break;
+        case GFX_IL_WRITE_OBJ:
+            ent.cmd.arg.write_obj.dat =
+                gfx_arena_copy(&ent, cmd->arg.write_obj.dat,
+                               cmd->arg.write_obj.n_bytes);
+            break;
+        case GFX_IL_READ_OBJ:
+        case GFX_IL_GRAB_FRAMEBUFFER:
+            // the caller needs the result before we return
+            sync = true;
+            break;
+        case GFX_IL_POST_FRAMEBUFFER:
+            atomic_store_explicit(&ring_peak_last_frame,
+                                  atomic_load_explicit(&ring_peak,
+                                                       memory_order_relaxed),
+                                  memory_order_relaxed);
+            atomic_store_explicit(&ring_peak, 0, memory_order_relaxed);
+            break;
+        default:
+            break;
+        }
+
+        ent.arena_end = arena_head;
+        gfx_ring_push(&ent);
+
+        if (sync) {
+            atomic_fetch_add_explicit(&sync_waits, 1, memory_order_relaxed);
+            gfx_sync();
+        }
+
+        cmd++;
+    }
+}
+
+void gfx_sync(void) {
+    if (threaded)
+        gfx_wait_for_cons(atomic_load_explicit(&prod_idx,
+                                               memory_order_relaxed));
+}
+
+void gfx_get_stat(struct gfx_stat *stat) {
+    struct rend_stat rend;
+
+    memset(stat, 0, sizeof(*stat));
+
+    // the overlay calls this while it draws, so we're on the render thread
+    gfx_rend_ifp->get_stat(&rend);
+    stat->rend_draw_calls = rend.draw_calls;
+    stat->rend_upload_bytes = rend.upload_bytes;
+    stat->rend_persistent_map = rend.persistent_map;
+
+    stat->threaded = threaded;
+    if (!threaded)
+        return;
+
+    uint64_t tail = atomic_load(&arena_tail);
+
+    stat->ring_len = atomic_load(&prod_idx) - atomic_load(&cons_idx);
+    stat->ring_cap = GFX_RING_LEN;
+    stat->ring_peak = atomic_load_explicit(&ring_peak_last_frame,
+                                           memory_order_relaxed);
+    // arena_head belongs to the emulation thread, so this is approximate
+    stat->arena_len = arena_head - tail;
+    stat->arena_cap = GFX_ARENA_SIZE;
+    stat->producer_stalls = atomic_load_explicit(&producer_stalls,
+                                                 memory_order_relaxed);
+    stat->sync_waits = atomic_load_explicit(&sync_waits, memory_order_relaxed);
+}
+
+static void *gfx_thread_main(void *arg) {
+    bool done = false;
+
+    gfx_do_init();
+
+    while (!done) {
+        unsigned idx = atomic_load_explicit(&cons_idx, memory_order_relaxed);
+
+        if (atomic_load(&prod_idx) == idx) {
+            pthread_mutex_lock(&ring_lock);
+            atomic_store(&cons_waiting, true);
+            while (atomic_load(&prod_idx) == idx)
+                pthread_cond_wait(&cons_cond, &ring_lock);
+            atomic_store(&cons_waiting, false);
+            pthread_mutex_unlock(&ring_lock);
+        }
+
+        struct gfx_ring_ent *ent = gfx_ring + (idx & GFX_RING_MASK);
+        switch (ent->op) {
+        case GFX_RING_OP_IL:
+            rend_exec_il_direct(&ent->cmd, 1);
+            break;
+        case GFX_RING_OP_REDRAW:
+            gfx_do_redraw();
+            break;
+        case GFX_RING_OP_EXIT:
+            gfx_do_cleanup();
+            done = true;
+            break;
+        }
+
+        free(ent->heap_dat);
+        atomic_store(&arena_tail, ent->arena_end);
+        atomic_store(&cons_idx, idx + 1);
+
+        if (atomic_load(&prod_waiting)) {
+            pthread_mutex_lock(&ring_lock);
+            pthread_cond_signal(&prod_cond);
+            pthread_mutex_unlock(&ring_lock);
+        }
+    }
+
+    return NULL;
+}
@@ -129,4 +129,38 @@ void gfx_toggle_output_filter(void);
 
 void gfx_set_overlay_intf(struct washdc_overlay_intf const *intf);
 
+/*
+ * block until the render thread has finished executing everything that has
+ * been sent to it.  This does nothing in single-threaded mode.
+ */
+void gfx_sync(void);
+
+struct gfx_stat {
+    bool threaded;
+
+    // commands waiting in the ring right now, and the ring's capacity
+    unsigned ring_len, ring_cap;
+
+    // the most commands that were waiting at once during the last frame
+    unsigned ring_peak;
+
+    // bytes of vertex/gfx_obj payload waiting in the arena, and its capacity
+    size_t arena_len, arena_cap;
+
+    // the number of times the emulation thread had to wait for free space
+    unsigned long long producer_stalls;
+
+    // the number of times the emulation thread had to wait for a result
+    unsigned long long sync_waits;
+
+    // draw calls and vertex bytes uploaded during the last render
+    unsigned rend_draw_calls;
+    unsigned long long rend_upload_bytes;
+
+    // whether the renderer streams vertices through a persistent mapping
+    bool rend_persistent_map;
+};
+
+void gfx_get_stat(struct gfx_stat *stat);
+
 #endif
@@ -216,6 +216,11 @@ struct gfx_il_inst {
     union gfx_il_arg arg;
 };
 
+/*
+ * send gfx_il commands to the renderer.  In threaded mode this only waits for
+ * the render thread on GFX_IL_READ_OBJ and GFX_IL_GRAB_FRAMEBUFFER; any
+ * pointers in the other commands only need to be valid until this returns.
+ */
 void rend_exec_il(struct gfx_il_inst *cmd, unsigned n_cmd);
 
 #endif
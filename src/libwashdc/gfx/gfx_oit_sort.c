@@ -0,0 +1,120 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "washdc/error.h"
+
+#include "gfx_oit_sort.h"
+
+#define GFX_OIT_SORT_INITIAL_CAP 4096
+
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX_SIZE - 1)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+void gfx_oit_sort_init(struct gfx_oit_sort *sort) {
+    sort->n_keys = 0;
+    sort->cap = GFX_OIT_SORT_INITIAL_CAP;
+    sort->keys = (uint64_t*)malloc(sort->cap * sizeof(uint64_t));
+    sort->tmp = (uint64_t*)malloc(sort->cap * sizeof(uint64_t));
+    if (!sort->keys || !sort->tmp)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+}
+
+void gfx_oit_sort_cleanup(struct gfx_oit_sort *sort) {
+    free(sort->tmp);
+    free(sort->keys);
+    sort->tmp = sort->keys = NULL;
+    sort->n_keys = sort->cap = 0;
+}
+
+void gfx_oit_sort_grow(struct gfx_oit_sort *sort) {
+    unsigned new_cap = sort->cap * 2;
+    uint64_t *keys = (uint64_t*)realloc(sort->keys, new_cap * sizeof(uint64_t));
+    if (!keys)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    sort->keys = keys;
+
+    // tmp never holds anything between calls to gfx_oit_sort_exec
+    free(sort->tmp);
+    sort->tmp = (uint64_t*)malloc(new_cap * sizeof(uint64_t));
+    if (!sort->tmp)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    sort->cap = new_cap;
+}
+
+void gfx_oit_sort_exec(struct gfx_oit_sort *sort) {
+    unsigned hist[RADIX_PASSES][RADIX_SIZE];
+    unsigned n_keys = sort->n_keys;
+    uint64_t *src = sort->keys, *dst = sort->tmp;
+    unsigned idx, pass;
+
+    if (n_keys < 2)
+        return;
+
+    // one trip through the keys builds the histograms for every pass
+    memset(hist, 0, sizeof(hist));
+    for (idx = 0; idx < n_keys; idx++) {
+        uint64_t key = src[idx];
+        for (pass = 0; pass < RADIX_PASSES; pass++)
+            hist[pass][(key >> (pass * RADIX_BITS)) & RADIX_MASK]++;
+    }
+
+    for (pass = 0; pass < RADIX_PASSES; pass++) {
+        unsigned shift = pass * RADIX_BITS;
+        unsigned *counts = hist[pass];
+
+        /*
+         * skip digits that are the same for every key.  This is the common
+         * case for the upper bytes of the submission order.
+         */
+        if (counts[(src[0] >> shift) & RADIX_MASK] == n_keys)
+            continue;
+
+        unsigned digit, total = 0;
+        for (digit = 0; digit < RADIX_SIZE; digit++) {
+            unsigned count = counts[digit];
+            counts[digit] = total;
+            total += count;
+        }
+
+        for (idx = 0; idx < n_keys; idx++) {
+            uint64_t key = src[idx];
+            dst[counts[(key >> shift) & RADIX_MASK]++] = key;
+        }
+
+        uint64_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != sort->keys) {
+        // odd number of passes, the result is in tmp
+        sort->tmp = sort->keys;
+        sort->keys = src;
+    }
+}
@@ -0,0 +1,99 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+
+#ifndef GFX_OIT_SORT_H_
+#define GFX_OIT_SORT_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include "gfx/gfx.h"
+
+/*
+ * Depth sort for order-independent transparency.
+ *
+ * Every polygon (or triangle, if the renderer splits strips) gets a 64-bit
+ * key: the upper 32 bits are its depth, flipped so that larger depths come
+ * first, and the lower 32 bits are its submission order.  The keys get a
+ * least-significant-digit radix sort, so the result depends only on the
+ * depths and the order they were added in: polygons at the same depth are
+ * drawn in the order the game sent them, every time.
+ *
+ * After gfx_oit_sort_exec, gfx_oit_sort_idx gives the submission index of
+ * each key so the caller can look up whatever it stored for that polygon.
+ */
+
+struct gfx_oit_sort {
+    uint64_t *keys, *tmp;
+    unsigned n_keys, cap;
+};
+
+void gfx_oit_sort_init(struct gfx_oit_sort *sort);
+void gfx_oit_sort_cleanup(struct gfx_oit_sort *sort);
+
+static inline void gfx_oit_sort_clear(struct gfx_oit_sort *sort) {
+    sort->n_keys = 0;
+}
+
+void gfx_oit_sort_grow(struct gfx_oit_sort *sort);
+
+/*
+ * maps depth onto an unsigned integer which sorts the opposite way, so that
+ * ascending keys are descending depths.  -0.0 and 0.0 are the same depth.
+ */
+static inline uint32_t gfx_oit_depth_bits(float depth) {
+    uint32_t bits;
+    depth += 0.0f;
+    memcpy(&bits, &depth, sizeof(bits));
+    if (bits & 0x80000000)
+        bits = ~bits;
+    else
+        bits |= 0x80000000;
+    return ~bits;
+}
+
+// returns the index of the new key, which is the same as its submission order
+static inline unsigned gfx_oit_sort_add(struct gfx_oit_sort *sort,
+                                        float depth) {
+    if (sort->n_keys >= sort->cap)
+        gfx_oit_sort_grow(sort);
+    unsigned idx = sort->n_keys++;
+    sort->keys[idx] = ((uint64_t)gfx_oit_depth_bits(depth) << 32) | idx;
+    return idx;
+}
+
+void gfx_oit_sort_exec(struct gfx_oit_sort *sort);
+
+static inline unsigned gfx_oit_sort_idx(uint64_t key) {
+    return (uint32_t)key;
+}
+
+static inline float gfx_oit_avg_depth(float const *verts, unsigned n_verts) {
+    float avg_depth = 0.0f;
+    unsigned vert_no;
+    for (vert_no = 0; vert_no < n_verts; vert_no++)
+        avg_depth += verts[vert_no * GFX_VERT_LEN + 2];
+    return avg_depth / n_verts;
+}
+
+#endif
@@ -31,6 +31,7 @@
 #include "gfx/gfx_config.h"
 #include "gfx/gfx_tex_cache.h"
 #include "gfx/gfx.h"
+#include "gfx/gfx_oit_sort.h"
 #include "log.h"
 #include "pix_conv.h"
 #include "washdc/config_file.h"
@@ -60,7 +61,87 @@ static struct shader pvr_ta_tex_shader;
  */
 static struct shader pvr_ta_no_color_shader;
 
-static GLuint vbo, vao;
+static GLuint vao;
+
+/*
+ * Every draw's vertices get appended to one big ring buffer, and the draw
+ * refers to them by their offset into it, so the VAO never has to change.
+ *
+ * When ARB_buffer_storage is available, the ring is mapped persistently and
+ * vertices get copied straight into it.  The ring is split into sectors, and
+ * a fence goes down every time the write position leaves a sector; before a
+ * sector gets reused, we wait for its fence so we don't overwrite vertices the
+ * GPU hasn't read yet.  A draw never spans two sectors.
+ *
+ * Otherwise vertices get uploaded with glBufferSubData, and the buffer is
+ * orphaned every time the ring wraps around so the driver can hand us fresh
+ * memory instead of stalling.
+ */
+#define VERT_RING_SECTORS 4
+#define VERT_RING_SECTOR_VERTS (128 * 1024)
+#define VERT_RING_VERTS (VERT_RING_SECTORS * VERT_RING_SECTOR_VERTS)
+#define VERT_SIZE (GFX_VERT_LEN * sizeof(float))
+
+// the longest draw that fits in a sector without splitting a triangle
+#define VERT_RING_MAX_DRAW (VERT_RING_SECTOR_VERTS - VERT_RING_SECTOR_VERTS % 3)
+
+static struct vert_ring {
+    GLuint vbo;
+
+    // the persistent mapping, or NULL if we're using glBufferSubData
+    float *map;
+
+    // next free vertex
+    unsigned head;
+
+    GLsync fences[VERT_RING_SECTORS];
+} vert_ring;
+
+/*
+ * state that gets set on a shader program, so that uniforms are only uploaded
+ * when they actually change.  trans_mat_serial is compared against the global
+ * trans_mat_serial.
+ */
+struct prog_state {
+    struct shader *shader;
+    unsigned trans_mat_serial;
+    int tex_inst;
+};
+
+enum prog_idx {
+    PROG_COLOR,
+    PROG_TEX,
+    PROG_NO_COLOR,
+
+    PROG_COUNT
+};
+
+static struct prog_state progs[PROG_COUNT] = {
+    [PROG_COLOR] = { .shader = &pvr_ta_shader },
+    [PROG_TEX] = { .shader = &pvr_ta_tex_shader },
+    [PROG_NO_COLOR] = { .shader = &pvr_ta_no_color_shader }
+};
+
+// the program the next draw uses, or NULL if nothing has set one yet
+static struct prog_state *cur_prog;
+
+/*
+ * whether cur_prog and vao are actually bound right now.  Anything else that
+ * draws (the video output and the UI overlay) can change these bindings
+ * behind our back, so they get forgotten between renders and whenever the
+ * video output is presented.
+ */
+static bool prog_bound, vao_bound;
+
+static GLfloat trans_mat[16];
+static unsigned trans_mat_serial;
+
+static struct {
+    unsigned draw_calls;
+    unsigned long long upload_bytes;
+} frame_stat;
+
+static struct rend_stat rend_stat;
 
 struct obj_tex_meta {
     unsigned width, height;
@@ -134,23 +215,47 @@ static const GLenum depth_funcs[PVR2_DEPTH_FUNC_COUNT] = {
     [PVR2_DEPTH_ALWAYS]              = GL_ALWAYS
 };
 
-#define OIT_MAX_GROUPS (4*1024)
-
+/*
+ * Translucent polygons which arrive between BEGIN_DEPTH_SORT and
+ * END_DEPTH_SORT get recorded here instead of being drawn.  Each DRAW_ARRAY
+ * becomes a group which remembers the rend_param that was current at the
+ * time.  Groups are sorted as a whole in per-group mode; in per-triangle mode
+ * each of their triangles is sorted on its own.
+ *
+ * The vertices get copied into rec_verts.  In threaded mode a DRAW_ARRAY's
+ * vertices live in gfx.c's payload arena, which is released as soon as the
+ * command has executed, so they're gone long before END_DEPTH_SORT.
+ */
 struct oit_group {
-    float const *verts;
-    unsigned n_verts;
-
-    float avg_depth;
-
     struct gfx_rend_param rend_param;
 };
 
+struct oit_poly {
+    unsigned first_vert; // index into rec_verts
+    unsigned n_verts;
+    unsigned group_idx;
+};
+
 static struct oit_state {
     unsigned tri_count;
-    unsigned group_count;
     bool enabled;
+    bool per_tri;
+
+    struct oit_group *groups;
+    unsigned group_count, group_cap;
+
+    // indexed by the submission order in sort
+    struct oit_poly *polys;
+    unsigned poly_cap;
+
+    struct gfx_oit_sort sort;
 
-    struct oit_group groups[OIT_MAX_GROUPS];
+    float *rec_verts;
+    unsigned rec_vert_count, rec_vert_cap;
+
+    // used to merge sorted polygons which aren't adjacent in memory
+    float *verts;
+    unsigned vert_cap;
 
     struct gfx_rend_param cur_rend_param;
 } oit_state;
@@ -163,6 +268,13 @@ static void render_conv_argb_1555(uint16_t *pixels, size_t n_pizels);
 
 static void opengl_render_init(void);
 static void opengl_render_cleanup(void);
+static void vert_ring_init(void);
+static void vert_ring_cleanup(void);
+
+static void oit_init(void);
+static void oit_cleanup(void);
+static void oit_add_group(float const *verts, unsigned n_verts);
+static void oit_draw_sorted(void);
 static void opengl_renderer_update_tex(unsigned tex_obj);
 static void opengl_renderer_release_tex(unsigned tex_obj);
 static void opengl_renderer_set_blend_enable(bool enable);
@@ -174,6 +286,11 @@ static void opengl_renderer_set_clip_range(float new_clip_min,
                                            float new_clip_max);
 static void opengl_renderer_begin_sort_mode(void);
 static void opengl_renderer_end_sort_mode(void);
+static void opengl_renderer_target_begin(unsigned width, unsigned height,
+                                         int tgt_handle);
+static void opengl_renderer_target_end(int tgt_handle);
+static void opengl_renderer_video_present(void);
+static void opengl_renderer_get_stat(struct rend_stat *stat);
 
 struct rend_if const opengl_rend_if = {
     .init = opengl_render_init,
@@ -190,12 +307,13 @@ struct rend_if const opengl_rend_if = {
     .end_sort_mode = opengl_renderer_end_sort_mode,
     .target_bind_obj = opengl_target_bind_obj,
     .target_unbind_obj = opengl_target_unbind_obj,
-    .target_begin = opengl_target_begin,
-    .target_end = opengl_target_end,
+    .target_begin = opengl_renderer_target_begin,
+    .target_end = opengl_renderer_target_end,
     .video_get_fb = opengl_video_get_fb,
-    .video_present = opengl_video_present,
+    .video_present = opengl_renderer_video_present,
     .video_new_framebuffer = opengl_video_new_framebuffer,
-    .video_toggle_filter = opengl_video_toggle_filter
+    .video_toggle_filter = opengl_video_toggle_filter,
+    .get_stat = opengl_renderer_get_stat
 };
 
 static char const * const pvr2_ta_vert_glsl =
@@ -327,11 +445,15 @@ static void opengl_render_init(void) {
     opengl_video_output_init();
     opengl_target_init();
 
+    oit_state.per_tri = false;
     char const *oit_mode_str = cfg_get_node("gfx.rend.oit-mode");
     if (oit_mode_str) {
-        if (strcmp(oit_mode_str, "per-group") == 0)
+        if (strcmp(oit_mode_str, "per-group") == 0) {
+            gfx_config_oit_enable();
+        } else if (strcmp(oit_mode_str, "per-triangle") == 0) {
             gfx_config_oit_enable();
-        else if (strcmp(oit_mode_str, "disabled") == 0)
+            oit_state.per_tri = true;
+        } else if (strcmp(oit_mode_str, "disabled") == 0)
             gfx_config_oit_disable();
         else
             gfx_config_oit_disable();
@@ -360,8 +482,27 @@ static void opengl_render_init(void) {
     tex_inst_slot = glGetUniformLocation(pvr_ta_tex_shader.shader_prog_obj,
                                          "tex_inst");
 
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
+    // textures always go in unit 0
+    glUseProgram(pvr_ta_tex_shader.shader_prog_obj);
+    glUniform1i(bound_tex_slot, 0);
+    glUseProgram(0);
+
+    unsigned prog_no;
+    for (prog_no = 0; prog_no < PROG_COUNT; prog_no++) {
+        progs[prog_no].trans_mat_serial = 0;
+        progs[prog_no].tex_inst = -1;
+    }
+    trans_mat_serial = 1;
+    cur_prog = NULL;
+    prog_bound = false;
+    vao_bound = false;
+
+    memset(&frame_stat, 0, sizeof(frame_stat));
+    memset(&rend_stat, 0, sizeof(rend_stat));
+
+    vert_ring_init();
+    oit_init();
+
     glGenTextures(GFX_OBJ_COUNT, obj_tex_array);
 
     memset(obj_tex_meta_array, 0, sizeof(obj_tex_meta_array));
@@ -386,18 +527,153 @@ static void opengl_render_init(void) {
 }
 
 static void opengl_render_cleanup(void) {
+    LOG_INFO("OPENGL GFX: %llu draw calls, %llu bytes of vertices uploaded, "
+             "%llu waits for the GPU\n", rend_stat.draw_calls_total,
+             rend_stat.upload_bytes_total, rend_stat.ring_waits);
+
     glDeleteTextures(GFX_OBJ_COUNT, obj_tex_array);
-    glDeleteBuffers(1, &vbo);
-    glDeleteVertexArrays(1, &vao);
+    oit_cleanup();
+    vert_ring_cleanup();
     shader_cleanup(&pvr_ta_no_color_shader);
     shader_cleanup(&pvr_ta_tex_shader);
     shader_cleanup(&pvr_ta_shader);
 
-    vao = 0;
-    vbo = 0;
+    cur_prog = NULL;
     memset(obj_tex_array, 0, sizeof(obj_tex_array));
 }
 
+static void vert_ring_init(void) {
+    GLsizeiptr n_bytes = VERT_RING_VERTS * VERT_SIZE;
+
+    memset(&vert_ring, 0, sizeof(vert_ring));
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vert_ring.vbo);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vert_ring.vbo);
+
+    if (GLEW_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+            GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, n_bytes, NULL, flags);
+        vert_ring.map = (float*)glMapBufferRange(GL_ARRAY_BUFFER, 0,
+                                                 n_bytes, flags);
+        if (!vert_ring.map) {
+            LOG_WARN("%s - unable to map the vertex buffer; falling back to "
+                     "glBufferSubData\n", __func__);
+
+            // buffer storage can't be respecified, so start over
+            glDeleteBuffers(1, &vert_ring.vbo);
+            glGenBuffers(1, &vert_ring.vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, vert_ring.vbo);
+        }
+    }
+
+    if (vert_ring.map) {
+        LOG_INFO("OPENGL GFX: using a persistently-mapped vertex buffer\n");
+    } else {
+        LOG_INFO("OPENGL GFX: using glBufferSubData for vertex uploads\n");
+        glBufferData(GL_ARRAY_BUFFER, n_bytes, NULL, GL_STREAM_DRAW);
+    }
+
+    glEnableVertexAttribArray(POSITION_SLOT);
+    glEnableVertexAttribArray(BASE_COLOR_SLOT);
+    glEnableVertexAttribArray(OFFS_COLOR_SLOT);
+    glEnableVertexAttribArray(TEX_COORD_SLOT);
+    glVertexAttribPointer(POSITION_SLOT, 3, GL_FLOAT, GL_FALSE, VERT_SIZE,
+                          (GLvoid*)(GFX_VERT_POS_OFFSET * sizeof(float)));
+    glVertexAttribPointer(BASE_COLOR_SLOT, 4, GL_FLOAT, GL_FALSE, VERT_SIZE,
+                          (GLvoid*)(GFX_VERT_BASE_COLOR_OFFSET * sizeof(float)));
+    glVertexAttribPointer(OFFS_COLOR_SLOT, 4, GL_FLOAT, GL_FALSE, VERT_SIZE,
+                          (GLvoid*)(GFX_VERT_OFFS_COLOR_OFFSET * sizeof(float)));
+    glVertexAttribPointer(TEX_COORD_SLOT, 2, GL_FLOAT, GL_FALSE, VERT_SIZE,
+                          (GLvoid*)(GFX_VERT_TEX_COORD_OFFSET * sizeof(float)));
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void vert_ring_cleanup(void) {
+    unsigned sector;
+
+    for (sector = 0; sector < VERT_RING_SECTORS; sector++)
+        if (vert_ring.fences[sector])
+            glDeleteSync(vert_ring.fences[sector]);
+
+    if (vert_ring.map) {
+        glBindBuffer(GL_ARRAY_BUFFER, vert_ring.vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    glDeleteBuffers(1, &vert_ring.vbo);
+    glDeleteVertexArrays(1, &vao);
+
+    memset(&vert_ring, 0, sizeof(vert_ring));
+    vao = 0;
+}
+
+/*
+ * returns the index of the first of n_verts vertices that can be written to
+ * the ring.  n_verts must not be more than VERT_RING_MAX_DRAW.  The ring's
+ * buffer has to be bound to GL_ARRAY_BUFFER.
+ */
+static unsigned vert_ring_alloc(unsigned n_verts) {
+    unsigned sector = vert_ring.head / VERT_RING_SECTOR_VERTS;
+    unsigned sector_end = (sector + 1) * VERT_RING_SECTOR_VERTS;
+
+    if (vert_ring.head + n_verts > sector_end) {
+        unsigned next = (sector + 1) % VERT_RING_SECTORS;
+
+        if (vert_ring.map) {
+            vert_ring.fences[sector] =
+                glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+            GLsync fence = vert_ring.fences[next];
+            if (fence) {
+                GLenum res = glClientWaitSync(fence, 0, 0);
+                if (res == GL_TIMEOUT_EXPIRED) {
+                    rend_stat.ring_waits++;
+                    do {
+                        res = glClientWaitSync(fence,
+                                               GL_SYNC_FLUSH_COMMANDS_BIT,
+                                               1000000000);
+                    } while (res == GL_TIMEOUT_EXPIRED);
+                }
+                if (res == GL_WAIT_FAILED)
+                    LOG_ERROR("%s - glClientWaitSync failed\n", __func__);
+                glDeleteSync(fence);
+                vert_ring.fences[next] = 0;
+            }
+        } else if (next == 0) {
+            // orphan the old storage; the GPU can keep it until it's done
+            glBufferData(GL_ARRAY_BUFFER, VERT_RING_VERTS * VERT_SIZE,
+                         NULL, GL_STREAM_DRAW);
+        }
+
+        vert_ring.head = next * VERT_RING_SECTOR_VERTS;
+    }
+
+    unsigned first = vert_ring.head;
+    vert_ring.head += n_verts;
+    return first;
+}
+
+// forget which program and VAO are bound
+static void invalidate_bindings(void) {
+    prog_bound = false;
+    vao_bound = false;
+}
+
+static void use_prog(struct prog_state *prog) {
+    if (prog != cur_prog || !prog_bound) {
+        glUseProgram(prog->shader->shader_prog_obj);
+        cur_prog = prog;
+        prog_bound = true;
+    }
+}
+
 static DEF_ERROR_INT_ATTR(max_length);
 
 static void opengl_renderer_update_tex(unsigned tex_obj) {
@@ -538,9 +814,30 @@ static void opengl_renderer_set_blend_enable(bool enable) {
 }
 
 static float clip_min, clip_max;
-static bool tex_enable;
 static unsigned screen_width, screen_height;
 
+// recalculate trans_mat after the screen dimensions or clip range change
+static void update_trans_mat(void) {
+    float clip_min_actual = clip_min * 1.01f;
+    float clip_max_actual = clip_max * 1.01f;
+
+    GLfloat half_screen_dims[2] = {
+        (GLfloat)(screen_width * 0.5),
+        (GLfloat)(screen_height * 0.5)
+    };
+
+    GLfloat clip_delta = clip_max_actual - clip_min_actual;
+    GLfloat mat[16] = {
+        1.0 / half_screen_dims[0], 0, 0, -1,
+        0, -1.0 / half_screen_dims[1], 0, 1,
+        0, 0, 2.0 / clip_delta, -2.0 * clip_min_actual / clip_delta - 1,
+        0, 0, 0, 1
+    };
+
+    memcpy(trans_mat, mat, sizeof(trans_mat));
+    trans_mat_serial++;
+}
+
 static void opengl_renderer_set_rend_param(struct gfx_rend_param const *param) {
     if (oit_state.enabled) {
         /*
@@ -559,7 +856,7 @@ static void opengl_renderer_set_rend_param(struct gfx_rend_param const *param) {
      * would be two independent settings.
      */
     if (param->tex_enable && rend_cfg.tex_enable && rend_cfg.color_enable) {
-        glUseProgram(pvr_ta_tex_shader.shader_prog_obj);
+        use_prog(progs + PROG_TEX);
 
         if (gfx_tex_cache_get(param->tex_idx)->valid) {
             int obj_handle = gfx_tex_cache_get(param->tex_idx)->obj_handle;
@@ -615,13 +912,15 @@ static void opengl_renderer_set_rend_param(struct gfx_rend_param const *param) {
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, tex_wrap_mode_gl[0]);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, tex_wrap_mode_gl[1]);
 
-        glUniform1i(bound_tex_slot, 0);
-        glUniform1i(tex_inst_slot, param->tex_inst);
+        if (progs[PROG_TEX].tex_inst != (int)param->tex_inst) {
+            glUniform1i(tex_inst_slot, param->tex_inst);
+            progs[PROG_TEX].tex_inst = param->tex_inst;
+        }
         glActiveTexture(GL_TEXTURE0);
     } else if (rend_cfg.color_enable) {
-        glUseProgram(pvr_ta_shader.shader_prog_obj);
+        use_prog(progs + PROG_COLOR);
     } else {
-        glUseProgram(pvr_ta_no_color_shader.shader_prog_obj);
+        use_prog(progs + PROG_NO_COLOR);
     }
 
     glBlendFunc(src_blend_factors[(unsigned)param->src_blend_factor],
@@ -629,8 +928,6 @@ static void opengl_renderer_set_rend_param(struct gfx_rend_param const *param) {
 
     glDepthMask(param->enable_depth_writes ? GL_TRUE : GL_FALSE);
     glDepthFunc(depth_funcs[param->depth_func]);
-
-    tex_enable = param->tex_enable;
 }
 
 static void opengl_renderer_draw_array(float const *verts, unsigned n_verts) {
@@ -640,72 +937,47 @@ static void opengl_renderer_draw_array(float const *verts, unsigned n_verts) {
     if (oit_state.enabled) {
         oit_state.tri_count += n_verts / 3;
 
-        if (oit_state.group_count < OIT_MAX_GROUPS) {
-            struct oit_group *grp = oit_state.groups + oit_state.group_count++;
-            grp->rend_param = oit_state.cur_rend_param;
-            grp->verts = verts;
-            grp->n_verts = n_verts;
-
-            float avg_depth = 0.0f;
-            unsigned vert_no;
-            for (vert_no = 0; vert_no < n_verts; vert_no++)
-                avg_depth += verts[vert_no * GFX_VERT_LEN + 2];
-            avg_depth /= n_verts;
+        oit_add_group(verts, n_verts);
+        return;
+    }
 
-            grp->avg_depth = avg_depth;
-        } else {
-            LOG_ERROR("OPENGL GFX: OIT BUFFER OVERFLOW!!!\n");
+    if (cur_prog) {
+        if (!prog_bound) {
+            glUseProgram(cur_prog->shader->shader_prog_obj);
+            prog_bound = true;
+        }
+        if (cur_prog->trans_mat_serial != trans_mat_serial) {
+            glUniformMatrix4fv(TRANS_MAT_SLOT, 1, GL_TRUE, trans_mat);
+            cur_prog->trans_mat_serial = trans_mat_serial;
         }
-        return;
     }
 
-    float clip_min_actual = clip_min * 1.01f;
-    float clip_max_actual = clip_max * 1.01f;
+    if (!vao_bound) {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vert_ring.vbo);
+        vao_bound = true;
+    }
 
-    GLfloat half_screen_dims[2] = {
-        (GLfloat)(screen_width * 0.5),
-        (GLfloat)(screen_height * 0.5)
-    };
+    while (n_verts) {
+        unsigned count = n_verts < VERT_RING_MAX_DRAW ?
+            n_verts : VERT_RING_MAX_DRAW;
+        size_t n_bytes = count * VERT_SIZE;
+        unsigned first = vert_ring_alloc(count);
 
-    GLfloat clip_delta = clip_max_actual - clip_min_actual;
-    GLfloat trans_mat[16] = {
-        1.0 / half_screen_dims[0], 0, 0, -1,
-        0, -1.0 / half_screen_dims[1], 0, 1,
-        0, 0, 2.0 / clip_delta, -2.0 * clip_min_actual / clip_delta - 1,
-        0, 0, 0, 1
-    };
+        if (vert_ring.map) {
+            memcpy(vert_ring.map + first * GFX_VERT_LEN, verts, n_bytes);
+        } else {
+            glBufferSubData(GL_ARRAY_BUFFER, first * VERT_SIZE,
+                            n_bytes, verts);
+        }
+        glDrawArrays(GL_TRIANGLES, first, count);
 
-    glUniformMatrix4fv(TRANS_MAT_SLOT, 1, GL_TRUE, trans_mat);
+        frame_stat.draw_calls++;
+        frame_stat.upload_bytes += n_bytes;
 
-    // now draw the geometry itself
-    glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER,
-                 sizeof(float) * n_verts * GFX_VERT_LEN,
-                 verts, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(POSITION_SLOT);
-    glEnableVertexAttribArray(BASE_COLOR_SLOT);
-    glEnableVertexAttribArray(OFFS_COLOR_SLOT);
-    glVertexAttribPointer(POSITION_SLOT, 3, GL_FLOAT, GL_FALSE,
-                          GFX_VERT_LEN * sizeof(float),
-                          (GLvoid*)(GFX_VERT_POS_OFFSET * sizeof(float)));
-    glVertexAttribPointer(BASE_COLOR_SLOT, 4, GL_FLOAT, GL_FALSE,
-                          GFX_VERT_LEN * sizeof(float),
-                          (GLvoid*)(GFX_VERT_BASE_COLOR_OFFSET * sizeof(float)));
-    glVertexAttribPointer(OFFS_COLOR_SLOT, 4, GL_FLOAT, GL_FALSE,
-                          GFX_VERT_LEN * sizeof(float),
-                          (GLvoid*)(GFX_VERT_OFFS_COLOR_OFFSET * sizeof(float)));
-    if (tex_enable) {
-        glEnableVertexAttribArray(TEX_COORD_SLOT);
-        glVertexAttribPointer(TEX_COORD_SLOT, 2, GL_FLOAT, GL_FALSE,
-                              GFX_VERT_LEN * sizeof(float),
-                              (GLvoid*)(GFX_VERT_TEX_COORD_OFFSET * sizeof(float)));
+        verts += count * GFX_VERT_LEN;
+        n_verts -= count;
     }
-    glDrawArrays(GL_TRIANGLES, 0, n_verts);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
 }
 
 static void opengl_renderer_clear(float const bgcolor[4]) {
@@ -755,12 +1027,45 @@ static void opengl_renderer_clear(float const bgcolor[4]) {
 static void opengl_renderer_set_screen_dim(unsigned width, unsigned height) {
     screen_width = width;
     screen_height = height;
+    update_trans_mat();
 }
 
 static void opengl_renderer_set_clip_range(float new_clip_min,
                                            float new_clip_max) {
     clip_min = new_clip_min;
     clip_max = new_clip_max;
+    update_trans_mat();
+}
+
+static void opengl_renderer_target_begin(unsigned width, unsigned height,
+                                         int tgt_handle) {
+    invalidate_bindings();
+    memset(&frame_stat, 0, sizeof(frame_stat));
+    opengl_target_begin(width, height, tgt_handle);
+}
+
+static void opengl_renderer_target_end(int tgt_handle) {
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    invalidate_bindings();
+
+    rend_stat.draw_calls = frame_stat.draw_calls;
+    rend_stat.upload_bytes = frame_stat.upload_bytes;
+    rend_stat.draw_calls_total += frame_stat.draw_calls;
+    rend_stat.upload_bytes_total += frame_stat.upload_bytes;
+
+    opengl_target_end(tgt_handle);
+}
+
+static void opengl_renderer_video_present(void) {
+    invalidate_bindings();
+    opengl_video_present();
+}
+
+static void opengl_renderer_get_stat(struct rend_stat *stat) {
+    *stat = rend_stat;
+    stat->persistent_map = vert_ring.map != NULL;
 }
 
 GLuint opengl_renderer_tex(unsigned obj_no) {
@@ -805,6 +1110,187 @@ bool opengl_renderer_tex_get_dirty(unsigned obj_no) {
     return obj_tex_meta_array[obj_no].dirty;
 }
 
+#define OIT_INITIAL_GROUPS 1024
+#define OIT_INITIAL_VERTS (16 * 1024)
+
+static void oit_init(void) {
+    oit_state.enabled = false;
+    oit_state.group_count = 0;
+    oit_state.group_cap = OIT_INITIAL_GROUPS;
+    oit_state.groups = (struct oit_group*)
+        malloc(oit_state.group_cap * sizeof(struct oit_group));
+    oit_state.poly_cap = OIT_INITIAL_GROUPS;
+    oit_state.polys = (struct oit_poly*)
+        malloc(oit_state.poly_cap * sizeof(struct oit_poly));
+    oit_state.vert_cap = OIT_INITIAL_VERTS;
+    oit_state.verts = (float*)malloc(oit_state.vert_cap *
+                                     GFX_VERT_LEN * sizeof(float));
+    oit_state.rec_vert_count = 0;
+    oit_state.rec_vert_cap = OIT_INITIAL_VERTS;
+    oit_state.rec_verts = (float*)malloc(oit_state.rec_vert_cap *
+                                         GFX_VERT_LEN * sizeof(float));
+    if (!oit_state.groups || !oit_state.polys || !oit_state.verts ||
+        !oit_state.rec_verts)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    gfx_oit_sort_init(&oit_state.sort);
+}
+
+static void oit_cleanup(void) {
+    gfx_oit_sort_cleanup(&oit_state.sort);
+    free(oit_state.rec_verts);
+    free(oit_state.verts);
+    free(oit_state.polys);
+    free(oit_state.groups);
+    oit_state.rec_verts = NULL;
+    oit_state.verts = NULL;
+    oit_state.polys = NULL;
+    oit_state.groups = NULL;
+    oit_state.rec_vert_cap = oit_state.rec_vert_count = 0;
+    oit_state.vert_cap = oit_state.poly_cap = oit_state.group_cap = 0;
+}
+
+static void oit_add_poly(unsigned first_vert, unsigned n_verts,
+                         unsigned group_idx) {
+    float const *verts = oit_state.rec_verts + first_vert * GFX_VERT_LEN;
+    unsigned idx = gfx_oit_sort_add(&oit_state.sort,
+                                    gfx_oit_avg_depth(verts, n_verts));
+    if (idx >= oit_state.poly_cap) {
+        unsigned new_cap = oit_state.poly_cap * 2;
+        struct oit_poly *new_polys = (struct oit_poly*)
+            realloc(oit_state.polys, new_cap * sizeof(struct oit_poly));
+        if (!new_polys)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        oit_state.polys = new_polys;
+        oit_state.poly_cap = new_cap;
+    }
+
+    struct oit_poly *poly = oit_state.polys + idx;
+    poly->first_vert = first_vert;
+    poly->n_verts = n_verts;
+    poly->group_idx = group_idx;
+}
+
+static void oit_add_group(float const *verts, unsigned n_verts) {
+    if (oit_state.group_count >= oit_state.group_cap) {
+        unsigned new_cap = oit_state.group_cap * 2;
+        struct oit_group *new_groups = (struct oit_group*)
+            realloc(oit_state.groups, new_cap * sizeof(struct oit_group));
+        if (!new_groups)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        oit_state.groups = new_groups;
+        oit_state.group_cap = new_cap;
+    }
+
+    if (n_verts > oit_state.rec_vert_cap - oit_state.rec_vert_count) {
+        unsigned new_cap = oit_state.rec_vert_cap;
+        while (new_cap - oit_state.rec_vert_count < n_verts)
+            new_cap *= 2;
+        float *new_verts = (float*)realloc(oit_state.rec_verts, new_cap *
+                                           GFX_VERT_LEN * sizeof(float));
+        if (!new_verts)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        oit_state.rec_verts = new_verts;
+        oit_state.rec_vert_cap = new_cap;
+    }
+
+    unsigned first_vert = oit_state.rec_vert_count;
+    memcpy(oit_state.rec_verts + first_vert * GFX_VERT_LEN, verts,
+           n_verts * GFX_VERT_LEN * sizeof(float));
+    oit_state.rec_vert_count += n_verts;
+
+    unsigned group_idx = oit_state.group_count++;
+    oit_state.groups[group_idx].rend_param = oit_state.cur_rend_param;
+
+    if (oit_state.per_tri) {
+        unsigned n_tris = n_verts / 3, tri_no;
+        for (tri_no = 0; tri_no < n_tris; tri_no++)
+            oit_add_poly(first_vert + tri_no * 3, 3, group_idx);
+    } else {
+        oit_add_poly(first_vert, n_verts, group_idx);
+    }
+}
+
+static bool rend_param_eq(struct gfx_rend_param const *lhs,
+                          struct gfx_rend_param const *rhs) {
+    if (lhs->tex_enable != rhs->tex_enable)
+        return false;
+    if (lhs->tex_enable &&
+        (lhs->tex_idx != rhs->tex_idx || lhs->tex_inst != rhs->tex_inst ||
+         lhs->tex_filter != rhs->tex_filter ||
+         lhs->tex_wrap_mode[0] != rhs->tex_wrap_mode[0] ||
+         lhs->tex_wrap_mode[1] != rhs->tex_wrap_mode[1]))
+        return false;
+    return lhs->src_blend_factor == rhs->src_blend_factor &&
+        lhs->dst_blend_factor == rhs->dst_blend_factor &&
+        lhs->enable_depth_writes == rhs->enable_depth_writes &&
+        lhs->depth_func == rhs->depth_func;
+}
+
+/*
+ * draw the polygons in sorted order.  Neighbors that share a rend_param go out
+ * in the same draw; that's what keeps per-triangle mode from turning every
+ * translucent triangle into its own draw call.
+ */
+static void oit_draw_sorted(void) {
+    uint64_t const *keys = oit_state.sort.keys;
+    unsigned n_keys = oit_state.sort.n_keys;
+    unsigned first, last;
+
+    for (first = 0; first < n_keys; first = last) {
+        struct oit_poly const *poly =
+            oit_state.polys + gfx_oit_sort_idx(keys[first]);
+        struct gfx_rend_param const *param =
+            &oit_state.groups[poly->group_idx].rend_param;
+        unsigned n_verts = poly->n_verts;
+        bool adjacent = true;
+
+        for (last = first + 1; last < n_keys; last++) {
+            struct oit_poly const *prev =
+                oit_state.polys + gfx_oit_sort_idx(keys[last - 1]);
+            struct oit_poly const *next =
+                oit_state.polys + gfx_oit_sort_idx(keys[last]);
+            if (next->group_idx != prev->group_idx &&
+                !rend_param_eq(param,
+                               &oit_state.groups[next->group_idx].rend_param))
+                break;
+            if (next->first_vert != prev->first_vert + prev->n_verts)
+                adjacent = false;
+            n_verts += next->n_verts;
+        }
+
+        float const *verts =
+            oit_state.rec_verts + poly->first_vert * GFX_VERT_LEN;
+        if (!adjacent) {
+            if (n_verts > oit_state.vert_cap) {
+                unsigned new_cap = oit_state.vert_cap;
+                while (new_cap < n_verts)
+                    new_cap *= 2;
+                float *new_verts = (float*)realloc(oit_state.verts, new_cap *
+                                                   GFX_VERT_LEN * sizeof(float));
+                if (!new_verts)
+                    RAISE_ERROR(ERROR_FAILED_ALLOC);
+                oit_state.verts = new_verts;
+                oit_state.vert_cap = new_cap;
+            }
+
+            float *outp = oit_state.verts;
+            unsigned idx;
+            for (idx = first; idx < last; idx++) {
+                struct oit_poly const *src =
+                    oit_state.polys + gfx_oit_sort_idx(keys[idx]);
+                memcpy(outp, oit_state.rec_verts +
+                       src->first_vert * GFX_VERT_LEN,
+                       src->n_verts * GFX_VERT_LEN * sizeof(float));
+                outp += src->n_verts * GFX_VERT_LEN;
+            }
+            verts = oit_state.verts;
+        }
+
+        opengl_renderer_set_rend_param(param);
+        opengl_renderer_draw_array(verts, n_verts);
+    }
+}
+
 static void opengl_renderer_begin_sort_mode(void) {
     if (oit_state.enabled)
         RAISE_ERROR(ERROR_INTEGRITY);
@@ -814,6 +1300,8 @@ static void opengl_renderer_begin_sort_mode(void) {
         oit_state.enabled = true;
         oit_state.tri_count = 0;
         oit_state.group_count = 0;
+        oit_state.rec_vert_count = 0;
+        gfx_oit_sort_clear(&oit_state.sort);
     }
 }
 
@@ -826,29 +1314,8 @@ static void opengl_renderer_end_sort_mode(void) {
     LOG_INFO("SORT MODE DISABLE (%u triangles)\n", oit_state.tri_count);
     oit_state.enabled = false;
 
-    // do an insertion sort because i'm a pleb
-    unsigned src_idx, dst_idx;
-    unsigned grp_cnt = oit_state.group_count;
-    if (grp_cnt) {
-        struct oit_group tmp;
-        for (src_idx = 0; src_idx < grp_cnt - 1; src_idx++) {
-            struct oit_group *grp_src = oit_state.groups + src_idx;
-            for (dst_idx = src_idx + 1; dst_idx < grp_cnt; dst_idx++) {
-                struct oit_group *grp_dst = oit_state.groups + dst_idx;
-                if (grp_dst->avg_depth >= grp_src->avg_depth) {
-                    tmp = *grp_src;
-                    *grp_src = *grp_dst;
-                    *grp_dst = tmp;
-                }
-            }
-        }
-
-        for (src_idx = 0; src_idx < grp_cnt; src_idx++) {
-            struct oit_group *grp_src = oit_state.groups + src_idx;
-            opengl_renderer_set_rend_param(&grp_src->rend_param);
-            opengl_renderer_draw_array(grp_src->verts, grp_src->n_verts);
-        }
-    }
+    gfx_oit_sort_exec(&oit_state.sort);
+    oit_draw_sorted();
 }
 
 static GLenum tex_fmt_to_data_type(enum gfx_tex_fmt gfx_fmt) {
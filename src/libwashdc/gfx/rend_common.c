@@ -186,7 +186,7 @@ static void rend_end_depth_sort(struct gfx_il_inst *cmd) {
     gfx_rend_ifp->end_sort_mode();
 }
 
-void rend_exec_il(struct gfx_il_inst *cmd, unsigned n_cmd) {
+void rend_exec_il_direct(struct gfx_il_inst *cmd, unsigned n_cmd) {
     /* bool rendering = false; */
 
     while (n_cmd--) {
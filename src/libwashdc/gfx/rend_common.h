@@ -31,6 +31,21 @@
 
 #include "gfx/gfx_il.h"
 
+struct rend_stat {
+    // whether vertex data goes through a persistently-mapped buffer
+    bool persistent_map;
+
+    // draw calls and bytes of vertex data uploaded during the last render
+    unsigned draw_calls;
+    unsigned long long upload_bytes;
+
+    // the same, since the renderer was initialized
+    unsigned long long draw_calls_total, upload_bytes_total;
+
+    // times the renderer had to wait for the GPU before reusing vertex memory
+    unsigned long long ring_waits;
+};
+
 struct rend_if {
     void (*init)(void);
 
@@ -83,6 +98,12 @@ struct rend_if {
                                   unsigned fb_new_height, bool do_flip);
 
     void (*video_toggle_filter)(void);
+
+    /*
+     * this reads state that belongs to the thread which owns the OpenGL
+     * context, so only call it from that thread.
+     */
+    void (*get_stat)(struct rend_stat *stat);
 };
 
 // initialize and clean up the graphics renderer
@@ -97,4 +118,10 @@ void rend_release_tex(unsigned tex_no);
 
 struct rend_if const * const gfx_rend_ifp;
 
+/*
+ * execute gfx_il commands immediately.  Only call this from the thread that
+ * owns the OpenGL context; everything else should go through rend_exec_il.
+ */
+void rend_exec_il_direct(struct gfx_il_inst *cmd, unsigned n_cmd);
+
 #endif
@@ -31,8 +31,6 @@
 
 #define CFG_FILE_NAME "wash.cfg"
 
-#define HOSTFILE_PATH_LEN 4096
-
 void hostfile_path_append(char *dst, char const *src, size_t dst_sz) {
     if (!src[0])
         return; // nothing to append
@@ -141,6 +139,17 @@ char const *hostfile_screenshot_dir(void) {
     return path;
 }
 
+char const *hostfile_jit_cache_dir(void) {
+    static char path[HOSTFILE_PATH_LEN];
+    char const *data_dir = hostfile_data_dir();
+    if (!data_dir)
+        return NULL;
+    strncpy(path, data_dir, HOSTFILE_PATH_LEN);
+    path[HOSTFILE_PATH_LEN - 1] = '\0';
+    hostfile_path_append(path, "/jit_cache", HOSTFILE_PATH_LEN);
+    return path;
+}
+
 void hostfile_create_screenshot_dir(void) {
     char const *data_dir = hostfile_data_dir();
     if (mkdir(data_dir, S_IRUSR | S_IWUSR | S_IXUSR) != 0 && errno != EEXIST)
@@ -149,3 +158,12 @@ void hostfile_create_screenshot_dir(void) {
     if (mkdir(screenshot_dir, S_IRUSR | S_IWUSR | S_IXUSR) != 0 && errno != EEXIST)
         LOG_ERROR("%s - failure to create %s\n", __func__, data_dir);
 }
+
+void hostfile_create_jit_cache_dir(void) {
+    char const *data_dir = hostfile_data_dir();
+    if (mkdir(data_dir, S_IRUSR | S_IWUSR | S_IXUSR) != 0 && errno != EEXIST)
+        LOG_ERROR("%s - failure to create %s\n", __func__, data_dir);
+    char const *jit_cache_dir = hostfile_jit_cache_dir();
+    if (mkdir(jit_cache_dir, S_IRUSR | S_IWUSR | S_IXUSR) != 0 && errno != EEXIST)
+        LOG_ERROR("%s - failure to create %s\n", __func__, jit_cache_dir);
+}
@@ -23,6 +23,8 @@
 #ifndef HOSTFILE_H_
 #define HOSTFILE_H_
 
+#define HOSTFILE_PATH_LEN 4096
+
 char const *hostfile_cfg_dir(void);
 
 char const *hostfile_cfg_file(void);
@@ -31,8 +33,12 @@ char const *hostfile_data_dir(void);
 
 char const *hostfile_screenshot_dir(void);
 
+char const *hostfile_jit_cache_dir(void);
+
 void hostfile_path_append(char *dst, char const *src, size_t dst_sz);
 
 void hostfile_create_screenshot_dir(void);
 
+void hostfile_create_jit_cache_dir(void);
+
 #endif
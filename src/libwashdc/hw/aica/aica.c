@@ -281,6 +281,7 @@ void aica_init(struct aica *aica, struct arm7 *arm7,
     aica->clk = clk;
     aica->sh4_clk = sh4_clk;
     aica->arm7 = arm7;
+    atomic_init(&aica->sh4_int_deferred, false);
 
     aica->aica_sh4_raise_event.handler = post_delay_raise_aica_sh4_int;
     aica->aica_sh4_raise_event.arg_ptr = aica;
@@ -496,8 +497,11 @@ aica_sys_reg_post_write(struct aica *aica, unsigned idx, bool from_sh4) {
         memcpy(&val, aica->sys_reg + (AICA_MCIRE/4), sizeof(val));
         aica->int_pending_sh4 &= ~val;
         aica_update_interrupts(aica);
-        if (val & (1<<5))
+        if (val & (1<<5)) {
+            atomic_store_explicit(&aica->sh4_int_deferred, false,
+                                  memory_order_relaxed);
             holly_clear_ext_int(HOLLY_EXT_INT_AICA);
+        }
         break;
     case AICA_SCIPD:
         /*
@@ -1776,11 +1780,26 @@ static void aica_process_sample(struct aica *aica) {
 }
 
 static void raise_aica_sh4_int(struct aica *aica) {
-    holly_raise_ext_int(HOLLY_EXT_INT_AICA);
+    if (aica->defer_sh4_int)
+        atomic_store_explicit(&aica->sh4_int_deferred, true,
+                              memory_order_release);
+    else
+        holly_raise_ext_int(HOLLY_EXT_INT_AICA);
     aica->int_pending_sh4 |= (1<<5);
     aica->aica_sh4_int_scheduled = false;
 }
 
+void aica_set_defer_sh4_int(struct aica *aica, bool defer) {
+    aica->defer_sh4_int = defer;
+    aica_flush_sh4_int(aica);
+}
+
+void aica_flush_sh4_int(struct aica *aica) {
+    if (atomic_exchange_explicit(&aica->sh4_int_deferred, false,
+                                 memory_order_acquire))
+        holly_raise_ext_int(HOLLY_EXT_INT_AICA);
+}
+
 static void post_delay_raise_aica_sh4_int(struct SchedEvent *event) {
     struct aica *aica = (struct aica*)event->arg_ptr;
     if (!aica->aica_sh4_int_scheduled) {
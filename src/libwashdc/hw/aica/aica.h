@@ -24,6 +24,8 @@
 #define AICA_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 #include "dc_sched.h"
 #include "aica_wave_mem.h"
@@ -175,6 +177,15 @@ struct aica {
     bool aica_sh4_int_scheduled;
     struct SchedEvent aica_sh4_raise_event;
 
+    /*
+     * when the ARM7 runs on its own thread (see aica_thread.h), the holly
+     * side of the SH4 interrupt can't be touched from here.  Instead the
+     * interrupt is latched into sh4_int_deferred and the SH4 thread raises it
+     * the next time it calls aica_flush_sh4_int.
+     */
+    bool defer_sh4_int;
+    atomic_bool sh4_int_deferred;
+
     /*
      * Selects the channel that the PlayStatus register refers to
      *
@@ -221,6 +232,14 @@ void aica_cleanup(struct aica *aica);
 
 extern struct memory_interface aica_sys_intf;
 
+void aica_set_defer_sh4_int(struct aica *aica, bool defer);
+
+/*
+ * raise any SH4 interrupt that was latched while defer_sh4_int was set.  This
+ * must only be called from the SH4's thread.
+ */
+void aica_flush_sh4_int(struct aica *aica);
+
 extern bool aica_log_verbose_val;
 
 void aica_get_sndchan_stat(struct aica const *aica,
@@ -0,0 +1,268 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "washdc/error.h"
+#include "log.h"
+#include "aica.h"
+
+#include "aica_thread.h"
+
+struct aica_thread_wrap {
+    struct memory_interface const *intf;
+    void *ctxt;
+};
+
+static struct aica *aica;
+static struct dc_clock *sh4_clk, *arm7_clk;
+static struct aica_thread_wrap wrap_sys, wrap_wave_mem;
+
+static pthread_t arm7_thread;
+static bool running;
+
+/*
+ * skew_lock guards sh4_stamp, arm7_stamp and stop_req.  Each side only ever
+ * waits for the other at a timeslice boundary, and only when it is more than
+ * skew_limit cycles ahead.  At least one side is always allowed to run, so
+ * this can't deadlock.
+ */
+static pthread_mutex_t skew_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sh4_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t arm7_cond = PTHREAD_COND_INITIALIZER;
+static dc_cycle_stamp_t sh4_stamp, arm7_stamp, skew_limit;
+static bool stop_req;
+
+/*
+ * The ARM7 thread holds domain_lock for as long as it's running a timeslice.
+ * An SH4 access raises aica_thread_sync_req and then takes domain_lock; the
+ * ARM7 notices the request between instructions and sleeps on domain_cond
+ * until sync_gen changes, which lets the SH4 in.  Waiting on the generation
+ * instead of the request flag guarantees the ARM7 gets at least one
+ * instruction in between back-to-back SH4 accesses.
+ */
+static pthread_mutex_t domain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t domain_cond = PTHREAD_COND_INITIALIZER;
+static unsigned sync_gen;
+atomic_bool aica_thread_sync_req = ATOMIC_VAR_INIT(false);
+
+// the SH4 thread is the only writer of sh4_* counters
+static unsigned long long sh4_skew_waits, sh4_accesses, sh4_access_waits;
+static atomic_ullong arm7_skew_waits;
+
+static void *aica_thread_main(void *arg);
+
+void aica_thread_init(struct aica *aica_in, struct dc_clock *sh4_clk_in,
+                      struct dc_clock *arm7_clk_in,
+                      dc_cycle_stamp_t skew_limit_in) {
+    aica = aica_in;
+    sh4_clk = sh4_clk_in;
+    arm7_clk = arm7_clk_in;
+    skew_limit = skew_limit_in;
+
+    wrap_sys.intf = &aica_sys_intf;
+    wrap_sys.ctxt = aica;
+    wrap_wave_mem.intf = &aica_wave_mem_intf;
+    wrap_wave_mem.ctxt = &aica->mem;
+
+    sh4_stamp = clock_cycle_stamp(sh4_clk);
+    arm7_stamp = clock_cycle_stamp(arm7_clk);
+    stop_req = false;
+    sync_gen = 0;
+    sh4_skew_waits = sh4_accesses = sh4_access_waits = 0;
+    atomic_init(&arm7_skew_waits, 0);
+    atomic_store_explicit(&aica_thread_sync_req, false, memory_order_relaxed);
+
+    aica_set_defer_sh4_int(aica, true);
+}
+
+void aica_thread_cleanup(void) {
+    aica_thread_stop();
+    aica_set_defer_sh4_int(aica, false);
+    aica = NULL;
+}
+
+void aica_thread_start(void) {
+    if (running)
+        return;
+
+    LOG_INFO("AICA: running the ARM7 on a dedicated thread (skew limit is "
+             "%llu cycles)\n", (unsigned long long)skew_limit);
+    if (pthread_create(&arm7_thread, NULL, aica_thread_main, NULL) != 0)
+        RAISE_ERROR(ERROR_EXT_FAILURE);
+    running = true;
+}
+
+void aica_thread_stop(void) {
+    if (!running)
+        return;
+
+    pthread_mutex_lock(&skew_lock);
+    stop_req = true;
+    pthread_cond_signal(&arm7_cond);
+    pthread_mutex_unlock(&skew_lock);
+
+    pthread_join(arm7_thread, NULL);
+    running = false;
+}
+
+void aica_thread_sh4_sync(void) {
+    dc_cycle_stamp_t now = clock_cycle_stamp(sh4_clk);
+
+    pthread_mutex_lock(&skew_lock);
+    sh4_stamp = now;
+    pthread_cond_signal(&arm7_cond);
+    if (now > arm7_stamp + skew_limit) {
+        sh4_skew_waits++;
+        do {
+            pthread_cond_wait(&sh4_cond, &skew_lock);
+        } while (now > arm7_stamp + skew_limit);
+    }
+    pthread_mutex_unlock(&skew_lock);
+
+    aica_flush_sh4_int(aica);
+}
+
+static void *aica_thread_main(void *arg) {
+    pthread_mutex_lock(&skew_lock);
+    while (!stop_req) {
+        dc_cycle_stamp_t now = clock_cycle_stamp(arm7_clk);
+        if (now > sh4_stamp + skew_limit) {
+            atomic_fetch_add_explicit(&arm7_skew_waits, 1,
+                                      memory_order_relaxed);
+            do {
+                pthread_cond_wait(&arm7_cond, &skew_lock);
+            } while (!stop_req && now > sh4_stamp + skew_limit);
+            continue;
+        }
+        pthread_mutex_unlock(&skew_lock);
+
+        pthread_mutex_lock(&domain_lock);
+        dc_clock_run_timeslice(arm7_clk);
+        pthread_mutex_unlock(&domain_lock);
+
+        pthread_mutex_lock(&skew_lock);
+        arm7_stamp = clock_cycle_stamp(arm7_clk);
+        pthread_cond_signal(&sh4_cond);
+    }
+    pthread_mutex_unlock(&skew_lock);
+
+    return NULL;
+}
+
+static void aica_thread_lock(void) {
+    sh4_accesses++;
+    atomic_store_explicit(&aica_thread_sync_req, true, memory_order_relaxed);
+    if (pthread_mutex_trylock(&domain_lock) != 0) {
+        sh4_access_waits++;
+        pthread_mutex_lock(&domain_lock);
+    }
+}
+
+static void aica_thread_unlock(void) {
+    atomic_store_explicit(&aica_thread_sync_req, false, memory_order_relaxed);
+    sync_gen++;
+    pthread_cond_broadcast(&domain_cond);
+    pthread_mutex_unlock(&domain_lock);
+
+    // the access may have caused the AICA to want to interrupt the SH4
+    aica_flush_sh4_int(aica);
+}
+
+void aica_thread_yield(void) {
+    unsigned gen = sync_gen;
+    do {
+        pthread_cond_wait(&domain_cond, &domain_lock);
+    } while (gen == sync_gen);
+}
+
+void *aica_thread_wrap_sys(void) {
+    return &wrap_sys;
+}
+
+void *aica_thread_wrap_wave_mem(void) {
+    return &wrap_wave_mem;
+}
+
+#define AICA_THREAD_DEF_READ(name, type)                                \
+    static type locked_##name(addr32_t addr, void *ctxt) {              \
+        struct aica_thread_wrap *wrap = (struct aica_thread_wrap*)ctxt; \
+        aica_thread_lock();                                             \
+        type val = wrap->intf->name(addr, wrap->ctxt);                  \
+        aica_thread_unlock();                                           \
+        return val;                                                     \
+    }
+
+#define AICA_THREAD_DEF_WRITE(name, type)                               \
+    static void locked_##name(addr32_t addr, type val, void *ctxt) {    \
+        struct aica_thread_wrap *wrap = (struct aica_thread_wrap*)ctxt; \
+        aica_thread_lock();                                             \
+        wrap->intf->name(addr, val, wrap->ctxt);                        \
+        aica_thread_unlock();                                           \
+    }
+
+AICA_THREAD_DEF_READ(readdouble, double)
+AICA_THREAD_DEF_READ(readfloat, float)
+AICA_THREAD_DEF_READ(read32, uint32_t)
+AICA_THREAD_DEF_READ(read16, uint16_t)
+AICA_THREAD_DEF_READ(read8, uint8_t)
+
+AICA_THREAD_DEF_WRITE(writedouble, double)
+AICA_THREAD_DEF_WRITE(writefloat, float)
+AICA_THREAD_DEF_WRITE(write32, uint32_t)
+AICA_THREAD_DEF_WRITE(write16, uint16_t)
+AICA_THREAD_DEF_WRITE(write8, uint8_t)
+
+struct memory_interface aica_thread_locked_intf = {
+    .readdouble = locked_readdouble,
+    .readfloat = locked_readfloat,
+    .read32 = locked_read32,
+    .read16 = locked_read16,
+    .read8 = locked_read8,
+
+    .writedouble = locked_writedouble,
+    .writefloat = locked_writefloat,
+    .write32 = locked_write32,
+    .write16 = locked_write16,
+    .write8 = locked_write8
+};
+
+void aica_thread_get_stats(struct aica_thread_stats *stats) {
+    stats->threaded = aica != NULL;
+    stats->skew_limit = skew_limit;
+    stats->sh4_skew_waits = sh4_skew_waits;
+    stats->arm7_skew_waits =
+        atomic_load_explicit(&arm7_skew_waits, memory_order_relaxed);
+    stats->sh4_accesses = sh4_accesses;
+    stats->sh4_access_waits = sh4_access_waits;
+}
+
+void aica_thread_print_stats(struct aica_thread_stats const *stats) {
+    LOG_INFO("ARM7 thread: skew limit is %llu cycles\n",
+             (unsigned long long)stats->skew_limit);
+    LOG_INFO("ARM7 thread: the SH4 waited for the ARM7 %llu times, the ARM7 "
+             "waited for the SH4 %llu times\n",
+             stats->sh4_skew_waits, stats->arm7_skew_waits);
+    LOG_INFO("ARM7 thread: %llu SH4 accesses to the AICA, %llu of which had to "
+             "stop the ARM7\n", stats->sh4_accesses, stats->sh4_access_waits);
+}
@@ -0,0 +1,104 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef AICA_THREAD_H_
+#define AICA_THREAD_H_
+
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "dc_sched.h"
+#include "washdc/MemoryMap.h"
+
+/*
+ * optional mode where the ARM7's clock (and everything scheduled on it: the
+ * AICA timers and sample generation) runs on its own host thread.
+ *
+ * The two clocks only meet in three places:
+ *   - at timeslice boundaries, where whichever side is more than skew_limit
+ *     cycles ahead of the other waits for it to catch up.
+ *   - when the SH4 touches AICA registers or wave memory.  The SH4 side of the
+ *     memory map goes through aica_thread_locked_intf, which parks the ARM7
+ *     at its next instruction boundary for the duration of the access.
+ *   - when the ARM7 raises an interrupt on the SH4.  Holly belongs to the SH4
+ *     thread, so the AICA latches the interrupt and the SH4 thread raises it
+ *     the next time it syncs (see aica_flush_sh4_int).
+ */
+
+struct aica;
+
+struct aica_thread_stats {
+    bool threaded;
+    dc_cycle_stamp_t skew_limit;
+
+    // times the SH4 waited at a timeslice boundary for the ARM7 to catch up
+    unsigned long long sh4_skew_waits;
+
+    // times the ARM7 waited at a timeslice boundary for the SH4 to catch up
+    unsigned long long arm7_skew_waits;
+
+    // SH4 accesses to the AICA, and how many of those had to wait for the ARM7
+    unsigned long long sh4_accesses;
+    unsigned long long sh4_access_waits;
+};
+
+void aica_thread_init(struct aica *aica, struct dc_clock *sh4_clk,
+                      struct dc_clock *arm7_clk, dc_cycle_stamp_t skew_limit);
+void aica_thread_cleanup(void);
+
+// spawn/join the ARM7 thread.  The ARM7 clock's dispatch must be set by now.
+void aica_thread_start(void);
+void aica_thread_stop(void);
+
+/*
+ * the SH4 thread calls this before every timeslice.  It publishes the SH4's
+ * clock, waits if the SH4 has gotten too far ahead of the ARM7 and raises any
+ * interrupts the AICA latched for the SH4.
+ */
+void aica_thread_sh4_sync(void);
+
+/*
+ * SH4-side memory interface for both the AICA's registers and wave memory.
+ * The context pointer must point to the struct returned by
+ * aica_thread_wrap_sys or aica_thread_wrap_wave_mem.
+ */
+extern struct memory_interface aica_thread_locked_intf;
+void *aica_thread_wrap_sys(void);
+void *aica_thread_wrap_wave_mem(void);
+
+void aica_thread_get_stats(struct aica_thread_stats *stats);
+void aica_thread_print_stats(struct aica_thread_stats const *stats);
+
+void aica_thread_yield(void);
+
+extern atomic_bool aica_thread_sync_req;
+
+/*
+ * the ARM7's dispatch loops call this between instructions so that a waiting
+ * SH4 can get in.  It does nothing unless the SH4 is waiting.
+ */
+static inline void aica_thread_poll(void) {
+    if (atomic_load_explicit(&aica_thread_sync_req, memory_order_relaxed))
+        aica_thread_yield();
+}
+
+#endif
@@ -41,6 +41,22 @@ void aica_log_verbose(bool verbose) {
 
 void aica_wave_mem_init(struct aica_wave_mem *wm) {
     memset(wm->mem, 0, sizeof(wm->mem));
+    memset(wm->code_pages, 0, sizeof(wm->code_pages));
+    memset(wm->code_gen, 0, sizeof(wm->code_gen));
+}
+
+static inline void invalidate_page(struct aica_wave_mem *wm, unsigned page_no) {
+    if (wm->code_pages[page_no]) {
+        wm->code_pages[page_no] = false;
+        wm->code_gen[page_no]++;
+    }
+}
+
+// invalidate any cached ARM7 code for the pages in the given range
+static inline void
+invalidate_code(struct aica_wave_mem *wm, addr32_t addr, unsigned len) {
+    invalidate_page(wm, addr >> AICA_WAVE_MEM_PAGE_SHIFT);
+    invalidate_page(wm, (addr + len - 1) >> AICA_WAVE_MEM_PAGE_SHIFT);
 }
 
 void aica_wave_mem_cleanup(struct aica_wave_mem *wm) {
@@ -116,6 +132,7 @@ void aica_wave_mem_write_8(addr32_t addr, uint8_t val, void *ctxt) {
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
 
+    invalidate_code(wm, addr, sizeof(val));
     *outp = val;
 }
 
@@ -163,6 +180,7 @@ void aica_wave_mem_write_16(addr32_t addr, uint16_t val, void *ctxt) {
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
 
+    invalidate_code(wm, addr, sizeof(val));
     memcpy(wm->mem + addr, &val, sizeof(val));
 }
 
@@ -185,6 +203,7 @@ void aica_wave_mem_write_32(addr32_t addr, uint32_t val, void *ctxt) {
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
 
+    invalidate_code(wm, addr, sizeof(val));
     memcpy(wm->mem + addr, &val, sizeof(val));
 }
 
@@ -40,8 +40,24 @@ static_assert(!(AICA_WAVE_MEM_LEN & (AICA_WAVE_MEM_LEN - 1)),
 
 #define AICA_WAVE_MEM_MASK (AICA_WAVE_MEM_LEN - 1)
 
+#define AICA_WAVE_MEM_PAGE_SHIFT 12
+#define AICA_WAVE_MEM_PAGE_SIZE (1 << AICA_WAVE_MEM_PAGE_SHIFT)
+#define AICA_WAVE_MEM_PAGE_MASK (AICA_WAVE_MEM_PAGE_SIZE - 1)
+#define AICA_WAVE_MEM_N_PAGES (AICA_WAVE_MEM_LEN / AICA_WAVE_MEM_PAGE_SIZE)
+
 struct aica_wave_mem {
     uint8_t mem[AICA_WAVE_MEM_LEN];
+
+    /*
+     * Self-modifying code tracking for the ARM7's icache and jit.
+     *
+     * Anything which caches code from a page sets the page's code_pages flag
+     * and remembers the page's code_gen.  A write to a page whose flag is set
+     * clears the flag and increments code_gen, so cached code is only valid
+     * while the page's code_gen still matches the one it was cached under.
+     */
+    bool code_pages[AICA_WAVE_MEM_N_PAGES];
+    uint32_t code_gen[AICA_WAVE_MEM_N_PAGES];
 };
 
 float aica_wave_mem_read_float(addr32_t addr, void *ctxt);
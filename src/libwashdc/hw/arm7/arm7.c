@@ -21,6 +21,7 @@
  ******************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 
@@ -49,8 +50,6 @@ static DEF_ERROR_U32_ATTR(arm7_pc)
 #define N_CYCLE 1 // access address with no relation to previous address.
 #define I_CYCLE 1
 
-static void arm7_check_excp(struct arm7 *arm7);
-
 static uint32_t do_fetch_inst(struct arm7 *arm7, uint32_t addr);
 static void reset_pipeline(struct arm7 *arm7);
 
@@ -202,6 +201,7 @@ void arm7_init(struct arm7 *arm7,
     memset(arm7, 0, sizeof(*arm7));
     arm7->clk = clk;
     arm7->inst_mem = inst_mem;
+    arm7->icache_enable = true;
 
     arm7_error_callback.arg = arm7;
     arm7_error_callback.callback_fn = arm7_error_set_regs;
@@ -210,6 +210,12 @@ void arm7_init(struct arm7 *arm7,
 
 void arm7_cleanup(struct arm7 *arm7) {
     error_rm_callback(&arm7_error_callback);
+
+    unsigned page_no;
+    for (page_no = 0; page_no < AICA_WAVE_MEM_N_PAGES; page_no++) {
+        free(arm7->icache[page_no]);
+        arm7->icache[page_no] = NULL;
+    }
 }
 
 void arm7_set_mem_map(struct arm7 *arm7, struct memory_map *arm7_mem_map) {
@@ -531,9 +537,42 @@ DEF_INST_FN(mvn, true, false, true)
 DEF_INST_FN(cmn, false, true, false)
 
 typedef void(*arm7_opcode_fn)(struct arm7*, arm7_inst);
+typedef void(*arm7_jit_fallback_fn)(void*, cpu_inst_param);
+
+/*
+ * the jit calls these through JIT_OP_FALLBACK, which passes the CPU as a void
+ * pointer.
+ */
+#define DEF_JIT_FALLBACK(op_fn)                                         \
+    static void op_fn##_jit(void *cpu, cpu_inst_param inst) {          \
+        op_fn((struct arm7*)cpu, inst);                                 \
+    }
+
+DEF_JIT_FALLBACK(arm7_inst_branch)
+DEF_JIT_FALLBACK(arm7_inst_ldr_str)
+DEF_JIT_FALLBACK(arm7_block_xfer)
+DEF_JIT_FALLBACK(arm7_inst_mrs)
+DEF_JIT_FALLBACK(arm7_inst_msr)
+DEF_JIT_FALLBACK(arm7_inst_mul)
+DEF_JIT_FALLBACK(arm7_inst_orr)
+DEF_JIT_FALLBACK(arm7_inst_eor)
+DEF_JIT_FALLBACK(arm7_inst_bic)
+DEF_JIT_FALLBACK(arm7_inst_mov)
+DEF_JIT_FALLBACK(arm7_inst_add)
+DEF_JIT_FALLBACK(arm7_inst_sub)
+DEF_JIT_FALLBACK(arm7_inst_rsb)
+DEF_JIT_FALLBACK(arm7_inst_cmp)
+DEF_JIT_FALLBACK(arm7_inst_tst)
+DEF_JIT_FALLBACK(arm7_inst_and)
+DEF_JIT_FALLBACK(arm7_inst_mvn)
+DEF_JIT_FALLBACK(arm7_inst_cmn)
+DEF_JIT_FALLBACK(arm7_inst_swi)
+
+#define ARM7_OP(op_fn) op_fn, op_fn##_jit
 
 static struct arm7_opcode {
     arm7_opcode_fn fn;
+    arm7_jit_fallback_fn jit_fn;
     arm7_inst mask;
     arm7_inst val;
     unsigned n_cycles;
@@ -545,75 +584,169 @@ static struct arm7_opcode {
      */
 
     // branch (with or without link)
-    { arm7_inst_branch, MASK_B, VAL_B, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_branch), MASK_B, VAL_B, 2 * S_CYCLE + 1 * N_CYCLE },
 
     /*
      * TODO: this is supposed to take 2 * S_CYCLE + 2 * N_CYCLE + I_CYCLE
      * cycles if R15 is involved...?
      */
-    { arm7_inst_ldr_str, MASK_LDR_STR, VAL_LDR_STR,
+    { ARM7_OP(arm7_inst_ldr_str), MASK_LDR_STR, VAL_LDR_STR,
       1 * S_CYCLE + 1 * N_CYCLE + 1 * I_CYCLE },
 
     // TODO: yet another made up fictional cycle-count
-    { arm7_block_xfer, MASK_BLOCK_XFER, VAL_BLOCK_XFER,
+    { ARM7_OP(arm7_block_xfer), MASK_BLOCK_XFER, VAL_BLOCK_XFER,
       1 * S_CYCLE + 1 * N_CYCLE + 1 * I_CYCLE },
 
     /*
      * It's important that these always go *before* the data processing
      * instructions due to opcode overlap.
      */
-    { arm7_inst_mrs, MASK_MRS, VAL_MRS, 1 * S_CYCLE },
-    { arm7_inst_msr, MASK_MSR, VAL_MSR, 1 * S_CYCLE },
+    { ARM7_OP(arm7_inst_mrs), MASK_MRS, VAL_MRS, 1 * S_CYCLE },
+    { ARM7_OP(arm7_inst_msr), MASK_MSR, VAL_MSR, 1 * S_CYCLE },
 
     /*
      * this one also has to go before the data processing instructions
      * TODO: yet another fake cycle count.
      */
-    { arm7_inst_mul, MASK_MUL, VAL_MUL, 4 * S_CYCLE },
+    { ARM7_OP(arm7_inst_mul), MASK_MUL, VAL_MUL, 4 * S_CYCLE },
 
     /*
      * TODO: this cycle count is literally just something I made up with no
      * basis in reality.  It needs to be corrected.
      */
-    { arm7_inst_orr, MASK_ORR, VAL_ORR, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_eor, MASK_EOR, VAL_EOR, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_bic, MASK_BIC, VAL_BIC, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_mov, MASK_MOV, VAL_MOV, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_add, MASK_ADD, VAL_ADD, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_sub, MASK_SUB, VAL_SUB, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_rsb, MASK_RSB, VAL_RSB, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_cmp, MASK_CMP, VAL_CMP, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_tst, MASK_TST, VAL_TST, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_and, MASK_AND, VAL_AND, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_mvn, MASK_MVN, VAL_MVN, 2 * S_CYCLE + 1 * N_CYCLE },
-    { arm7_inst_cmn, MASK_CMN, VAL_CMN, 2 * S_CYCLE + 1 * N_CYCLE },
-
-    { arm7_inst_swi, MASK_SWI, VAL_SWI, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_orr), MASK_ORR, VAL_ORR, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_eor), MASK_EOR, VAL_EOR, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_bic), MASK_BIC, VAL_BIC, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_mov), MASK_MOV, VAL_MOV, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_add), MASK_ADD, VAL_ADD, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_sub), MASK_SUB, VAL_SUB, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_rsb), MASK_RSB, VAL_RSB, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_cmp), MASK_CMP, VAL_CMP, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_tst), MASK_TST, VAL_TST, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_and), MASK_AND, VAL_AND, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_mvn), MASK_MVN, VAL_MVN, 2 * S_CYCLE + 1 * N_CYCLE },
+    { ARM7_OP(arm7_inst_cmn), MASK_CMN, VAL_CMN, 2 * S_CYCLE + 1 * N_CYCLE },
+
+    { ARM7_OP(arm7_inst_swi), MASK_SWI, VAL_SWI, 2 * S_CYCLE + 1 * N_CYCLE },
 
     { NULL }
 };
 
-void arm7_decode(struct arm7 *arm7, struct arm7_decoded_inst *inst_out,
-                 arm7_inst inst) {
+static struct arm7_opcode const *arm7_decode_op(arm7_inst inst) {
     struct arm7_opcode const *curs = ops;
     while (curs->fn) {
-        if ((curs->mask & inst) == curs->val) {
-            inst_out->op = curs->fn;
-            inst_out->cycles = curs->n_cycles;
-            goto return_success;
-        }
+        if ((curs->mask & inst) == curs->val)
+            return curs;
         curs++;
     }
 
-    error_set_arm7_inst(inst);
-    error_set_arm7_pc(arm7->reg[ARM7_REG_PC]);
-    RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    return NULL;
+}
 
-return_success:
+void arm7_decode(struct arm7 *arm7, struct arm7_decoded_inst *inst_out,
+                 arm7_inst inst) {
+    struct arm7_opcode const *op = arm7_decode_op(inst);
+    if (!op) {
+        error_set_arm7_inst(inst);
+        error_set_arm7_pc(arm7->reg[ARM7_REG_PC]);
+        RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    }
+
+    inst_out->op = op->fn;
+    inst_out->cycles = op->n_cycles;
     inst_out->cond = arm7_cond(inst);
     inst_out->inst = inst;
 }
 
+static void arm7_jit_fallback_cond(void *cpu, cpu_inst_param inst) {
+    struct arm7 *arm7 = (struct arm7*)cpu;
+    if (arm7_cond(inst)(arm7))
+        arm7_decode_op(inst)->fn(arm7, inst);
+    else
+        next_inst(arm7);
+}
+
+void (*arm7_jit_fallback(arm7_inst inst))(void*, cpu_inst_param) {
+    struct arm7_opcode const *op = arm7_decode_op(inst);
+    if (!op)
+        return NULL;
+
+    if (arm7_cond(inst) == arm7_cond_al)
+        return op->jit_fn;
+    return arm7_jit_fallback_cond;
+}
+
+/*
+ * return the cached decoding of the instruction at addr (which must already be
+ * masked down to an offset into inst_mem), or NULL if there isn't one.
+ */
+static inline struct arm7_decoded_inst *
+icache_find(struct arm7 *arm7, uint32_t addr) {
+    unsigned page_no = addr >> AICA_WAVE_MEM_PAGE_SHIFT;
+    if (!arm7->icache_enable || !arm7->icache[page_no] ||
+        arm7->icache_gen[page_no] != arm7->inst_mem->code_gen[page_no])
+        return NULL;
+
+    struct arm7_decoded_inst *ent = arm7->icache[page_no] +
+        ((addr & AICA_WAVE_MEM_PAGE_MASK) / sizeof(arm7_inst));
+    return ent->op ? ent : NULL;
+}
+
+static void icache_insert(struct arm7 *arm7, uint32_t addr,
+                          struct arm7_decoded_inst const *inst) {
+    unsigned page_no = addr >> AICA_WAVE_MEM_PAGE_SHIFT;
+    struct aica_wave_mem *inst_mem = arm7->inst_mem;
+
+    if (!arm7->icache[page_no] ||
+        arm7->icache_gen[page_no] != inst_mem->code_gen[page_no]) {
+        // page is either new or has been written to since it was cached
+        size_t page_bytes =
+            ARM7_ICACHE_PAGE_LEN * sizeof(struct arm7_decoded_inst);
+        if (!arm7->icache[page_no]) {
+            arm7->icache[page_no] =
+                (struct arm7_decoded_inst*)malloc(page_bytes);
+            if (!arm7->icache[page_no])
+                RAISE_ERROR(ERROR_FAILED_ALLOC);
+        }
+        memset(arm7->icache[page_no], 0, page_bytes);
+        arm7->icache_gen[page_no] = inst_mem->code_gen[page_no];
+    }
+    inst_mem->code_pages[page_no] = true;
+
+    arm7->icache[page_no][(addr & AICA_WAVE_MEM_PAGE_MASK) /
+                          sizeof(arm7_inst)] = *inst;
+}
+
+/*
+ * decode the instruction which was fetched from pc, going through the icache
+ * if possible.
+ */
+static void arm7_decode_cached(struct arm7 *arm7,
+                               struct arm7_decoded_inst *inst_out,
+                               uint32_t pc, arm7_inst inst) {
+    if (!arm7->icache_enable || pc > 0x007fffff || (pc & 3)) {
+        arm7_decode(arm7, inst_out, inst);
+        return;
+    }
+
+    uint32_t addr = pc & 0x001fffff;
+    struct arm7_decoded_inst const *ent = icache_find(arm7, addr);
+    if (ent && ent->inst == inst) {
+        *inst_out = *ent;
+        return;
+    }
+
+    arm7_decode(arm7, inst_out, inst);
+
+    /*
+     * The pipeline fetches instructions two steps ahead of when they get
+     * executed, so memory could have changed since then.  Only cache the
+     * instruction if it's still the one in memory.
+     */
+    if (aica_wave_mem_read_32(addr, arm7->inst_mem) == inst)
+        icache_insert(arm7, addr, inst_out);
+}
+
 static void next_inst(struct arm7 *arm7) {
     arm7->reg[ARM7_REG_PC] += 4;
 }
@@ -643,23 +776,33 @@ void arm7_fetch_inst(struct arm7 *arm7, struct arm7_decoded_inst *inst_out) {
     uint32_t newpc = arm7->pipeline_pc[0];
     arm7_inst newinst = arm7->pipeline[0];
     arm7_inst ret = arm7->pipeline[1];
+    uint32_t ret_pc = arm7->pipeline_pc[1];
 
     arm7->pipeline_pc[0] = pc;
     arm7->pipeline[0] = inst_fetched;
     arm7->pipeline_pc[1] = newpc;
     arm7->pipeline[1] = newinst;
 
-    arm7_decode(arm7, inst_out, ret);
+    arm7_decode_cached(arm7, inst_out, ret_pc, ret);
     inst_out->cycles += cycle_count;
 }
 
+void arm7_fill_pipeline(struct arm7 *arm7, uint32_t pc) {
+    arm7->pipeline_pc[1] = pc;
+    arm7->pipeline[1] = do_fetch_inst(arm7, pc);
+    arm7->pipeline_pc[0] = pc + 4;
+    arm7->pipeline[0] = do_fetch_inst(arm7, pc + 4);
+    arm7->reg[ARM7_REG_PC] = pc + 8;
+    arm7->pipeline_full = true;
+}
+
 uint32_t arm7_pc_next(struct arm7 *arm7) {
     if (arm7->pipeline_full)
         return arm7->pipeline_pc[1];
     return arm7->reg[ARM7_REG_PC];
 }
 
-static void arm7_check_excp(struct arm7 *arm7) {
+void arm7_check_excp(struct arm7 *arm7) {
     if (arm7->excp_dirty) {
         enum arm7_excp excp = arm7->excp;
         uint32_t cpsr = arm7->reg[ARM7_REG_CPSR];
@@ -719,8 +862,15 @@ static void arm7_check_excp(struct arm7 *arm7) {
 }
 
 static uint32_t do_fetch_inst(struct arm7 *arm7, uint32_t addr) {
-    if (addr <= 0x007fffff)
-        return aica_wave_mem_read_32(addr & 0x001fffff, arm7->inst_mem);
+    if (addr <= 0x007fffff) {
+        addr &= 0x001fffff;
+        if (!(addr & 3)) {
+            struct arm7_decoded_inst const *ent = icache_find(arm7, addr);
+            if (ent)
+                return ent->inst;
+        }
+        return aica_wave_mem_read_32(addr, arm7->inst_mem);
+    }
     return ~0;
     /* return memory_map_read_32(arm7->map, addr); */
 }
@@ -27,6 +27,7 @@
 #include <assert.h>
 
 #include "washdc/error.h"
+#include "washdc/cpu.h"
 #include "dc_sched.h"
 #include "washdc/MemoryMap.h"
 #include "hw/aica/aica_wave_mem.h"
@@ -105,6 +106,22 @@ typedef uint32_t arm7_inst;
 
 typedef bool(*arm7_irq_fn)(void *dat);
 
+struct arm7;
+
+typedef bool(*arm7_cond_fn)(struct arm7*);
+typedef void(*arm7_op_fn)(struct arm7*,arm7_inst);
+
+struct arm7_decoded_inst {
+    arm7_cond_fn cond;
+    arm7_op_fn op;
+    arm7_inst inst;
+
+    unsigned cycles;
+};
+
+// number of instructions in each page of the decoded-instruction cache
+#define ARM7_ICACHE_PAGE_LEN (AICA_WAVE_MEM_PAGE_SIZE / sizeof(arm7_inst))
+
 struct arm7 {
     /*
      * For the sake of instruction-fetching, ARM7 disregards the memory_map and
@@ -145,17 +162,19 @@ struct arm7 {
     bool excp_dirty;
 
     bool pipeline_full;
-};
 
-typedef bool(*arm7_cond_fn)(struct arm7*);
-typedef void(*arm7_op_fn)(struct arm7*,arm7_inst);
-
-struct arm7_decoded_inst {
-    arm7_cond_fn cond;
-    arm7_op_fn op;
-    arm7_inst inst;
-
-    unsigned cycles;
+    /*
+     * decoded instructions, one array for each page of inst_mem.  These are
+     * allocated the first time an instruction from the page gets executed,
+     * and they're only valid while inst_mem->code_gen for that page matches
+     * icache_gen.  An entry whose op is NULL has not been decoded yet.
+     *
+     * When icache_enable is false every instruction goes through arm7_decode
+     * instead; this is mostly there for src/bench/arm7_bench.
+     */
+    struct arm7_decoded_inst *icache[AICA_WAVE_MEM_N_PAGES];
+    uint32_t icache_gen[AICA_WAVE_MEM_N_PAGES];
+    bool icache_enable;
 };
 
 void arm7_init(struct arm7 *arm7, struct dc_clock *clk, struct aica_wave_mem *inst_mem);
@@ -163,6 +182,24 @@ void arm7_cleanup(struct arm7 *arm7);
 
 void arm7_fetch_inst(struct arm7 *arm7, struct arm7_decoded_inst *inst_out);
 
+// handle any pending exceptions.  arm7_fetch_inst does this automatically.
+void arm7_check_excp(struct arm7 *arm7);
+
+/*
+ * put the pipeline in the state it would be in right before the instruction
+ * at pc is fetched, as if execution had fallen through to pc without any
+ * branches.  This is for the jit, which doesn't keep the pipeline up to date.
+ */
+void arm7_fill_pipeline(struct arm7 *arm7, uint32_t pc);
+
+/*
+ * returns an interpreter function which executes inst, for use as a
+ * JIT_OP_FALLBACK.  The function expects a struct arm7 as its first argument
+ * and inst as its second argument.  It evaluates the condition code itself
+ * unless the condition is AL.  Returns NULL if inst is not implemented.
+ */
+void (*arm7_jit_fallback(arm7_inst inst))(void*, cpu_inst_param);
+
 void arm7_decode(struct arm7 *arm7, struct arm7_decoded_inst *inst_out,
                  arm7_inst inst);
 
@@ -179,9 +216,10 @@ uint32_t arm7_pc_next(struct arm7 *arm7);
 void arm7_set_fiq(struct arm7 *arm7);
 void arm7_clear_fiq(struct arm7 *arm7);
 
-inline static uint32_t *arm7_gen_reg(struct arm7 *arm7, unsigned reg) {
+// index into the reg array of general-purpose register reg in the given mode
+inline static unsigned arm7_reg_idx(uint32_t mode, unsigned reg) {
     unsigned idx_actual;
-    switch (arm7->reg[ARM7_REG_CPSR] & ARM7_CPSR_M_MASK) {
+    switch (mode & ARM7_CPSR_M_MASK) {
     case ARM7_MODE_USER:
         idx_actual = reg + ARM7_REG_R0;
         break;
@@ -219,7 +257,11 @@ inline static uint32_t *arm7_gen_reg(struct arm7 *arm7, unsigned reg) {
         RAISE_ERROR(ERROR_UNIMPLEMENTED);
     }
 
-    return arm7->reg + idx_actual;
+    return idx_actual;
+}
+
+inline static uint32_t *arm7_gen_reg(struct arm7 *arm7, unsigned reg) {
+    return arm7->reg + arm7_reg_idx(arm7->reg[ARM7_REG_CPSR], reg);
 }
 
 #endif
@@ -0,0 +1,955 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "washdc/error.h"
+#include "jit/jit_il.h"
+
+#ifdef JIT_OPTIMIZE
+#include "jit/jit_opt.h"
+#endif
+
+#include "arm7_jit.h"
+
+// anything above this is not wave memory, and can't hold any code
+#define ARM7_JIT_ADDR_LAST 0x007fffff
+#define ARM7_JIT_ADDR_MASK (AICA_WAVE_MEM_LEN - 1)
+
+// fields of a data-processing instruction
+#define DATA_OP_AND 0x0
+#define DATA_OP_EOR 0x1
+#define DATA_OP_SUB 0x2
+#define DATA_OP_RSB 0x3
+#define DATA_OP_ADD 0x4
+#define DATA_OP_TST 0x8
+#define DATA_OP_CMP 0xa
+#define DATA_OP_CMN 0xb
+#define DATA_OP_ORR 0xc
+#define DATA_OP_MOV 0xd
+#define DATA_OP_BIC 0xe
+#define DATA_OP_MVN 0xf
+
+#define ARM7_COND_AL 0xe
+#define ARM7_COND_NV 0xf
+
+static struct memory_interface const arm7_jit_lockstep_intf;
+
+static unsigned arm7_jit_hash(uint32_t pc) {
+    return (pc >> 2) & ARM7_JIT_HASH_MASK;
+}
+
+static unsigned arm7_jit_page(uint32_t pc) {
+    return (pc & ARM7_JIT_ADDR_MASK) >> AICA_WAVE_MEM_PAGE_SHIFT;
+}
+
+void arm7_jit_init(struct arm7_jit *jit, struct arm7 *arm7,
+                   bool native, bool lockstep) {
+    memset(jit, 0, sizeof(*jit));
+
+    jit->arm7 = arm7;
+    jit->lockstep = lockstep;
+
+#ifdef ENABLE_JIT_X86_64
+    jit->native = native;
+    if (native)
+        jit->call_native = native_dispatch_call_create();
+#else
+    if (native)
+        LOG_WARN("%s - x86_64 backend not available, using the IL "
+                 "interpreter instead\n", __func__);
+#endif
+
+    memory_map_init(&jit->lockstep_map);
+    jit->lockstep_map.unmap = &arm7_jit_lockstep_intf;
+    jit->lockstep_map.unmap_ctxt = jit;
+}
+
+static void arm7_jit_block_cleanup(struct arm7_jit *jit,
+                                   struct arm7_jit_block *blk) {
+#ifdef ENABLE_JIT_X86_64
+    if (jit->native) {
+        code_block_x86_64_cleanup(&blk->code.x86_64);
+        return;
+    }
+#endif
+    code_block_intp_cleanup(&blk->code.intp);
+}
+
+void arm7_jit_cleanup(struct arm7_jit *jit) {
+    unsigned idx;
+    for (idx = 0; idx < ARM7_JIT_HASH_LEN; idx++) {
+        struct arm7_jit_block *blk = jit->tbl[idx];
+        while (blk) {
+            struct arm7_jit_block *next = blk->next;
+            arm7_jit_block_cleanup(jit, blk);
+            free(blk);
+            blk = next;
+        }
+    }
+
+    memory_map_cleanup(&jit->lockstep_map);
+    memset(jit, 0, sizeof(*jit));
+}
+
+static void arm7_jit_discard(struct il_code_block *il, unsigned slot_no) {
+    free_slot(il, slot_no);
+    jit_discard_slot(il, slot_no);
+}
+
+static unsigned arm7_jit_copy(struct il_code_block *il, unsigned slot_src) {
+    unsigned slot_dst = alloc_slot(il);
+    jit_mov(il, slot_src, slot_dst);
+    return slot_dst;
+}
+
+// R15 reads as the address of the instruction plus 8
+static void arm7_jit_load_reg(struct arm7_jit *jit, struct il_code_block *il,
+                              uint32_t mode, uint32_t pc,
+                              unsigned reg_no, unsigned slot_no) {
+    if (reg_no == 15)
+        jit_set_slot(il, slot_no, pc + 8);
+    else
+        jit_load_slot(il, slot_no,
+                      jit->arm7->reg + arm7_reg_idx(mode, reg_no));
+}
+
+static void arm7_jit_store_const(struct il_code_block *il,
+                                 uint32_t val, uint32_t *dst) {
+    unsigned slot_no = alloc_slot(il);
+    jit_set_slot(il, slot_no, val);
+    jit_store_slot(il, slot_no, dst);
+    arm7_jit_discard(il, slot_no);
+}
+
+static void arm7_jit_jump_const(struct il_code_block *il, uint32_t pc) {
+    unsigned slot_no = alloc_slot(il);
+    jit_set_slot(il, slot_no, pc);
+    jit_jump(il, slot_no);
+    free_slot(il, slot_no);
+}
+
+/*
+ * put the pipeline in the state the interpreter would have it in while it
+ * executes the instruction at pc.
+ */
+static void arm7_jit_sync_pipeline(void *cpu, uint32_t pc) {
+    struct arm7 *arm7 = (struct arm7*)cpu;
+    arm7_fill_pipeline(arm7, pc + 4);
+    arm7->reg[ARM7_REG_PC] = pc + 8;
+}
+
+static void
+arm7_jit_emit_fallback(struct arm7_jit *jit, struct il_code_block *il,
+                       uint32_t pc, arm7_inst inst, bool ends_block,
+                       void(*fallback_fn)(void*, cpu_inst_param)) {
+    if (ends_block) {
+        unsigned slot_no = alloc_slot(il);
+        jit_set_slot(il, slot_no, pc);
+        jit_call_func(il, arm7_jit_sync_pipeline, slot_no);
+        arm7_jit_discard(il, slot_no);
+    } else {
+        arm7_jit_store_const(il, pc + 8, jit->arm7->reg + ARM7_REG_PC);
+    }
+
+    jit_fallback(il, fallback_fn, inst);
+
+    if (ends_block) {
+        // the return value is ignored since the fallback already set the pc
+        arm7_jit_jump_const(il, 0);
+    }
+}
+
+// shift the low bit of slot_no into bit and OR it into slot_cpsr
+static void arm7_jit_set_flag(struct il_code_block *il, unsigned slot_no,
+                              unsigned bit, unsigned slot_cpsr) {
+    jit_and_const32(il, slot_no, 1);
+    jit_shll(il, slot_no, bit);
+    jit_or(il, slot_no, slot_cpsr);
+}
+
+/*
+ * Leave 1 in the returned slot if the condition passes, or 0 if it fails.
+ * This matches arm7_cond in arm7.c.
+ */
+static unsigned arm7_jit_cond(struct arm7_jit *jit, struct il_code_block *il,
+                              unsigned cond) {
+    unsigned slot_cpsr = alloc_slot(il);
+    unsigned slot_res = alloc_slot(il);
+    unsigned slot_tmp;
+    bool invert = cond & 1;
+
+    jit_load_slot(il, slot_cpsr, jit->arm7->reg + ARM7_REG_CPSR);
+    jit_mov(il, slot_cpsr, slot_res);
+
+    switch (cond >> 1) {
+    case 0:
+        // EQ/NE
+        jit_shlr(il, slot_res, ARM7_CPSR_Z_SHIFT);
+        break;
+    case 1:
+        // CS/CC
+        jit_shlr(il, slot_res, ARM7_CPSR_C_SHIFT);
+        break;
+    case 2:
+        // MI/PL
+        jit_shlr(il, slot_res, ARM7_CPSR_N_SHIFT);
+        break;
+    case 3:
+        // VS/VC
+        jit_shlr(il, slot_res, ARM7_CPSR_V_SHIFT);
+        break;
+    case 4:
+        // HI/LS: C set and Z clear
+        slot_tmp = arm7_jit_copy(il, slot_cpsr);
+        jit_shlr(il, slot_res, ARM7_CPSR_C_SHIFT);
+        jit_shlr(il, slot_tmp, ARM7_CPSR_Z_SHIFT);
+        jit_not(il, slot_tmp);
+        jit_and(il, slot_tmp, slot_res);
+        arm7_jit_discard(il, slot_tmp);
+        break;
+    case 5:
+        // GE/LT: N == V
+        slot_tmp = arm7_jit_copy(il, slot_cpsr);
+        jit_shlr(il, slot_res, ARM7_CPSR_N_SHIFT);
+        jit_shlr(il, slot_tmp, ARM7_CPSR_V_SHIFT);
+        jit_xor(il, slot_tmp, slot_res);
+        jit_not(il, slot_res);
+        arm7_jit_discard(il, slot_tmp);
+        break;
+    case 6:
+        // GT/LE: Z clear and N == V
+        slot_tmp = arm7_jit_copy(il, slot_cpsr);
+        jit_shlr(il, slot_res, ARM7_CPSR_N_SHIFT);
+        jit_shlr(il, slot_tmp, ARM7_CPSR_V_SHIFT);
+        jit_xor(il, slot_tmp, slot_res);
+        jit_mov(il, slot_cpsr, slot_tmp);
+        jit_shlr(il, slot_tmp, ARM7_CPSR_Z_SHIFT);
+        jit_or(il, slot_tmp, slot_res);
+        jit_not(il, slot_res);
+        arm7_jit_discard(il, slot_tmp);
+        break;
+    default:
+        RAISE_ERROR(ERROR_INTEGRITY);
+    }
+
+    jit_and_const32(il, slot_res, 1);
+    if (invert)
+        jit_xor_const32(il, slot_res, 1);
+
+    arm7_jit_discard(il, slot_cpsr);
+    return slot_res;
+}
+
+/*
+ * returns true if the data-processing instruction can be translated to IL by
+ * arm7_jit_data_op.  This has to agree with the interpreter on every corner
+ * case, so anything that it would raise an error on, any condition other
+ * than AL, and anything which writes the CPSR from the SPSR falls back.
+ */
+static bool arm7_jit_data_op_native(arm7_inst inst) {
+    unsigned opcode = (inst >> 21) & 0xf;
+    bool s_flag = inst & (1 << 20);
+    bool i_flag = inst & (1 << 25);
+    unsigned rd = (inst >> 12) & 0xf;
+
+    if ((inst >> 28) != ARM7_COND_AL || (inst & (3 << 26)))
+        return false;
+
+    switch (opcode) {
+    case DATA_OP_TST:
+    case DATA_OP_CMP:
+    case DATA_OP_CMN:
+        // without the S flag these are MRS/MSR
+        if (!s_flag || rd == 15)
+            return false;
+        break;
+    case DATA_OP_AND:
+    case DATA_OP_EOR:
+    case DATA_OP_SUB:
+    case DATA_OP_RSB:
+    case DATA_OP_ADD:
+    case DATA_OP_ORR:
+    case DATA_OP_MOV:
+    case DATA_OP_BIC:
+    case DATA_OP_MVN:
+        if (s_flag && rd == 15)
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    if (!i_flag) {
+        unsigned shift_fn = (inst >> 5) & 3;
+        unsigned shift_amt = (inst >> 7) & 0x1f;
+
+        // register-specified shift amounts go through the interpreter
+        if (inst & (1 << 4))
+            return false;
+
+        // ROR has no IL equivalent, ASR #0 is unimplemented
+        if (shift_fn == 3 || (shift_fn == 2 && !shift_amt))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * compute the second operand of a data-processing instruction.  If
+ * slot_carry_out is not NULL, the shifter's carry-out gets stored there (or
+ * it's set to -1 if the carry flag is left unchanged).
+ */
+static unsigned
+arm7_jit_operand2(struct arm7_jit *jit, struct il_code_block *il,
+                  uint32_t mode, uint32_t pc, arm7_inst inst,
+                  int *slot_carry_out) {
+    unsigned slot_op2 = alloc_slot(il);
+
+    if (slot_carry_out)
+        *slot_carry_out = -1;
+
+    if (inst & (1 << 25)) {
+        uint32_t imm = inst & 0xff;
+        unsigned rot = 2 * ((inst >> 8) & 0xf);
+        if (rot)
+            imm = (imm >> rot) | (imm << (32 - rot));
+        jit_set_slot(il, slot_op2, imm);
+        return slot_op2;
+    }
+
+    unsigned shift_fn = (inst >> 5) & 3;
+    unsigned shift_amt = (inst >> 7) & 0x1f;
+
+    arm7_jit_load_reg(jit, il, mode, pc, inst & 0xf, slot_op2);
+
+    if (!shift_amt)
+        return slot_op2; // LSL #0 and LSR #0 both leave the carry alone
+
+    if (slot_carry_out) {
+        unsigned slot_carry = arm7_jit_copy(il, slot_op2);
+        if (shift_fn == 0)
+            jit_shlr(il, slot_carry, 32 - shift_amt);
+        else
+            jit_shlr(il, slot_carry, shift_amt - 1);
+        *slot_carry_out = slot_carry;
+    }
+
+    switch (shift_fn) {
+    case 0:
+        jit_shll(il, slot_op2, shift_amt);
+        break;
+    case 1:
+        jit_shlr(il, slot_op2, shift_amt);
+        break;
+    case 2:
+        jit_shar(il, slot_op2, shift_amt);
+        break;
+    default:
+        RAISE_ERROR(ERROR_INTEGRITY);
+    }
+
+    return slot_op2;
+}
+
+/*
+ * translate one of the instructions accepted by arm7_jit_data_op_native.
+ * Returns true if it ended the block (ie it wrote to R15).
+ */
+static bool arm7_jit_data_op(struct arm7_jit *jit, struct il_code_block *il,
+                             uint32_t mode, uint32_t pc, arm7_inst inst) {
+    unsigned opcode = (inst >> 21) & 0xf;
+    bool s_flag = inst & (1 << 20);
+    unsigned rn = (inst >> 16) & 0xf;
+    unsigned rd = (inst >> 12) & 0xf;
+    bool is_logic = true, write_result = true;
+    int slot_carry = -1;
+    unsigned slot_rn = 0, slot_res, slot_v_lhs = 0, slot_v_rhs = 0;
+    bool uses_rn = opcode != DATA_OP_MOV && opcode != DATA_OP_MVN;
+
+    switch (opcode) {
+    case DATA_OP_TST:
+        write_result = false;
+        break;
+    case DATA_OP_CMP:
+    case DATA_OP_CMN:
+        write_result = false;
+        // fall-through
+    case DATA_OP_SUB:
+    case DATA_OP_RSB:
+    case DATA_OP_ADD:
+        is_logic = false;
+        break;
+    }
+
+    unsigned slot_op2 = arm7_jit_operand2(jit, il, mode, pc, inst,
+                                          (s_flag && is_logic) ?
+                                          &slot_carry : NULL);
+    if (uses_rn) {
+        slot_rn = alloc_slot(il);
+        arm7_jit_load_reg(jit, il, mode, pc, rn, slot_rn);
+    }
+
+    switch (opcode) {
+    case DATA_OP_AND:
+    case DATA_OP_TST:
+        slot_res = arm7_jit_copy(il, slot_rn);
+        jit_and(il, slot_op2, slot_res);
+        break;
+    case DATA_OP_EOR:
+        slot_res = arm7_jit_copy(il, slot_rn);
+        jit_xor(il, slot_op2, slot_res);
+        break;
+    case DATA_OP_ORR:
+        slot_res = arm7_jit_copy(il, slot_rn);
+        jit_or(il, slot_op2, slot_res);
+        break;
+    case DATA_OP_BIC:
+        slot_res = arm7_jit_copy(il, slot_op2);
+        jit_not(il, slot_res);
+        jit_and(il, slot_rn, slot_res);
+        break;
+    case DATA_OP_MOV:
+        slot_res = arm7_jit_copy(il, slot_op2);
+        break;
+    case DATA_OP_MVN:
+        slot_res = arm7_jit_copy(il, slot_op2);
+        jit_not(il, slot_res);
+        break;
+    case DATA_OP_ADD:
+    case DATA_OP_CMN:
+        slot_res = arm7_jit_copy(il, slot_rn);
+        jit_add(il, slot_op2, slot_res);
+        slot_v_lhs = slot_rn;
+        slot_v_rhs = slot_op2;
+        break;
+    case DATA_OP_SUB:
+    case DATA_OP_CMP:
+        slot_res = arm7_jit_copy(il, slot_rn);
+        jit_sub(il, slot_op2, slot_res);
+        slot_v_lhs = slot_rn;
+        slot_v_rhs = slot_op2;
+        break;
+    case DATA_OP_RSB:
+        slot_res = arm7_jit_copy(il, slot_op2);
+        jit_sub(il, slot_rn, slot_res);
+        slot_v_lhs = slot_op2;
+        slot_v_rhs = slot_rn;
+        break;
+    default:
+        RAISE_ERROR(ERROR_INTEGRITY);
+    }
+
+    if (s_flag) {
+        uint32_t mask = ARM7_CPSR_N_MASK | ARM7_CPSR_Z_MASK;
+        if (!is_logic)
+            mask |= ARM7_CPSR_C_MASK | ARM7_CPSR_V_MASK;
+        else if (slot_carry >= 0)
+            mask |= ARM7_CPSR_C_MASK;
+
+        unsigned slot_cpsr = alloc_slot(il);
+        unsigned slot_flag = alloc_slot(il);
+        uint32_t *cpsr = jit->arm7->reg + ARM7_REG_CPSR;
+
+        jit_load_slot(il, slot_cpsr, cpsr);
+        jit_and_const32(il, slot_cpsr, ~mask);
+
+        jit_mov(il, slot_res, slot_flag);
+        jit_shlr(il, slot_flag, 31);
+        arm7_jit_set_flag(il, slot_flag, ARM7_CPSR_N_SHIFT, slot_cpsr);
+
+        jit_mov(il, slot_res, slot_flag);
+        jit_slot_to_bool(il, slot_flag);
+        jit_xor_const32(il, slot_flag, 1);
+        arm7_jit_set_flag(il, slot_flag, ARM7_CPSR_Z_SHIFT, slot_cpsr);
+
+        if (is_logic) {
+            if (slot_carry >= 0) {
+                arm7_jit_set_flag(il, slot_carry, ARM7_CPSR_C_SHIFT,
+                                  slot_cpsr);
+            }
+        } else {
+            // carry
+            jit_set_slot(il, slot_flag, 0);
+            if (opcode == DATA_OP_ADD || opcode == DATA_OP_CMN)
+                jit_set_gt_unsigned(il, slot_rn, slot_res, slot_flag);
+            else
+                jit_set_ge_unsigned(il, slot_v_lhs, slot_v_rhs, slot_flag);
+            arm7_jit_set_flag(il, slot_flag, ARM7_CPSR_C_SHIFT, slot_cpsr);
+
+            /*
+             * overflow: for addition the result's sign differs from both
+             * inputs, for subtraction the inputs' signs differ and the
+             * result's sign differs from the left-hand side.
+             */
+            unsigned slot_tmp = alloc_slot(il);
+            jit_mov(il, slot_v_lhs, slot_flag);
+            jit_xor(il, slot_res, slot_flag);
+            if (opcode == DATA_OP_ADD || opcode == DATA_OP_CMN) {
+                jit_mov(il, slot_v_rhs, slot_tmp);
+                jit_xor(il, slot_res, slot_tmp);
+            } else {
+                jit_mov(il, slot_v_lhs, slot_tmp);
+                jit_xor(il, slot_v_rhs, slot_tmp);
+            }
+            jit_and(il, slot_tmp, slot_flag);
+            jit_shlr(il, slot_flag, 31);
+            arm7_jit_set_flag(il, slot_flag, ARM7_CPSR_V_SHIFT, slot_cpsr);
+            arm7_jit_discard(il, slot_tmp);
+        }
+
+        jit_store_slot(il, slot_cpsr, cpsr);
+        arm7_jit_discard(il, slot_flag);
+        arm7_jit_discard(il, slot_cpsr);
+    }
+
+    bool ends_block = false;
+    if (write_result) {
+        if (rd == 15) {
+            arm7_jit_store_const(il, 1, &jit->flushed);
+            jit_jump(il, slot_res);
+            ends_block = true;
+        } else {
+            jit_store_slot(il, slot_res,
+                           jit->arm7->reg + arm7_reg_idx(mode, rd));
+        }
+    }
+
+    if (slot_carry >= 0)
+        arm7_jit_discard(il, slot_carry);
+    if (uses_rn)
+        arm7_jit_discard(il, slot_rn);
+    arm7_jit_discard(il, slot_op2);
+    arm7_jit_discard(il, slot_res);
+
+    return ends_block;
+}
+
+static void arm7_jit_branch(struct arm7_jit *jit, struct il_code_block *il,
+                            uint32_t mode, uint32_t pc, arm7_inst inst) {
+    unsigned cond = inst >> 28;
+    uint32_t offs = inst & ((1 << 24) - 1);
+    if (offs & (1 << 23))
+        offs |= 0xff000000;
+    uint32_t pc_new = pc + 8 + (offs << 2);
+
+    unsigned slot_tgt = alloc_slot(il);
+    jit_set_slot(il, slot_tgt, pc_new);
+
+    if (cond == ARM7_COND_AL) {
+        if (inst & (1 << 24)) {
+            arm7_jit_store_const(il, pc + 4,
+                                 jit->arm7->reg + arm7_reg_idx(mode, 14));
+        }
+        arm7_jit_store_const(il, 1, &jit->flushed);
+        jit_jump(il, slot_tgt);
+    } else {
+        unsigned slot_cond = arm7_jit_cond(jit, il, cond);
+        unsigned slot_alt = alloc_slot(il);
+        jit_set_slot(il, slot_alt, pc + 4);
+        jit_store_slot(il, slot_cond, &jit->flushed);
+        jit_jump_cond(il, slot_cond, slot_tgt, slot_alt, 1);
+        free_slot(il, slot_alt);
+        free_slot(il, slot_cond);
+    }
+
+    free_slot(il, slot_tgt);
+}
+
+/*
+ * returns true if the fallback for inst could change the pc, the CPU mode or
+ * the state of the exception handling, or if it stores to memory.  Stores end
+ * the block because they can have side-effects on the rest of the AICA.
+ */
+static bool arm7_jit_fallback_ends_block(arm7_inst inst) {
+    unsigned rd = (inst >> 12) & 0xf;
+
+    switch ((inst >> 25) & 7) {
+    case 0:
+    case 1:
+        // data processing, MRS/MSR or MUL
+        if ((inst & 0x0fc000f0) == 0x00000090)
+            return false; // MUL, rd is in bits 16-19 and can't be R15
+        if ((inst & 0x0db00000) == 0x01200000)
+            return true; // MSR
+        if ((inst & 0x0fb00000) == 0x01000000)
+            return false; // MRS
+        return rd == 15;
+    case 2:
+    case 3:
+        // LDR/STR
+        return !(inst & (1 << 20)) || rd == 15;
+    case 4:
+        // LDM/STM
+        return !(inst & (1 << 20)) || (inst & (1 << 15));
+    default:
+        // branches and SWI
+        return true;
+    }
+}
+
+void arm7_jit_translate(struct arm7_jit *jit, struct arm7_jit_block *blk,
+                        struct il_code_block *il) {
+    struct arm7 *arm7 = jit->arm7;
+    struct aica_wave_mem *mem = arm7->inst_mem;
+    uint32_t pc = blk->pc;
+    uint32_t mode = blk->mode;
+    unsigned page = arm7_jit_page(pc);
+
+    mem->code_pages[page] = true;
+    blk->gen = mem->code_gen[page];
+    blk->n_insts = 0;
+    blk->cycles = 0;
+    blk->fallback_exit = false;
+
+    for (;;) {
+        arm7_inst inst = aica_wave_mem_read_32(pc & ARM7_JIT_ADDR_MASK, mem);
+        void(*fallback_fn)(void*, cpu_inst_param) = arm7_jit_fallback(inst);
+
+        if (!fallback_fn) {
+            /*
+             * the interpreter will raise the error if this instruction ever
+             * actually gets executed.
+             */
+            if (blk->n_insts) {
+                arm7_jit_store_const(il, 0, &jit->flushed);
+                arm7_jit_jump_const(il, pc);
+            }
+            return;
+        }
+
+        struct arm7_decoded_inst decoded;
+        arm7_decode(arm7, &decoded, inst);
+        blk->cycles += decoded.cycles;
+        blk->n_insts++;
+
+        unsigned cond = inst >> 28;
+        bool is_branch = ((inst >> 25) & 7) == 5;
+
+        if (cond == ARM7_COND_NV) {
+            // never executed
+        } else if (is_branch && (cond == ARM7_COND_AL ||
+                                 !(inst & (1 << 24)))) {
+            arm7_jit_branch(jit, il, mode, pc, inst);
+            return;
+        } else if (arm7_jit_data_op_native(inst)) {
+            if (arm7_jit_data_op(jit, il, mode, pc, inst))
+                return;
+        } else if (arm7_jit_fallback_ends_block(inst)) {
+            arm7_jit_emit_fallback(jit, il, pc, inst, true, fallback_fn);
+            blk->fallback_exit = true;
+            return;
+        } else {
+            arm7_jit_emit_fallback(jit, il, pc, inst, false, fallback_fn);
+        }
+
+        pc += 4;
+        if (!(pc & AICA_WAVE_MEM_PAGE_MASK) ||
+            blk->n_insts >= ARM7_JIT_MAX_INSTS) {
+            arm7_jit_store_const(il, 0, &jit->flushed);
+            arm7_jit_jump_const(il, pc);
+            return;
+        }
+    }
+}
+
+static void arm7_jit_compile(struct arm7_jit *jit, struct arm7_jit_block *blk) {
+    struct il_code_block il_blk;
+
+    il_code_block_init(&il_blk);
+    arm7_jit_translate(jit, blk, &il_blk);
+#ifdef JIT_OPTIMIZE
+    jit_opt_run(&il_blk, blk->n_insts, &jit->stats.opt);
+#endif
+
+    if (blk->n_insts) {
+#ifdef ENABLE_JIT_X86_64
+        if (jit->native) {
+            code_block_x86_64_compile(jit->arm7, &blk->code.x86_64, &il_blk,
+                                      NULL, blk->cycles);
+        } else {
+#endif
+            code_block_intp_cleanup(&blk->code.intp);
+            code_block_intp_init(&blk->code.intp);
+            code_block_intp_compile(jit->arm7, &blk->code.intp, &il_blk,
+                                    blk->cycles);
+#ifdef ENABLE_JIT_X86_64
+        }
+#endif
+    }
+
+    il_code_block_cleanup(&il_blk);
+}
+
+static struct arm7_jit_block *
+arm7_jit_get_block(struct arm7_jit *jit, uint32_t pc, uint32_t mode) {
+    struct arm7_jit_block **head = jit->tbl + arm7_jit_hash(pc);
+    struct arm7_jit_block *blk;
+    uint32_t gen = jit->arm7->inst_mem->code_gen[arm7_jit_page(pc)];
+
+    for (blk = *head; blk; blk = blk->next) {
+        if (blk->pc == pc && blk->mode == mode) {
+            if (blk->gen != gen) {
+                jit->stats.n_recompiles++;
+                arm7_jit_compile(jit, blk);
+            }
+            return blk;
+        }
+    }
+
+    blk = (struct arm7_jit_block*)calloc(1, sizeof(*blk));
+    if (!blk)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    blk->pc = pc;
+    blk->mode = mode;
+#ifdef ENABLE_JIT_X86_64
+    if (jit->native)
+        code_block_x86_64_init(&blk->code.x86_64);
+    else
+#endif
+        code_block_intp_init(&blk->code.intp);
+
+    arm7_jit_compile(jit, blk);
+
+    blk->next = *head;
+    *head = blk;
+    jit->stats.n_blocks++;
+
+    return blk;
+}
+
+static unsigned arm7_jit_interp_step(struct arm7_jit *jit) {
+    struct arm7_decoded_inst decoded;
+
+    jit->stats.n_interp_steps++;
+    arm7_fetch_inst(jit->arm7, &decoded);
+    return arm7_exec(jit->arm7, &decoded);
+}
+
+static unsigned arm7_jit_exec(struct arm7_jit *jit,
+                              struct arm7_jit_block *blk) {
+    struct arm7 *arm7 = jit->arm7;
+    unsigned cycles = blk->cycles;
+    uint32_t pc_new;
+
+    if (!arm7->pipeline_full) {
+        arm7_fill_pipeline(arm7, blk->pc);
+        cycles += 2;
+    }
+
+#ifdef ENABLE_JIT_X86_64
+    if (jit->native)
+        pc_new = jit->call_native(blk->code.x86_64.native);
+    else
+#endif
+        pc_new = code_block_intp_exec(arm7, &blk->code.intp);
+
+    if (!blk->fallback_exit) {
+        if (jit->flushed) {
+            arm7->reg[ARM7_REG_PC] = pc_new;
+            arm7->pipeline_full = false;
+        } else {
+            arm7_fill_pipeline(arm7, pc_new);
+        }
+    }
+
+    jit->stats.n_blocks_run++;
+
+    return cycles;
+}
+
+static void arm7_jit_lockstep_fail(struct arm7_jit_block const *blk,
+                                   char const *what,
+                                   uint32_t jit_val, uint32_t intp_val) {
+    LOG_ERROR("ARM7 JIT lockstep mismatch after block at 0x%08x: %s is "
+              "0x%08x but the interpreter has 0x%08x\n",
+              (unsigned)blk->pc, what, (unsigned)jit_val, (unsigned)intp_val);
+    error_set_address(blk->pc);
+    error_set_value(jit_val);
+    RAISE_ERROR(ERROR_INTEGRITY);
+}
+
+static unsigned arm7_jit_run_lockstep(struct arm7_jit *jit,
+                                      struct arm7_jit_block *blk) {
+    struct arm7 *arm7 = jit->arm7;
+    struct arm7 shadow = *arm7;
+    unsigned shadow_cycles = 0, idx;
+
+    shadow.icache_enable = false;
+    shadow.map = &jit->lockstep_map;
+
+    jit->n_undo = 0;
+    for (idx = 0; idx < blk->n_insts; idx++) {
+        struct arm7_decoded_inst decoded;
+        arm7_fetch_inst(&shadow, &decoded);
+        shadow_cycles += arm7_exec(&shadow, &decoded);
+    }
+
+    while (jit->n_undo) {
+        struct arm7_jit_undo const *undo = jit->undo + --jit->n_undo;
+        memory_map_write_32(arm7->map, undo->addr, undo->val);
+    }
+
+    unsigned cycles = arm7_jit_exec(jit, blk);
+
+    for (idx = 0; idx < ARM7_REGISTER_COUNT; idx++) {
+        if (arm7->reg[idx] != shadow.reg[idx]) {
+            char what[32];
+            snprintf(what, sizeof(what), "register index %u", idx);
+            arm7_jit_lockstep_fail(blk, what, arm7->reg[idx],
+                                   shadow.reg[idx]);
+        }
+    }
+
+    if (arm7->pipeline_full != shadow.pipeline_full) {
+        arm7_jit_lockstep_fail(blk, "pipeline_full",
+                               arm7->pipeline_full, shadow.pipeline_full);
+    }
+    if (arm7_pc_next(arm7) != arm7_pc_next(&shadow)) {
+        arm7_jit_lockstep_fail(blk, "the next pc",
+                               arm7_pc_next(arm7), arm7_pc_next(&shadow));
+    }
+
+    /*
+     * Only the SWI bit is compared because writes to the AICA's registers
+     * never reach them from the interpreter's copy (see
+     * arm7_jit_lockstep_write), so they can't raise an interrupt there.
+     */
+    if ((arm7->excp & ARM7_EXCP_SWI) != (shadow.excp & ARM7_EXCP_SWI)) {
+        arm7_jit_lockstep_fail(blk, "the SWI exception",
+                               arm7->excp, shadow.excp);
+    }
+    if (cycles != shadow_cycles)
+        arm7_jit_lockstep_fail(blk, "the cycle count", cycles, shadow_cycles);
+
+    jit->stats.n_lockstep_checks++;
+
+    return cycles;
+}
+
+unsigned arm7_jit_run(struct arm7_jit *jit) {
+    struct arm7 *arm7 = jit->arm7;
+    uint32_t pc;
+
+    arm7_check_excp(arm7);
+
+    if (arm7->pipeline_full)
+        pc = arm7->pipeline_pc[1];
+    else
+        pc = arm7->reg[ARM7_REG_PC];
+
+    if (pc > ARM7_JIT_ADDR_LAST || (pc & 3))
+        return arm7_jit_interp_step(jit);
+
+    struct arm7_jit_block *blk =
+        arm7_jit_get_block(jit, pc, arm7->reg[ARM7_REG_CPSR] & ARM7_CPSR_M_MASK);
+
+    if (!blk->n_insts)
+        return arm7_jit_interp_step(jit);
+
+    if (jit->lockstep)
+        return arm7_jit_run_lockstep(jit, blk);
+    return arm7_jit_exec(jit, blk);
+}
+
+void arm7_jit_get_stats(struct arm7_jit const *jit,
+                        struct arm7_jit_stats *stats) {
+    *stats = jit->stats;
+}
+
+void arm7_jit_print_stats(struct arm7_jit_stats const *stats) {
+    LOG_INFO("ARM7 jit: %llu blocks compiled, %llu recompiled after writes to "
+             "wave memory\n", stats->n_blocks, stats->n_recompiles);
+    LOG_INFO("ARM7 jit: %llu blocks executed, %llu instructions interpreted\n",
+             stats->n_blocks_run, stats->n_interp_steps);
+    if (stats->n_lockstep_checks) {
+        LOG_INFO("ARM7 jit: %llu blocks checked against the interpreter\n",
+                 stats->n_lockstep_checks);
+    }
+#ifdef JIT_OPTIMIZE
+    jit_opt_print_stats("ARM7", &stats->opt);
+#endif
+}
+
+/*
+ * memory interface for the interpreter's copy of the CPU in lockstep mode.
+ * Reads go to the real memory map.  Writes to wave memory also go to the real
+ * memory map, but the old value gets logged first so it can be restored before
+ * the block runs for real.  Writes to anything else are dropped since they
+ * would have side-effects; they only happen at the end of a block anyways
+ * (see arm7_jit_fallback_ends_block).
+ *
+ * Reads from the AICA's registers do happen twice in this mode, which is fine
+ * as long as they don't have side-effects.
+ */
+static void arm7_jit_lockstep_log(struct arm7_jit *jit, uint32_t addr) {
+    if (jit->n_undo >= ARM7_JIT_UNDO_LEN)
+        RAISE_ERROR(ERROR_OVERFLOW);
+    addr &= ~3;
+    jit->undo[jit->n_undo].addr = addr;
+    jit->undo[jit->n_undo].val = memory_map_read_32(jit->arm7->map, addr);
+    jit->n_undo++;
+}
+
+#define ARM7_JIT_LOCKSTEP_ACCESS(type, postfix)                         \
+    static type arm7_jit_lockstep_read##postfix(uint32_t addr,          \
+                                                void *ctxt) {           \
+        struct arm7_jit *jit = (struct arm7_jit*)ctxt;                  \
+        return memory_map_read##postfix(jit->arm7->map, addr);          \
+    }                                                                   \
+                                                                        \
+    static void arm7_jit_lockstep_write##postfix(uint32_t addr,         \
+                                                 type val,              \
+                                                 void *ctxt) {          \
+        struct arm7_jit *jit = (struct arm7_jit*)ctxt;                  \
+        if (addr > ARM7_JIT_ADDR_LAST)                                  \
+            return;                                                     \
+        arm7_jit_lockstep_log(jit, addr);                               \
+        if (sizeof(type) == 8)                                          \
+            arm7_jit_lockstep_log(jit, addr + 4);                       \
+        memory_map_write##postfix(jit->arm7->map, addr, val);           \
+    }
+
+ARM7_JIT_LOCKSTEP_ACCESS(uint8_t, _8)
+ARM7_JIT_LOCKSTEP_ACCESS(uint16_t, _16)
+ARM7_JIT_LOCKSTEP_ACCESS(uint32_t, _32)
+ARM7_JIT_LOCKSTEP_ACCESS(float, _float)
+ARM7_JIT_LOCKSTEP_ACCESS(double, _double)
+
+static struct memory_interface const arm7_jit_lockstep_intf = {
+    .readdouble = arm7_jit_lockstep_read_double,
+    .readfloat = arm7_jit_lockstep_read_float,
+    .read32 = arm7_jit_lockstep_read_32,
+    .read16 = arm7_jit_lockstep_read_16,
+    .read8 = arm7_jit_lockstep_read_8,
+
+    .writedouble = arm7_jit_lockstep_write_double,
+    .writefloat = arm7_jit_lockstep_write_float,
+    .write32 = arm7_jit_lockstep_write_32,
+    .write16 = arm7_jit_lockstep_write_16,
+    .write8 = arm7_jit_lockstep_write_8
+};
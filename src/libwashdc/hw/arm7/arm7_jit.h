@@ -0,0 +1,164 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef ARM7_JIT_H_
+#define ARM7_JIT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "washdc/MemoryMap.h"
+#include "jit/code_block.h"
+
+#ifdef JIT_OPTIMIZE
+#include "jit/jit_opt.h"
+#endif
+#include "arm7.h"
+
+#ifdef ENABLE_JIT_X86_64
+#include "jit/x86_64/native_dispatch.h"
+#endif
+
+/*
+ * Dynamic recompiler for the ARM7.  This translates basic blocks into jit_il
+ * and runs them on either the IL interpreter or the x86_64 backend, just like
+ * the SH4 does.
+ *
+ * The ARM7 can't share the SH4's code cache or dispatcher since both of those
+ * are singletons tied to the SH4, so it has its own hash table of blocks keyed
+ * on the PC and the CPU mode.  Blocks never cross a page of wave memory, and
+ * each block remembers the page's code_gen from when it was compiled; a block
+ * whose page has been written since then gets recompiled the next time it is
+ * looked up.
+ *
+ * Only the most common data-processing instructions and branches are
+ * translated directly.  Everything else is a JIT_OP_FALLBACK to the
+ * interpreter.
+ */
+
+// upper limit on the number of ARM7 instructions in a block
+#define ARM7_JIT_MAX_INSTS 64
+
+#define ARM7_JIT_HASH_SHIFT 12
+#define ARM7_JIT_HASH_LEN (1 << ARM7_JIT_HASH_SHIFT)
+#define ARM7_JIT_HASH_MASK (ARM7_JIT_HASH_LEN - 1)
+
+// maximum number of 32-bit words one block can write in lockstep mode
+#define ARM7_JIT_UNDO_LEN 64
+
+struct arm7_jit_block {
+    struct arm7_jit_block *next;
+
+    uint32_t pc;
+    uint32_t mode;
+
+    // inst_mem->code_gen of the block's page when it was compiled
+    uint32_t gen;
+
+    unsigned n_insts;
+    unsigned cycles;
+
+    /*
+     * if true, the block ended with a fallback which left the pc and pipeline
+     * the way the interpreter would.  Otherwise the block's return value is the
+     * new pc, and arm7_jit.flushed says whether the pipeline was flushed.
+     */
+    bool fallback_exit;
+
+    union jit_code_block code;
+};
+
+struct arm7_jit_stats {
+    unsigned long long n_blocks;
+    unsigned long long n_recompiles;
+    unsigned long long n_blocks_run;
+    unsigned long long n_interp_steps;
+    unsigned long long n_lockstep_checks;
+
+#ifdef JIT_OPTIMIZE
+    struct jit_opt_stats opt;
+#endif
+};
+
+struct arm7_jit_undo {
+    uint32_t addr;
+    uint32_t val;
+};
+
+struct arm7_jit {
+    struct arm7 *arm7;
+
+    bool native;
+    bool lockstep;
+
+    // written by blocks which end with a jump; see arm7_jit_block.fallback_exit
+    uint32_t flushed;
+
+    struct arm7_jit_block *tbl[ARM7_JIT_HASH_LEN];
+
+    struct arm7_jit_stats stats;
+
+#ifdef ENABLE_JIT_X86_64
+    native_dispatch_call_func call_native;
+#endif
+
+    /*
+     * In lockstep mode, every block is also run on the interpreter with a copy
+     * of the CPU state before the block runs for real, and then the two
+     * register files get compared.  The interpreter's copy goes through
+     * lockstep_map, which logs the old value of everything it writes to wave
+     * memory into undo so that the write can be rolled back.
+     */
+    struct memory_map lockstep_map;
+    struct arm7_jit_undo undo[ARM7_JIT_UNDO_LEN];
+    unsigned n_undo;
+};
+
+/*
+ * native requests the x86_64 backend; if it's false (or WashingtonDC was built
+ * without ENABLE_JIT_X86_64) the IL interpreter gets used instead.
+ */
+void arm7_jit_init(struct arm7_jit *jit, struct arm7 *arm7,
+                   bool native, bool lockstep);
+void arm7_jit_cleanup(struct arm7_jit *jit);
+
+/*
+ * Run one block (or one instruction if there's no block for the current pc)
+ * and return the number of ARM7 cycles it took.  Like arm7_fetch_inst, this
+ * handles pending exceptions first.
+ */
+unsigned arm7_jit_run(struct arm7_jit *jit);
+
+/*
+ * translate the block at blk->pc (in mode blk->mode) into jit_il without
+ * compiling it for either backend.  This also fills in the rest of blk except
+ * for blk->code.  arm7_jit_run does this itself; this is exposed for
+ * src/bench/jit_compile_bench.
+ */
+void arm7_jit_translate(struct arm7_jit *jit, struct arm7_jit_block *blk,
+                        struct il_code_block *il);
+
+void arm7_jit_get_stats(struct arm7_jit const *jit,
+                        struct arm7_jit_stats *stats);
+void arm7_jit_print_stats(struct arm7_jit_stats const *stats);
+
+#endif
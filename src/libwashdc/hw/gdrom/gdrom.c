@@ -198,6 +198,17 @@ struct gdrom_bufq_node {
     uint8_t dat[GDROM_BUFQ_LEN];
 };
 
+// bufq nodes get allocated this many at a time
+#define GDROM_BUFQ_SLAB_LEN 64
+
+struct gdrom_bufq_slab {
+    struct gdrom_bufq_slab *next;
+    struct gdrom_bufq_node nodes[GDROM_BUFQ_SLAB_LEN];
+};
+
+// number of sectors gdrom_input_read_packet asks the mount layer for at once
+#define GDROM_READ_BATCH 32
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // ATA commands
@@ -380,6 +391,7 @@ void gdrom_init(struct gdrom_ctxt *gdrom, struct dc_clock *gdrom_clk) {
     gdrom->data_byte_count = GDROM_DATA_BYTE_COUNT_DEFAULT;
 
     fifo_init(&gdrom->bufq);
+    fifo_init(&gdrom->bufq_pool);
 
     gdrom_reg_init(gdrom);
 }
@@ -425,12 +437,43 @@ void gdrom_reg_cleanup(struct gdrom_ctxt *gdrom) {
 
 void gdrom_cleanup(struct gdrom_ctxt *gdrom) {
     gdrom_reg_cleanup(gdrom);
+
+    while (gdrom->bufq_slabs) {
+        struct gdrom_bufq_slab *next = gdrom->bufq_slabs->next;
+        free(gdrom->bufq_slabs);
+        gdrom->bufq_slabs = next;
+    }
+    fifo_init(&gdrom->bufq);
+    fifo_init(&gdrom->bufq_pool);
+}
+
+static struct gdrom_bufq_node *bufq_node_alloc(struct gdrom_ctxt *gdrom) {
+    if (fifo_empty(&gdrom->bufq_pool)) {
+        struct gdrom_bufq_slab *slab =
+            (struct gdrom_bufq_slab*)malloc(sizeof(struct gdrom_bufq_slab));
+        if (!slab)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        slab->next = gdrom->bufq_slabs;
+        gdrom->bufq_slabs = slab;
+
+        unsigned idx;
+        for (idx = 0; idx < GDROM_BUFQ_SLAB_LEN; idx++)
+            fifo_push(&gdrom->bufq_pool, &slab->nodes[idx].fifo_node);
+    }
+
+    return &FIFO_DEREF(fifo_pop(&gdrom->bufq_pool),
+                       struct gdrom_bufq_node, fifo_node);
+}
+
+static void bufq_node_free(struct gdrom_ctxt *gdrom,
+                           struct gdrom_bufq_node *node) {
+    fifo_push(&gdrom->bufq_pool, &node->fifo_node);
 }
 
 static void bufq_clear(struct gdrom_ctxt *gdrom) {
     while (!fifo_empty(&gdrom->bufq)) {
-        free(&FIFO_DEREF(fifo_pop(&gdrom->bufq),
-                         struct gdrom_bufq_node, fifo_node));
+        bufq_node_free(gdrom, &FIFO_DEREF(fifo_pop(&gdrom->bufq),
+                                          struct gdrom_bufq_node, fifo_node));
     }
 }
 
@@ -445,7 +488,7 @@ static int bufq_consume_byte(struct gdrom_ctxt *gdrom, unsigned *byte) {
 
         if (bufq_node->idx >= bufq_node->len) {
             fifo_pop(&gdrom->bufq);
-            free(bufq_node);
+            bufq_node_free(gdrom, bufq_node);
         }
 
         return 0;
@@ -503,7 +546,7 @@ static void gdrom_complete_dma(struct gdrom_ctxt *gdrom) {
 
     chunk_finished:
         addr += chunk_sz;
-        free(bufq_node);
+        bufq_node_free(gdrom, bufq_node);
     }
 
 done:
@@ -562,18 +605,15 @@ static void gdrom_input_read_packet(struct gdrom_ctxt *gdrom) {
     if (!gdrom->feat_reg.dma_enable && gdrom->data_byte_count > UINT16_MAX)
         LOG_WARN("OVERFLOW: Reading %u bytes from gdrom PIO!\n", gdrom->data_byte_count);
 
-    unsigned fad_offs = 0;
-    while (trans_len--) {
-        struct gdrom_bufq_node *node =
-            (struct gdrom_bufq_node*)malloc(sizeof(struct gdrom_bufq_node));
-
-        if (!node)
-            RAISE_ERROR(ERROR_FAILED_ALLOC);
-
-        if (mount_read_sectors(node->dat, start_addr + fad_offs++, 1) < 0) {
-            LOG_ERROR("GD-ROM failed to read fad %u\n", fad_offs);
+    static uint8_t read_buf[GDROM_READ_BATCH * CDROM_FRAME_DATA_SIZE];
+    unsigned fad = start_addr;
+    while (trans_len) {
+        unsigned batch_len = trans_len < GDROM_READ_BATCH ?
+            trans_len : GDROM_READ_BATCH;
 
-            free(node);
+        if (mount_read_sectors(read_buf, fad, batch_len) < 0) {
+            LOG_ERROR("GD-ROM failed to read %u sectors from fad %u\n",
+                      batch_len, fad);
 
             gdrom->error_reg.sense_key = SENSE_KEY_ILLEGAL_REQ;
             gdrom->stat_reg.check = true;
@@ -581,10 +621,20 @@ static void gdrom_input_read_packet(struct gdrom_ctxt *gdrom) {
             return;
         }
 
-        node->idx = 0;
-        node->len = CDROM_FRAME_DATA_SIZE;
+        unsigned sector_no;
+        for (sector_no = 0; sector_no < batch_len; sector_no++) {
+            struct gdrom_bufq_node *node = bufq_node_alloc(gdrom);
 
-        fifo_push(&gdrom->bufq, &node->fifo_node);
+            memcpy(node->dat, read_buf + sector_no * CDROM_FRAME_DATA_SIZE,
+                   CDROM_FRAME_DATA_SIZE);
+            node->idx = 0;
+            node->len = CDROM_FRAME_DATA_SIZE;
+
+            fifo_push(&gdrom->bufq, &node->fifo_node);
+        }
+
+        fad += batch_len;
+        trans_len -= batch_len;
     }
 
     if (gdrom->feat_reg.dma_enable) {
@@ -730,11 +780,7 @@ void gdrom_cmd_identify(struct gdrom_ctxt *gdrom) {
 
     bufq_clear(gdrom);
 
-    struct gdrom_bufq_node *node =
-        (struct gdrom_bufq_node*)malloc(sizeof(struct gdrom_bufq_node));
-
-    if (!node)
-        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    struct gdrom_bufq_node *node = bufq_node_alloc(gdrom);
 
     node->idx = 0;
     node->len = GDROM_IDENT_RESP_LEN;
@@ -813,8 +859,7 @@ static void gdrom_input_req_error_packet(struct gdrom_ctxt *gdrom) {
 
     unsigned byte_count;
     if (len != 0) {
-        struct gdrom_bufq_node *node =
-            (struct gdrom_bufq_node*)malloc(sizeof(struct gdrom_bufq_node));
+        struct gdrom_bufq_node *node = bufq_node_alloc(gdrom);
         node->idx = 0;
         node->len = len;
         memcpy(&node->dat, dat_out, len);
@@ -872,8 +917,7 @@ static void gdrom_input_packet_71(struct gdrom_ctxt *gdrom) {
 
     bufq_clear(gdrom);
 
-    struct gdrom_bufq_node *node =
-        (struct gdrom_bufq_node*)malloc(sizeof(struct gdrom_bufq_node));
+    struct gdrom_bufq_node *node = bufq_node_alloc(gdrom);
     node->idx = 0;
     node->len = GDROM_PKT_71_RESP_LEN;
 
@@ -934,8 +978,7 @@ static void gdrom_input_req_mode_packet(struct gdrom_ctxt *gdrom) {
         if (last_idx > (GDROM_REQ_MODE_RESP_LEN - 1))
             last_idx = GDROM_REQ_MODE_RESP_LEN - 1;
 
-        struct gdrom_bufq_node *node =
-            (struct gdrom_bufq_node*)malloc(sizeof(struct gdrom_bufq_node));
+        struct gdrom_bufq_node *node = bufq_node_alloc(gdrom);
 
         node->idx = 0;
         node->len = last_idx - first_idx + 1;
@@ -967,8 +1010,7 @@ static void gdrom_input_read_toc_packet(struct gdrom_ctxt *gdrom) {
     mount_read_toc(&toc, session);
 
     bufq_clear(gdrom);
-    struct gdrom_bufq_node *node =
-        (struct gdrom_bufq_node*)malloc(sizeof(struct gdrom_bufq_node));
+    struct gdrom_bufq_node *node = bufq_node_alloc(gdrom);
 
     uint8_t const *ptr = mount_encode_toc(&toc);
 
@@ -993,8 +1035,7 @@ static void gdrom_input_read_subcode_packet(struct gdrom_ctxt *gdrom) {
 
 
     bufq_clear(gdrom);
-    struct gdrom_bufq_node *node =
-        (struct gdrom_bufq_node*)malloc(sizeof(struct gdrom_bufq_node));
+    struct gdrom_bufq_node *node = bufq_node_alloc(gdrom);
 
     node->idx = 0;
     node->len = len;
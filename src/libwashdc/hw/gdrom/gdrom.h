@@ -193,6 +193,13 @@ struct gdrom_ctxt {
     unsigned n_bytes_received;
 
     struct fifo_head bufq;
+
+    /*
+     * bufq nodes which aren't in use.  These come from bufq_slabs and are
+     * never freed until gdrom_cleanup.
+     */
+    struct fifo_head bufq_pool;
+    struct gdrom_bufq_slab *bufq_slabs;
 };
 
 /*
@@ -33,6 +33,7 @@
 #include <stdbool.h>
 
 #include "washdc/error.h"
+#include "washdc/config_file.h"
 #include "gfx/gfx.h"
 #include "hw/sys/holly_intc.h"
 #include "pvr2_tex_mem.h"
@@ -152,7 +153,8 @@ char const *display_list_names[DISPLAY_LIST_COUNT] = {
     "Unknown Display list 7"
 };
 
-static void input_poly_fifo(struct pvr2 *pvr2, uint8_t byte);
+static void
+input_poly_fifo(struct pvr2 *pvr2, void const *src, unsigned n_bytes);
 
 // this function gets called every time a full packet is received by the TA
 static int decode_packet(struct pvr2 *pvr2, struct pvr2_pkt *pkt);
@@ -176,7 +178,7 @@ static int decode_user_clip(struct pvr2 *pvr2, struct pvr2_pkt *pkt);
 static void ta_fifo_finish_packet(struct pvr2_ta *ta);
 
 static void unpack_uv16(float *u_coord, float *v_coord, void const *input);
-static void unpack_rgba_8888(uint32_t const *ta_fifo32, float *rgba, uint32_t input);
+static void update_unpack_fmt(struct pvr2_ta *ta);
 
 /*
  * the delay between when the STARTRENDER command is received and when the
@@ -211,6 +213,9 @@ static void pvr2_trans_complete_int_event_handler(struct SchedEvent *event);
 static void pvr2_trans_mod_complete_int_event_handler(struct SchedEvent *event);
 static void pvr2_pt_complete_int_event_handler(struct SchedEvent *event);
 
+// see pvr2_ta_capture_open
+static FILE *capture_fp;
+
 #define PVR2_TA_VERT_BUF_LEN (1024 * 1024)
 
 #define PVR2_GFX_IL_INST_BUF_LEN (1024 * 256)
@@ -250,10 +255,28 @@ void pvr2_ta_init(struct pvr2 *pvr2) {
     pvr2->ta.pvr2_ta_vert_buf_count = 0;
     pvr2->ta.pvr2_ta_vert_cur_group = 0;
 
+    pvr2_ta_unpack_init();
+    update_unpack_fmt(ta);
+
+    pvr2_ta_batch_init(&ta->batch);
+    bool batch_draws;
+    if (cfg_get_bool("gfx.rend.batch-draws", &batch_draws) == 0 &&
+        !batch_draws) {
+        LOG_INFO("PVR2 TA draw batching is disabled\n");
+        ta->batch.enable = false;
+    }
+    bool batch_reorder;
+    if (cfg_get_bool("gfx.rend.batch-reorder", &batch_reorder) == 0 &&
+        batch_reorder) {
+        LOG_INFO("PVR2 TA draw reordering is enabled\n");
+        ta->batch.reorder = true;
+    }
+
     render_frame_init(pvr2);
 }
 
 void pvr2_ta_cleanup(struct pvr2 *pvr2) {
+    pvr2_ta_batch_cleanup(&pvr2->ta.batch);
     free(pvr2->ta.gfx_il_inst_buf);
     free(pvr2->ta.pvr2_ta_vert_buf);
     pvr2->ta.pvr2_ta_vert_buf = NULL;
@@ -316,16 +339,15 @@ void pvr2_ta_fifo_poly_write_32(addr32_t addr, uint32_t val, void *ctxt) {
     struct pvr2 *pvr2 = (struct pvr2*)ctxt;
     PVR2_TRACE("writing 4 bytes to TA polygon FIFO: 0x%08x\n", (unsigned)val);
 
-    uint8_t bytes[4] = {
-        val & 0xff,
-        (val >> 8) & 0xff,
-        (val >> 16) & 0xff,
-        (val >> 24) & 0xff
-    };
-    input_poly_fifo(pvr2, bytes[0]);
-    input_poly_fifo(pvr2, bytes[1]);
-    input_poly_fifo(pvr2, bytes[2]);
-    input_poly_fifo(pvr2, bytes[3]);
+    input_poly_fifo(pvr2, &val, sizeof(val));
+}
+
+void pvr2_ta_fifo_poly_write_burst32(addr32_t addr, uint32_t const *src,
+                                     unsigned n_words, void *ctxt) {
+    struct pvr2 *pvr2 = (struct pvr2*)ctxt;
+    PVR2_TRACE("writing %u words to TA polygon FIFO\n", n_words);
+
+    input_poly_fifo(pvr2, src, n_words * sizeof(*src));
 }
 
 uint16_t pvr2_ta_fifo_poly_read_16(addr32_t addr, void *ctxt) {
@@ -342,12 +364,7 @@ void pvr2_ta_fifo_poly_write_16(addr32_t addr, uint16_t val, void *ctxt) {
     LOG_DBG("WARNING: writing 2 bytes to TA polygon FIFO: 0x%04x\n",
             (unsigned)val);
 #endif
-    uint8_t bytes[2] = {
-        val & 0xff,
-        (val >> 8) & 0xff,
-    };
-    input_poly_fifo(pvr2, bytes[0]);
-    input_poly_fifo(pvr2, bytes[1]);
+    input_poly_fifo(pvr2, &val, sizeof(val));
 }
 
 
@@ -365,7 +382,7 @@ void pvr2_ta_fifo_poly_write_8(addr32_t addr, uint8_t val, void *ctxt) {
     LOG_DBG("WARNING: writing 1 byte to TA polygon FIFO: 0x%02x\n",
             (unsigned)val);
 #endif
-    input_poly_fifo(pvr2, val);
+    input_poly_fifo(pvr2, &val, sizeof(val));
 }
 
 float pvr2_ta_fifo_poly_read_float(addr32_t addr, void *ctxt) {
@@ -526,6 +543,8 @@ static void on_pkt_hdr_received(struct pvr2 *pvr2, struct pvr2_pkt const *pkt) {
         PVR2_TRACE("textures are NOT enabled\n");
         /* poly_state.tex_enable = false; */
     }
+
+    update_unpack_fmt(ta);
 }
 
 static void
@@ -885,19 +904,58 @@ static void handle_packet(struct pvr2 *pvr2, struct pvr2_pkt const *pkt) {
     }
 }
 
-static void input_poly_fifo(struct pvr2 *pvr2, uint8_t byte) {
+/*
+ * The TA only looks at its FIFO in 32-byte chunks, so writes get copied in up
+ * to the next 32-byte boundary at a time and a packet is decoded every time
+ * one of those fills up.  Store-queue flushes and DMA bursts arrive as whole
+ * chunks, so they only need one copy per chunk.
+ */
+static void
+input_poly_fifo(struct pvr2 *pvr2, void const *src, unsigned n_bytes) {
     struct pvr2_ta *ta = &pvr2->ta;
-    ta->ta_fifo[ta->ta_fifo_byte_count++] = byte;
-
-    if (!(ta->ta_fifo_byte_count % 32)) {
-        struct pvr2_pkt pkt;
-        if (decode_packet(pvr2, &pkt) == 0) {
-            handle_packet(pvr2, &pkt);
-            ta_fifo_finish_packet(ta);
+    uint8_t const *src8 = (uint8_t const*)src;
+
+    if (capture_fp)
+        fwrite(src, 1, n_bytes, capture_fp);
+
+    while (n_bytes) {
+        unsigned chunk_len = 32 - ta->ta_fifo_byte_count % 32;
+        if (chunk_len > n_bytes)
+            chunk_len = n_bytes;
+
+        memcpy(ta->ta_fifo + ta->ta_fifo_byte_count, src8, chunk_len);
+        ta->ta_fifo_byte_count += chunk_len;
+        src8 += chunk_len;
+        n_bytes -= chunk_len;
+
+        if (!(ta->ta_fifo_byte_count % 32)) {
+            struct pvr2_pkt pkt;
+            if (decode_packet(pvr2, &pkt) == 0) {
+                handle_packet(pvr2, &pkt);
+                ta_fifo_finish_packet(ta);
+            }
         }
     }
 }
 
+void pvr2_ta_capture_open(char const *path) {
+    pvr2_ta_capture_close();
+
+    capture_fp = fopen(path, "wb");
+    if (!capture_fp) {
+        LOG_ERROR("%s - failed to open \"%s\"\n", __func__, path);
+        return;
+    }
+    LOG_INFO("recording TA FIFO capture to \"%s\"\n", path);
+}
+
+void pvr2_ta_capture_close(void) {
+    if (capture_fp) {
+        fclose(capture_fp);
+        capture_fp = NULL;
+    }
+}
+
 static void dump_fifo(struct pvr2 *pvr2) {
 #ifdef ENABLE_LOG_DEBUG
     unsigned idx;
@@ -968,156 +1026,74 @@ static int decode_vtx(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
         RAISE_ERROR(ERROR_INTEGRITY);
     }
 
+    // this is not supported, AFAIK
+    if (ta->hdr.two_volumes_mode && ta->hdr.ta_color_fmt == TA_COLOR_TYPE_FLOAT)
+        RAISE_ERROR(ERROR_UNIMPLEMENTED);
+
     pkt->tp = PVR2_PKT_VTX;
     struct pvr2_pkt_vtx *vtx = &pkt->dat.vtx;
 
     vtx->end_of_strip = (bool)(ta_fifo32[0] & TA_CMD_END_OF_STRIP_MASK);
 
-    memcpy(vtx->pos, ta_fifo32 + 1, 3 * sizeof(float));
+    pvr2_ta_unpack_vtx(vtx, ta_fifo32, &ta->unpack_fmt);
 
-    if (ta->hdr.tex_enable) {
-        if (ta->hdr.tex_coord_16_bit_enable)
-            unpack_uv16(vtx->uv, vtx->uv + 1, ta_fifo32 + 4);
-        else
-            memcpy(vtx->uv, ta_fifo32 + 4, 2 * sizeof(float));
-    }
+    return 0;
+}
 
-    if (ta->hdr.two_volumes_mode) {
-        switch (ta->hdr.ta_color_fmt) {
-        case TA_COLOR_TYPE_PACKED:
-            if (ta->hdr.tex_enable)
-                unpack_rgba_8888(ta_fifo32, vtx->base_color, ta_fifo32[6]);
-            else
-                unpack_rgba_8888(ta_fifo32, vtx->base_color, ta_fifo32[4]);
-            if (ta->hdr.offset_color_enable && ta->hdr.tex_enable) {
-                unpack_rgba_8888(ta_fifo32, vtx->offs_color, ta_fifo32[7]);
-            } else {
-                vtx->offs_color[0] = 0.0f;
-                vtx->offs_color[1] = 0.0f;
-                vtx->offs_color[2] = 0.0f;
-                vtx->offs_color[3] = 0.0f;
-            }
-            break;
-        case TA_COLOR_TYPE_INTENSITY_MODE_1:
-        case TA_COLOR_TYPE_INTENSITY_MODE_2:
-            {
-                float base_intensity, offs_intensity;
-                if (ta->hdr.tex_enable) {
-                    memcpy(&base_intensity, ta_fifo32 + 6, sizeof(float));
-                    memcpy(&offs_intensity, ta_fifo32 + 7, sizeof(float));
-                } else {
-                    memcpy(&base_intensity, ta_fifo32 + 4, sizeof(float));
-                    memcpy(&offs_intensity, ta_fifo32 + 5, sizeof(float));
-                }
-                vtx->base_color[0] =
-                    base_intensity * ta->poly_base_color_rgba[0];
-                vtx->base_color[1] =
-                    base_intensity * ta->poly_base_color_rgba[1];
-                vtx->base_color[2] =
-                    base_intensity * ta->poly_base_color_rgba[2];
-                vtx->base_color[3] = ta->poly_base_color_rgba[3];
-                if (ta->hdr.offset_color_enable) {
-                    vtx->offs_color[0] =
-                        offs_intensity * ta->poly_offs_color_rgba[0];
-                    vtx->offs_color[1] =
-                        offs_intensity * ta->poly_offs_color_rgba[1];
-                    vtx->offs_color[2] =
-                        offs_intensity * ta->poly_offs_color_rgba[2];
-                    vtx->offs_color[3] = ta->poly_offs_color_rgba[3];
-                } else {
-                    vtx->offs_color[0] = 0.0f;
-                    vtx->offs_color[1] = 0.0f;
-                    vtx->offs_color[2] = 0.0f;
-                    vtx->offs_color[3] = 0.0f;
-                }
-            }
-            break;
-        case TA_COLOR_TYPE_FLOAT:
-            // this is not supported, AFAIK
-        default:
-            RAISE_ERROR(ERROR_UNIMPLEMENTED);
+/*
+ * figure out where decode_vtx will find each field of the vertices that
+ * follow the current header.  This needs to be called whenever ta->hdr or the
+ * intensity-mode colors change.
+ */
+static void update_unpack_fmt(struct pvr2_ta *ta) {
+    struct pvr2_pkt_hdr const *hdr = &ta->hdr;
+    struct pvr2_ta_unpack_fmt *fmt = &ta->unpack_fmt;
+
+    fmt->uv_idx = hdr->tex_enable ? 4 : 0;
+    fmt->uv16 = hdr->tex_coord_16_bit_enable;
+
+    memcpy(fmt->intensity_color, ta->poly_base_color_rgba,
+           sizeof(ta->poly_base_color_rgba));
+    memcpy(fmt->intensity_color + 4, ta->poly_offs_color_rgba,
+           sizeof(ta->poly_offs_color_rgba));
+
+    switch (hdr->ta_color_fmt) {
+    case TA_COLOR_TYPE_PACKED:
+        fmt->col_tp = PVR2_TA_UNPACK_COL_PACKED;
+        if (hdr->two_volumes_mode) {
+            fmt->base_idx = hdr->tex_enable ? 6 : 4;
+            fmt->offs_idx =
+                (hdr->offset_color_enable && hdr->tex_enable) ? 7 : 0;
+        } else {
+            fmt->base_idx = 6;
+            fmt->offs_idx = hdr->offset_color_enable ? 7 : 0;
         }
-    } else {
-        switch (ta->hdr.ta_color_fmt) {
-        case TA_COLOR_TYPE_PACKED:
-            unpack_rgba_8888(ta_fifo32, vtx->base_color, ta_fifo32[6]);
-            if (ta->hdr.offset_color_enable) {
-                unpack_rgba_8888(ta_fifo32, vtx->offs_color, ta_fifo32[7]);
-            } else {
-                vtx->offs_color[0] = 0.0f;
-                vtx->offs_color[1] = 0.0f;
-                vtx->offs_color[2] = 0.0f;
-                vtx->offs_color[3] = 0.0f;
-            }
-            break;
-        case TA_COLOR_TYPE_FLOAT:
-            if (ta->hdr.tex_enable) {
-                memcpy(vtx->base_color + 3, ta_fifo32 + 8, sizeof(float));
-                memcpy(vtx->base_color + 0, ta_fifo32 + 9, sizeof(float));
-                memcpy(vtx->base_color + 1, ta_fifo32 + 10, sizeof(float));
-                memcpy(vtx->base_color + 2, ta_fifo32 + 11, sizeof(float));
-                if (ta->hdr.offset_color_enable) {
-                    memcpy(vtx->offs_color + 3, ta_fifo32 + 12,
-                           sizeof(float));
-                    memcpy(vtx->offs_color + 0, ta_fifo32 + 13,
-                           sizeof(float));
-                    memcpy(vtx->offs_color + 1, ta_fifo32 + 14,
-                           sizeof(float));
-                    memcpy(vtx->offs_color + 2, ta_fifo32 + 15,
-                           sizeof(float));
-                } else {
-                    vtx->offs_color[0] = 0.0f;
-                    vtx->offs_color[1] = 0.0f;
-                    vtx->offs_color[2] = 0.0f;
-                    vtx->offs_color[3] = 0.0f;
-                }
-            } else {
-                memcpy(vtx->base_color + 3, ta_fifo32 + 4, sizeof(float));
-                memcpy(vtx->base_color + 0, ta_fifo32 + 5, sizeof(float));
-                memcpy(vtx->base_color + 1, ta_fifo32 + 6, sizeof(float));
-                memcpy(vtx->base_color + 2, ta_fifo32 + 7, sizeof(float));
-
-                vtx->offs_color[0] = 0.0f;
-                vtx->offs_color[1] = 0.0f;
-                vtx->offs_color[2] = 0.0f;
-                vtx->offs_color[3] = 0.0f;
-            }
-            break;
-        case TA_COLOR_TYPE_INTENSITY_MODE_1:
-        case TA_COLOR_TYPE_INTENSITY_MODE_2:
-            {
-                float base_intensity, offs_intensity;
-                memcpy(&base_intensity, ta_fifo32 + 6, sizeof(float));
-                memcpy(&offs_intensity, ta_fifo32 + 7, sizeof(float));
-                vtx->base_color[0] =
-                    base_intensity * ta->poly_base_color_rgba[0];
-                vtx->base_color[1] =
-                    base_intensity * ta->poly_base_color_rgba[1];
-                vtx->base_color[2] =
-                    base_intensity * ta->poly_base_color_rgba[2];
-                vtx->base_color[3] = ta->poly_base_color_rgba[3];
-                if (ta->hdr.offset_color_enable) {
-                    vtx->offs_color[0] =
-                        offs_intensity * ta->poly_offs_color_rgba[0];
-                    vtx->offs_color[1] =
-                        offs_intensity * ta->poly_offs_color_rgba[1];
-                    vtx->offs_color[2] =
-                        offs_intensity * ta->poly_offs_color_rgba[2];
-                    vtx->offs_color[3] = ta->poly_offs_color_rgba[3];
-                } else {
-                    vtx->offs_color[0] = 0.0f;
-                    vtx->offs_color[1] = 0.0f;
-                    vtx->offs_color[2] = 0.0f;
-                    vtx->offs_color[3] = 0.0f;
-                }
-            }
-            break;
-        default:
-            RAISE_ERROR(ERROR_INTEGRITY);
+        break;
+    case TA_COLOR_TYPE_FLOAT:
+        // decode_vtx refuses two-volumes float vertices
+        fmt->col_tp = PVR2_TA_UNPACK_COL_FLOAT;
+        if (hdr->tex_enable) {
+            fmt->base_idx = 8;
+            fmt->offs_idx = hdr->offset_color_enable ? 12 : 0;
+        } else {
+            fmt->base_idx = 4;
+            fmt->offs_idx = 0;
         }
+        break;
+    case TA_COLOR_TYPE_INTENSITY_MODE_1:
+    case TA_COLOR_TYPE_INTENSITY_MODE_2:
+        fmt->col_tp = PVR2_TA_UNPACK_COL_INTENSITY;
+        if (hdr->two_volumes_mode && !hdr->tex_enable) {
+            fmt->base_idx = 4;
+            fmt->offs_idx = hdr->offset_color_enable ? 5 : 0;
+        } else {
+            fmt->base_idx = 6;
+            fmt->offs_idx = hdr->offset_color_enable ? 7 : 0;
+        }
+        break;
+    default:
+        RAISE_ERROR(ERROR_INTEGRITY);
     }
-
-    return 0;
 }
 
 static int decode_user_clip(struct pvr2 *pvr2, struct pvr2_pkt *pkt) {
@@ -1353,18 +1329,6 @@ static void unpack_uv16(float *u_coord, float *v_coord, void const *input) {
     memcpy(v_coord, &v_val, sizeof(*v_coord));
 }
 
-static void unpack_rgba_8888(uint32_t const *ta_fifo32, float *rgba, uint32_t input) {
-    float alpha = (float)((ta_fifo32[6] & 0xff000000) >> 24) / 255.0f;
-    float red = (float)((ta_fifo32[6] & 0x00ff0000) >> 16) / 255.0f;
-    float green = (float)((ta_fifo32[6] & 0x0000ff00) >> 8) / 255.0f;
-    float blue = (float)((ta_fifo32[6] & 0x000000ff) >> 0) / 255.0f;
-
-    rgba[0] = red;
-    rgba[1] = green;
-    rgba[2] = blue;
-    rgba[3] = alpha;
-}
-
 static void
 pvr2_op_complete_int_event_handler(struct SchedEvent *event) {
     struct pvr2_ta *ta = &((struct pvr2*)event->arg_ptr)->ta;
@@ -1548,9 +1512,14 @@ void pvr2_ta_startrender(struct pvr2 *pvr2) {
             }
         }
         struct gfx_il_inst_chain *chain = ta->disp_list_begin[list];
-        while (chain) {
-            rend_exec_il(&chain->cmd, 1);
-            chain = chain->next;
+        if (list == DISPLAY_LIST_OPAQUE ||
+            list == DISPLAY_LIST_PUNCH_THROUGH) {
+            pvr2_ta_batch_exec(&ta->batch, chain);
+        } else {
+            while (chain) {
+                rend_exec_il(&chain->cmd, 1);
+                chain = chain->next;
+            }
         }
         if (sort_mode) {
             cmd.op = GFX_IL_END_DEPTH_SORT;
@@ -1563,6 +1532,8 @@ void pvr2_ta_startrender(struct pvr2 *pvr2) {
     cmd.arg.end_rend.rend_tgt_obj = tgt;
     rend_exec_il(&cmd, 1);
 
+    pvr2_ta_batch_end_frame(&ta->batch);
+
     ta->next_frame_stamp++;
     render_frame_init(pvr2);
 
@@ -1681,6 +1652,7 @@ static void finish_poly_group(struct pvr2 *pvr2, enum display_list_type disp_lis
 
 static void ta_fifo_finish_packet(struct pvr2_ta *ta) {
     ta->ta_fifo_byte_count = 0;
+    ta->pkt_count++;
 }
 
 static void render_frame_init(struct pvr2 *pvr2) {
@@ -1691,6 +1663,7 @@ static void render_frame_init(struct pvr2 *pvr2) {
     ta->pvr2_ta_vert_cur_group = 0;
 
     ta->open_group = false;
+    ta->pkt_count = 0;
 
     // free up gfx_il commands
     ta->gfx_il_inst_buf_count = 0;
@@ -1713,6 +1686,10 @@ unsigned get_cur_frame_stamp(struct pvr2 *pvr2) {
     return pvr2->ta.next_frame_stamp;
 }
 
+void pvr2_ta_get_batch_stat(struct pvr2 *pvr2, struct pvr2_ta_batch_stat *stat) {
+    pvr2_ta_batch_get_stat(&pvr2->ta.batch, stat);
+}
+
 struct memory_interface pvr2_ta_fifo_intf = {
     .readdouble = pvr2_ta_fifo_poly_read_double,
     .readfloat = pvr2_ta_fifo_poly_read_float,
@@ -1724,5 +1701,7 @@ struct memory_interface pvr2_ta_fifo_intf = {
     .writefloat = pvr2_ta_fifo_poly_write_float,
     .write32 = pvr2_ta_fifo_poly_write_32,
     .write16 = pvr2_ta_fifo_poly_write_16,
-    .write8 = pvr2_ta_fifo_poly_write_8
+    .write8 = pvr2_ta_fifo_poly_write_8,
+
+    .write_burst32 = pvr2_ta_fifo_poly_write_burst32
 };
@@ -32,6 +32,9 @@
 #include "gfx/gfx.h"
 #include "gfx/gfx_il.h"
 
+#include "pvr2_ta_unpack.h"
+#include "pvr2_ta_batch.h"
+
 struct pvr2;
 
 // texture control word
@@ -106,6 +109,8 @@ double pvr2_ta_fifo_poly_read_double(addr32_t addr, void *ctxt);
 void pvr2_ta_fifo_poly_write_double(addr32_t addr, double val, void *ctxt);
 uint32_t pvr2_ta_fifo_poly_read_32(addr32_t addr, void *ctxt);
 void pvr2_ta_fifo_poly_write_32(addr32_t addr, uint32_t val, void *ctxt);
+void pvr2_ta_fifo_poly_write_burst32(addr32_t addr, uint32_t const *src,
+                                     unsigned n_words, void *ctxt);
 uint16_t pvr2_ta_fifo_poly_read_16(addr32_t addr, void *ctxt);
 void pvr2_ta_fifo_poly_write_16(addr32_t addr, uint16_t val, void *ctxt);
 uint8_t pvr2_ta_fifo_poly_read_8(addr32_t addr, void *ctxt);
@@ -121,9 +126,19 @@ void pvr2_ta_startrender(struct pvr2 *pvr2);
  */
 void pvr2_ta_reinit(struct pvr2 *pvr2);
 
+/*
+ * TA FIFO captures.  While a capture is open, every byte written to the TA's
+ * polygon FIFO gets appended to the capture file exactly as it was received.
+ * src/bench/ta_fifo_bench replays these.
+ */
+void pvr2_ta_capture_open(char const *path);
+void pvr2_ta_capture_close(void);
+
 void pvr2_ta_init(struct pvr2 *pvr2);
 void pvr2_ta_cleanup(struct pvr2 *pvr2);
 
+void pvr2_ta_get_batch_stat(struct pvr2 *pvr2, struct pvr2_ta_batch_stat *stat);
+
 unsigned get_cur_frame_stamp(struct pvr2 *pvr2);
 
 /*
@@ -279,6 +294,9 @@ struct pvr2_ta {
     uint8_t ta_fifo[PVR2_CMD_MAX_LEN];
     unsigned ta_fifo_byte_count;
 
+    // packets decoded since the last STARTRENDER
+    unsigned pkt_count;
+
     bool list_submitted[DISPLAY_LIST_COUNT];
 
     struct pvr2_pkt_hdr hdr;
@@ -324,6 +342,12 @@ struct pvr2_ta {
     float sprite_base_color_rgba[4];
     float sprite_offs_color_rgba[4];
 
+    // vertex layout for the current polygon header, see update_unpack_fmt
+    struct pvr2_ta_unpack_fmt unpack_fmt;
+
+    // merges draws in the opaque and punch-through lists, see pvr2_ta_batch.h
+    struct pvr2_ta_batch batch;
+
     struct SchedEvent pvr2_render_complete_int_event,
         pvr2_op_complete_int_event,
         pvr2_op_mod_complete_int_event,
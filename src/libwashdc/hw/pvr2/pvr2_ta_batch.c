@@ -0,0 +1,298 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "washdc/error.h"
+#include "gfx/gfx.h"
+#include "gfx/gfx_il.h"
+#include "pvr2_ta.h"
+
+#include "pvr2_ta_batch.h"
+
+#define PVR2_TA_BATCH_INITIAL_DRAWS 1024
+#define PVR2_TA_BATCH_INITIAL_VERTS (16 * 1024)
+
+void pvr2_ta_batch_init(struct pvr2_ta_batch *batch) {
+    memset(batch, 0, sizeof(*batch));
+
+    batch->enable = true;
+    batch->reorder = false;
+
+    batch->draws_cap = PVR2_TA_BATCH_INITIAL_DRAWS;
+    batch->draws = (struct pvr2_ta_batch_draw*)
+        malloc(batch->draws_cap * sizeof(struct pvr2_ta_batch_draw));
+    if (!batch->draws)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    batch->verts_cap = PVR2_TA_BATCH_INITIAL_VERTS;
+    batch->verts = (float*)malloc(batch->verts_cap *
+                                  GFX_VERT_LEN * sizeof(float));
+    if (!batch->verts)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+}
+
+void pvr2_ta_batch_cleanup(struct pvr2_ta_batch *batch) {
+    free(batch->verts);
+    free(batch->draws);
+    batch->verts = NULL;
+    batch->draws = NULL;
+    batch->verts_cap = batch->draws_cap = batch->n_draws = 0;
+}
+
+static void exec_cmd(struct gfx_il_inst const *cmd) {
+    struct gfx_il_inst tmp = *cmd;
+    rend_exec_il(&tmp, 1);
+}
+
+#define CMP_FIELD(lhs, rhs)                     \
+    do {                                        \
+        if ((lhs) != (rhs))                     \
+            return (lhs) < (rhs) ? -1 : 1;      \
+    } while (0)
+
+/*
+ * total order on render state.  tex_idx, tex_inst and tex_filter only count
+ * when texturing is enabled; the TA leaves tex_idx uninitialized otherwise.
+ */
+static int state_cmp(struct pvr2_ta_batch_draw const *lhs,
+                     struct pvr2_ta_batch_draw const *rhs) {
+    struct gfx_rend_param const *lp = &lhs->param, *rp = &rhs->param;
+
+    CMP_FIELD(lhs->blend_enable, rhs->blend_enable);
+    CMP_FIELD(lp->tex_enable, rp->tex_enable);
+    if (lp->tex_enable) {
+        CMP_FIELD(lp->tex_idx, rp->tex_idx);
+        CMP_FIELD(lp->tex_inst, rp->tex_inst);
+        CMP_FIELD(lp->tex_filter, rp->tex_filter);
+    }
+    CMP_FIELD(lp->tex_wrap_mode[0], rp->tex_wrap_mode[0]);
+    CMP_FIELD(lp->tex_wrap_mode[1], rp->tex_wrap_mode[1]);
+    CMP_FIELD(lp->src_blend_factor, rp->src_blend_factor);
+    CMP_FIELD(lp->dst_blend_factor, rp->dst_blend_factor);
+    CMP_FIELD(lp->enable_depth_writes, rp->enable_depth_writes);
+    CMP_FIELD(lp->depth_func, rp->depth_func);
+
+    return 0;
+}
+
+// state first, then submission order so the sort is stable
+static int draw_cmp(void const *lhs_p, void const *rhs_p) {
+    struct pvr2_ta_batch_draw const *lhs = lhs_p, *rhs = rhs_p;
+    int res = state_cmp(lhs, rhs);
+    if (res)
+        return res;
+    CMP_FIELD(lhs->seq, rhs->seq);
+    return 0;
+}
+
+#undef CMP_FIELD
+
+static bool draw_reorderable(struct pvr2_ta_batch_draw const *draw) {
+    if (!draw->param.enable_depth_writes || draw->blend_enable)
+        return false;
+
+    switch (draw->param.depth_func) {
+    case PVR2_DEPTH_LESS:
+    case PVR2_DEPTH_LEQUAL:
+    case PVR2_DEPTH_GREATER:
+    case PVR2_DEPTH_GEQUAL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void push_draw(struct pvr2_ta_batch *batch,
+                      struct gfx_rend_param const *param, bool blend_enable,
+                      float const *verts, unsigned n_verts) {
+    if (batch->n_draws >= batch->draws_cap) {
+        unsigned new_cap = batch->draws_cap * 2;
+        struct pvr2_ta_batch_draw *new_draws = (struct pvr2_ta_batch_draw*)
+            realloc(batch->draws, new_cap * sizeof(struct pvr2_ta_batch_draw));
+        if (!new_draws)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        batch->draws = new_draws;
+        batch->draws_cap = new_cap;
+    }
+
+    struct pvr2_ta_batch_draw *draw = batch->draws + batch->n_draws;
+    draw->param = *param;
+    if (!draw->param.tex_enable)
+        draw->param.tex_idx = 0;
+    draw->blend_enable = blend_enable;
+    draw->verts = verts;
+    draw->n_verts = n_verts;
+    draw->seq = batch->n_draws++;
+}
+
+static float *reserve_verts(struct pvr2_ta_batch *batch, unsigned n_verts) {
+    if (n_verts > batch->verts_cap) {
+        unsigned new_cap = batch->verts_cap;
+        while (new_cap < n_verts)
+            new_cap *= 2;
+        float *new_verts = (float*)realloc(batch->verts, new_cap *
+                                           GFX_VERT_LEN * sizeof(float));
+        if (!new_verts)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        batch->verts = new_verts;
+        batch->verts_cap = new_cap;
+    }
+    return batch->verts;
+}
+
+/*
+ * if reordering is on, sort every run of reorderable draws which share a depth
+ * function by state.  Then send each stretch of draws with identical state as
+ * one DRAW_ARRAY.
+ */
+static void flush_draws(struct pvr2_ta_batch *batch) {
+    struct pvr2_ta_batch_draw *draws = batch->draws;
+    unsigned n_draws = batch->n_draws;
+    unsigned first, last;
+
+    if (!n_draws)
+        return;
+
+    for (first = 0; batch->reorder && first < n_draws; first = last) {
+        last = first + 1;
+        if (!draw_reorderable(draws + first))
+            continue;
+        while (last < n_draws && draw_reorderable(draws + last) &&
+               draws[last].param.depth_func == draws[first].param.depth_func)
+            last++;
+        if (last - first > 1)
+            qsort(draws + first, last - first, sizeof(draws[0]), draw_cmp);
+    }
+
+    struct pvr2_ta_batch_draw const *cur_state = NULL;
+    struct gfx_il_inst cmd;
+    for (first = 0; first < n_draws; first = last) {
+        unsigned n_verts = draws[first].n_verts;
+        bool adjacent = true;
+        for (last = first + 1;
+             last < n_draws && state_cmp(draws + first, draws + last) == 0;
+             last++) {
+            if (draws[last].verts != draws[last - 1].verts +
+                draws[last - 1].n_verts * GFX_VERT_LEN)
+                adjacent = false;
+            n_verts += draws[last].n_verts;
+        }
+
+        if (!cur_state || state_cmp(cur_state, draws + first) != 0) {
+            cmd.op = GFX_IL_SET_REND_PARAM;
+            cmd.arg.set_rend_param.param = draws[first].param;
+            rend_exec_il(&cmd, 1);
+        }
+        if (!cur_state || cur_state->blend_enable != draws[first].blend_enable) {
+            cmd.op = GFX_IL_SET_BLEND_ENABLE;
+            cmd.arg.set_blend_enable.do_enable = draws[first].blend_enable;
+            rend_exec_il(&cmd, 1);
+        }
+        cur_state = draws + first;
+
+        /*
+         * rend_exec_il is done with the vertices by the time it returns (in
+         * threaded mode it copies them into the command arena) so one scratch
+         * buffer is enough for every batch.
+         */
+        float const *verts = draws[first].verts;
+        if (!adjacent) {
+            float *outp = reserve_verts(batch, n_verts);
+            unsigned idx;
+            verts = outp;
+            for (idx = first; idx < last; idx++) {
+                size_t n_floats = draws[idx].n_verts * GFX_VERT_LEN;
+                memcpy(outp, draws[idx].verts, n_floats * sizeof(float));
+                outp += n_floats;
+            }
+            batch->stat.verts_copied += n_verts;
+        }
+
+        cmd.op = GFX_IL_DRAW_ARRAY;
+        cmd.arg.draw_array.n_verts = n_verts;
+        cmd.arg.draw_array.verts = (float*)verts;
+        rend_exec_il(&cmd, 1);
+        batch->stat.draws_out++;
+    }
+
+    batch->n_draws = 0;
+}
+
+void pvr2_ta_batch_exec(struct pvr2_ta_batch *batch,
+                        struct gfx_il_inst_chain const *chain) {
+    if (!batch->enable) {
+        while (chain) {
+            exec_cmd(&chain->cmd);
+            chain = chain->next;
+        }
+        return;
+    }
+
+    struct gfx_rend_param const *param = NULL;
+    bool blend_enable = false, have_blend = false;
+
+    for (; chain; chain = chain->next) {
+        struct gfx_il_inst const *cmd = &chain->cmd;
+        switch (cmd->op) {
+        case GFX_IL_SET_REND_PARAM:
+            param = &cmd->arg.set_rend_param.param;
+            break;
+        case GFX_IL_SET_BLEND_ENABLE:
+            blend_enable = cmd->arg.set_blend_enable.do_enable;
+            have_blend = true;
+            break;
+        case GFX_IL_DRAW_ARRAY:
+            batch->stat.draws_in++;
+            if (param && have_blend) {
+                if (cmd->arg.draw_array.n_verts) {
+                    push_draw(batch, param, blend_enable,
+                              cmd->arg.draw_array.verts,
+                              cmd->arg.draw_array.n_verts);
+                }
+            } else {
+                // drawing with whatever state was already set; leave it alone
+                flush_draws(batch);
+                exec_cmd(cmd);
+                batch->stat.draws_out++;
+            }
+            break;
+        default:
+            flush_draws(batch);
+            exec_cmd(cmd);
+        }
+    }
+
+    flush_draws(batch);
+}
+
+void pvr2_ta_batch_end_frame(struct pvr2_ta_batch *batch) {
+    batch->stat_last_frame = batch->stat;
+    memset(&batch->stat, 0, sizeof(batch->stat));
+}
+
+void pvr2_ta_batch_get_stat(struct pvr2_ta_batch const *batch,
+                            struct pvr2_ta_batch_stat *stat) {
+    *stat = batch->stat_last_frame;
+}
@@ -0,0 +1,103 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+
+#ifndef PVR2_TA_BATCH_H_
+#define PVR2_TA_BATCH_H_
+
+#include <stdbool.h>
+
+#include "gfx/gfx_il.h"
+
+struct gfx_il_inst_chain;
+
+/*
+ * Draw batching for the opaque and punch-through lists.
+ *
+ * The TA emits SET_REND_PARAM, SET_BLEND_ENABLE and DRAW_ARRAY for every
+ * polygon header, so a list with a few thousand headers turns into a few
+ * thousand draws even when most of them share the same texture and blend
+ * state.  pvr2_ta_batch_exec replays a list through rend_exec_il with draws
+ * that have identical state merged together.
+ *
+ * Consecutive draws with the same state get merged; that never changes what
+ * ends up on screen.
+ *
+ * If reordering is also turned on, draws may move past each other when they're
+ * in a run of polygons that all write depth and use the same ordered depth
+ * comparison (LESS, LEQUAL, GREATER or GEQUAL), so that draws with the same
+ * state end up next to each other.  The depth test picks the same winner no
+ * matter which one gets drawn first, except for coplanar polygons: with an
+ * or-equal compare the last one drawn wins, with a strict compare the first
+ * one does.  Reordering can therefore change which coplanar decal shows, so
+ * it's off by default.
+ *
+ * wash.cfg settings:
+ *     gfx.rend.batch-draws false - send lists through in order, unmerged
+ *     gfx.rend.batch-reorder true - also reorder draws as described above
+ */
+
+struct pvr2_ta_batch_draw {
+    struct gfx_rend_param param;
+    bool blend_enable;
+    float const *verts;
+    unsigned n_verts;
+    unsigned seq; // submission order within the list
+};
+
+struct pvr2_ta_batch_stat {
+    unsigned draws_in, draws_out;
+    unsigned verts_copied;
+};
+
+struct pvr2_ta_batch {
+    bool enable;
+    bool reorder;
+
+    struct pvr2_ta_batch_draw *draws;
+    unsigned n_draws, draws_cap;
+
+    // merged vertices for batches whose draws aren't already adjacent
+    float *verts;
+    unsigned verts_cap;
+
+    // stat is for the frame in progress, stat_last_frame is the one before
+    struct pvr2_ta_batch_stat stat, stat_last_frame;
+};
+
+void pvr2_ta_batch_init(struct pvr2_ta_batch *batch);
+void pvr2_ta_batch_cleanup(struct pvr2_ta_batch *batch);
+
+/*
+ * replay the gfx_il commands of one display list.  If batching is disabled
+ * this is the same as calling rend_exec_il on each command in order.
+ */
+void pvr2_ta_batch_exec(struct pvr2_ta_batch *batch,
+                        struct gfx_il_inst_chain const *chain);
+
+// call once per frame after the last pvr2_ta_batch_exec
+void pvr2_ta_batch_end_frame(struct pvr2_ta_batch *batch);
+
+void pvr2_ta_batch_get_stat(struct pvr2_ta_batch const *batch,
+                            struct pvr2_ta_batch_stat *stat);
+
+#endif
@@ -0,0 +1,331 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <string.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include "log.h"
+
+#include "pvr2_ta.h"
+#include "pvr2_ta_unpack.h"
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define PVR2_TA_UNPACK_X86_64
+#endif
+
+/*
+ * the vector kernels write base_color and offs_color with a single 8-float
+ * store.
+ */
+static_assert(offsetof(struct pvr2_pkt_vtx, offs_color) ==
+              offsetof(struct pvr2_pkt_vtx, base_color) + 4 * sizeof(float),
+              "base_color and offs_color need to be contiguous");
+
+static void unpack_vtx_scalar(struct pvr2_pkt_vtx *vtx,
+                              uint32_t const *ta_fifo32,
+                              struct pvr2_ta_unpack_fmt const *fmt);
+
+pvr2_ta_unpack_vtx_func pvr2_ta_unpack_vtx_impl = unpack_vtx_scalar;
+
+static enum pvr2_ta_unpack_impl cur_impl = PVR2_TA_UNPACK_IMPL_SCALAR;
+
+static char const *impl_names[PVR2_TA_UNPACK_IMPL_COUNT] = {
+    [PVR2_TA_UNPACK_IMPL_SCALAR] = "scalar",
+    [PVR2_TA_UNPACK_IMPL_SSE2] = "SSE2",
+    [PVR2_TA_UNPACK_IMPL_AVX2] = "AVX2"
+};
+
+static void unpack_argb_8888(float *rgba, uint32_t argb) {
+    rgba[0] = (float)((argb & 0x00ff0000) >> 16) / 255.0f;
+    rgba[1] = (float)((argb & 0x0000ff00) >> 8) / 255.0f;
+    rgba[2] = (float)((argb & 0x000000ff) >> 0) / 255.0f;
+    rgba[3] = (float)((argb & 0xff000000) >> 24) / 255.0f;
+}
+
+// float colors are stored as ARGB
+static void unpack_argb_float(float *rgba, uint32_t const *argb) {
+    memcpy(rgba, argb + 1, 3 * sizeof(float));
+    memcpy(rgba + 3, argb, sizeof(float));
+}
+
+static void unpack_intensity(float *rgba, float const *color,
+                             uint32_t const *intensity_word) {
+    float intensity;
+    memcpy(&intensity, intensity_word, sizeof(intensity));
+
+    rgba[0] = intensity * color[0];
+    rgba[1] = intensity * color[1];
+    rgba[2] = intensity * color[2];
+    rgba[3] = color[3];
+}
+
+static void unpack_vtx_scalar(struct pvr2_pkt_vtx *vtx,
+                              uint32_t const *ta_fifo32,
+                              struct pvr2_ta_unpack_fmt const *fmt) {
+    memcpy(vtx->pos, ta_fifo32 + 1, 3 * sizeof(float));
+
+    if (fmt->uv_idx) {
+        if (fmt->uv16) {
+            uint32_t val = ta_fifo32[fmt->uv_idx];
+            uint32_t u_val = val & 0xffff0000;
+            uint32_t v_val = val << 16;
+
+            memcpy(vtx->uv, &u_val, sizeof(float));
+            memcpy(vtx->uv + 1, &v_val, sizeof(float));
+        } else {
+            memcpy(vtx->uv, ta_fifo32 + fmt->uv_idx, 2 * sizeof(float));
+        }
+    }
+
+    switch (fmt->col_tp) {
+    case PVR2_TA_UNPACK_COL_PACKED:
+        unpack_argb_8888(vtx->base_color, ta_fifo32[fmt->base_idx]);
+        if (fmt->offs_idx)
+            unpack_argb_8888(vtx->offs_color, ta_fifo32[fmt->offs_idx]);
+        break;
+    case PVR2_TA_UNPACK_COL_FLOAT:
+        unpack_argb_float(vtx->base_color, ta_fifo32 + fmt->base_idx);
+        if (fmt->offs_idx)
+            unpack_argb_float(vtx->offs_color, ta_fifo32 + fmt->offs_idx);
+        break;
+    case PVR2_TA_UNPACK_COL_INTENSITY:
+        unpack_intensity(vtx->base_color, fmt->intensity_color,
+                         ta_fifo32 + fmt->base_idx);
+        if (fmt->offs_idx) {
+            unpack_intensity(vtx->offs_color, fmt->intensity_color + 4,
+                             ta_fifo32 + fmt->offs_idx);
+        }
+        break;
+    }
+
+    if (!fmt->offs_idx) {
+        vtx->offs_color[0] = 0.0f;
+        vtx->offs_color[1] = 0.0f;
+        vtx->offs_color[2] = 0.0f;
+        vtx->offs_color[3] = 0.0f;
+    }
+}
+
+#ifdef PVR2_TA_UNPACK_X86_64
+
+/*
+ * Everything below has to match the scalar kernel bit-for-bit, so there are no
+ * reciprocal multiplies in place of the divisions by 255 and alpha channels
+ * get blended in rather than multiplied by 1.0.  Float colors are shuffled as
+ * integers so that NaN payloads survive.
+ */
+
+static inline void unpack_uv16_sse2(float *uv, uint32_t val) {
+    // swap the two halves, then move each into the top of a 32-bit lane
+    __m128i in = _mm_shufflelo_epi16(_mm_cvtsi32_si128(val),
+                                     _MM_SHUFFLE(3, 2, 0, 1));
+    _mm_storel_epi64((__m128i*)uv,
+                     _mm_unpacklo_epi16(_mm_setzero_si128(), in));
+}
+
+static inline void unpack_uv_sse2(struct pvr2_pkt_vtx *vtx,
+                                  uint32_t const *ta_fifo32,
+                                  struct pvr2_ta_unpack_fmt const *fmt) {
+    if (fmt->uv16) {
+        unpack_uv16_sse2(vtx->uv, ta_fifo32[fmt->uv_idx]);
+    } else {
+        _mm_storel_epi64((__m128i*)vtx->uv,
+                         _mm_loadl_epi64((__m128i const*)
+                                         (ta_fifo32 + fmt->uv_idx)));
+    }
+}
+
+static inline __m128 unpack_argb_8888_sse2(uint32_t argb) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i bytes = _mm_cvtsi32_si128(argb);
+
+    // lanes are B, G, R, A after widening
+    __m128i bgra = _mm_unpacklo_epi16(_mm_unpacklo_epi8(bytes, zero), zero);
+    __m128i rgba = _mm_shuffle_epi32(bgra, _MM_SHUFFLE(3, 0, 1, 2));
+
+    return _mm_div_ps(_mm_cvtepi32_ps(rgba), _mm_set1_ps(255.0f));
+}
+
+static inline __m128i unpack_argb_float_sse2(uint32_t const *argb) {
+    return _mm_shuffle_epi32(_mm_loadu_si128((__m128i const*)argb),
+                             _MM_SHUFFLE(0, 3, 2, 1));
+}
+
+static inline __m128 unpack_intensity_sse2(float const *color,
+                                           uint32_t const *intensity_word) {
+    __m128 rgb_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 col = _mm_loadu_ps(color);
+    __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(
+                                   _mm_set1_epi32(*intensity_word)), col);
+    return _mm_or_ps(_mm_and_ps(rgb_mask, scaled),
+                     _mm_andnot_ps(rgb_mask, col));
+}
+
+static void unpack_vtx_sse2(struct pvr2_pkt_vtx *vtx,
+                            uint32_t const *ta_fifo32,
+                            struct pvr2_ta_unpack_fmt const *fmt) {
+    memcpy(vtx->pos, ta_fifo32 + 1, 3 * sizeof(float));
+
+    if (fmt->uv_idx)
+        unpack_uv_sse2(vtx, ta_fifo32, fmt);
+
+    __m128i base, offs = _mm_setzero_si128();
+    switch (fmt->col_tp) {
+    case PVR2_TA_UNPACK_COL_PACKED:
+        base = _mm_castps_si128(
+            unpack_argb_8888_sse2(ta_fifo32[fmt->base_idx]));
+        if (fmt->offs_idx) {
+            offs = _mm_castps_si128(
+                unpack_argb_8888_sse2(ta_fifo32[fmt->offs_idx]));
+        }
+        break;
+    case PVR2_TA_UNPACK_COL_FLOAT:
+        base = unpack_argb_float_sse2(ta_fifo32 + fmt->base_idx);
+        if (fmt->offs_idx)
+            offs = unpack_argb_float_sse2(ta_fifo32 + fmt->offs_idx);
+        break;
+    case PVR2_TA_UNPACK_COL_INTENSITY:
+    default:
+        base = _mm_castps_si128(
+            unpack_intensity_sse2(fmt->intensity_color,
+                                  ta_fifo32 + fmt->base_idx));
+        if (fmt->offs_idx) {
+            offs = _mm_castps_si128(
+                unpack_intensity_sse2(fmt->intensity_color + 4,
+                                      ta_fifo32 + fmt->offs_idx));
+        }
+        break;
+    }
+
+    _mm_storeu_si128((__m128i*)vtx->base_color, base);
+    _mm_storeu_si128((__m128i*)vtx->offs_color, offs);
+}
+
+// the AVX2 kernel does the base and offset colors together in one register
+__attribute__((target("avx2")))
+static void unpack_vtx_avx2(struct pvr2_pkt_vtx *vtx,
+                            uint32_t const *ta_fifo32,
+                            struct pvr2_ta_unpack_fmt const *fmt) {
+    memcpy(vtx->pos, ta_fifo32 + 1, 3 * sizeof(float));
+
+    if (fmt->uv_idx)
+        unpack_uv_sse2(vtx, ta_fifo32, fmt);
+
+    uint32_t base_word = ta_fifo32[fmt->base_idx];
+    uint32_t offs_word = fmt->offs_idx ? ta_fifo32[fmt->offs_idx] : 0;
+    __m256i cols;
+
+    switch (fmt->col_tp) {
+    case PVR2_TA_UNPACK_COL_PACKED:
+        {
+            __m256i words = _mm256_setr_epi32(base_word, base_word,
+                                              base_word, base_word,
+                                              offs_word, offs_word,
+                                              offs_word, offs_word);
+            __m256i shifts = _mm256_setr_epi32(16, 8, 0, 24, 16, 8, 0, 24);
+            __m256i rgba = _mm256_and_si256(_mm256_srlv_epi32(words, shifts),
+                                            _mm256_set1_epi32(0xff));
+            // a missing offset color comes out as 0 / 255 == +0.0f
+            cols = _mm256_castps_si256(
+                _mm256_div_ps(_mm256_cvtepi32_ps(rgba),
+                              _mm256_set1_ps(255.0f)));
+        }
+        break;
+    case PVR2_TA_UNPACK_COL_FLOAT:
+        {
+            __m128i base =
+                _mm_loadu_si128((__m128i const*)(ta_fifo32 + fmt->base_idx));
+            __m128i offs = fmt->offs_idx ?
+                _mm_loadu_si128((__m128i const*)(ta_fifo32 + fmt->offs_idx)) :
+                _mm_setzero_si128();
+            __m256i argb =
+                _mm256_inserti128_si256(_mm256_castsi128_si256(base), offs, 1);
+            /*
+             * the zeroes for a missing offset color stay zero no matter how
+             * they get shuffled.
+             */
+            cols = _mm256_shuffle_epi32(argb, _MM_SHUFFLE(0, 3, 2, 1));
+        }
+        break;
+    case PVR2_TA_UNPACK_COL_INTENSITY:
+    default:
+        {
+            __m256 col = _mm256_loadu_ps(fmt->intensity_color);
+            __m256 intensity = _mm256_castsi256_ps(
+                _mm256_setr_epi32(base_word, base_word, base_word, base_word,
+                                  offs_word, offs_word, offs_word, offs_word));
+            __m256 rgba = _mm256_blend_ps(_mm256_mul_ps(intensity, col),
+                                          col, 0x88);
+            if (!fmt->offs_idx)
+                rgba = _mm256_blend_ps(rgba, _mm256_setzero_ps(), 0xf0);
+            cols = _mm256_castps_si256(rgba);
+        }
+        break;
+    }
+
+    _mm256_storeu_si256((__m256i*)vtx->base_color, cols);
+}
+
+#endif
+
+void pvr2_ta_unpack_init(void) {
+    enum pvr2_ta_unpack_impl impl;
+
+    for (impl = PVR2_TA_UNPACK_IMPL_COUNT - 1;
+         impl > PVR2_TA_UNPACK_IMPL_SCALAR; impl--)
+        if (pvr2_ta_unpack_get_impl(impl))
+            break;
+
+    cur_impl = impl;
+    pvr2_ta_unpack_vtx_impl = pvr2_ta_unpack_get_impl(impl);
+
+    LOG_INFO("%s: using the %s vertex unpacker\n", __func__, impl_names[impl]);
+}
+
+pvr2_ta_unpack_vtx_func pvr2_ta_unpack_get_impl(enum pvr2_ta_unpack_impl impl) {
+    switch (impl) {
+    case PVR2_TA_UNPACK_IMPL_SCALAR:
+        return unpack_vtx_scalar;
+#ifdef PVR2_TA_UNPACK_X86_64
+    case PVR2_TA_UNPACK_IMPL_SSE2:
+        // every x86_64 CPU has SSE2
+        return unpack_vtx_sse2;
+    case PVR2_TA_UNPACK_IMPL_AVX2:
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return unpack_vtx_avx2;
+        return NULL;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+char const *pvr2_ta_unpack_impl_name(enum pvr2_ta_unpack_impl impl) {
+    return impl_names[impl];
+}
+
+enum pvr2_ta_unpack_impl pvr2_ta_unpack_cur_impl(void) {
+    return cur_impl;
+}
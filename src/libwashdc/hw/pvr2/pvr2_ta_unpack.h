@@ -0,0 +1,98 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef PVR2_TA_UNPACK_H_
+#define PVR2_TA_UNPACK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+struct pvr2_pkt_vtx;
+
+/*
+ * kernels that turn the colors and texture coordinates of a TA vertex
+ * parameter into the floats in struct pvr2_pkt_vtx.  The scalar kernel is the
+ * reference; the SSE2 and AVX2 kernels must produce bit-identical output (see
+ * src/bench/ta_unpack_bench.c).  pvr2_ta_unpack_init picks the best kernel the
+ * host supports, and pvr2_ta_unpack_vtx calls it.
+ */
+
+enum pvr2_ta_unpack_col {
+    PVR2_TA_UNPACK_COL_PACKED,    // one 32-bit ARGB word per color
+    PVR2_TA_UNPACK_COL_FLOAT,     // four floats per color, in ARGB order
+    PVR2_TA_UNPACK_COL_INTENSITY  // one float which scales intensity_color
+};
+
+/*
+ * Where everything lives in a vertex parameter.  This only depends on the
+ * polygon header, so it gets filled in once per header instead of once per
+ * vertex.  Indices are in 32-bit words; an index of 0 means the field isn't
+ * there (word 0 is always the parameter control word).  Vertices without an
+ * offset color get zeroes.  Vertices without texture coordinates leave uv
+ * alone.
+ */
+struct pvr2_ta_unpack_fmt {
+    enum pvr2_ta_unpack_col col_tp;
+    unsigned uv_idx, base_idx, offs_idx;
+    bool uv16;
+
+    /*
+     * base color followed by offset color for intensity-mode vertices.  Each
+     * vertex's intensities scale the RGB components; alpha is taken as-is.
+     */
+    float intensity_color[8];
+};
+
+enum pvr2_ta_unpack_impl {
+    PVR2_TA_UNPACK_IMPL_SCALAR,
+    PVR2_TA_UNPACK_IMPL_SSE2,
+    PVR2_TA_UNPACK_IMPL_AVX2,
+
+    PVR2_TA_UNPACK_IMPL_COUNT
+};
+
+typedef void(*pvr2_ta_unpack_vtx_func)(struct pvr2_pkt_vtx*,
+                                       uint32_t const*,
+                                       struct pvr2_ta_unpack_fmt const*);
+
+// selects the kernel pvr2_ta_unpack_vtx uses.  Calling this again is harmless.
+void pvr2_ta_unpack_init(void);
+
+/*
+ * returns the given kernel, or NULL if it wasn't compiled in or the host
+ * can't run it.  The scalar kernel is always available.
+ */
+pvr2_ta_unpack_vtx_func pvr2_ta_unpack_get_impl(enum pvr2_ta_unpack_impl impl);
+
+char const *pvr2_ta_unpack_impl_name(enum pvr2_ta_unpack_impl impl);
+
+enum pvr2_ta_unpack_impl pvr2_ta_unpack_cur_impl(void);
+
+extern pvr2_ta_unpack_vtx_func pvr2_ta_unpack_vtx_impl;
+
+static inline void
+pvr2_ta_unpack_vtx(struct pvr2_pkt_vtx *vtx, uint32_t const *ta_fifo32,
+                   struct pvr2_ta_unpack_fmt const *fmt) {
+    pvr2_ta_unpack_vtx_impl(vtx, ta_fifo32, fmt);
+}
+
+#endif
@@ -39,13 +39,10 @@
 #include "pvr2_reg.h"
 
 #include "pvr2_tex_cache.h"
+#include "pvr2_tex_decode.h"
 
 static DEF_ERROR_INT_ATTR(tex_fmt);
 
-#define PVR2_CODE_BOOK_ENTRY_SIZE (4 * sizeof(uint16_t))
-#define PVR2_CODE_BOOK_ENTRY_COUNT 256
-#define PVR2_CODE_BOOK_LEN (PVR2_CODE_BOOK_ENTRY_COUNT * \
-                            PVR2_CODE_BOOK_ENTRY_SIZE)
 
 static enum gfx_tex_fmt pvr2_tex_fmt_to_gfx(enum TexCtrlPixFmt in_fmt);
 
@@ -79,81 +76,148 @@ static bool pvr2_tex_valid(enum pvr2_tex_state state) {
     return state == PVR2_TEX_READY || state == PVR2_TEX_DIRTY;
 }
 
-static unsigned tex_twiddle(unsigned x, unsigned y,
-                            unsigned w_shift, unsigned h_shift);
-
 static enum gfx_tex_fmt
 translate_palette_to_pix_format(enum palette_tp palette_tp);
 
+static bool pvr2_tex_is_pal(int tex_fmt) {
+    return tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL ||
+        tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL;
+}
+
 /*
- * maps from a normal row-major configuration to the
- * pvr2's own "twiddled" format.
- *
- * The twiddled format is a recursive way of ordering pixels in which the image
- * is divided up into four sub-images.  Those four subimages are stored in the
- * following order: upper-left, lower-left, upper-right, lower-right.  Each of
- * these subimages are themselves twiddled into four smaller subimages, and this
- * recursion continues until you reach the point where each subimage is a single
- * pixel.
- *
- * twiddled rectangular textures are stored as a series of squares each
- * with a width and height of min(w, h) (where w and h denote the width and
- * height of the full rectangular texture).
- *
- * Each one of these squares is twiddled internally, but the squares
- * themselves are stored in order from left to right (when width > height)
- * or from top to bottom (when height > width).
+ * hash all the parameters that pvr2_tex_cache_find compares.  pal_addr is
+ * ignored for textures that aren't paletted.
  */
-static unsigned tex_twiddle(unsigned x, unsigned y, unsigned w_shift, unsigned h_shift) {
-    unsigned twid_idx = 0;
-
-    unsigned w = 1 << w_shift;
-    unsigned h = 1 << h_shift;
-    unsigned min_square, min_square_shift;
-    if (w < h) {
-        min_square = w;
-        min_square_shift = w_shift;
-    } else {
-        min_square = h;
-        min_square_shift = h_shift;
-    }
+static unsigned tex_hash(uint32_t addr, uint32_t pal_addr,
+                         unsigned w_shift, unsigned h_shift,
+                         int tex_fmt, bool twiddled,
+                         bool vq_compression, bool mipmap) {
+    uint32_t key = w_shift | (h_shift << 4) | ((unsigned)tex_fmt << 8) |
+        (twiddled << 12) | (vq_compression << 13) | (mipmap << 14);
+    if (pvr2_tex_is_pal(tex_fmt))
+        key |= pal_addr << 16;
+
+    uint32_t hash = addr * 0x9e3779b1 ^ key * 0x85ebca6b;
+    hash ^= hash >> 15;
+    return hash & (PVR2_TEX_HASH_SIZE - 1);
+}
+
+static unsigned tex_hash_meta(struct pvr2_tex_meta const *meta) {
+    return tex_hash(meta->addr_first, meta->tex_palette_start,
+                    meta->w_shift, meta->h_shift, meta->tex_fmt,
+                    meta->twiddled, meta->vq_compression, meta->mipmap);
+}
 
-    unsigned x_resid = x & ~(min_square - 1);
-    unsigned y_resid = y & ~(min_square - 1);
-    unsigned x_sq = x & (min_square - 1);
-    unsigned y_sq = y & (min_square - 1);
+static inline void tex_set_add(uint64_t *set, unsigned idx) {
+    set[idx / 64] |= ((uint64_t)1) << (idx % 64);
+}
 
-    unsigned shift;
+static inline void tex_set_remove(uint64_t *set, unsigned idx) {
+    set[idx / 64] &= ~(((uint64_t)1) << (idx % 64));
+}
 
-    for (shift = 0; shift <= min_square_shift; shift++) {
-        unsigned mask = (1 << (shift + 1)) - 1;
-        unsigned pow = 1 << shift;
+static void tex_regions(struct pvr2_tex const *tex,
+                        unsigned *first, unsigned *last) {
+    *first = tex->meta.addr_first / PVR2_TEX_REGION_SIZE;
+    *last = tex->meta.addr_last / PVR2_TEX_REGION_SIZE;
+    if (*last >= PVR2_TEX_N_REGIONS)
+        *last = PVR2_TEX_N_REGIONS - 1;
+}
 
-        if ((x_sq & mask) >= pow)
-            twid_idx |= 1 << (shift * 2 + 1);
-        if ((y_sq & mask) >= pow)
-            twid_idx |= 1 << (shift * 2);
-    }
+static void lru_unlink(struct pvr2_tex_cache *cache, int idx) {
+    struct pvr2_tex *tex = cache->tex_cache + idx;
 
-    if (x_resid) {
-        twid_idx += (x / min_square) * min_square * min_square;
-    } else if (y_resid) {
-        twid_idx += (y / min_square) * min_square * min_square;
+    if (tex->lru_prev >= 0)
+        cache->tex_cache[tex->lru_prev].lru_next = tex->lru_next;
+    else
+        cache->lru_head = tex->lru_next;
+
+    if (tex->lru_next >= 0)
+        cache->tex_cache[tex->lru_next].lru_prev = tex->lru_prev;
+    else
+        cache->lru_tail = tex->lru_prev;
+
+    tex->lru_prev = tex->lru_next = -1;
+}
+
+static void lru_append(struct pvr2_tex_cache *cache, int idx) {
+    struct pvr2_tex *tex = cache->tex_cache + idx;
+
+    tex->lru_next = -1;
+    tex->lru_prev = cache->lru_tail;
+    if (cache->lru_tail >= 0)
+        cache->tex_cache[cache->lru_tail].lru_next = idx;
+    else
+        cache->lru_head = idx;
+    cache->lru_tail = idx;
+}
+
+/*
+ * add the texture in the given slot to the hash index, the LRU list and the
+ * region masks.  Its meta must already be filled in.
+ */
+static void tex_link(struct pvr2_tex_cache *cache, int idx) {
+    struct pvr2_tex *tex = cache->tex_cache + idx;
+    unsigned bucket = tex_hash_meta(&tex->meta);
+
+    tex->hash_next = cache->hash_heads[bucket];
+    cache->hash_heads[bucket] = idx;
+
+    lru_append(cache, idx);
+
+    unsigned region, region_last;
+    tex_regions(tex, &region, &region_last);
+    for (; region <= region_last; region++)
+        tex_set_add(cache->region_tex[region], idx);
+}
+
+// undo tex_link
+static void tex_unlink(struct pvr2_tex_cache *cache, int idx) {
+    struct pvr2_tex *tex = cache->tex_cache + idx;
+    int *link = cache->hash_heads + tex_hash_meta(&tex->meta);
+
+    while (*link != idx) {
+#ifdef INVARIANTS
+        if (*link < 0)
+            RAISE_ERROR(ERROR_INTEGRITY);
+#endif
+        link = &cache->tex_cache[*link].hash_next;
     }
+    *link = tex->hash_next;
+    tex->hash_next = -1;
+
+    lru_unlink(cache, idx);
+
+    unsigned region, region_last;
+    tex_regions(tex, &region, &region_last);
+    for (; region <= region_last; region++)
+        tex_set_remove(cache->region_tex[region], idx);
 
-    return twid_idx;
+    tex_set_remove(cache->dirty_tex, idx);
 }
 
 void pvr2_tex_cache_init(struct pvr2 *pvr2) {
     struct pvr2_tex_cache *cache = &pvr2->tex_cache;
 
+    memset(cache, 0, sizeof(*cache));
+
+    pvr2_tex_decode_init();
+
     unsigned idx;
     for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
-        memset(cache->tex_cache + idx, 0, sizeof(cache->tex_cache[idx]));
-        cache->tex_cache[idx].obj_no = -1;
+        struct pvr2_tex *tex = cache->tex_cache + idx;
+        tex->obj_no = -1;
+        tex->hash_next = tex->lru_prev = tex->lru_next = -1;
+
+        // lowest slots get handed out first
+        cache->free_slots[idx] = PVR2_TEX_CACHE_SIZE - 1 - idx;
     }
+    cache->n_free_slots = PVR2_TEX_CACHE_SIZE;
+
+    for (idx = 0; idx < PVR2_TEX_HASH_SIZE; idx++)
+        cache->hash_heads[idx] = -1;
 
-    memset(cache->page_stamps, 0, sizeof(cache->page_stamps));
+    cache->lru_head = cache->lru_tail = -1;
 }
 
 void pvr2_tex_cache_cleanup(struct pvr2 *pvr2) {
@@ -163,6 +227,12 @@ void pvr2_tex_cache_cleanup(struct pvr2 *pvr2) {
     for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++)
         if (cache->tex_cache[idx].obj_no >= 0)
             pvr2_free_gfx_obj(cache->tex_cache[idx].obj_no);
+
+    for (idx = 0; idx < 2; idx++) {
+        free(cache->scratch[idx]);
+        cache->scratch[idx] = NULL;
+        cache->scratch_len[idx] = 0;
+    }
 }
 
 struct pvr2_tex *pvr2_tex_cache_find(struct pvr2 *pvr2,
@@ -171,15 +241,17 @@ struct pvr2_tex *pvr2_tex_cache_find(struct pvr2 *pvr2,
                                      int tex_fmt, bool twiddled,
                                      bool vq_compression, bool mipmap,
                                      bool stride_sel) {
-    unsigned idx;
-    struct pvr2_tex *tex;
-    bool pal_tex =
-        tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL ||
-        tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL;
-    struct pvr2_tex *tex_cache = pvr2->tex_cache.tex_cache;
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
+    struct pvr2_tex *tex_cache = cache->tex_cache;
+    bool pal_tex = pvr2_tex_is_pal(tex_fmt);
+    int idx = cache->hash_heads[tex_hash(addr, pal_addr, w_shift, h_shift,
+                                         tex_fmt, twiddled,
+                                         vq_compression, mipmap)];
 
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
-        tex = tex_cache + idx;
+    cache->stat.lookups++;
+
+    while (idx >= 0) {
+        struct pvr2_tex *tex = tex_cache + idx;
         if (pvr2_tex_valid(tex->state) && (tex->meta.addr_first == addr) &&
             (tex->meta.w_shift == w_shift) && (tex->meta.h_shift == h_shift) &&
             (tex->meta.tex_fmt == tex_fmt) && (tex->meta.twiddled == twiddled) &&
@@ -187,8 +259,14 @@ struct pvr2_tex *pvr2_tex_cache_find(struct pvr2 *pvr2,
             (mipmap == tex->meta.mipmap) &&
             (!pal_tex || pal_addr == tex->meta.tex_palette_start)) {
             tex->frame_stamp_last_used = get_cur_frame_stamp(pvr2);
+            if (cache->lru_tail != idx) {
+                lru_unlink(cache, idx);
+                lru_append(cache, idx);
+            }
+            cache->stat.hits++;
             return tex;
         }
+        idx = tex->hash_next;
     }
 
     return NULL;
@@ -214,31 +292,25 @@ struct pvr2_tex *pvr2_tex_cache_add(struct pvr2 *pvr2,
     }
 #endif
 
-    unsigned idx;// = addr & PVR2_TEX_CACHE_MASK;
-    struct pvr2_tex *tex_cache = pvr2->tex_cache.tex_cache;
-    struct pvr2_tex *tex, *oldest_tex = NULL;
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
-        tex = tex_cache + idx;
-
-        if (!pvr2_tex_valid(tex->state))
-            break;
-
-        if (tex->frame_stamp_last_used < cur_frame_stamp) {
-            if (!oldest_tex ||
-                tex->frame_stamp_last_used < oldest_tex->frame_stamp_last_used)
-                oldest_tex = tex;
-        }
-    }
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
+    struct pvr2_tex *tex;
+    int idx;
 
-    if (idx >= PVR2_TEX_CACHE_SIZE) {
-        // kick the oldest tex out of the cache to make room
-        if (oldest_tex) {
-            tex = oldest_tex;
-        } else {
+    if (cache->n_free_slots) {
+        idx = cache->free_slots[--cache->n_free_slots];
+        tex = cache->tex_cache + idx;
+    } else {
+        // kick the least-recently used tex out of the cache to make room
+        idx = cache->lru_head;
+        tex = cache->tex_cache + idx;
+        if (idx < 0 || tex->frame_stamp_last_used >= cur_frame_stamp) {
             LOG_ERROR("ERROR: TEXTURE CACHE OVERFLOW\n");
             return NULL;
         }
 
+        tex_unlink(cache, idx);
+        cache->stat.evictions++;
+
         if (tex->obj_no >= 0) {
             struct gfx_il_inst cmd;
             cmd.op = GFX_IL_FREE_OBJ;
@@ -320,6 +392,8 @@ struct pvr2_tex *pvr2_tex_cache_add(struct pvr2 *pvr2,
      * We defer reading the actual data from texture memory until we're ready
      * to transmit this to the rendering thread.
      */
+    tex_link(cache, idx);
+    tex_set_add(cache->dirty_tex, idx);
 
     return tex;
 }
@@ -346,6 +420,13 @@ void pvr2_tex_cache_notify_write(struct pvr2 *pvr2,
     unsigned page_no;
     for (page_no = page_first; page_no <= page_last; page_no++)
         page_stamps[page_no] = time;
+
+    unsigned region;
+    unsigned region_last = addr_last / PVR2_TEX_REGION_SIZE;
+    for (region = addr_first / PVR2_TEX_REGION_SIZE;
+         region <= region_last; region++) {
+        cache->dirty_regions[region / 64] |= ((uint64_t)1) << (region % 64);
+    }
 }
 
 void
@@ -362,126 +443,27 @@ pvr2_tex_cache_notify_palette_write(struct pvr2 *pvr2,
 }
 
 void pvr2_tex_cache_notify_palette_tp_change(struct pvr2 *pvr2) {
-    unsigned idx;
-    struct pvr2_tex *tex_cache = pvr2->tex_cache.tex_cache;
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
-        struct pvr2_tex *tex = tex_cache + idx;
-        if (tex->state == PVR2_TEX_READY &&
-            (tex->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL ||
-             tex->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL))
+    struct pvr2_tex_cache *cache = &pvr2->tex_cache;
+    int idx;
+    for (idx = cache->lru_head; idx >= 0; idx = cache->tex_cache[idx].lru_next) {
+        struct pvr2_tex *tex = cache->tex_cache + idx;
+        if (tex->state == PVR2_TEX_READY && pvr2_tex_is_pal(tex->meta.tex_fmt)) {
             tex->state = PVR2_TEX_DIRTY;
-    }
-}
-
-/*
- * de-twiddle src into dst.  Both src and dst must be preallocated buffers with
- * a length of (1 << tex_w_shift) * (1 << tex_h_shift) * bytes_per_pix.
- */
-static void pvr2_tex_detwiddle(void *dst, void const *src,
-                               unsigned tex_w_shift, unsigned tex_h_shift,
-                               unsigned bytes_per_pix) {
-    uint8_t *dst8 = (uint8_t*)dst;
-    unsigned tex_w = 1 << tex_w_shift, tex_h = 1 << tex_h_shift;
-    unsigned row, col;
-    for (row = 0; row < tex_h; row++) {
-        for (col = 0; col < tex_w; col++) {
-            unsigned twid_idx = tex_twiddle(col, row, tex_w_shift, tex_h_shift);
-
-#ifdef INVARIANTS
-            if (twid_idx >= tex_w * tex_h)
-                RAISE_ERROR(ERROR_INTEGRITY);
-#endif
-
-            memcpy(dst8 + (row * tex_w + col) * bytes_per_pix,
-                   src + twid_idx * bytes_per_pix,
-                   bytes_per_pix);
+            tex_set_add(cache->dirty_tex, idx);
         }
     }
 }
 
-/*
- * special version of pvr2_tex_detwiddle for 4bpp paletted textures.
- *
- * The normal version of pvr2_tex_detwiddle won't work since each byte contains
- * two packed pixels.
- */
-static void pvr2_tex_detwiddle_4bpp(void *dst, void const *src,
-                                    unsigned tex_w_shift, unsigned tex_h_shift) {
-    uint8_t *dst8 = (uint8_t*)dst;
-    uint8_t const *src8 = (uint8_t*)src;
-    unsigned tex_w = 1 << tex_w_shift, tex_h = 1 << tex_h_shift;
-    unsigned row, col;
-    for (row = 0; row < tex_h; row++) {
-        for (col = 0; col < tex_w; col++) {
-            unsigned twid_idx = tex_twiddle(col, row, tex_w_shift, tex_h_shift);
-
-#ifdef INVARIANTS
-            if (twid_idx >= tex_w * tex_h)
-                RAISE_ERROR(ERROR_INTEGRITY);
-#endif
-            unsigned dst_idx = row * tex_w + col;
-
-            uint8_t in_px;
-            if (twid_idx % 2 == 0)
-                in_px = src8[twid_idx / 2] & 0xf;
-            else
-                in_px = src8[twid_idx / 2] >> 4;
-
-            if (dst_idx % 2 == 0) {
-                dst8[dst_idx / 2] &= ~0xf;
-                dst8[dst_idx / 2] |= in_px;
-            } else {
-                dst8[dst_idx / 2] &= ~0xf0;
-                dst8[dst_idx / 2] |= (in_px << 4);
-            }
-        }
-    }
-}
-
-/*
- * decompress src into dst.
- *
- * src must be a VQ-encoded texture with a length of
- * PVR2_CODE_BOOK_LEN + (1 << side_shift) * (1 << side_shift) / 4.
- *
- * dst must be a buffer with a length of
- * 2 * (1 << side_shift) * (1 << side_shift) bytes.  This is because the data
- * will be uncompressed into dst, and because only 2-byte pixel formats are
- * supported (TEX_CTRL_PIX_FMT_ARGB_1555, TEX_CTRL_PIX_FMT_RGB_565,
- * TEX_CTRL_PIX_FMT_ARGB_4444).
- */
-static void pvr2_tex_vq_decompress(void *dst, void const *code_book,
-                                   void const *src, unsigned side_shift) {
-    unsigned dst_side = 1 << side_shift;
-    unsigned src_side_shift = side_shift - 1;
-    unsigned src_side = 1 << src_side_shift;
-    unsigned row, col;
-    uint8_t const *code_book_src = (uint8_t const*)code_book;
-    uint8_t const *img_dat_src = (uint8_t const*)src;
-    uint16_t *dst_img = (uint16_t*)dst;
-
-    for (row = 0; row < src_side; row++) {
-        for (col = 0; col < src_side; col++) {
-            unsigned twid_idx = tex_twiddle(col, row,
-                                            src_side_shift, src_side_shift);
-
-            // code book index
-            unsigned idx = img_dat_src[twid_idx];
-            uint16_t color[4];
-            memcpy(color, code_book_src + PVR2_CODE_BOOK_ENTRY_SIZE * idx,
-                   PVR2_CODE_BOOK_ENTRY_SIZE);
-
-            unsigned dst_row = row * 2, dst_col = col * 2;
-            memcpy(dst_img + dst_row * dst_side + dst_col,
-                   color, sizeof(color[0]));
-            memcpy(dst_img + (dst_row + 1) * dst_side + dst_col,
-                   color + 1, sizeof(color[1]));
-            memcpy(dst_img + dst_row * dst_side + dst_col + 1,
-                   color + 2, sizeof(color[2]));
-            memcpy(dst_img + (dst_row + 1) * dst_side + dst_col + 1,
-                   color + 3, sizeof(color[3]));
-        }
+static void *tex_scratch(struct pvr2_tex_cache *cache,
+                         unsigned which, size_t n_bytes) {
+    if (cache->scratch_len[which] < n_bytes) {
+        void *buf = realloc(cache->scratch[which], n_bytes);
+        if (!buf)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        cache->scratch[which] = buf;
+        cache->scratch_len[which] = n_bytes;
     }
+    return cache->scratch[which];
 }
 
 void pvr2_tex_cache_read(struct pvr2 *pvr2,
@@ -509,12 +491,7 @@ void pvr2_tex_cache_read(struct pvr2 *pvr2,
         n_bytes = tex_w * tex_h * px_sz;
     }
 
-    void *tex_dat = NULL;
-    if (n_bytes)
-        tex_dat = malloc(n_bytes * sizeof(uint8_t));
-
-    if (!tex_dat)
-        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    void *tex_dat = tex_scratch(&pvr2->tex_cache, 0, n_bytes);
 
     uint8_t const *beg;
     uint8_t const *code_book; // points to the code book if this is VQ
@@ -642,9 +619,7 @@ void pvr2_tex_cache_read(struct pvr2 *pvr2,
         }
         n_bytes = tex_size_actual * tex_w * tex_h;
         uint8_t *tex_dat_no_palette =
-            (uint8_t*)malloc(n_bytes);
-        if (!tex_dat_no_palette)
-            RAISE_ERROR(ERROR_FAILED_ALLOC);
+            (uint8_t*)tex_scratch(&pvr2->tex_cache, 1, n_bytes);
 
         uint32_t pal_start = (meta->tex_palette_start & 0x30) << 4;
         uint8_t const *tex_dat8 = (uint8_t const*)tex_dat;
@@ -662,7 +637,6 @@ void pvr2_tex_cache_read(struct pvr2 *pvr2,
                 memcpy(pix_out, pal_ram + palette_addr, tex_size_actual);
             }
         }
-        free(tex_dat);
         tex_dat = tex_dat_no_palette;
         LOG_DBG("PVR2 paletted texture: tex_palette_start is 0x%04x\n",
                (unsigned)meta->tex_palette_start);
@@ -687,9 +661,7 @@ void pvr2_tex_cache_read(struct pvr2 *pvr2,
         }
         n_bytes = tex_size_actual * tex_w * tex_h;
         uint8_t *tex_dat_no_palette =
-            (uint8_t*)malloc(n_bytes);
-        if (!tex_dat_no_palette)
-            RAISE_ERROR(ERROR_FAILED_ALLOC);
+            (uint8_t*)tex_scratch(&pvr2->tex_cache, 1, n_bytes);
 
         uint32_t pal_start = meta->tex_palette_start << 4;
         uint8_t const *tex_dat8 = (uint8_t const*)tex_dat;
@@ -714,7 +686,6 @@ void pvr2_tex_cache_read(struct pvr2 *pvr2,
                 memcpy(pix_out, pal_ram + palette_addr, tex_size_actual);
             }
         }
-        free(tex_dat);
         tex_dat = tex_dat_no_palette;
         LOG_DBG("PVR2 paletted texture: tex_palette_start is 0x%04x\n",
                (unsigned)meta->tex_palette_start);
@@ -725,124 +696,164 @@ void pvr2_tex_cache_read(struct pvr2 *pvr2,
 }
 
 void pvr2_tex_cache_xmit(struct pvr2 *pvr2) {
-    unsigned idx;
+    int idx;
     unsigned cur_frame_stamp = get_cur_frame_stamp(pvr2);
     struct gfx_il_inst cmd;
     struct pvr2_tex_cache *cache = &pvr2->tex_cache;
     dc_cycle_stamp_t *page_stamps = cache->page_stamps;
     struct pvr2_tex *tex_cache = pvr2->tex_cache.tex_cache;
 
-    for (idx = 0; idx < PVR2_TEX_CACHE_SIZE; idx++) {
+    for (idx = cache->lru_head; idx >= 0; idx = tex_cache[idx].lru_next) {
         struct pvr2_tex *tex_in = tex_cache + idx;
+        pvr2_framebuffer_notify_texture(pvr2,
+                                        tex_in->meta.addr_first +
+                                        ADDR_TEX64_FIRST,
+                                        tex_in->meta.addr_last +
+                                        ADDR_TEX64_FIRST);
+    }
 
-        if (tex_in->state != PVR2_TEX_INVALID) {
-            pvr2_framebuffer_notify_texture(pvr2,
-                                            tex_in->meta.addr_first +
-                                            ADDR_TEX64_FIRST,
-                                            tex_in->meta.addr_last +
-                                            ADDR_TEX64_FIRST);
+    /*
+     * only textures which overlap a region that was written to since the last
+     * frame (or which were explicitly marked dirty) need to be looked at.
+     */
+    unsigned word, region_word;
+    for (region_word = 0; region_word < PVR2_TEX_N_REGIONS / 64;
+         region_word++) {
+        uint64_t mask = cache->dirty_regions[region_word];
+        while (mask) {
+            unsigned region = region_word * 64 + __builtin_ctzll(mask);
+            mask &= mask - 1;
+            for (word = 0; word < PVR2_TEX_SET_WORDS; word++)
+                cache->dirty_tex[word] |= cache->region_tex[region][word];
         }
+        cache->dirty_regions[region_word] = 0;
+    }
 
-        bool need_update = false;
-        if (tex_in->state == PVR2_TEX_DIRTY)
-            need_update = true;
-        else if (tex_in->state == PVR2_TEX_READY) {
-            unsigned page = tex_in->meta.addr_first / PVR2_TEX_PAGE_SIZE;
-            unsigned last_page = tex_in->meta.addr_last / PVR2_TEX_PAGE_SIZE;
-            while (page <= last_page) {
-                if (page_stamps[page++] > tex_in->last_update) {
-                    need_update = true;
-                    break;
+    for (word = 0; word < PVR2_TEX_SET_WORDS; word++) {
+        uint64_t mask = cache->dirty_tex[word];
+        cache->dirty_tex[word] = 0;
+        while (mask) {
+            idx = word * 64 + __builtin_ctzll(mask);
+            mask &= mask - 1;
+
+            struct pvr2_tex *tex_in = tex_cache + idx;
+
+            bool need_update = false;
+            if (tex_in->state == PVR2_TEX_DIRTY)
+                need_update = true;
+            else if (tex_in->state == PVR2_TEX_READY) {
+                unsigned page =
+                    tex_in->meta.addr_first / PVR2_TEX_PAGE_SIZE;
+                unsigned last_page =
+                    tex_in->meta.addr_last / PVR2_TEX_PAGE_SIZE;
+                while (page <= last_page) {
+                    if (page_stamps[page++] > tex_in->last_update) {
+                        need_update = true;
+                        break;
+                    }
                 }
             }
-        }
 
-        if (need_update) {
-            /*
-             * If the texture has been written to this frame but it is not
-             * actively in use then tell the gfx system to evict it from the
-             * cache.
-             */
-            if (tex_in->frame_stamp_last_used != cur_frame_stamp) {
-                tex_in->state = PVR2_TEX_INVALID;
+            if (need_update) {
+                /*
+                 * If the texture has been written to this frame but it is not
+                 * actively in use then tell the gfx system to evict it from the
+                 * cache.
+                 */
+                if (tex_in->frame_stamp_last_used != cur_frame_stamp) {
+                    tex_in->state = PVR2_TEX_INVALID;
 
-                cmd.op = GFX_IL_UNBIND_TEX;
-                cmd.arg.unbind_tex.tex_no = idx;
-                rend_exec_il(&cmd, 1);
+                    cmd.op = GFX_IL_UNBIND_TEX;
+                    cmd.arg.unbind_tex.tex_no = idx;
+                    rend_exec_il(&cmd, 1);
 
-                cmd.op = GFX_IL_FREE_OBJ;
-                cmd.arg.free_obj.obj_no = tex_in->obj_no;
-                rend_exec_il(&cmd, 1);
+                    cmd.op = GFX_IL_FREE_OBJ;
+                    cmd.arg.free_obj.obj_no = tex_in->obj_no;
+                    rend_exec_il(&cmd, 1);
 
-                pvr2_free_gfx_obj(tex_in->obj_no);
-                tex_in->obj_no = -1;
+                    pvr2_free_gfx_obj(tex_in->obj_no);
+                    tex_in->obj_no = -1;
 
-                continue;
-            }
+                    tex_unlink(cache, idx);
+                    cache->free_slots[cache->n_free_slots++] = idx;
+                    cache->stat.evictions++;
 
-            if (tex_in->obj_no < 0) {
-                /*
-                 * This is a new texture; we need to create a data store,
-                 * upload the texture and bind the store to the texture object.
-                 */
-                tex_in->obj_no = pvr2_alloc_gfx_obj();
-
-                void *tex_dat;
-                size_t n_bytes;
-                struct pvr2_tex_meta tmp = tex_in->meta;
-                if (tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL ||
-                    tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL) {
-                    tmp.pix_fmt =
-                        translate_palette_to_pix_format(get_palette_tp(pvr2));
+                    continue;
                 }
-                pvr2_tex_cache_read(pvr2, &tex_dat, &n_bytes, &tmp);
-
-                cmd.op = GFX_IL_INIT_OBJ;
-                cmd.arg.init_obj.obj_no = tex_in->obj_no;
-                cmd.arg.init_obj.n_bytes = n_bytes;
-                rend_exec_il(&cmd, 1);
-
-                cmd.op = GFX_IL_WRITE_OBJ;
-                cmd.arg.write_obj.dat = tex_dat;
-                cmd.arg.write_obj.obj_no = tex_in->obj_no;
-                cmd.arg.write_obj.n_bytes = n_bytes;
-                rend_exec_il(&cmd, 1);
-                free(tex_dat);
-
-                cmd.op = GFX_IL_BIND_TEX;
-                cmd.arg.bind_tex.gfx_obj_handle = tex_in->obj_no;
-                cmd.arg.bind_tex.tex_no = idx;
-                cmd.arg.bind_tex.pix_fmt = tmp.pix_fmt;
-                cmd.arg.bind_tex.width = 1 << tex_in->meta.w_shift;
-                cmd.arg.bind_tex.height = 1 << tex_in->meta.h_shift;
-
-                rend_exec_il(&cmd, 1);
-            } else {
-                /*
-                 * This is a pre-existing texture; since the data-store has
-                 * already been created and bound, all we have to do is write
-                 * to it.
-                 */
-                struct pvr2_tex_meta tmp = tex_in->meta;
-                if (tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL ||
-                    tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL) {
-                    tmp.pix_fmt = translate_palette_to_pix_format(get_palette_tp(pvr2));
+
+                if (tex_in->obj_no < 0) {
+                    /*
+                     * This is a new texture; we need to create a data
+                     * store, upload the texture and bind the store to the
+                     * texture object.
+                     */
+                    tex_in->obj_no = pvr2_alloc_gfx_obj();
+
+                    void *tex_dat;
+                    size_t n_bytes;
+                    struct pvr2_tex_meta tmp = tex_in->meta;
+                    if (tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL ||
+                        tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL) {
+                        tmp.pix_fmt = translate_palette_to_pix_format(
+                            get_palette_tp(pvr2));
+                    }
+                    pvr2_tex_cache_read(pvr2, &tex_dat, &n_bytes, &tmp);
+
+                    cmd.op = GFX_IL_INIT_OBJ;
+                    cmd.arg.init_obj.obj_no = tex_in->obj_no;
+                    cmd.arg.init_obj.n_bytes = n_bytes;
+                    rend_exec_il(&cmd, 1);
+
+                    cmd.op = GFX_IL_WRITE_OBJ;
+                    cmd.arg.write_obj.dat = tex_dat;
+                    cmd.arg.write_obj.obj_no = tex_in->obj_no;
+                    cmd.arg.write_obj.n_bytes = n_bytes;
+                    rend_exec_il(&cmd, 1);
+
+                    cmd.op = GFX_IL_BIND_TEX;
+                    cmd.arg.bind_tex.gfx_obj_handle = tex_in->obj_no;
+                    cmd.arg.bind_tex.tex_no = idx;
+                    cmd.arg.bind_tex.pix_fmt = tmp.pix_fmt;
+                    cmd.arg.bind_tex.width = 1 << tex_in->meta.w_shift;
+                    cmd.arg.bind_tex.height = 1 << tex_in->meta.h_shift;
+
+                    rend_exec_il(&cmd, 1);
+                } else {
+                    /*
+                     * This is a pre-existing texture; since the data-store
+                     * has already been created and bound, all we have to do
+                     * is write to it.
+                     */
+                    struct pvr2_tex_meta tmp = tex_in->meta;
+                    if (tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_8_BPP_PAL ||
+                        tex_in->meta.tex_fmt == TEX_CTRL_PIX_FMT_4_BPP_PAL) {
+                        tmp.pix_fmt = translate_palette_to_pix_format(
+                            get_palette_tp(pvr2));
+                    }
+                    void *tex_dat;
+                    size_t n_bytes;
+                    pvr2_tex_cache_read(pvr2, &tex_dat, &n_bytes, &tmp);
+                    cmd.op = GFX_IL_WRITE_OBJ;
+                    cmd.arg.write_obj.dat = tex_dat;
+                    cmd.arg.write_obj.obj_no = tex_in->obj_no;
+                    cmd.arg.write_obj.n_bytes = n_bytes;
+                    rend_exec_il(&cmd, 1);
                 }
-                void *tex_dat;
-                size_t n_bytes;
-                pvr2_tex_cache_read(pvr2, &tex_dat, &n_bytes, &tmp);
-                cmd.op = GFX_IL_WRITE_OBJ;
-                cmd.arg.write_obj.dat = tex_dat;
-                cmd.arg.write_obj.obj_no = tex_in->obj_no;
-                cmd.arg.write_obj.n_bytes = n_bytes;
-                rend_exec_il(&cmd, 1);
-                free(tex_dat);
-            }
 
-            tex_in->state = PVR2_TEX_READY;
-            tex_in->last_update = clock_cycle_stamp(pvr2->clk);
+                tex_in->state = PVR2_TEX_READY;
+                tex_in->last_update = clock_cycle_stamp(pvr2->clk);
+                cache->stat.uploads++;
+            }
         }
     }
+
+    cache->stat_last_frame = cache->stat;
+    memset(&cache->stat, 0, sizeof(cache->stat));
+}
+
+void pvr2_tex_cache_get_stat(struct pvr2 *pvr2,
+                             struct pvr2_tex_cache_stat *stat) {
+    *stat = pvr2->tex_cache.stat_last_frame;
 }
 
 int pvr2_tex_cache_get_idx(struct pvr2 *pvr2, struct pvr2_tex const *tex) {
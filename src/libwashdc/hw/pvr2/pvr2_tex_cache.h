@@ -100,6 +100,12 @@ struct pvr2_tex {
     unsigned frame_stamp_last_used;
 
     enum pvr2_tex_state state;
+
+    // next texture in the same hash bucket, or -1
+    int hash_next;
+
+    // neighbors in the LRU list (only meaningful for valid textures), or -1
+    int lru_prev, lru_next;
 };
 
 /*
@@ -116,9 +122,64 @@ struct pvr2_tex {
 #define PVR2_TEX_MEM_LEN (ADDR_TEX64_LAST - ADDR_TEX64_FIRST + 1)
 #define PVR2_TEX_N_PAGES (PVR2_TEX_MEM_LEN / PVR2_TEX_PAGE_SIZE)
 
+/*
+ * Texture memory is also divided into much larger regions, and every region
+ * keeps a bitmask of which texture slots overlap it.  Writes to texture memory
+ * only mark the region as dirty; pvr2_tex_cache_xmit then only has to look at
+ * the textures that overlap a dirty region instead of every texture in the
+ * cache.
+ */
+#define PVR2_TEX_REGION_SIZE (64 * 1024)
+#define PVR2_TEX_N_REGIONS (PVR2_TEX_MEM_LEN / PVR2_TEX_REGION_SIZE)
+
+// number of 64-bit words in a bitmask of texture cache slots
+#define PVR2_TEX_SET_WORDS (PVR2_TEX_CACHE_SIZE / 64)
+
+static_assert(PVR2_TEX_CACHE_SIZE % 64 == 0,
+              "PVR2_TEX_CACHE_SIZE must be a multiple of 64");
+static_assert(PVR2_TEX_N_REGIONS % 64 == 0,
+              "PVR2_TEX_N_REGIONS must be a multiple of 64");
+
+// number of buckets in the hash index.  This must be a power of two.
+#define PVR2_TEX_HASH_SIZE 1024
+
+struct pvr2_tex_cache_stat {
+    unsigned lookups, hits, evictions, uploads;
+};
+
 struct pvr2_tex_cache {
     dc_cycle_stamp_t page_stamps[PVR2_TEX_N_PAGES];
     struct pvr2_tex tex_cache[PVR2_TEX_CACHE_SIZE];
+
+    // first texture in each hash bucket, or -1
+    int hash_heads[PVR2_TEX_HASH_SIZE];
+
+    /*
+     * every valid texture is on the LRU list; lru_head is the one that was
+     * used the longest time ago and lru_tail is the most recent.
+     */
+    int lru_head, lru_tail;
+
+    // slots which don't hold a valid texture
+    int free_slots[PVR2_TEX_CACHE_SIZE];
+    unsigned n_free_slots;
+
+    uint64_t region_tex[PVR2_TEX_N_REGIONS][PVR2_TEX_SET_WORDS];
+    uint64_t dirty_regions[PVR2_TEX_N_REGIONS / 64];
+
+    // textures which need to be checked by the next pvr2_tex_cache_xmit
+    uint64_t dirty_tex[PVR2_TEX_SET_WORDS];
+
+    // stat is for the frame in progress, stat_last_frame is the one before
+    struct pvr2_tex_cache_stat stat, stat_last_frame;
+
+    /*
+     * pvr2_tex_cache_read decodes into these.  They only ever grow, so after
+     * the first few uploads there are no more allocations.  Paletted textures
+     * need both (one for the indices and one for the colors).
+     */
+    void *scratch[2];
+    size_t scratch_len[2];
 };
 
 /*
@@ -165,10 +226,19 @@ void pvr2_tex_cache_xmit(struct pvr2 *pvr2);
 int pvr2_tex_get_meta(struct pvr2 *pvr2,
                       struct pvr2_tex_meta *meta, unsigned tex_idx);
 
+/*
+ * decode the given texture into a format gfx can use.  *tex_dat_out points to
+ * one of the cache's scratch buffers; the caller must not free it, and it is
+ * only valid until the next call to pvr2_tex_cache_read.
+ */
 void pvr2_tex_cache_read(struct pvr2 *pvr2,
                          void **tex_dat_out, size_t *n_bytes_out,
                          struct pvr2_tex_meta const *meta);
 
+// counters from the last frame that was rendered
+void pvr2_tex_cache_get_stat(struct pvr2 *pvr2,
+                             struct pvr2_tex_cache_stat *stat);
+
 void pvr2_tex_cache_init(struct pvr2 *pvr2);
 void pvr2_tex_cache_cleanup(struct pvr2 *pvr2);
 
@@ -0,0 +1,200 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <string.h>
+#include <stdint.h>
+
+#include "washdc/error.h"
+
+#include "pvr2_tex_decode.h"
+
+/*
+ * The twiddled format is a recursive way of ordering pixels in which the image
+ * is divided up into four sub-images.  Those four subimages are stored in the
+ * following order: upper-left, lower-left, upper-right, lower-right.  Each of
+ * these subimages are themselves twiddled into four smaller subimages, and this
+ * recursion continues until you reach the point where each subimage is a single
+ * pixel.
+ *
+ * twiddled rectangular textures are stored as a series of squares each
+ * with a width and height of min(w, h) (where w and h denote the width and
+ * height of the full rectangular texture).
+ *
+ * Each one of these squares is twiddled internally, but the squares
+ * themselves are stored in order from left to right (when width > height)
+ * or from top to bottom (when height > width).
+ *
+ * Within a square, the twiddled index is the y-coordinate's bits interleaved
+ * with the x-coordinate's bits (y in the even bits, x in the odd bits).
+ * twiddle_tab holds the y half of that; the x half is the same thing shifted
+ * left by one.
+ *
+ * Every texture is at least 8x8, so the image can always be walked in 4x4
+ * tiles.  The 16 pixels of a tile are contiguous in the twiddled source, and
+ * tile_offs gives each one's position within that run.
+ */
+static uint32_t twiddle_tab[1 << PVR2_TEX_MAX_SHIFT];
+
+static unsigned const tile_offs[4][4] = {
+    { 0,  2,  8, 10 },
+    { 1,  3,  9, 11 },
+    { 4,  6, 12, 14 },
+    { 5,  7, 13, 15 }
+};
+
+void pvr2_tex_decode_init(void) {
+    unsigned idx;
+    for (idx = 0; idx < (1 << PVR2_TEX_MAX_SHIFT); idx++) {
+        uint32_t twid = 0;
+        unsigned bit;
+        for (bit = 0; bit < PVR2_TEX_MAX_SHIFT; bit++)
+            if (idx & (1 << bit))
+                twid |= 1 << (bit * 2);
+        twiddle_tab[idx] = twid;
+    }
+}
+
+// twiddled index of the upper-left pixel of the 4x4 tile containing (x, y)
+static inline unsigned
+tile_base(unsigned x, unsigned y, unsigned sq_shift) {
+    unsigned sq_mask = (1 << sq_shift) - 1;
+    return (twiddle_tab[x & sq_mask] << 1) + twiddle_tab[y & sq_mask] +
+        (((x >> sq_shift) + (y >> sq_shift)) << (sq_shift * 2));
+}
+
+#define DEF_DETWIDDLE_FN(name, pix_tp)                                  \
+    static void name(pix_tp *dst, pix_tp const *src,                    \
+                     unsigned tex_w_shift, unsigned tex_h_shift) {      \
+        unsigned tex_w = 1 << tex_w_shift, tex_h = 1 << tex_h_shift;    \
+        unsigned sq_shift =                                             \
+            tex_w_shift < tex_h_shift ? tex_w_shift : tex_h_shift;      \
+        unsigned row, col, tile_row;                                    \
+        for (row = 0; row < tex_h; row += 4) {                          \
+            for (col = 0; col < tex_w; col += 4) {                      \
+                pix_tp const *tile = src + tile_base(col, row, sq_shift); \
+                pix_tp *out = dst + row * tex_w + col;                  \
+                for (tile_row = 0; tile_row < 4; tile_row++) {          \
+                    out[0] = tile[tile_offs[tile_row][0]];              \
+                    out[1] = tile[tile_offs[tile_row][1]];              \
+                    out[2] = tile[tile_offs[tile_row][2]];              \
+                    out[3] = tile[tile_offs[tile_row][3]];              \
+                    out += tex_w;                                       \
+                }                                                       \
+            }                                                           \
+        }                                                               \
+    }
+
+DEF_DETWIDDLE_FN(detwiddle_8, uint8_t)
+DEF_DETWIDDLE_FN(detwiddle_16, uint16_t)
+
+void pvr2_tex_detwiddle(void *dst, void const *src,
+                        unsigned tex_w_shift, unsigned tex_h_shift,
+                        unsigned bytes_per_pix) {
+    switch (bytes_per_pix) {
+    case 1:
+        detwiddle_8((uint8_t*)dst, (uint8_t const*)src,
+                    tex_w_shift, tex_h_shift);
+        break;
+    case 2:
+        detwiddle_16((uint16_t*)dst, (uint16_t const*)src,
+                     tex_w_shift, tex_h_shift);
+        break;
+    default:
+        RAISE_ERROR(ERROR_INTEGRITY);
+    }
+}
+
+void pvr2_tex_detwiddle_4bpp(void *dst, void const *src,
+                             unsigned tex_w_shift, unsigned tex_h_shift) {
+    uint8_t *dst8 = (uint8_t*)dst;
+    uint8_t const *src8 = (uint8_t const*)src;
+    unsigned tex_w = 1 << tex_w_shift, tex_h = 1 << tex_h_shift;
+    unsigned sq_shift = tex_w_shift < tex_h_shift ? tex_w_shift : tex_h_shift;
+    unsigned row, col, tile_row;
+
+    // each tile is 8 bytes of input and 2 bytes per row of output
+    for (row = 0; row < tex_h; row += 4) {
+        for (col = 0; col < tex_w; col += 4) {
+            uint8_t const *tile = src8 + tile_base(col, row, sq_shift) / 2;
+            uint8_t nib[16];
+            unsigned idx;
+            for (idx = 0; idx < 8; idx++) {
+                nib[idx * 2] = tile[idx] & 0xf;
+                nib[idx * 2 + 1] = tile[idx] >> 4;
+            }
+
+            uint8_t *out = dst8 + (row * tex_w + col) / 2;
+            for (tile_row = 0; tile_row < 4; tile_row++) {
+                unsigned const *offs = tile_offs[tile_row];
+                out[0] = nib[offs[0]] | (nib[offs[1]] << 4);
+                out[1] = nib[offs[2]] | (nib[offs[3]] << 4);
+                out += tex_w / 2;
+            }
+        }
+    }
+}
+
+void pvr2_tex_vq_decompress(void *dst, void const *code_book,
+                            void const *src, unsigned side_shift) {
+    unsigned dst_side = 1 << side_shift;
+    unsigned src_side_shift = side_shift - 1;
+    unsigned src_side = 1 << src_side_shift;
+    unsigned row, col, tile_row, tile_col, idx;
+    uint8_t const *code_book_src = (uint8_t const*)code_book;
+    uint8_t const *img_dat_src = (uint8_t const*)src;
+    uint16_t *dst_img = (uint16_t*)dst;
+
+    /*
+     * Each code book entry is a 2x2 block stored in column-major order.
+     * Rearrange them to be row-major so that each output row is a single
+     * 4-byte copy.
+     */
+    uint16_t blocks[PVR2_CODE_BOOK_ENTRY_COUNT][4];
+    for (idx = 0; idx < PVR2_CODE_BOOK_ENTRY_COUNT; idx++) {
+        uint16_t color[4];
+        memcpy(color, code_book_src + PVR2_CODE_BOOK_ENTRY_SIZE * idx,
+               PVR2_CODE_BOOK_ENTRY_SIZE);
+        blocks[idx][0] = color[0];
+        blocks[idx][1] = color[2];
+        blocks[idx][2] = color[1];
+        blocks[idx][3] = color[3];
+    }
+
+    // each 4x4 tile of code book indices decodes to an 8x8 tile of pixels
+    for (row = 0; row < src_side; row += 4) {
+        for (col = 0; col < src_side; col += 4) {
+            uint8_t const *tile =
+                img_dat_src + tile_base(col, row, src_side_shift);
+            for (tile_row = 0; tile_row < 4; tile_row++) {
+                uint16_t *out = dst_img +
+                    (row + tile_row) * 2 * dst_side + col * 2;
+                for (tile_col = 0; tile_col < 4; tile_col++) {
+                    uint16_t const *blk =
+                        blocks[tile[tile_offs[tile_row][tile_col]]];
+                    memcpy(out + tile_col * 2, blk, 2 * sizeof(uint16_t));
+                    memcpy(out + dst_side + tile_col * 2, blk + 2,
+                           2 * sizeof(uint16_t));
+                }
+            }
+        }
+    }
+}
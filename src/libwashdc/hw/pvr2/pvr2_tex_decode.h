@@ -0,0 +1,78 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef PVR2_TEX_DECODE_H_
+#define PVR2_TEX_DECODE_H_
+
+#include <stdint.h>
+
+/*
+ * texture-format conversions that don't depend on any pvr2 state, split out
+ * of pvr2_tex_cache.c so src/bench can get at them.
+ */
+
+#define PVR2_CODE_BOOK_ENTRY_SIZE (4 * sizeof(uint16_t))
+#define PVR2_CODE_BOOK_ENTRY_COUNT 256
+#define PVR2_CODE_BOOK_LEN (PVR2_CODE_BOOK_ENTRY_COUNT * \
+                            PVR2_CODE_BOOK_ENTRY_SIZE)
+
+// textures are at most 1024x1024 (w_shift/h_shift are 3-bit fields plus 3)
+#define PVR2_TEX_MAX_SHIFT 10
+
+// builds the twiddle tables; this needs to be called before anything else here
+void pvr2_tex_decode_init(void);
+
+/*
+ * de-twiddle src into dst.  Both src and dst must be preallocated buffers with
+ * a length of (1 << tex_w_shift) * (1 << tex_h_shift) * bytes_per_pix.
+ *
+ * bytes_per_pix must be 1 or 2.
+ */
+void pvr2_tex_detwiddle(void *dst, void const *src,
+                        unsigned tex_w_shift, unsigned tex_h_shift,
+                        unsigned bytes_per_pix);
+
+/*
+ * special version of pvr2_tex_detwiddle for 4bpp paletted textures.
+ *
+ * The normal version of pvr2_tex_detwiddle won't work since each byte contains
+ * two packed pixels.
+ */
+void pvr2_tex_detwiddle_4bpp(void *dst, void const *src,
+                             unsigned tex_w_shift, unsigned tex_h_shift);
+
+/*
+ * decompress src into dst.
+ *
+ * src must be a VQ-encoded texture with a length of
+ * (1 << side_shift) * (1 << side_shift) / 4.
+ *
+ * dst must be a buffer with a length of
+ * 2 * (1 << side_shift) * (1 << side_shift) bytes.  This is because the data
+ * will be uncompressed into dst, and because only 2-byte pixel formats are
+ * supported (TEX_CTRL_PIX_FMT_ARGB_1555, TEX_CTRL_PIX_FMT_RGB_565,
+ * TEX_CTRL_PIX_FMT_ARGB_4444).
+ */
+void pvr2_tex_vq_decompress(void *dst, void const *code_book,
+                            void const *src, unsigned side_shift);
+
+#endif
@@ -35,6 +35,8 @@
 #include "log.h"
 #include "dc_sched.h"
 #include "dreamcast.h"
+#include "config.h"
+#include "jit/code_cache.h"
 
 static void raise_ch2_dma_int_event_handler(struct SchedEvent *event);
 
@@ -297,6 +299,14 @@ void sh4_dmac_dmaor_reg_write_handler(Sh4 *sh4,
 void sh4_dmac_transfer_to_mem(Sh4 *sh4, addr32_t transfer_dst, size_t unit_sz,
                               size_t n_units, void const *dat) {
     size_t total_len = unit_sz * n_units;
+
+    /*
+     * throw out any compiled code the transfer is about to overwrite.  The
+     * writes below would do this anyways, but this way it only happens once
+     * instead of once for every unit.
+     */
+    if (config_get_jit())
+        code_cache_notify_write(transfer_dst, total_len);
     if (total_len % 4 == 0) {
         total_len /= 4;
         uint32_t const *dat32 = (uint32_t const*)dat;
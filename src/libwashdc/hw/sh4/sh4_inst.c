@@ -175,7 +175,7 @@ static struct InstOpcode opcode_list[] = {
       SH4_GROUP_FE, 1, 0xffff, 0xfbfd },
 
     // FSCHG
-    { &sh4_inst_fschg, sh4_jit_fallback, false,
+    { &sh4_inst_fschg, sh4_jit_fpscr_mode_change, false,
       SH4_GROUP_FE, 1, 0xffff, 0xf3fd },
 
     // MOVT Rn
@@ -816,11 +816,11 @@ static struct InstOpcode opcode_list[] = {
       false, SH4_GROUP_LS, 1, 0xf0ff, 0x00c3 },
 
     // FLDI0 FRn
-    { FPU_HANDLER(fldi0), sh4_jit_fallback, false,
+    { FPU_HANDLER(fldi0), sh4_jit_fldi0_frn, false,
       SH4_GROUP_LS, 1, 0xf0ff, 0xf08d },
 
     // FLDI1 Frn
-    { FPU_HANDLER(fldi1), sh4_jit_fallback, false,
+    { FPU_HANDLER(fldi1), sh4_jit_fldi1_frn, false,
       SH4_GROUP_LS, 1, 0xf0ff, 0xf09d },
 
     // FMOV FRm, FRn
@@ -833,7 +833,7 @@ static struct InstOpcode opcode_list[] = {
     // 1111nnn1mmm01100
     // FMOV XDm, XDn
     // 1111nnn1mmm11100
-    { FPU_HANDLER(fmov_gen), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmov_gen), sh4_jit_fmov_gen, false,
       SH4_GROUP_LS, 1, 0xf00f, 0xf00c },
 
     // FMOV.S @Rm, FRn
@@ -842,7 +842,7 @@ static struct InstOpcode opcode_list[] = {
     // 1111nnn0mmmm1000
     // FMOV @Rm, XDn
     // 1111nnn1mmmm1000
-    { FPU_HANDLER(fmovs_ind_gen), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmovs_ind_gen), sh4_jit_fmovs_arm_frn, false,
       SH4_GROUP_LS, 1, 0xf00f, 0xf008 },
 
     // FMOV.S @(R0, Rm), FRn
@@ -851,7 +851,8 @@ static struct InstOpcode opcode_list[] = {
     // 1111nnn0mmmm0110
     // FMOV @(R0, Rm), XDn
     // 1111nnn1mmmm0110
-    { FPU_HANDLER(fmov_binind_r0_gen_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmov_binind_r0_gen_fpu),
+      sh4_jit_fmovs_a_r0_rm_frn, false,
       SH4_GROUP_LS, 1, 0xf00f, 0xf006 },
 
     // FMOV.S @Rm+, FRn
@@ -860,7 +861,7 @@ static struct InstOpcode opcode_list[] = {
     // 1111nnn0mmmm1001
     // FMOV @Rm+, XDn
     // 1111nnn1mmmm1001
-    { FPU_HANDLER(fmov_indgeninc_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmov_indgeninc_fpu), sh4_jit_fmovs_armp_frn, false,
       SH4_GROUP_LS, 1, 0xf00f, 0xf009 },
 
     // FMOV.S FRm, @Rn
@@ -869,7 +870,7 @@ static struct InstOpcode opcode_list[] = {
     // 1111nnnnmmm01010
     // FMOV XDm, @Rn
     // 1111nnnnmmm11010
-    { FPU_HANDLER(fmov_fpu_indgen), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmov_fpu_indgen), sh4_jit_fmovs_frm_arn, false,
       SH4_GROUP_LS, 1, 0xf00f, 0xf00a },
 
     // FMOV.S FRm, @-Rn
@@ -878,7 +879,7 @@ static struct InstOpcode opcode_list[] = {
     // 1111nnnnmmm01011
     // FMOV XDm, @-Rn
     // 1111nnnnmmm11011
-    { FPU_HANDLER(fmov_fpu_inddecgen), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmov_fpu_inddecgen), sh4_jit_fmovs_frm_amrn, false,
       SH4_GROUP_LS, 1, 0xf00f, 0xf00b },
 
     // FMOV.S FRm, @(R0, Rn)
@@ -887,99 +888,100 @@ static struct InstOpcode opcode_list[] = {
     // 1111nnnnmmm00111
     // FMOV XDm, @(R0, Rn)
     // 1111nnnnmmm10111
-    { FPU_HANDLER(fmov_fpu_binind_r0_gen), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmov_fpu_binind_r0_gen),
+      sh4_jit_fmovs_frm_a_r0_rn, false,
       SH4_GROUP_LS, 1, 0xf00f, 0xf007 },
 
     // FLDS FRm, FPUL
     // XXX Should this check the SZ or PR bits of FPSCR ?
-    { &sh4_inst_binary_flds_fr_fpul, sh4_jit_fallback, false,
+    { &sh4_inst_binary_flds_fr_fpul, sh4_jit_flds_frm_fpul, false,
       SH4_GROUP_LS, 1, 0xf0ff, 0xf01d },
 
     // FSTS FPUL, FRn
     // XXX Should this check the SZ or PR bits of FPSCR ?
-    { &sh4_inst_binary_fsts_fpul_fr, sh4_jit_fallback, false,
+    { &sh4_inst_binary_fsts_fpul_fr, sh4_jit_fsts_fpul_frn, false,
       SH4_GROUP_LS, 1, 0xf0ff, 0xf00d },
 
     // FABS FRn
     // 1111nnnn01011101
     // FABS DRn
     // 1111nnn001011101
-    { FPU_HANDLER(fabs_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fabs_fpu), sh4_jit_fabs_frn, false,
       SH4_GROUP_LS, 1, 0xf0ff, 0xf05d },
 
     // FADD FRm, FRn
     // 1111nnnnmmmm0000
     // FADD DRm, DRn
     // 1111nnn0mmm00000
-    { FPU_HANDLER(fadd_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fadd_fpu), sh4_jit_fadd_frm_frn, false,
       SH4_GROUP_FE, 1, 0xf00f, 0xf000 },
 
     // FCMP/EQ FRm, FRn
     // 1111nnnnmmmm0100
     // FCMP/EQ DRm, DRn
     // 1111nnn0mmm00100
-    { FPU_HANDLER(fcmpeq_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fcmpeq_fpu), sh4_jit_fcmpeq_frm_frn, false,
       SH4_GROUP_FE, 1, 0xf00f, 0xf004 },
 
     // FCMP/GT FRm, FRn
     // 1111nnnnmmmm0101
     // FCMP/GT DRm, DRn
     // 1111nnn0mmm00101
-    { FPU_HANDLER(fcmpgt_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fcmpgt_fpu), sh4_jit_fcmpgt_frm_frn, false,
       SH4_GROUP_FE, 1, 0xf00f, 0xf005 },
 
     // FDIV FRm, FRn
     // 1111nnnnmmmm0011
     // FDIV DRm, DRn
     // 1111nnn0mmm00011
-    { FPU_HANDLER(fdiv_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fdiv_fpu), sh4_jit_fdiv_frm_frn, false,
       SH4_GROUP_FE, 1, 0xf00f, 0xf003 },
 
     // FLOAT FPUL, FRn
     // 1111nnnn00101101
     // FLOAT FPUL, DRn
     // 1111nnn000101101
-    { FPU_HANDLER(float_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(float_fpu), sh4_jit_float_fpul_frn, false,
       SH4_GROUP_FE, 1, 0xf0ff, 0xf02d },
 
     // FMAC FR0, FRm, FRn
     // 1111nnnnmmmm1110
-    { FPU_HANDLER(fmac_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmac_fpu), sh4_jit_fmac_fr0_frm_frn, false,
       SH4_GROUP_FE, 1, 0xf00f, 0xf00e },
 
     // FMUL FRm, FRn
     // 1111nnnnmmmm0010
     // FMUL DRm, DRn
     // 1111nnn0mmm00010
-    { FPU_HANDLER(fmul_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fmul_fpu), sh4_jit_fmul_frm_frn, false,
       SH4_GROUP_FE, 1, 0xf00f, 0xf002 },
 
     // FNEG FRn
     // 1111nnnn01001101
     // FNEG DRn
     // 1111nnn001001101
-    { FPU_HANDLER(fneg_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fneg_fpu), sh4_jit_fneg_frn, false,
       SH4_GROUP_LS, 1, 0xf0ff, 0xf04d },
 
     // FSQRT FRn
     // 1111nnnn01101101
     // FSQRT DRn
     // 1111nnn001101101
-    { FPU_HANDLER(fsqrt_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fsqrt_fpu), sh4_jit_fsqrt_frn, false,
       SH4_GROUP_FE, 1, 0xf0ff, 0xf06d },
 
     // FSUB FRm, FRn
     // 1111nnnnmmmm0001
     // FSUB DRm, DRn
     // 1111nnn0mmm00001
-    { FPU_HANDLER(fsub_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(fsub_fpu), sh4_jit_fsub_frm_frn, false,
       SH4_GROUP_FE, 1, 0xf00f, 0xf001 },
 
     // FTRC FRm, FPUL
     // 1111mmmm00111101
     // FTRC DRm, FPUL
     // 1111mmm000111101
-    { FPU_HANDLER(ftrc_fpu), sh4_jit_fallback, false,
+    { FPU_HANDLER(ftrc_fpu), sh4_jit_ftrc_frm_fpul, false,
       SH4_GROUP_FE, 1, 0xf0ff, 0xf03d },
 
     // FCNVDS DRm, FPUL
@@ -993,7 +995,7 @@ static struct InstOpcode opcode_list[] = {
       SH4_GROUP_FE, 1, 0xf1ff, 0xf0ad },
 
     // LDS Rm, FPSCR
-    { &sh4_inst_binary_lds_gen_fpscr, sh4_jit_fallback, false,
+    { &sh4_inst_binary_lds_gen_fpscr, sh4_jit_fpscr_mode_change, false,
       SH4_GROUP_CO, 1, 0xf0ff, 0x406a },
 
     // LDS Rm, FPUL
@@ -1001,7 +1003,8 @@ static struct InstOpcode opcode_list[] = {
       SH4_GROUP_LS, 1, 0xf0ff, 0x405a },
 
     // LDS.L @Rm+, FPSCR
-    { &sh4_inst_binary_ldsl_indgeninc_fpscr, sh4_jit_fallback, false,
+    { &sh4_inst_binary_ldsl_indgeninc_fpscr,
+      sh4_jit_fpscr_mode_change, false,
       SH4_GROUP_CO, 1, 0xf0ff, 0x4066 },
 
     // LDS.L @Rm+, FPUL
@@ -1025,11 +1028,11 @@ static struct InstOpcode opcode_list[] = {
       SH4_GROUP_CO, 1, 0xf0ff, 0x4052 },
 
     // FIPR FVm, FVn - vector dot product
-    { &sh4_inst_binary_fipr_fv_fv, sh4_jit_fallback, false,
+    { &sh4_inst_binary_fipr_fv_fv, sh4_jit_fipr_fvm_fvn, false,
       SH4_GROUP_FE, 1, 0xf0ff, 0xf0ed },
 
     // FTRV XMTRX, FVn - multiple vector by matrix
-    { &sh4_inst_binary_fitrv_mxtrx_fv, sh4_jit_fallback, false,
+    { &sh4_inst_binary_fitrv_mxtrx_fv, sh4_jit_ftrv_xmtrx_fvn, false,
       SH4_GROUP_FE, 1, 0xf3ff, 0xf1fd },
 
     // FSCA FPUL, DRn - sine/cosine table lookup
@@ -20,11 +20,16 @@
  *
  ******************************************************************************/
 
+#include <time.h>
+
 #include "jit/jit_il.h"
 #include "jit/code_block.h"
 #include "jit/jit_mem.h"
+#include "jit/jit_disk_cache.h"
 
 #include "log.h"
+#include "config.h"
+#include "dc_sched.h"
 #include "sh4.h"
 #include "sh4_read_inst.h"
 #include "sh4_jit.h"
@@ -146,6 +151,280 @@ void sh4_jit_new_block(void) {
     }
 }
 
+/*
+ * Idle-loop detection.
+ *
+ * A lot of games spin on a status register or a RAM variable that only
+ * changes when an interrupt or some other scheduled event happens.  Emulating
+ * the spin just burns host time, so blocks that look like this get compiled
+ * with a call to sh4_jit_idle_skip right before the backwards branch, and that
+ * moves the SH4's clock straight to the next scheduled event.
+ *
+ * A block counts as an idle loop if it branches back to its own first
+ * instruction and everything in it is either a load or a register operation
+ * that can't carry state from one iteration into the next.  Any register the
+ * loop writes has to be written before it's read within an iteration, so
+ * every iteration starts from the same state and only memory can break the
+ * loop.  Anything else (stores, fallbacks, post-increment loads, DT, etc)
+ * disqualifies the block.
+ */
+#define SH4_JIT_IDLE_MAX_INSTS 8
+
+#define IDLE_GPR(reg_no) (1u << (reg_no))
+#define IDLE_T (1u << 16)
+
+struct idle_inst_use {
+    unsigned reads, writes;
+};
+
+static struct sh4_jit_idle_stats idle_stats;
+
+#ifdef JIT_OPTIMIZE
+struct jit_opt_stats sh4_jit_opt_stats;
+#endif
+static unsigned long long idle_cycles_frame_start;
+
+// fills in use and returns true if inst can appear in an idle loop
+static bool
+sh4_jit_idle_classify(cpu_inst_param inst, struct idle_inst_use *use) {
+    unsigned rn = (inst >> 8) & 0xf;
+    unsigned rm = (inst >> 4) & 0xf;
+
+    use->reads = 0;
+    use->writes = 0;
+
+    if (inst == 0x0009) // nop
+        return true;
+
+    switch (inst >> 12) {
+    case 0x0:
+        switch (inst & 0xf) {
+        case 0xc: // mov.b @(R0, Rm), Rn
+        case 0xd: // mov.w @(R0, Rm), Rn
+        case 0xe: // mov.l @(R0, Rm), Rn
+            use->reads = IDLE_GPR(0) | IDLE_GPR(rm);
+            use->writes = IDLE_GPR(rn);
+            return true;
+        }
+        return false;
+    case 0x2:
+        switch (inst & 0xf) {
+        case 0x8: // tst Rm, Rn
+            use->reads = IDLE_GPR(rn) | IDLE_GPR(rm);
+            use->writes = IDLE_T;
+            return true;
+        case 0x9: // and Rm, Rn
+        case 0xa: // xor Rm, Rn
+        case 0xb: // or Rm, Rn
+            use->reads = IDLE_GPR(rn) | IDLE_GPR(rm);
+            use->writes = IDLE_GPR(rn);
+            return true;
+        }
+        return false;
+    case 0x3:
+        switch (inst & 0xf) {
+        case 0x0: // cmp/eq Rm, Rn
+        case 0x2: // cmp/hs Rm, Rn
+        case 0x3: // cmp/ge Rm, Rn
+        case 0x6: // cmp/hi Rm, Rn
+        case 0x7: // cmp/gt Rm, Rn
+            use->reads = IDLE_GPR(rn) | IDLE_GPR(rm);
+            use->writes = IDLE_T;
+            return true;
+        }
+        return false;
+    case 0x4:
+        switch (inst & 0xff) {
+        case 0x11: // cmp/pz Rn
+        case 0x15: // cmp/pl Rn
+            use->reads = IDLE_GPR(rn);
+            use->writes = IDLE_T;
+            return true;
+        case 0x09: // shlr2 Rn
+        case 0x19: // shlr8 Rn
+        case 0x29: // shlr16 Rn
+        case 0x08: // shll2 Rn
+        case 0x18: // shll8 Rn
+        case 0x28: // shll16 Rn
+            use->reads = IDLE_GPR(rn);
+            use->writes = IDLE_GPR(rn);
+            return true;
+        }
+        return false;
+    case 0x5: // mov.l @(disp, Rm), Rn
+        use->reads = IDLE_GPR(rm);
+        use->writes = IDLE_GPR(rn);
+        return true;
+    case 0x6:
+        switch (inst & 0xf) {
+        case 0x0: // mov.b @Rm, Rn
+        case 0x1: // mov.w @Rm, Rn
+        case 0x2: // mov.l @Rm, Rn
+        case 0x3: // mov Rm, Rn
+        case 0xc: // extu.b Rm, Rn
+        case 0xd: // extu.w Rm, Rn
+        case 0xe: // exts.b Rm, Rn
+        case 0xf: // exts.w Rm, Rn
+            use->reads = IDLE_GPR(rm);
+            use->writes = IDLE_GPR(rn);
+            return true;
+        }
+        return false;
+    case 0x8:
+        switch (rn) {
+        case 0x4: // mov.b @(disp, Rm), R0
+        case 0x5: // mov.w @(disp, Rm), R0
+            use->reads = IDLE_GPR(rm);
+            use->writes = IDLE_GPR(0);
+            return true;
+        case 0x8: // cmp/eq #imm, R0
+            use->reads = IDLE_GPR(0);
+            use->writes = IDLE_T;
+            return true;
+        }
+        return false;
+    case 0x9: // mov.w @(disp, PC), Rn
+    case 0xd: // mov.l @(disp, PC), Rn
+    case 0xe: // mov #imm, Rn
+        use->writes = IDLE_GPR(rn);
+        return true;
+    case 0xc:
+        switch (rn) {
+        case 0x4: // mov.b @(disp, GBR), R0
+        case 0x5: // mov.w @(disp, GBR), R0
+        case 0x6: // mov.l @(disp, GBR), R0
+            use->writes = IDLE_GPR(0);
+            return true;
+        case 0x8: // tst #imm, R0
+            use->reads = IDLE_GPR(0);
+            use->writes = IDLE_T;
+            return true;
+        case 0x9: // and #imm, R0
+            use->reads = IDLE_GPR(0);
+            use->writes = IDLE_GPR(0);
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+static bool sh4_jit_detect_idle_loop(Sh4 *sh4, addr32_t blk_start) {
+    struct idle_inst_use use[SH4_JIT_IDLE_MAX_INSTS + 2];
+    unsigned n_use = 0, idx;
+    addr32_t pc = blk_start;
+
+    for (idx = 0; idx < SH4_JIT_IDLE_MAX_INSTS; idx++, pc += 2) {
+        cpu_inst_param inst = sh4_do_read_inst(sh4, pc);
+        addr32_t tgt;
+        bool delay_slot;
+
+        switch (inst >> 8) {
+        case 0x89: // bt
+        case 0x8b: // bf
+            delay_slot = false;
+            tgt = pc + 4 + (int)(int8_t)(inst & 0xff) * 2;
+            use[n_use].reads = IDLE_T;
+            break;
+        case 0x8d: // bt/s
+        case 0x8f: // bf/s
+            delay_slot = true;
+            tgt = pc + 4 + (int)(int8_t)(inst & 0xff) * 2;
+            use[n_use].reads = IDLE_T;
+            break;
+        default:
+            if ((inst >> 12) == 0xa) { // bra
+                int32_t disp = inst & 0x0fff;
+                if (disp & 0x0800)
+                    disp |= 0xfffff000;
+                delay_slot = true;
+                tgt = pc + 4 + disp * 2;
+                use[n_use].reads = 0;
+                break;
+            }
+            if (!sh4_jit_idle_classify(inst, use + n_use++))
+                return false;
+            continue;
+        }
+
+        // this is the instruction that ends the block
+        if (tgt != blk_start)
+            return false;
+        use[n_use++].writes = 0;
+
+        if (delay_slot &&
+            !sh4_jit_idle_classify(sh4_do_read_inst(sh4, pc + 2),
+                                   use + n_use++))
+            return false;
+
+        unsigned loop_writes = 0, written = 0;
+        for (idx = 0; idx < n_use; idx++)
+            loop_writes |= use[idx].writes;
+        for (idx = 0; idx < n_use; idx++) {
+            if (use[idx].reads & loop_writes & ~written)
+                return false;
+            written |= use[idx].writes;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+static void sh4_jit_idle_skip(void *cpu, uint32_t unused) {
+    struct Sh4 *sh4 = (struct Sh4*)cpu;
+    dc_cycle_stamp_t now = clock_cycle_stamp(sh4->clk);
+    dc_cycle_stamp_t tgt = clock_target_stamp(sh4->clk);
+
+    /*
+     * The block's own cycles get added on after this, and the dispatcher
+     * clamps the clock back down to the target stamp.
+     */
+    if (tgt > now) {
+        idle_stats.n_skips++;
+        idle_stats.cycles_skipped += (tgt - now) / SH4_CLOCK_SCALE;
+        clock_set_cycle_stamp(sh4->clk, tgt);
+    }
+}
+
+// called with SR for bt and bt/s; the loop is only taken if T is set
+static void sh4_jit_idle_skip_t(void *cpu, uint32_t sr) {
+    if (sr & SH4_SR_FLAG_T_MASK)
+        sh4_jit_idle_skip(cpu, sr);
+}
+
+// called with SR for bf and bf/s; the loop is only taken if T is clear
+static void sh4_jit_idle_skip_f(void *cpu, uint32_t sr) {
+    if (!(sr & SH4_SR_FLAG_T_MASK))
+        sh4_jit_idle_skip(cpu, sr);
+}
+
+void sh4_jit_idle_begin_block(Sh4 *sh4, struct sh4_jit_compile_ctx *ctx,
+                              addr32_t blk_start) {
+    ctx->blk_start = blk_start;
+    ctx->idle_loop = config_get_jit_idle_skip() &&
+        sh4_jit_detect_idle_loop(sh4, blk_start);
+    if (ctx->idle_loop)
+        idle_stats.n_loops++;
+}
+
+void sh4_jit_idle_end_frame(void) {
+    idle_stats.cycles_skipped_last_frame =
+        idle_stats.cycles_skipped - idle_cycles_frame_start;
+    idle_cycles_frame_start = idle_stats.cycles_skipped;
+}
+
+void sh4_jit_idle_get_stats(struct sh4_jit_idle_stats *stats) {
+    *stats = idle_stats;
+}
+
+void sh4_jit_idle_print_stats(struct sh4_jit_idle_stats const *stats) {
+    LOG_INFO("idle loops: %llu blocks compiled as idle loops\n",
+             stats->n_loops);
+    LOG_INFO("idle loops: %llu SH4 cycles skipped over %llu fast-forwards\n",
+             stats->cycles_skipped, stats->n_skips);
+}
+
 static void
 sh4_jit_delay_slot(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
                    struct il_code_block *block, unsigned pc) {
@@ -188,14 +467,354 @@ sh4_jit_compile_inst(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
     return inst_op->disas(sh4, ctx, block, pc, inst_op, inst);
 }
 
+/*
+ * Fallbacks.
+ *
+ * Instructions which the frontend doesn't have an implementation for get
+ * compiled into calls to their interpreter functions.  The interpreter works
+ * on the sh4's reg array, so any register it reads has to be written back
+ * first and any register it writes can't stay cached in a slot.  For the
+ * instructions below that's only a handful of registers, so everything else
+ * gets to stay where it is across the call (see the x86_64 backend's register
+ * allocator).  Anything else is assumed to touch every register.
+ *
+ * Nothing on this list can change the register bank or raise an exception.
+ */
+#define FB_GPR(reg_no) (1u << (reg_no))
+#define FB_SR (1u << 16)
+#define FB_MACH (1u << 17)
+#define FB_MACL (1u << 18)
+#define FB_GBR (1u << 19)
+#define FB_PR (1u << 20)
+
+static unsigned const fb_named_regs[][2] = {
+    { FB_SR, SH4_REG_SR },
+    { FB_MACH, SH4_REG_MACH },
+    { FB_MACL, SH4_REG_MACL },
+    { FB_GBR, SH4_REG_GBR },
+    { FB_PR, SH4_REG_PR }
+};
+
+#define FB_N_NAMED_REGS (sizeof(fb_named_regs) / sizeof(fb_named_regs[0]))
+
+struct fallback_use {
+    unsigned reads, writes;
+};
+
+static struct sh4_jit_fallback_stats fallback_stats;
+
+// fills in use and returns true if the registers inst touches are known
+static bool
+sh4_jit_fallback_classify(cpu_inst_param inst, struct fallback_use *use) {
+    unsigned rn = (inst >> 8) & 0xf;
+    unsigned rm = (inst >> 4) & 0xf;
+
+    use->reads = 0;
+    use->writes = 0;
+
+    switch (inst) {
+    case 0x0028: // clrmac
+        use->writes = FB_MACH | FB_MACL;
+        return true;
+    case 0x0048: // clrs
+    case 0x0058: // sets
+    case 0x0019: // div0u
+        use->reads = FB_SR;
+        use->writes = FB_SR;
+        return true;
+    }
+
+    switch (inst >> 12) {
+    case 0x0:
+        switch (inst & 0xf) {
+        case 0x4: // mov.b Rm, @(R0, Rn)
+        case 0x5: // mov.w Rm, @(R0, Rn)
+        case 0x6: // mov.l Rm, @(R0, Rn)
+            use->reads = FB_GPR(0) | FB_GPR(rn) | FB_GPR(rm);
+            return true;
+        case 0x7: // mul.l Rm, Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm);
+            use->writes = FB_MACL;
+            return true;
+        case 0xc: // mov.b @(R0, Rm), Rn
+        case 0xd: // mov.w @(R0, Rm), Rn
+        case 0xe: // mov.l @(R0, Rm), Rn
+            use->reads = FB_GPR(0) | FB_GPR(rm);
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0xf: // mac.l @Rm+, @Rn+
+            use->reads = FB_GPR(rn) | FB_GPR(rm) | FB_SR | FB_MACH | FB_MACL;
+            use->writes = FB_GPR(rn) | FB_GPR(rm) | FB_MACH | FB_MACL;
+            return true;
+        }
+        switch (inst & 0xff) {
+        case 0x0a: // sts mach, Rn
+            use->reads = FB_MACH;
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x1a: // sts macl, Rn
+            use->reads = FB_MACL;
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x2a: // sts pr, Rn
+            use->reads = FB_PR;
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x12: // stc gbr, Rn
+            use->reads = FB_GBR;
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x83: // pref @Rn
+            use->reads = FB_GPR(rn);
+            return true;
+        case 0xc3: // movca.l R0, @Rn
+            use->reads = FB_GPR(0) | FB_GPR(rn);
+            return true;
+        }
+        return false;
+    case 0x1: // mov.l Rm, @(disp, Rn)
+        use->reads = FB_GPR(rn) | FB_GPR(rm);
+        return true;
+    case 0x2:
+        switch (inst & 0xf) {
+        case 0x0: // mov.b Rm, @Rn
+        case 0x1: // mov.w Rm, @Rn
+        case 0x2: // mov.l Rm, @Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm);
+            return true;
+        case 0x4: // mov.b Rm, @-Rn
+        case 0x5: // mov.w Rm, @-Rn
+        case 0x6: // mov.l Rm, @-Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm);
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x7: // div0s Rm, Rn
+        case 0xc: // cmp/str Rm, Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm) | FB_SR;
+            use->writes = FB_SR;
+            return true;
+        case 0xd: // xtrct Rm, Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm);
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0xe: // mulu.w Rm, Rn
+        case 0xf: // muls.w Rm, Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm);
+            use->writes = FB_MACL;
+            return true;
+        }
+        return false;
+    case 0x3:
+        switch (inst & 0xf) {
+        case 0x4: // div1 Rm, Rn
+        case 0xa: // subc Rm, Rn
+        case 0xb: // subv Rm, Rn
+        case 0xe: // addc Rm, Rn
+        case 0xf: // addv Rm, Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm) | FB_SR;
+            use->writes = FB_GPR(rn) | FB_SR;
+            return true;
+        case 0x5: // dmulu.l Rm, Rn
+        case 0xd: // dmuls.l Rm, Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm);
+            use->writes = FB_MACH | FB_MACL;
+            return true;
+        }
+        return false;
+    case 0x4:
+        if ((inst & 0xf) == 0xd) { // shld Rm, Rn
+            use->reads = FB_GPR(rn) | FB_GPR(rm);
+            use->writes = FB_GPR(rn);
+            return true;
+        }
+        if ((inst & 0xf) == 0xf) { // mac.w @Rm+, @Rn+
+            use->reads = FB_GPR(rn) | FB_GPR(rm) | FB_SR | FB_MACH | FB_MACL;
+            use->writes = FB_GPR(rn) | FB_GPR(rm) | FB_MACH | FB_MACL;
+            return true;
+        }
+        switch (inst & 0xff) {
+        case 0x04: // rotl Rn
+        case 0x05: // rotr Rn
+        case 0x24: // rotcl Rn
+        case 0x25: // rotcr Rn
+            use->reads = FB_GPR(rn) | FB_SR;
+            use->writes = FB_GPR(rn) | FB_SR;
+            return true;
+        case 0x1b: // tas.b @Rn
+            use->reads = FB_GPR(rn) | FB_SR;
+            use->writes = FB_SR;
+            return true;
+        case 0x0a: // lds Rn, mach
+            use->reads = FB_GPR(rn);
+            use->writes = FB_MACH;
+            return true;
+        case 0x1a: // lds Rn, macl
+            use->reads = FB_GPR(rn);
+            use->writes = FB_MACL;
+            return true;
+        case 0x2a: // lds Rn, pr
+            use->reads = FB_GPR(rn);
+            use->writes = FB_PR;
+            return true;
+        case 0x1e: // ldc Rn, gbr
+            use->reads = FB_GPR(rn);
+            use->writes = FB_GBR;
+            return true;
+        case 0x06: // lds.l @Rn+, mach
+            use->reads = FB_GPR(rn);
+            use->writes = FB_GPR(rn) | FB_MACH;
+            return true;
+        case 0x16: // lds.l @Rn+, macl
+            use->reads = FB_GPR(rn);
+            use->writes = FB_GPR(rn) | FB_MACL;
+            return true;
+        case 0x26: // lds.l @Rn+, pr
+            use->reads = FB_GPR(rn);
+            use->writes = FB_GPR(rn) | FB_PR;
+            return true;
+        case 0x17: // ldc.l @Rn+, gbr
+            use->reads = FB_GPR(rn);
+            use->writes = FB_GPR(rn) | FB_GBR;
+            return true;
+        case 0x02: // sts.l mach, @-Rn
+            use->reads = FB_GPR(rn) | FB_MACH;
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x12: // sts.l macl, @-Rn
+            use->reads = FB_GPR(rn) | FB_MACL;
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x22: // sts.l pr, @-Rn
+            use->reads = FB_GPR(rn) | FB_PR;
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x13: // stc.l gbr, @-Rn
+            use->reads = FB_GPR(rn) | FB_GBR;
+            use->writes = FB_GPR(rn);
+            return true;
+        }
+        return false;
+    case 0x6:
+        switch (inst & 0xf) {
+        case 0x0: // mov.b @Rm, Rn
+        case 0x1: // mov.w @Rm, Rn
+        case 0x2: // mov.l @Rm, Rn
+        case 0x8: // swap.b Rm, Rn
+        case 0x9: // swap.w Rm, Rn
+        case 0xb: // neg Rm, Rn
+        case 0xc: // extu.b Rm, Rn
+        case 0xd: // extu.w Rm, Rn
+        case 0xe: // exts.b Rm, Rn
+        case 0xf: // exts.w Rm, Rn
+            use->reads = FB_GPR(rm);
+            use->writes = FB_GPR(rn);
+            return true;
+        case 0x4: // mov.b @Rm+, Rn
+        case 0x5: // mov.w @Rm+, Rn
+        case 0x6: // mov.l @Rm+, Rn
+            use->reads = FB_GPR(rm);
+            use->writes = FB_GPR(rn) | FB_GPR(rm);
+            return true;
+        case 0xa: // negc Rm, Rn
+            use->reads = FB_GPR(rm) | FB_SR;
+            use->writes = FB_GPR(rn) | FB_SR;
+            return true;
+        }
+        return false;
+    case 0x8:
+        switch (rn) {
+        case 0x0: // mov.b R0, @(disp, Rn)
+        case 0x1: // mov.w R0, @(disp, Rn)
+            use->reads = FB_GPR(0) | FB_GPR(rm);
+            return true;
+        case 0x4: // mov.b @(disp, Rm), R0
+        case 0x5: // mov.w @(disp, Rm), R0
+            use->reads = FB_GPR(rm);
+            use->writes = FB_GPR(0);
+            return true;
+        case 0x8: // cmp/eq #imm, R0
+            use->reads = FB_GPR(0) | FB_SR;
+            use->writes = FB_SR;
+            return true;
+        }
+        return false;
+    case 0xc:
+        switch (rn) {
+        case 0x0: // mov.b R0, @(disp, GBR)
+        case 0x1: // mov.w R0, @(disp, GBR)
+        case 0x2: // mov.l R0, @(disp, GBR)
+        case 0xd: // and.b #imm, @(R0, GBR)
+        case 0xe: // xor.b #imm, @(R0, GBR)
+        case 0xf: // or.b #imm, @(R0, GBR)
+            use->reads = FB_GPR(0) | FB_GBR;
+            return true;
+        case 0x4: // mov.b @(disp, GBR), R0
+        case 0x5: // mov.w @(disp, GBR), R0
+        case 0x6: // mov.l @(disp, GBR), R0
+            use->reads = FB_GBR;
+            use->writes = FB_GPR(0);
+            return true;
+        case 0xc: // tst.b #imm, @(R0, GBR)
+            use->reads = FB_GPR(0) | FB_GBR | FB_SR;
+            use->writes = FB_SR;
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+// maps a bit in struct fallback_use onto its index in the sh4's reg array
+static unsigned fallback_reg_idx(Sh4 *sh4, unsigned bit_no) {
+    unsigned named_no;
+
+    if (bit_no < 16)
+        return sh4_gen_reg_idx(sh4, bit_no);
+
+    for (named_no = 0; named_no < FB_N_NAMED_REGS; named_no++)
+        if (fb_named_regs[named_no][0] == (1u << bit_no))
+            return fb_named_regs[named_no][1];
+
+    RAISE_ERROR(ERROR_INTEGRITY);
+}
+
 bool
 sh4_jit_fallback(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
                  struct il_code_block *block, unsigned pc,
                  struct InstOpcode const *op, cpu_inst_param inst) {
     struct jit_inst il_inst;
-
-    res_drain_all_regs(sh4, block);
-    res_invalidate_all_regs(block);
+    struct fallback_use use;
+    unsigned reg_no, bit_no;
+
+    fallback_stats.n_fallbacks++;
+
+    if (sh4_jit_fallback_classify(inst, &use)) {
+        for (bit_no = 0; bit_no < 32; bit_no++) {
+            if (!((use.reads | use.writes) & (1u << bit_no)))
+                continue;
+            reg_no = fallback_reg_idx(sh4, bit_no);
+
+            if (reg_map[reg_no].stat == REG_STATUS_SLOT)
+                fallback_stats.n_regs_stored++;
+            res_drain_reg(sh4, block, reg_no);
+
+            if ((use.writes & (1u << bit_no)) &&
+                reg_map[reg_no].stat != REG_STATUS_SH4) {
+                fallback_stats.n_regs_invalidated++;
+                res_invalidate_reg(block, reg_no);
+            }
+        }
+    } else {
+        fallback_stats.n_full_drains++;
+        for (reg_no = 0; reg_no < SH4_REGISTER_COUNT; reg_no++) {
+            if (reg_map[reg_no].stat == REG_STATUS_SLOT)
+                fallback_stats.n_regs_stored++;
+            if (reg_map[reg_no].stat != REG_STATUS_SH4)
+                fallback_stats.n_regs_invalidated++;
+        }
+        res_drain_all_regs(sh4, block);
+        res_invalidate_all_regs(block);
+    }
 
     il_inst.op = JIT_OP_FALLBACK;
     il_inst.immed.fallback.fallback_fn = op->func;
@@ -206,6 +825,351 @@ sh4_jit_fallback(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
     return true;
 }
 
+void sh4_jit_fallback_get_stats(struct sh4_jit_fallback_stats *stats) {
+    *stats = fallback_stats;
+}
+
+void
+sh4_jit_fallback_print_stats(struct sh4_jit_fallback_stats const *stats) {
+    double n_fallbacks = stats->n_fallbacks ? (double)stats->n_fallbacks : 1.0;
+    LOG_INFO("SH4 fallbacks: %llu compiled, %llu of them wrote back every "
+             "register\n", stats->n_fallbacks, stats->n_full_drains);
+    LOG_INFO("SH4 fallbacks: %.2f registers stored and %.2f registers "
+             "invalidated per fallback\n", stats->n_regs_stored / n_fallbacks,
+             stats->n_regs_invalidated / n_fallbacks);
+}
+
+/*
+ * version of the SH4 frontend's output.  Blocks saved by a build with a
+ * different version don't get used, so bump this whenever a change to the
+ * frontend changes what IL it emits for a given piece of guest code.
+ */
+#define SH4_JIT_CACHE_VERSION 1
+
+/*
+ * SH4 side of the persistent translation cache (see jit/jit_disk_cache.h).
+ * These are the only functions the SH4 frontend ever passes to
+ * jit_call_func; if another one gets added it needs to go here too or else
+ * blocks that call it won't be cached.
+ */
+static jit_disk_cache_call_fn const sh4_jit_cache_call_funcs[] = {
+    sh4_jit_set_sr,
+    sh4_jit_idle_skip,
+    sh4_jit_idle_skip_t,
+    sh4_jit_idle_skip_f
+};
+
+static jit_disk_cache_fallback_fn sh4_jit_cache_fallback_fn(cpu_inst_param inst) {
+    return sh4_decode_inst(inst)->func;
+}
+
+static uint64_t
+sh4_jit_cache_hash_code(void *ctx, addr32_t first, addr32_t last) {
+    Sh4 *sh4 = (Sh4*)ctx;
+    uint64_t hash = JIT_DISK_CACHE_HASH_INIT;
+    addr32_t addr;
+
+    for (addr = first; addr < last; addr += 2) {
+        uint16_t inst = sh4_do_read_inst(sh4, addr);
+        hash = jit_disk_cache_hash(hash, &inst, sizeof(inst));
+    }
+
+    return hash;
+}
+
+void sh4_jit_cache_init(Sh4 *sh4, char const *path) {
+    uint32_t const frontend_version = SH4_JIT_CACHE_VERSION;
+    struct jit_disk_cache_target target = {
+        .reg_base = sh4->reg,
+        .reg_len = sizeof(sh4->reg),
+        .map = sh4->mem.map,
+        .call_funcs = sh4_jit_cache_call_funcs,
+        .n_call_funcs = sizeof(sh4_jit_cache_call_funcs) /
+            sizeof(sh4_jit_cache_call_funcs[0]),
+        .fallback_fn = sh4_jit_cache_fallback_fn
+    };
+
+    /*
+     * anything that changes what IL the frontend emits for a given piece of
+     * guest code goes in here.  SH4_JIT_CACHE_VERSION covers changes to the
+     * frontend itself; changes to the IL are covered by the disk cache.
+     */
+    uint64_t cfg_hash =
+        jit_disk_cache_hash(JIT_DISK_CACHE_HASH_INIT, &frontend_version,
+                            sizeof(frontend_version));
+    bool idle_skip = config_get_jit_idle_skip();
+    cfg_hash = jit_disk_cache_hash(cfg_hash, &idle_skip, sizeof(idle_skip));
+#ifdef JIT_OPTIMIZE
+    unsigned pass;
+    for (pass = 0; pass < JIT_OPT_PASS_COUNT; pass++) {
+        bool enable = jit_opt_get_pass_enabled(pass);
+        cfg_hash = jit_disk_cache_hash(cfg_hash, &enable, sizeof(enable));
+    }
+#endif
+
+    jit_disk_cache_init(path, cfg_hash, &target);
+}
+
+void sh4_jit_cache_cleanup(void) {
+    jit_disk_cache_cleanup();
+}
+
+static addr32_t
+sh4_jit_translate(Sh4 *sh4, struct il_code_block *block, addr32_t pc,
+                  unsigned *cycle_count) {
+    struct sh4_jit_compile_ctx ctx = { .last_inst_type = SH4_GROUP_NONE,
+                                       .cycle_count = 0 };
+
+    addr32_t last_addr = sh4_jit_il_code_block_compile(sh4, &ctx, block, pc);
+    block->n_guest_insts = (last_addr + 1 - pc) / 2;
+#ifdef JIT_OPTIMIZE
+    jit_opt_run(block, block->n_guest_insts, &sh4_jit_opt_stats);
+#endif
+    *cycle_count = ctx.cycle_count;
+    return last_addr;
+}
+
+static unsigned long long
+sh4_jit_cache_elapsed_ns(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000000ull +
+        end.tv_nsec - start->tv_nsec;
+}
+
+addr32_t sh4_jit_il_block_get(Sh4 *sh4, struct il_code_block *block,
+                              addr32_t pc, unsigned *cycle_count) {
+    struct jit_disk_cache_blk_info info;
+    struct timespec start;
+    code_cache_key key;
+
+    if (!jit_disk_cache_enabled())
+        return sh4_jit_translate(sh4, block, pc, cycle_count);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    key = code_cache_key_make(pc);
+
+    if (jit_disk_cache_fetch(key, block, &info,
+                             sh4_jit_cache_hash_code, sh4)) {
+#ifdef JIT_OPTIMIZE
+        jit_determ_pass(block);
+#endif
+        block->n_guest_insts = (info.last_addr + 1 - pc) / 2;
+        *cycle_count = info.cycle_count;
+        jit_disk_cache_count_hit_time(sh4_jit_cache_elapsed_ns(&start));
+        return info.last_addr;
+    }
+
+    info.last_addr = sh4_jit_translate(sh4, block, pc, cycle_count);
+    info.cycle_count = *cycle_count;
+    info.code_hash = sh4_jit_cache_hash_code(sh4, pc, info.last_addr);
+    jit_disk_cache_store(key, block, &info);
+    jit_disk_cache_count_miss_time(sh4_jit_cache_elapsed_ns(&start));
+
+    return info.last_addr;
+}
+
+/*
+ * Traces.
+ *
+ * When a block gets promoted out of the IL interpreter, sh4_jit_trace compiles
+ * it again, but instead of stopping at the branch at the end it keeps going
+ * into whichever successor the branch profile says is taken at least
+ * SH4_JIT_TRACE_BIAS percent of the time.  For conditional branches, the
+ * other successor becomes a side-exit.  Registers stay in their slots from one
+ * block of the trace to the next, so only the first block has to load them.
+ *
+ * Each block in the trace starts with the same pipeline state and idle-loop
+ * check that it would get on its own, and the trace checks whether the
+ * scheduler needs to run between blocks, so the timing is exactly what it
+ * would have been if the blocks had run one after another.  A trace stops
+ * when it would loop back into a block it already has, when the FPU mode
+ * isn't known or when a block hasn't been profiled enough.
+ */
+#define SH4_JIT_TRACE_MIN_EXECS 8
+#define SH4_JIT_TRACE_BIAS 90
+
+#ifdef ENABLE_JIT_X86_64
+/*
+ * returns true if the trace should continue past the end of the current
+ * block, in which case hot_pc is where it continues.
+ */
+static bool sh4_jit_trace_pick(struct sh4_jit_compile_ctx const *ctx,
+                               addr32_t *hot_pc) {
+    struct code_cache_trace const *trace = ctx->trace;
+    struct code_cache_profile prof;
+    unsigned idx;
+
+    if (!trace || trace->n_blocks >= CODE_CACHE_TRACE_MAX_BLOCKS ||
+        !ctx->fpscr_mode_known)
+        return false;
+
+    code_cache_key key = code_cache_key_make_mode(ctx->blk_start,
+                                                  ctx->fpscr_mode);
+    if (!code_cache_get_profile(key, &prof) ||
+        prof.n_execs < SH4_JIT_TRACE_MIN_EXECS)
+        return false;
+
+    for (idx = 0; idx < CODE_CACHE_PROFILE_EXITS; idx++) {
+        if (prof.exit_count[idx] * 100ull >=
+            prof.n_execs * (unsigned long long)SH4_JIT_TRACE_BIAS)
+            break;
+    }
+    if (idx == CODE_CACHE_PROFILE_EXITS)
+        return false;
+    *hot_pc = prof.exit_pc[idx];
+
+    for (idx = 0; idx < trace->n_blocks; idx++)
+        if (trace->blocks[idx].first == *hot_pc)
+            return false;
+
+    return true;
+}
+
+/*
+ * number of guest instructions from the start of the trace to last_addr,
+ * which is in the current block.
+ */
+static unsigned
+sh4_jit_trace_insts(struct sh4_jit_compile_ctx const *ctx, addr32_t last_addr) {
+    struct code_cache_trace const *trace = ctx->trace;
+    unsigned n_insts = (last_addr + 1 - ctx->blk_start) / 2;
+    unsigned idx;
+
+    for (idx = 0; idx + 1 < trace->n_blocks; idx++)
+        n_insts += (trace->blocks[idx].last + 1 - trace->blocks[idx].first) / 2;
+
+    return n_insts;
+}
+
+/*
+ * end the current block of the trace at last_addr and continue at next_pc.
+ * All registers must have been drained, since the trace can leave here if
+ * it's time for the scheduler to run.
+ */
+static void sh4_jit_trace_continue(struct sh4_jit_compile_ctx *ctx,
+                                   struct il_code_block *block,
+                                   addr32_t last_addr, addr32_t next_pc) {
+    struct code_cache_trace *trace = ctx->trace;
+
+    jit_trace_join(block, next_pc, ctx->cycle_count * SH4_CLOCK_SCALE,
+                   sh4_jit_trace_insts(ctx, last_addr));
+
+    trace->blocks[trace->n_blocks - 1].last = last_addr;
+    trace->blocks[trace->n_blocks].first = next_pc;
+    trace->n_blocks++;
+
+    ctx->trace_redirect = true;
+    ctx->trace_next_pc = next_pc;
+}
+#endif
+
+/*
+ * called by BT, BF, BT/S and BF/S.  If the trace continues past the branch,
+ * this compiles the branch as a side-exit and returns true.  Otherwise it
+ * returns false and the branch gets compiled as usual.
+ */
+static bool
+sh4_jit_trace_branch(Sh4 *sh4, struct sh4_jit_compile_ctx *ctx,
+                     struct il_code_block *block, unsigned pc,
+                     addr32_t taken_pc, addr32_t fall_pc, unsigned t_flag,
+                     bool delay_slot) {
+#ifdef ENABLE_JIT_X86_64
+    addr32_t hot_pc, exit_pc;
+    unsigned exit_t_flag;
+
+    if (!sh4_jit_trace_pick(ctx, &hot_pc))
+        return false;
+
+    if (hot_pc == taken_pc) {
+        exit_pc = fall_pc;
+        exit_t_flag = !t_flag;
+    } else if (hot_pc == fall_pc) {
+        exit_pc = taken_pc;
+        exit_t_flag = t_flag;
+    } else {
+        return false;
+    }
+
+    unsigned slot_no = reg_slot(sh4, block, SH4_REG_SR);
+    res_disassociate_reg(sh4, block, SH4_REG_SR);
+
+    if (delay_slot)
+        sh4_jit_delay_slot(sh4, ctx, block, pc + 2);
+
+    res_drain_all_regs(sh4, block);
+
+    if (ctx->idle_loop && taken_pc == ctx->blk_start) {
+        jit_call_func(block, t_flag ? sh4_jit_idle_skip_t : sh4_jit_idle_skip_f,
+                      slot_no);
+    }
+
+    jit_exit_cond(block, slot_no, exit_t_flag, exit_pc,
+                  ctx->cycle_count * SH4_CLOCK_SCALE,
+                  sh4_jit_trace_insts(ctx, delay_slot ? pc + 3 : pc + 1));
+
+    free_slot(block, slot_no);
+    jit_discard_slot(block, slot_no);
+
+    sh4_jit_trace_continue(ctx, block, delay_slot ? pc + 3 : pc + 1, hot_pc);
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef ENABLE_JIT_X86_64
+bool sh4_jit_trace(void *cpu, code_cache_key key, struct il_code_block *block,
+                   struct code_cache_trace *trace) {
+    Sh4 *sh4 = (Sh4*)cpu;
+    addr32_t pc = code_cache_key_addr(key);
+    addr32_t addr = pc, hot_pc;
+    bool do_continue;
+    struct sh4_jit_compile_ctx ctx = {
+        .last_inst_type = SH4_GROUP_NONE,
+        .cycle_count = 0,
+        .fpscr_mode = code_cache_key_mode(key),
+        .fpscr_mode_known = true,
+        .blk_start = pc,
+        .trace = trace
+    };
+
+    trace->n_blocks = 1;
+    trace->blocks[0].first = pc;
+
+    // don't bother translating anything if the profile doesn't lead anywhere
+    if (!sh4_jit_trace_pick(&ctx, &hot_pc))
+        return false;
+
+    sh4_jit_new_block();
+    sh4_jit_idle_begin_block(sh4, &ctx, pc);
+
+    do {
+        do_continue = sh4_jit_compile_inst(sh4, &ctx, block, addr);
+        addr += 2;
+
+        if (ctx.trace_redirect) {
+            ctx.trace_redirect = false;
+            addr = ctx.trace_next_pc;
+            ctx.last_inst_type = SH4_GROUP_NONE;
+            sh4_jit_idle_begin_block(sh4, &ctx, addr);
+        }
+    } while (do_continue);
+
+    trace->blocks[trace->n_blocks - 1].last = addr + 1;
+    if (trace->n_blocks == 1)
+        return false; // the block didn't end with a branch that could be followed
+
+    block->n_guest_insts = sh4_jit_trace_insts(&ctx, addr + 1);
+#ifdef JIT_OPTIMIZE
+    jit_opt_run(block, block->n_guest_insts, &sh4_jit_opt_stats);
+#endif
+    trace->cycle_count = ctx.cycle_count * SH4_CLOCK_SCALE;
+
+    return true;
+}
+#endif
+
 bool sh4_jit_rts(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
                  struct il_code_block *block, unsigned pc,
                  struct InstOpcode const *op, cpu_inst_param inst) {
@@ -306,6 +1270,10 @@ bool sh4_jit_bf(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
                 struct InstOpcode const *op, cpu_inst_param inst) {
     int jump_offs = (int)((int8_t)(inst & 0x00ff)) * 2 + 4;
 
+    if (sh4_jit_trace_branch(sh4, ctx, block, pc, pc + jump_offs, pc + 2, 0,
+                             false))
+        return true;
+
     unsigned slot_no = reg_slot(sh4, block, SH4_REG_SR);
     res_disassociate_reg(sh4, block, SH4_REG_SR);
 
@@ -317,6 +1285,9 @@ bool sh4_jit_bf(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
     jit_set_slot(block, jmp_addr_slot, pc + jump_offs);
     jit_set_slot(block, alt_jmp_addr_slot, pc + 2);
 
+    if (ctx->idle_loop && pc + jump_offs == ctx->blk_start)
+        jit_call_func(block, sh4_jit_idle_skip_f, slot_no);
+
     jit_jump_cond(block, slot_no, jmp_addr_slot, alt_jmp_addr_slot, 0);
 
     free_slot(block, alt_jmp_addr_slot);
@@ -335,6 +1306,10 @@ bool sh4_jit_bt(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
                 struct InstOpcode const *op, cpu_inst_param inst) {
     int jump_offs = (int)((int8_t)(inst & 0x00ff)) * 2 + 4;
 
+    if (sh4_jit_trace_branch(sh4, ctx, block, pc, pc + jump_offs, pc + 2, 1,
+                             false))
+        return true;
+
     unsigned slot_no = reg_slot(sh4, block, SH4_REG_SR);
     res_disassociate_reg(sh4, block, SH4_REG_SR);
 
@@ -346,6 +1321,9 @@ bool sh4_jit_bt(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
     jit_set_slot(block, jmp_addr_slot, pc + jump_offs);
     jit_set_slot(block, alt_jmp_addr_slot, pc + 2);
 
+    if (ctx->idle_loop && pc + jump_offs == ctx->blk_start)
+        jit_call_func(block, sh4_jit_idle_skip_t, slot_no);
+
     jit_jump_cond(block, slot_no, jmp_addr_slot, alt_jmp_addr_slot, 1);
 
     free_slot(block, alt_jmp_addr_slot);
@@ -364,6 +1342,10 @@ bool sh4_jit_bfs(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
                  struct InstOpcode const *op, cpu_inst_param inst) {
     int jump_offs = (int)((int8_t)(inst & 0x00ff)) * 2 + 4;
 
+    if (sh4_jit_trace_branch(sh4, ctx, block, pc, pc + jump_offs, pc + 4, 0,
+                             true))
+        return true;
+
     unsigned slot_no = reg_slot(sh4, block, SH4_REG_SR);
     res_disassociate_reg(sh4, block, SH4_REG_SR);
 
@@ -377,6 +1359,9 @@ bool sh4_jit_bfs(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
     jit_set_slot(block, jmp_addr_slot, pc + jump_offs);
     jit_set_slot(block, alt_jmp_addr_slot, pc + 4);
 
+    if (ctx->idle_loop && pc + jump_offs == ctx->blk_start)
+        jit_call_func(block, sh4_jit_idle_skip_f, slot_no);
+
     jit_jump_cond(block, slot_no, jmp_addr_slot, alt_jmp_addr_slot, 0);
 
     free_slot(block, alt_jmp_addr_slot);
@@ -395,6 +1380,10 @@ bool sh4_jit_bts(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
                  struct InstOpcode const *op, cpu_inst_param inst) {
     int jump_offs = (int)((int8_t)(inst & 0x00ff)) * 2 + 4;
 
+    if (sh4_jit_trace_branch(sh4, ctx, block, pc, pc + jump_offs, pc + 4, 1,
+                             true))
+        return true;
+
     unsigned slot_no = reg_slot(sh4, block, SH4_REG_SR);
     res_disassociate_reg(sh4, block, SH4_REG_SR);
 
@@ -408,6 +1397,9 @@ bool sh4_jit_bts(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
     jit_set_slot(block, jmp_addr_slot, pc + jump_offs);
     jit_set_slot(block, alt_jmp_addr_slot, pc + 4);
 
+    if (ctx->idle_loop && pc + jump_offs == ctx->blk_start)
+        jit_call_func(block, sh4_jit_idle_skip_t, slot_no);
+
     jit_jump_cond(block, slot_no, jmp_addr_slot, alt_jmp_addr_slot, 1);
 
     free_slot(block, alt_jmp_addr_slot);
@@ -431,11 +1423,28 @@ bool sh4_jit_bra(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
 
     sh4_jit_delay_slot(sh4, ctx, block, pc + 2);
 
+#ifdef ENABLE_JIT_X86_64
+    // there's only one way to go, so a trace doesn't need a side-exit here
+    addr32_t hot_pc;
+    bool trace_continue = sh4_jit_trace_pick(ctx, &hot_pc) &&
+        hot_pc == pc + disp;
+#endif
+
     res_drain_all_regs(sh4, block);
 
+#ifdef ENABLE_JIT_X86_64
+    if (trace_continue) {
+        sh4_jit_trace_continue(ctx, block, pc + 3, hot_pc);
+        return true;
+    }
+#endif
+
     unsigned addr_slot = alloc_slot(block);
     jit_set_slot(block, addr_slot, pc + disp);
 
+    if (ctx->idle_loop && pc + disp == ctx->blk_start)
+        jit_call_func(block, sh4_jit_idle_skip, addr_slot);
+
     jit_jump(block, addr_slot);
 
     free_slot(block, addr_slot);
@@ -1479,6 +2488,595 @@ bool sh4_jit_movt(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
     return true;
 }
 
+/*
+ * Returns true if the FPSCR bits in mask are known to equal val at this point
+ * in the block.  FPU opcodes whose meaning depends on PR or SZ can only be
+ * compiled when this is true; otherwise they have to go through the
+ * interpreter.  Opcodes that don't depend on the mode pass a mask of 0.
+ *
+ * The compiled FPU ops don't do any of the error-checking that the interpreter
+ * does when SH4_FPU_PEDANTIC is defined, so everything falls back in that case.
+ */
+static bool
+fpscr_mode_is(struct sh4_jit_compile_ctx const *ctx, uint32_t mask,
+              uint32_t val) {
+#ifdef SH4_FPU_PEDANTIC
+    return false;
+#else
+    if (!mask)
+        return true;
+    return ctx->fpscr_mode_known && (ctx->fpscr_mode & mask) == val;
+#endif
+}
+
+// IL equivalent of sh4_fpu_clear_cause
+static void sh4_jit_fpu_clear_cause(Sh4 *sh4, struct il_code_block *block) {
+#ifndef SH4_FPU_FAST
+    unsigned slot_fpscr = reg_slot(sh4, block, SH4_REG_FPSCR);
+    jit_and_const32(block, slot_fpscr, ~SH4_FPSCR_CAUSE_MASK);
+    reg_map[SH4_REG_FPSCR].stat = REG_STATUS_SLOT;
+#endif
+}
+
+static void
+sh4_jit_fmov_reg(Sh4 *sh4, struct il_code_block *block,
+                 unsigned reg_src, unsigned reg_dst) {
+    unsigned slot_src = reg_slot(sh4, block, reg_src);
+    unsigned slot_dst = reg_slot(sh4, block, reg_dst);
+
+    jit_mov(block, slot_src, slot_dst);
+
+    reg_map[reg_dst].stat = REG_STATUS_SLOT;
+}
+
+// FLDI0 FRn
+// 1111nnnn10001101
+bool sh4_jit_fldi0_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                       struct il_code_block *block, unsigned pc,
+                       struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+    unsigned slot_dst = reg_slot_noload(sh4, block, reg_dst);
+
+    jit_set_slot(block, slot_dst, 0);
+
+    return true;
+}
+
+// FLDI1 FRn
+// 1111nnnn10011101
+bool sh4_jit_fldi1_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                       struct il_code_block *block, unsigned pc,
+                       struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+    unsigned slot_dst = reg_slot_noload(sh4, block, reg_dst);
+
+    // 1.0f
+    jit_set_slot(block, slot_dst, 0x3f800000);
+
+    return true;
+}
+
+// FMOV FRm, FRn
+// 1111nnnnmmmm1100
+// FMOV DRm, DRn
+// 1111nnn0mmm01100
+// FMOV XDm, DRn
+// 1111nnn0mmm11100
+// FMOV DRm, XDn
+// 1111nnn1mmm01100
+bool sh4_jit_fmov_gen(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                      struct il_code_block *block, unsigned pc,
+                      struct InstOpcode const *op, cpu_inst_param inst) {
+    unsigned reg_src, reg_dst;
+
+    if (fpscr_mode_is(ctx, SH4_FPSCR_SZ_MASK, 0)) {
+        reg_src = ((inst >> 4) & 0xf) + SH4_REG_FR0;
+        reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+        sh4_jit_fmov_reg(sh4, block, reg_src, reg_dst);
+        return true;
+    }
+
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_SZ_MASK, SH4_FPSCR_SZ_MASK))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    /*
+     * with SZ set, this moves a pair of registers.  The two halves of a double
+     * are moved as two independent 32-bit values.
+     */
+    reg_src = ((inst >> 5) & 7) * 2;
+    reg_dst = ((inst >> 9) & 7) * 2;
+
+    switch (inst & ((1 << 8) | (1 << 4))) {
+    case 0:
+        // DR to DR
+        reg_src += SH4_REG_DR0;
+        reg_dst += SH4_REG_DR0;
+        break;
+    case 1 << 4:
+        // XD to DR
+        reg_src += SH4_REG_XD0;
+        reg_dst += SH4_REG_DR0;
+        break;
+    case 1 << 8:
+        // DR to XD
+        reg_src += SH4_REG_DR0;
+        reg_dst += SH4_REG_XD0;
+        break;
+    default:
+        // XD to XD
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+    }
+
+    sh4_jit_fmov_reg(sh4, block, reg_src, reg_dst);
+    sh4_jit_fmov_reg(sh4, block, reg_src + 1, reg_dst + 1);
+
+    return true;
+}
+
+// FMOV.S @Rm, FRn
+// 1111nnnnmmmm1000
+bool sh4_jit_fmovs_arm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_SZ_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_addr = ((inst >> 4) & 0xf) + SH4_REG_R0;
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    unsigned slot_addr = reg_slot(sh4, block, reg_addr);
+    unsigned slot_dst = reg_slot(sh4, block, reg_dst);
+
+    jit_read_32_slot(block, sh4->mem.map, slot_addr, slot_dst);
+
+    reg_map[reg_dst].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+// FMOV.S @(R0, Rm), FRn
+// 1111nnnnmmmm0110
+bool sh4_jit_fmovs_a_r0_rm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                               struct il_code_block *block, unsigned pc,
+                               struct InstOpcode const *op,
+                               cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_SZ_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_base = ((inst >> 4) & 0xf) + SH4_REG_R0;
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    unsigned slot_addr = alloc_slot(block);
+    jit_mov(block, reg_slot(sh4, block, SH4_REG_R0), slot_addr);
+    jit_add(block, reg_slot(sh4, block, reg_base), slot_addr);
+
+    unsigned slot_dst = reg_slot(sh4, block, reg_dst);
+
+    jit_read_32_slot(block, sh4->mem.map, slot_addr, slot_dst);
+
+    reg_map[reg_dst].stat = REG_STATUS_SLOT;
+
+    free_slot(block, slot_addr);
+    jit_discard_slot(block, slot_addr);
+
+    return true;
+}
+
+// FMOV.S @Rm+, FRn
+// 1111nnnnmmmm1001
+bool sh4_jit_fmovs_armp_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_SZ_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_addr = ((inst >> 4) & 0xf) + SH4_REG_R0;
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    unsigned slot_addr = reg_slot(sh4, block, reg_addr);
+    unsigned slot_dst = reg_slot(sh4, block, reg_dst);
+
+    jit_read_32_slot(block, sh4->mem.map, slot_addr, slot_dst);
+    jit_add_const32(block, slot_addr, 4);
+
+    reg_map[reg_dst].stat = REG_STATUS_SLOT;
+    reg_map[reg_addr].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+// FMOV.S FRm, @Rn
+// 1111nnnnmmmm1010
+bool sh4_jit_fmovs_frm_arn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_SZ_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 4) & 0xf) + SH4_REG_FR0;
+    unsigned reg_addr = ((inst >> 8) & 0xf) + SH4_REG_R0;
+
+    unsigned slot_src = reg_slot(sh4, block, reg_src);
+    unsigned slot_addr = reg_slot(sh4, block, reg_addr);
+
+    jit_write_32_slot(block, sh4->mem.map, slot_src, slot_addr);
+
+    return true;
+}
+
+// FMOV.S FRm, @-Rn
+// 1111nnnnmmmm1011
+bool sh4_jit_fmovs_frm_amrn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_SZ_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 4) & 0xf) + SH4_REG_FR0;
+    unsigned reg_addr = ((inst >> 8) & 0xf) + SH4_REG_R0;
+
+    unsigned slot_src = reg_slot(sh4, block, reg_src);
+    unsigned slot_addr = reg_slot(sh4, block, reg_addr);
+
+    jit_add_const32(block, slot_addr, -4);
+    jit_write_32_slot(block, sh4->mem.map, slot_src, slot_addr);
+
+    reg_map[reg_addr].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+// FMOV.S FRm, @(R0, Rn)
+// 1111nnnnmmmm0111
+bool sh4_jit_fmovs_frm_a_r0_rn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                               struct il_code_block *block, unsigned pc,
+                               struct InstOpcode const *op,
+                               cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_SZ_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 4) & 0xf) + SH4_REG_FR0;
+    unsigned reg_base = ((inst >> 8) & 0xf) + SH4_REG_R0;
+
+    unsigned slot_addr = alloc_slot(block);
+    jit_mov(block, reg_slot(sh4, block, SH4_REG_R0), slot_addr);
+    jit_add(block, reg_slot(sh4, block, reg_base), slot_addr);
+
+    unsigned slot_src = reg_slot(sh4, block, reg_src);
+
+    jit_write_32_slot(block, sh4->mem.map, slot_src, slot_addr);
+
+    free_slot(block, slot_addr);
+    jit_discard_slot(block, slot_addr);
+
+    return true;
+}
+
+// FLDS FRm, FPUL
+// 1111mmmm00011101
+bool sh4_jit_flds_frm_fpul(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst) {
+    sh4_jit_fmov_reg(sh4, block, ((inst >> 8) & 0xf) + SH4_REG_FR0,
+                     SH4_REG_FPUL);
+    return true;
+}
+
+// FSTS FPUL, FRn
+// 1111nnnn00001101
+bool sh4_jit_fsts_fpul_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst) {
+    sh4_jit_fmov_reg(sh4, block, SH4_REG_FPUL,
+                     ((inst >> 8) & 0xf) + SH4_REG_FR0);
+    return true;
+}
+
+// FABS FRn
+// 1111nnnn01011101
+bool sh4_jit_fabs_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                      struct il_code_block *block, unsigned pc,
+                      struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_no = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+    unsigned slot_no = reg_slot(sh4, block, reg_no);
+
+    jit_and_const32(block, slot_no, 0x7fffffff);
+
+    reg_map[reg_no].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+// FNEG FRn
+// 1111nnnn01001101
+bool sh4_jit_fneg_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                      struct il_code_block *block, unsigned pc,
+                      struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_no = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+    unsigned slot_no = reg_slot(sh4, block, reg_no);
+
+    jit_xor_const32(block, slot_no, 0x80000000);
+
+    reg_map[reg_no].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+static bool
+sh4_jit_fpu_binop(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                  struct il_code_block *block, unsigned pc,
+                  struct InstOpcode const *op, cpu_inst_param inst,
+                  void(*il_op)(struct il_code_block*, unsigned, unsigned)) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 4) & 0xf) + SH4_REG_FR0;
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    sh4_jit_fpu_clear_cause(sh4, block);
+
+    unsigned slot_src = reg_slot(sh4, block, reg_src);
+    unsigned slot_dst = reg_slot(sh4, block, reg_dst);
+
+    il_op(block, slot_src, slot_dst);
+
+    reg_map[reg_dst].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+// FADD FRm, FRn
+// 1111nnnnmmmm0000
+bool sh4_jit_fadd_frm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst) {
+    return sh4_jit_fpu_binop(sh4, ctx, block, pc, op, inst, jit_fadd);
+}
+
+// FSUB FRm, FRn
+// 1111nnnnmmmm0001
+bool sh4_jit_fsub_frm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst) {
+    return sh4_jit_fpu_binop(sh4, ctx, block, pc, op, inst, jit_fsub);
+}
+
+// FMUL FRm, FRn
+// 1111nnnnmmmm0010
+bool sh4_jit_fmul_frm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst) {
+    return sh4_jit_fpu_binop(sh4, ctx, block, pc, op, inst, jit_fmul);
+}
+
+// FDIV FRm, FRn
+// 1111nnnnmmmm0011
+bool sh4_jit_fdiv_frm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst) {
+    return sh4_jit_fpu_binop(sh4, ctx, block, pc, op, inst, jit_fdiv);
+}
+
+// FMAC FR0, FRm, FRn
+// 1111nnnnmmmm1110
+bool sh4_jit_fmac_fr0_frm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                              struct il_code_block *block, unsigned pc,
+                              struct InstOpcode const *op,
+                              cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 4) & 0xf) + SH4_REG_FR0;
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    sh4_jit_fpu_clear_cause(sh4, block);
+
+    /*
+     * the interpreter rounds the product before adding it, so this does the
+     * same instead of using a fused multiply-add.
+     */
+    unsigned slot_prod = alloc_slot(block);
+    jit_mov(block, reg_slot(sh4, block, SH4_REG_FR0), slot_prod);
+    jit_fmul(block, reg_slot(sh4, block, reg_src), slot_prod);
+
+    unsigned slot_dst = reg_slot(sh4, block, reg_dst);
+    jit_fadd(block, slot_prod, slot_dst);
+
+    reg_map[reg_dst].stat = REG_STATUS_SLOT;
+
+    free_slot(block, slot_prod);
+    jit_discard_slot(block, slot_prod);
+
+    return true;
+}
+
+// FSQRT FRn
+// 1111nnnn01101101
+bool sh4_jit_fsqrt_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                       struct il_code_block *block, unsigned pc,
+                       struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_no = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    sh4_jit_fpu_clear_cause(sh4, block);
+
+    unsigned slot_no = reg_slot(sh4, block, reg_no);
+
+    jit_fsqrt(block, slot_no);
+
+    reg_map[reg_no].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+// FLOAT FPUL, FRn
+// 1111nnnn00101101
+bool sh4_jit_float_fpul_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    sh4_jit_fmov_reg(sh4, block, SH4_REG_FPUL, reg_dst);
+    jit_cvt_i32_f32(block, reg_slot(sh4, block, reg_dst));
+
+    return true;
+}
+
+// FTRC FRm, FPUL
+// 1111mmmm00111101
+bool sh4_jit_ftrc_frm_fpul(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    sh4_jit_fpu_clear_cause(sh4, block);
+
+    sh4_jit_fmov_reg(sh4, block, reg_src, SH4_REG_FPUL);
+    jit_cvt_f32_i32(block, reg_slot(sh4, block, SH4_REG_FPUL));
+
+    return true;
+}
+
+// FCMP/EQ FRm, FRn
+// 1111nnnnmmmm0100
+bool sh4_jit_fcmpeq_frm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 4) & 0xf) + SH4_REG_FR0;
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    sh4_jit_fpu_clear_cause(sh4, block);
+
+    unsigned slot_src = reg_slot(sh4, block, reg_src);
+    unsigned slot_dst = reg_slot(sh4, block, reg_dst);
+    unsigned slot_sr = reg_slot(sh4, block, SH4_REG_SR);
+
+    jit_and_const32(block, slot_sr, ~1);
+    jit_fset_eq(block, slot_dst, slot_src, slot_sr);
+
+    reg_map[SH4_REG_SR].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+// FCMP/GT FRm, FRn
+// 1111nnnnmmmm0101
+bool sh4_jit_fcmpgt_frm_frn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, SH4_FPSCR_PR_MASK, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 4) & 0xf) + SH4_REG_FR0;
+    unsigned reg_dst = ((inst >> 8) & 0xf) + SH4_REG_FR0;
+
+    sh4_jit_fpu_clear_cause(sh4, block);
+
+    unsigned slot_src = reg_slot(sh4, block, reg_src);
+    unsigned slot_dst = reg_slot(sh4, block, reg_dst);
+    unsigned slot_sr = reg_slot(sh4, block, SH4_REG_SR);
+
+    jit_and_const32(block, slot_sr, ~1);
+    jit_fset_gt(block, slot_dst, slot_src, slot_sr);
+
+    reg_map[SH4_REG_SR].stat = REG_STATUS_SLOT;
+
+    return true;
+}
+
+// FIPR FVm, FVn
+// 1111nnmm11101101
+bool sh4_jit_fipr_fvm_fvn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, 0, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_src = ((inst >> 8) & 0x3) * 4 + SH4_REG_FR0;
+    unsigned reg_dst = ((inst >> 10) & 0x3) * 4 + SH4_REG_FR0;
+    unsigned idx;
+
+    sh4_jit_fpu_clear_cause(sh4, block);
+
+    // the vectors get read straight out of the register file
+    for (idx = 0; idx < 4; idx++) {
+        res_drain_reg(sh4, block, reg_src + idx);
+        res_drain_reg(sh4, block, reg_dst + idx);
+    }
+    res_invalidate_reg(block, reg_dst + 3);
+
+    jit_dot4(block, (float*)(sh4->reg + reg_src), (float*)(sh4->reg + reg_dst),
+             (float*)(sh4->reg + reg_dst + 3));
+
+    return true;
+}
+
+// FTRV XMTRX, FVn
+// 1111nn0111111101
+bool sh4_jit_ftrv_xmtrx_fvn(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst) {
+    if (!fpscr_mode_is(ctx, 0, 0))
+        return sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    unsigned reg_vec = ((inst >> 10) & 0x3) * 4 + SH4_REG_FR0;
+    unsigned idx;
+
+    sh4_jit_fpu_clear_cause(sh4, block);
+
+    for (idx = 0; idx < 16; idx++)
+        res_drain_reg(sh4, block, SH4_REG_XF0 + idx);
+    for (idx = 0; idx < 4; idx++) {
+        res_drain_reg(sh4, block, reg_vec + idx);
+        res_invalidate_reg(block, reg_vec + idx);
+    }
+
+    jit_mat4_xform(block, (float*)(sh4->reg + SH4_REG_XF0),
+                   (float*)(sh4->reg + reg_vec));
+
+    return true;
+}
+
+bool sh4_jit_fpscr_mode_change(Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                               struct il_code_block *block, unsigned pc,
+                               struct InstOpcode const *op,
+                               cpu_inst_param inst) {
+    sh4_jit_fallback(sh4, ctx, block, pc, op, inst);
+
+    // FSCHG is the only one of these whose effect is known ahead of time
+    if (inst == 0xf3fd)
+        ctx->fpscr_mode ^= SH4_FPSCR_SZ_MASK;
+    else
+        ctx->fpscr_mode_known = false;
+
+    block->mode_change = true;
+
+    return true;
+}
+
 static unsigned reg_slot(Sh4 *sh4, struct il_code_block *block, unsigned reg_no) {
     struct residency *res = reg_map + reg_no;
 
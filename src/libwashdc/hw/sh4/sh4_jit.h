@@ -27,9 +27,16 @@
 
 #include "washdc/cpu.h"
 #include "washdc/types.h"
+#include "sh4.h"
 #include "sh4_inst.h"
+#include "sh4_reg_flags.h"
 #include "jit/jit_il.h"
 #include "jit/code_block.h"
+#include "jit/code_cache.h"
+
+#ifdef JIT_OPTIMIZE
+#include "jit/jit_opt.h"
+#endif
 
 #ifdef ENABLE_JIT_X86_64
 #include "jit/x86_64/code_block_x86_64.h"
@@ -45,44 +52,186 @@ struct Sh4;
  */
 void sh4_jit_new_block(void);
 
+/*
+ * the bits of FPSCR which change the meaning of FPU opcodes.  Compiled blocks
+ * are specialized for one value of these bits, so they're part of the key that
+ * the code cache looks blocks up with.
+ */
+#define SH4_JIT_FPSCR_MODE_MASK (SH4_FPSCR_PR_MASK | SH4_FPSCR_SZ_MASK)
+
 struct sh4_jit_compile_ctx {
     unsigned last_inst_type;
     unsigned cycle_count;
+
+    /*
+     * value of FPSCR & SH4_JIT_FPSCR_MODE_MASK at the current instruction.
+     * This is only valid if fpscr_mode_known is true; it becomes false after
+     * any instruction that writes an unknown value to FPSCR.
+     */
+    uint32_t fpscr_mode;
+    bool fpscr_mode_known;
+
+    // address of the block's first instruction
+    addr32_t blk_start;
+
+    /*
+     * true if the block is an idle loop, in which case the backwards branch
+     * to blk_start fast-forwards the clock to the next scheduled event.
+     */
+    bool idle_loop;
+
+    /*
+     * non-NULL while a trace is being compiled (see sh4_jit_trace).  When a
+     * branch decides that the trace keeps going, it sets trace_redirect and
+     * compilation picks up again at trace_next_pc, which is the start of the
+     * trace's next block.  blk_start is always the start of the current block.
+     */
+    struct code_cache_trace *trace;
+    bool trace_redirect;
+    addr32_t trace_next_pc;
+};
+
+struct sh4_jit_idle_stats {
+    // blocks that were compiled as idle loops
+    unsigned long long n_loops;
+
+    // times an idle loop fast-forwarded the clock
+    unsigned long long n_skips;
+
+    // SH4 cycles skipped, in total and during the last full frame
+    unsigned long long cycles_skipped;
+    unsigned long long cycles_skipped_last_frame;
+};
+
+/*
+ * checks whether the block starting at blk_start is an idle loop, and sets up
+ * ctx accordingly.  Call this before compiling the block's first instruction.
+ */
+void sh4_jit_idle_begin_block(struct Sh4 *sh4, struct sh4_jit_compile_ctx *ctx,
+                              addr32_t blk_start);
+
+// call this at the end of every frame to update cycles_skipped_last_frame
+void sh4_jit_idle_end_frame(void);
+
+void sh4_jit_idle_get_stats(struct sh4_jit_idle_stats *stats);
+void sh4_jit_idle_print_stats(struct sh4_jit_idle_stats const *stats);
+
+struct sh4_jit_fallback_stats {
+    /*
+     * instructions compiled as calls to the interpreter, and how many of those
+     * had to write back and invalidate every register because it isn't known
+     * which registers they use.
+     */
+    unsigned long long n_fallbacks;
+    unsigned long long n_full_drains;
+
+    /*
+     * registers written back to the reg array before a fallback, and registers
+     * dropped from their slots (which means they get loaded again the next
+     * time they're used)
+     */
+    unsigned long long n_regs_stored;
+    unsigned long long n_regs_invalidated;
 };
 
+void sh4_jit_fallback_get_stats(struct sh4_jit_fallback_stats *stats);
+void
+sh4_jit_fallback_print_stats(struct sh4_jit_fallback_stats const *stats);
+
+#ifdef JIT_OPTIMIZE
+// only touched on the emulation thread; see dc_print_perf_stats
+extern struct jit_opt_stats sh4_jit_opt_stats;
+#endif
+
 bool
 sh4_jit_compile_inst(struct Sh4 *sh4, struct sh4_jit_compile_ctx *ctx,
                      struct il_code_block *block, unsigned pc);
 
-static inline void
+/*
+ * returns the address of the last byte of guest code in the block.  The final
+ * instruction's delay slot (if it has one) is included.
+ */
+static inline addr32_t
 sh4_jit_il_code_block_compile(struct Sh4 *sh4, struct sh4_jit_compile_ctx *ctx,
                               struct il_code_block *block, addr32_t addr) {
     bool do_continue;
 
     sh4_jit_new_block();
 
+    ctx->fpscr_mode = sh4->reg[SH4_REG_FPSCR] & SH4_JIT_FPSCR_MODE_MASK;
+    ctx->fpscr_mode_known = true;
+
+    sh4_jit_idle_begin_block(sh4, ctx, addr);
+
     do {
         do_continue = sh4_jit_compile_inst(sh4, ctx, block, addr);
         addr += 2;
     } while (do_continue);
+
+    return addr + 1;
 }
 
+/*
+ * fills in block with the IL for the block at pc, either by translating it or
+ * by loading it from the persistent translation cache.  Returns the address of
+ * the last byte of guest code in the block, and the number of cycles it takes
+ * goes in cycle_count.
+ */
+addr32_t sh4_jit_il_block_get(struct Sh4 *sh4, struct il_code_block *block,
+                              addr32_t pc, unsigned *cycle_count);
+
+#ifdef ENABLE_JIT_X86_64
+/*
+ * code_cache_trace_func for the SH4.  This only works when tiered compilation
+ * is enabled, since that's where the branch profiles come from.
+ */
+bool sh4_jit_trace(void *cpu, code_cache_key key, struct il_code_block *block,
+                   struct code_cache_trace *trace);
+#endif
+
+/*
+ * open the persistent translation cache at path.  Call this after the SH4's
+ * memory map has been set and the jit has been configured.  If this is never
+ * called then every block is translated from scratch.
+ */
+void sh4_jit_cache_init(struct Sh4 *sh4, char const *path);
+
+// write the persistent translation cache back to disk
+void sh4_jit_cache_cleanup(void);
+
 #ifdef ENABLE_JIT_X86_64
 static inline void
 sh4_jit_compile_native(void *cpu, void *blk_ptr, uint32_t pc) {
     struct il_code_block il_blk;
     struct code_block_x86_64 *blk = (struct code_block_x86_64*)blk_ptr;
-    struct sh4_jit_compile_ctx ctx = { .last_inst_type = SH4_GROUP_NONE,
-                                       .cycle_count = 0 };
+    unsigned cycle_count;
 
     il_code_block_init(&il_blk);
-    sh4_jit_il_code_block_compile(cpu, &ctx, &il_blk, pc);
-#ifdef JIT_OPTIMIZE
-    jit_determ_pass(&il_blk);
-#endif
+    addr32_t last_addr = sh4_jit_il_block_get(cpu, &il_blk, pc, &cycle_count);
     code_block_x86_64_compile(cpu, blk, &il_blk, sh4_jit_compile_native,
-                              ctx.cycle_count * SH4_CLOCK_SCALE);
+                              cycle_count * SH4_CLOCK_SCALE);
     il_code_block_cleanup(&il_blk);
+    code_cache_track_block(pc, last_addr);
+}
+
+/*
+ * compile handler for the native dispatcher when tiered compilation is
+ * enabled.  Blocks start out in the IL interpreter and get compiled to native
+ * code once they're hot (see struct code_cache_tier).
+ */
+static inline void
+sh4_jit_compile_tiered(void *cpu, void *blk_ptr, uint32_t pc) {
+    struct il_code_block il_blk;
+    struct cache_entry *ent =
+        code_cache_entry_of_x86_64((struct code_block_x86_64*)blk_ptr);
+    unsigned cycle_count;
+
+    il_code_block_init(&il_blk);
+    addr32_t last_addr = sh4_jit_il_block_get(cpu, &il_blk, pc, &cycle_count);
+    code_cache_tier_compile(cpu, ent, &il_blk, sh4_jit_compile_tiered,
+                            cycle_count * SH4_CLOCK_SCALE);
+    il_code_block_cleanup(&il_blk);
+    code_cache_track_block(pc, last_addr);
 }
 #endif
 
@@ -90,16 +239,13 @@ static inline void
 sh4_jit_compile_intp(void *cpu, void *blk_ptr, uint32_t pc) {
     struct il_code_block il_blk;
     struct code_block_intp *blk = (struct code_block_intp*)blk_ptr;
-    struct sh4_jit_compile_ctx ctx = { .last_inst_type = SH4_GROUP_NONE,
-                                       .cycle_count = 0 };
+    unsigned cycle_count;
 
     il_code_block_init(&il_blk);
-    sh4_jit_il_code_block_compile(cpu, &ctx, &il_blk, pc);
-#ifdef JIT_OPTIMIZE
-    jit_determ_pass(&il_blk);
-#endif
-    code_block_intp_compile(cpu, blk, &il_blk, ctx.cycle_count * SH4_CLOCK_SCALE);
+    addr32_t last_addr = sh4_jit_il_block_get(cpu, &il_blk, pc, &cycle_count);
+    code_block_intp_compile(cpu, blk, &il_blk, cycle_count * SH4_CLOCK_SCALE);
     il_code_block_cleanup(&il_blk);
+    code_cache_track_block(pc, last_addr);
 }
 
 /*
@@ -483,4 +629,170 @@ sh4_jit_movl_a_disp8_gbr_r0(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
                             struct il_code_block *block, unsigned pc,
                             struct InstOpcode const *op, cpu_inst_param inst);
 
+// FLDI0 FRn
+// 1111nnnn10001101
+bool sh4_jit_fldi0_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                       struct il_code_block *block, unsigned pc,
+                       struct InstOpcode const *op, cpu_inst_param inst);
+
+// FLDI1 FRn
+// 1111nnnn10011101
+bool sh4_jit_fldi1_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                       struct il_code_block *block, unsigned pc,
+                       struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMOV FRm, FRn
+// 1111nnnnmmmm1100
+// FMOV DRm, DRn
+// 1111nnn0mmm01100
+// FMOV XDm, DRn
+// 1111nnn0mmm11100
+// FMOV DRm, XDn
+// 1111nnn1mmm01100
+bool sh4_jit_fmov_gen(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                      struct il_code_block *block, unsigned pc,
+                      struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMOV.S @Rm, FRn
+// 1111nnnnmmmm1000
+bool sh4_jit_fmovs_arm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMOV.S @(R0, Rm), FRn
+// 1111nnnnmmmm0110
+bool sh4_jit_fmovs_a_r0_rm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                               struct il_code_block *block, unsigned pc,
+                               struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMOV.S @Rm+, FRn
+// 1111nnnnmmmm1001
+bool sh4_jit_fmovs_armp_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMOV.S FRm, @Rn
+// 1111nnnnmmmm1010
+bool sh4_jit_fmovs_frm_arn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMOV.S FRm, @-Rn
+// 1111nnnnmmmm1011
+bool sh4_jit_fmovs_frm_amrn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMOV.S FRm, @(R0, Rn)
+// 1111nnnnmmmm0111
+bool sh4_jit_fmovs_frm_a_r0_rn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                               struct il_code_block *block, unsigned pc,
+                               struct InstOpcode const *op, cpu_inst_param inst);
+
+// FLDS FRm, FPUL
+// 1111mmmm00011101
+bool sh4_jit_flds_frm_fpul(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst);
+
+// FSTS FPUL, FRn
+// 1111nnnn00001101
+bool sh4_jit_fsts_fpul_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst);
+
+// FABS FRn
+// 1111nnnn01011101
+bool sh4_jit_fabs_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                      struct il_code_block *block, unsigned pc,
+                      struct InstOpcode const *op, cpu_inst_param inst);
+
+// FNEG FRn
+// 1111nnnn01001101
+bool sh4_jit_fneg_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                      struct il_code_block *block, unsigned pc,
+                      struct InstOpcode const *op, cpu_inst_param inst);
+
+// FADD FRm, FRn
+// 1111nnnnmmmm0000
+bool sh4_jit_fadd_frm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst);
+
+// FSUB FRm, FRn
+// 1111nnnnmmmm0001
+bool sh4_jit_fsub_frm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMUL FRm, FRn
+// 1111nnnnmmmm0010
+bool sh4_jit_fmul_frm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst);
+
+// FDIV FRm, FRn
+// 1111nnnnmmmm0011
+bool sh4_jit_fdiv_frm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst);
+
+// FMAC FR0, FRm, FRn
+// 1111nnnnmmmm1110
+bool sh4_jit_fmac_fr0_frm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                              struct il_code_block *block, unsigned pc,
+                              struct InstOpcode const *op, cpu_inst_param inst);
+
+// FSQRT FRn
+// 1111nnnn01101101
+bool sh4_jit_fsqrt_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                       struct il_code_block *block, unsigned pc,
+                       struct InstOpcode const *op, cpu_inst_param inst);
+
+// FLOAT FPUL, FRn
+// 1111nnnn00101101
+bool sh4_jit_float_fpul_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst);
+
+// FTRC FRm, FPUL
+// 1111mmmm00111101
+bool sh4_jit_ftrc_frm_fpul(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                           struct il_code_block *block, unsigned pc,
+                           struct InstOpcode const *op, cpu_inst_param inst);
+
+// FCMP/EQ FRm, FRn
+// 1111nnnnmmmm0100
+bool sh4_jit_fcmpeq_frm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst);
+
+// FCMP/GT FRm, FRn
+// 1111nnnnmmmm0101
+bool sh4_jit_fcmpgt_frm_frn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst);
+
+// FIPR FVm, FVn
+// 1111nnmm11101101
+bool sh4_jit_fipr_fvm_fvn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                          struct il_code_block *block, unsigned pc,
+                          struct InstOpcode const *op, cpu_inst_param inst);
+
+// FTRV XMTRX, FVn
+// 1111nn0111111101
+bool sh4_jit_ftrv_xmtrx_fvn(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                            struct il_code_block *block, unsigned pc,
+                            struct InstOpcode const *op, cpu_inst_param inst);
+
+/*
+ * LDS Rm, FPSCR, LDS.L @Rm+, FPSCR and FSCHG.  These go through the
+ * interpreter, but they also change the FPSCR mode for the rest of the block
+ * and for the block's successors.
+ */
+bool sh4_jit_fpscr_mode_change(struct Sh4 *sh4, struct sh4_jit_compile_ctx* ctx,
+                               struct il_code_block *block, unsigned pc,
+                               struct InstOpcode const *op,
+                               cpu_inst_param inst);
+
 #endif
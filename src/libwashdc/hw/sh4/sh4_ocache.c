@@ -31,6 +31,7 @@
 #include "washdc/error.h"
 #include "log.h"
 #include "washdc/MemoryMap.h"
+#include "jit/code_cache.h"
 
 #include "sh4_ocache.h"
 
@@ -214,7 +215,10 @@ int sh4_sq_pref(Sh4 *sh4, addr32_t addr) {
     addr32_t addr_actual = (addr & SH4_SQ_ADDR_MASK) |
         (((qacr & SH4_QACR_MASK) >> SH4_QACR_SHIFT) << 26);
 
-    struct memory_map_region *region =
+    struct memory_map_page const *page =
+        memory_map_get_page(sh4->mem.map, addr_actual,
+                            addr_actual + (8 * sizeof(uint32_t) - 1));
+    struct memory_map_region const *region = page ? page->region :
         memory_map_get_region(sh4->mem.map, addr_actual, 8 * sizeof(uint32_t));
 
     if (region) {
@@ -224,6 +228,23 @@ int sh4_sq_pref(Sh4 *sh4, addr32_t addr) {
         memory_map_write32_func write32 = intf->write32;
         uint32_t *sq = sh4->ocache.sq + sq_idx;
 
+        // throw out any compiled code the burst is about to overwrite
+        if (region->id == MEMORY_MAP_REGION_RAM)
+            code_cache_notify_write(addr_actual, 8 * sizeof(uint32_t));
+
+        if (intf->write_burst32) {
+            CHECK_W_WATCHPOINT(addr_actual + 0, uint32_t);
+            CHECK_W_WATCHPOINT(addr_actual + 4, uint32_t);
+            CHECK_W_WATCHPOINT(addr_actual + 8, uint32_t);
+            CHECK_W_WATCHPOINT(addr_actual + 12, uint32_t);
+            CHECK_W_WATCHPOINT(addr_actual + 16, uint32_t);
+            CHECK_W_WATCHPOINT(addr_actual + 20, uint32_t);
+            CHECK_W_WATCHPOINT(addr_actual + 24, uint32_t);
+            CHECK_W_WATCHPOINT(addr_actual + 28, uint32_t);
+            intf->write_burst32(addr_actual & mask, sq, 8, ctxt);
+            return MEM_ACCESS_SUCCESS;
+        }
+
         CHECK_W_WATCHPOINT(addr_actual + 0, uint32_t);
         write32((addr_actual + 0) & mask, sq[0], ctxt);
         CHECK_W_WATCHPOINT(addr_actual + 4, uint32_t);
@@ -681,8 +681,11 @@ static void
 sh4_ccr_write_handler(Sh4 *sh4,
                       struct Sh4MemMappedReg const *reg_info,
                       sh4_reg_val val) {
-    if (config_get_jit())
-        code_cache_invalidate_all();
+    /*
+     * there's no need to flush the code cache when the instruction cache gets
+     * invalidated, since every write to main RAM already throws out the
+     * compiled code on the page it writes to (see code_cache_ram_pages).
+     */
     sh4->reg[SH4_REG_CCR] = val;
 }
 
@@ -60,6 +60,16 @@ void(*memory_map_write16_func)(uint32_t addr, uint16_t val, void *ctxt);
 typedef
 void(*memory_map_write8_func)(uint32_t addr, uint8_t val, void *ctxt);
 
+/*
+ * write n_words consecutive 32-bit words starting at addr, as if write32 had
+ * been called for each one in order.  This is for burst writes like
+ * store-queue flushes, so that regions which consume data in packets can take
+ * the whole thing at once.
+ */
+typedef
+void(*memory_map_write_burst32_func)(uint32_t addr, uint32_t const *src,
+                                     unsigned n_words, void *ctxt);
+
 /*
  * read/write functions which will return an error instead of crashing if the
  * requested address has not been implemented.
@@ -127,6 +137,9 @@ struct memory_interface {
     memory_map_try_write32_func try_write32;
     memory_map_try_write16_func try_write16;
     memory_map_try_write8_func try_write8;
+
+    // optional; if this is NULL then bursts go through write32 one at a time
+    memory_map_write_burst32_func write_burst32;
 };
 
 struct memory_map_region {
@@ -144,10 +157,52 @@ struct memory_map_region {
 
 #define MAX_MEM_MAP_REGIONS 64
 
+/*
+ * The memory_map keeps a flat page table over the entire 32-bit address space
+ * so that reads and writes can be dispatched without scanning the regions
+ * array.  Each page either points directly at host memory (for
+ * MEMORY_MAP_REGION_RAM), or at the single region which covers it.  Pages
+ * which are shared between several regions (this is mostly the case for the
+ * MMIO registers in area 0) get a second-level table with finer granularity.
+ * Anything that still can't be resolved to exactly one region falls back to
+ * the linear scan.
+ */
+#define MEMORY_MAP_PAGE_SHIFT 16
+#define MEMORY_MAP_PAGE_SIZE (1 << MEMORY_MAP_PAGE_SHIFT)
+#define MEMORY_MAP_PAGE_MASK (MEMORY_MAP_PAGE_SIZE - 1)
+#define MEMORY_MAP_N_PAGES (1 << (32 - MEMORY_MAP_PAGE_SHIFT))
+
+#define MEMORY_MAP_SUBPAGE_SHIFT 8
+#define MEMORY_MAP_SUBPAGE_SIZE (1 << MEMORY_MAP_SUBPAGE_SHIFT)
+#define MEMORY_MAP_SUBPAGE_MASK (MEMORY_MAP_SUBPAGE_SIZE - 1)
+#define MEMORY_MAP_N_SUBPAGES \
+    (1 << (MEMORY_MAP_PAGE_SHIFT - MEMORY_MAP_SUBPAGE_SHIFT))
+
+struct memory_map_page {
+    /*
+     * if this is non-NULL, then the page is backed by RAM and this points to
+     * the host memory at the beginning of the page.  This is only ever set on
+     * top-level pages, never on subpages.
+     */
+    uint8_t *host;
+
+    // the one region which covers this page, or NULL
+    struct memory_map_region const *region;
+
+    /*
+     * second-level table with MEMORY_MAP_N_SUBPAGES entries, for pages which
+     * are shared by more than one region.
+     */
+    struct memory_map_page *subpages;
+};
+
 struct memory_map {
     struct memory_map_region regions[MAX_MEM_MAP_REGIONS];
     unsigned n_regions;
 
+    // MEMORY_MAP_N_PAGES entries, allocated by memory_map_init
+    struct memory_map_page *pages;
+
     /*
      * Called when software tries to read/write to an address that is not in
      * any of the regions.
@@ -246,6 +301,29 @@ memory_map_get_region(struct memory_map *map,
     return NULL;
 }
 
+/*
+ * return the page table entry which fully contains the given address range, or
+ * NULL if there isn't one (which means the caller needs to fall back to
+ * memory_map_get_region).
+ */
+static inline struct memory_map_page const *
+memory_map_get_page(struct memory_map const *map,
+                    uint32_t first_addr, uint32_t last_addr) {
+    if ((first_addr ^ last_addr) >> MEMORY_MAP_PAGE_SHIFT)
+        return NULL;
+
+    struct memory_map_page const *page =
+        map->pages + (first_addr >> MEMORY_MAP_PAGE_SHIFT);
+    if (page->subpages) {
+        if ((first_addr ^ last_addr) >> MEMORY_MAP_SUBPAGE_SHIFT)
+            return NULL;
+        page = page->subpages +
+            ((first_addr & MEMORY_MAP_PAGE_MASK) >> MEMORY_MAP_SUBPAGE_SHIFT);
+    }
+
+    return page->region ? page : NULL;
+}
+
 #ifdef __cplusplus
 }
 #endif
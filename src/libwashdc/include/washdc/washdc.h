@@ -24,6 +24,7 @@
 #define LIBWASHDC_H_
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "sound_intf.h"
@@ -78,6 +79,13 @@ struct washdc_overlay_intf {
     void (*overlay_draw)(void);
     void (*overlay_set_fps)(double fps);
     void (*overlay_set_virt_fps)(double fps);
+
+    /*
+     * called to release the overlay's OpenGL resources.  This gets called
+     * from whichever thread owns the OpenGL context, which isn't necessarily
+     * the one that called washdc_cleanup.
+     */
+    void (*overlay_cleanup_gfx)(void);
 };
 
 struct washdc_launch_settings {
@@ -88,6 +96,9 @@ struct washdc_launch_settings {
     char const *path_dc_flash;
     char const *path_gdi;
 
+    // if non-NULL, record a scheduler trace to this path
+    char const *path_sched_trace;
+
     struct win_intf const *win_intf;
     struct washdc_overlay_intf const *overlay_intf;
 
@@ -108,11 +119,35 @@ struct washdc_launch_settings {
     /* #endif */
     bool inline_mem;
     bool enable_jit;
+
+    /*
+     * fast-forward the SH4 through idle loops (jit only).  Some titles poll
+     * things that change without a scheduled event, so this can be turned
+     * off.
+     */
+    bool jit_idle_skip;
     /* #ifdef ENABLE_JIT_X86_64 */
     bool enable_native_jit;
+    bool fastmem;
     /* #endif */
+    bool enable_arm7_jit;
+    bool arm7_jit_lockstep;
     bool cmd_session;
     bool enable_serial;
+
+    /*
+     * do the OpenGL rendering on its own thread instead of the emulation
+     * thread.  overlay_draw gets called from that thread too.
+     */
+    bool threaded_render;
+
+    /*
+     * run the ARM7 and AICA on their own thread.  arm7_skew_limit is the
+     * furthest (in microseconds of emulated time) either CPU may get ahead
+     * of the other; 0 means use the default.
+     */
+    bool arm7_thread;
+    int arm7_skew_limit;
 };
 
 int washdc_save_screenshot(char const *path);
@@ -206,10 +241,55 @@ enum washdc_pvr2_poly_group {
 
 struct washdc_pvr2_stat {
     unsigned poly_count[WASHDC_PVR2_POLY_GROUP_COUNT];
+
+    // texture cache activity during the last frame
+    unsigned tex_lookups, tex_hits, tex_evictions, tex_uploads;
+
+    /*
+     * opaque and punch-through draws during the last frame, before and after
+     * batching, and how many vertices had to be copied to merge them
+     */
+    unsigned batch_draws_in, batch_draws_out, batch_verts_copied;
 };
 
 void washdc_get_pvr2_stat(struct washdc_pvr2_stat *stat);
 
+struct washdc_gfx_stat {
+    bool threaded;
+
+    // render thread command ring: current length, capacity, last frame's peak
+    unsigned ring_len, ring_cap, ring_peak;
+
+    // render thread payload arena: bytes in use and capacity
+    size_t arena_len, arena_cap;
+
+    // times the emulation thread blocked on a full ring or arena
+    unsigned long long producer_stalls;
+
+    // times the emulation thread blocked waiting for a result
+    unsigned long long sync_waits;
+
+    // renderer draw calls and vertex bytes uploaded during the last render
+    unsigned rend_draw_calls;
+    unsigned long long rend_upload_bytes;
+
+    // whether vertex data goes through a persistently-mapped buffer
+    bool rend_persistent_map;
+};
+
+void washdc_get_gfx_stat(struct washdc_gfx_stat *stat);
+
+struct washdc_idle_stat {
+    // SH4 cycles the jit skipped by fast-forwarding through idle loops
+    unsigned long long cycles_skipped_last_frame;
+    unsigned long long cycles_skipped;
+
+    // blocks that were compiled as idle loops
+    unsigned long long n_loops;
+};
+
+void washdc_get_idle_stat(struct washdc_idle_stat *stat);
+
 void washdc_pause(void);
 void washdc_resume(void);
 bool washdc_is_paused(void);
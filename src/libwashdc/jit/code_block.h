@@ -57,8 +57,22 @@ struct il_code_block {
 
     struct il_slot slots[MAX_SLOTS];
 
+    /*
+     * set by the frontend if this block can change the mode that the code
+     * cache keys blocks on (see code_cache_key_make).  The successors of such
+     * a block can't be linked to it directly because they may need to be
+     * looked up under a different mode.
+     */
+    bool mode_change;
+
+    /*
+     * number of guest instructions the block runs if it goes all the way to
+     * the end, or 0 if the frontend doesn't say.  This is only used for stats.
+     */
+    unsigned n_guest_insts;
+
 #ifdef JIT_OPTIMIZE
-    // The length of this array is inst_count, but only if it is non-NULL
+    // filled in by jit_determ_pass, or NULL if the pass hasn't been run
     struct jit_determ_state *determ;
 #endif
 };
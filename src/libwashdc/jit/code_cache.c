@@ -21,9 +21,11 @@
  ******************************************************************************/
 
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
 
 #include "washdc/error.h"
 #include "code_block.h"
@@ -33,6 +35,7 @@
 
 #ifdef ENABLE_JIT_X86_64
 #include "x86_64/exec_mem.h"
+#include "x86_64/native_dispatch.h"
 #endif
 
 #include "code_cache.h"
@@ -69,6 +72,41 @@ static struct avl_tree tree;
 
 struct cache_entry* code_cache_tbl[CODE_CACHE_HASH_TBL_LEN];
 
+uint32_t code_cache_ram_pages[CODE_CACHE_N_PAGES];
+
+uint32_t const *code_cache_mode_src;
+uint32_t code_cache_mode_mask;
+
+/*
+ * list of individual entries that were removed from the tree by
+ * code_cache_invalidate_ram.  Like oldroot, these can't be freed until the
+ * emulator exits CPU context.
+ */
+struct retired_node {
+    struct cache_entry *ent;
+    struct retired_node *next;
+};
+static struct retired_node *retired;
+
+static struct code_cache_stats stats;
+
+/*
+ * every page of main RAM has a list of the entries whose guest code is in that
+ * page, so code_cache_invalidate_ram can go straight to the entries it needs to
+ * replace.  An entry has one page_ref for each page it's in.
+ */
+struct code_cache_page_ref {
+    struct cache_entry *ent;
+    unsigned page;
+
+    // the entry's next page_ref
+    struct code_cache_page_ref *ent_next;
+
+    // the other entries on the same page
+    struct code_cache_page_ref *next, **pprev;
+};
+static struct code_cache_page_ref *page_blocks[CODE_CACHE_N_PAGES];
+
 /*
  * the maximum number of code-cache entries that can be created before the
  * cache assumes something is wrong.  This is completely arbitrary, and it may
@@ -90,6 +128,10 @@ static unsigned n_entries;
 
 #ifdef ENABLE_JIT_X86_64
 static bool native_mode = true;
+
+static unsigned tier_threshold;
+static struct code_cache_tier_stats tier_stats;
+static code_cache_trace_func trace_func;
 #endif
 
 static struct avl_node*
@@ -97,9 +139,10 @@ cache_entry_ctor(void) {
     struct cache_entry *ent = calloc(1, sizeof(struct cache_entry));
 
 #ifdef ENABLE_JIT_X86_64
-    if (native_mode)
+    if (native_mode) {
         code_block_x86_64_init(&ent->blk.x86_64);
-    else
+        code_block_intp_init(&ent->tier.intp);
+    } else
 #endif
         code_block_intp_init(&ent->blk.intp);
 
@@ -109,13 +152,42 @@ cache_entry_ctor(void) {
     return &ent->node;
 }
 
+/*
+ * free every page_ref belonging to ent.  If unlink is false, then the page
+ * lists they're on must have already been thrown out.
+ */
+static void free_page_refs(struct cache_entry *ent, bool unlink) {
+    while (ent->page_refs) {
+        struct code_cache_page_ref *ref = ent->page_refs;
+        if (unlink) {
+            *ref->pprev = ref->next;
+            if (ref->next)
+                ref->next->pprev = ref->pprev;
+        }
+        ent->page_refs = ref->ent_next;
+        free(ref);
+    }
+}
+
 static void
 cache_entry_dtor(struct avl_node *node) {
     struct cache_entry *ent = &AVL_DEREF(node, struct cache_entry, node);
+
+    /*
+     * this only happens to entries which have already been removed from the
+     * page lists (either by code_cache_invalidate_ram or because
+     * code_cache_invalidate_all threw out all the lists).
+     */
+    free_page_refs(ent, false);
+
 #ifdef ENABLE_JIT_X86_64
-    if (native_mode)
+    if (native_mode) {
         code_block_x86_64_cleanup(&ent->blk.x86_64);
-    else
+        code_block_intp_cleanup(&ent->tier.intp);
+        if (ent->tier.thunk)
+            exec_mem_free(ent->tier.thunk);
+        free(ent->tier.trace);
+    } else
 #endif
         code_block_intp_cleanup(&ent->blk.intp);
     free(ent);
@@ -136,6 +208,9 @@ void code_cache_init(void) {
 void code_cache_cleanup(void) {
     code_cache_invalidate_all();
     code_cache_gc();
+
+    code_cache_mode_src = NULL;
+    code_cache_mode_mask = 0;
 }
 
 void code_cache_invalidate_all(void) {
@@ -163,6 +238,16 @@ void code_cache_invalidate_all(void) {
 
     reinit_tree();
     memset(code_cache_tbl, 0, sizeof(code_cache_tbl));
+    memset(code_cache_ram_pages, 0, sizeof(code_cache_ram_pages));
+    memset(page_blocks, 0, sizeof(page_blocks));
+
+    stats.n_full_flush++;
+
+#ifdef ENABLE_JIT_X86_64
+    // blocks can't jump directly to their successors anymore
+    if (native_mode)
+        native_dispatch_unlink_all();
+#endif
 
     n_entries = 0;
 }
@@ -175,23 +260,386 @@ void code_cache_gc(void) {
         oldroot = next;
     }
 
+    while (retired) {
+        struct retired_node *next = retired->next;
+        cache_entry_dtor(&retired->ent->node);
+        free(retired);
+        retired = next;
+    }
+
 #ifdef INVARIANTS
     exec_mem_check_integrity();
 #endif
 }
 
+void code_cache_set_mode_src(uint32_t const *src, uint32_t mask) {
+    code_cache_mode_src = src;
+    code_cache_mode_mask = mask;
+}
+
 struct cache_entry *code_cache_find(addr32_t addr) {
+    code_cache_key key = code_cache_key_make(addr);
     unsigned hash_idx = addr & CODE_CACHE_HASH_TBL_MASK;
     struct cache_entry *maybe = code_cache_tbl[hash_idx];
-    if (maybe && maybe->node.key == addr)
+    if (maybe && maybe->node.key == key)
         return maybe;
 
-    struct cache_entry *ret = code_cache_find_slow(addr);
+    struct cache_entry *ret = code_cache_find_slow(key);
     code_cache_tbl[hash_idx] = ret;
     return ret;
 }
 
-struct cache_entry *code_cache_find_slow(addr32_t addr) {
-    struct avl_node *node = avl_find(&tree, addr);
+struct cache_entry *code_cache_find_slow(code_cache_key key) {
+    struct avl_node *node = avl_find(&tree, key);
     return &AVL_DEREF(node, struct cache_entry, node);
 }
+
+/*
+ * returns true if addr is in main RAM, in which case *offs is set to its
+ * offset from the beginning of main RAM
+ */
+static bool ram_offs(addr32_t addr, addr32_t *offs) {
+    addr &= 0x1fffffff;
+    if (addr < ADDR_AREA3_FIRST || addr > ADDR_AREA3_LAST)
+        return false;
+    *offs = addr & ADDR_AREA3_MASK;
+    return true;
+}
+
+static bool entry_on_page(struct cache_entry const *ent, unsigned page) {
+    struct code_cache_page_ref const *ref;
+    for (ref = ent->page_refs; ref; ref = ref->ent_next)
+        if (ref->page == page)
+            return true;
+    return false;
+}
+
+/*
+ * flag the pages of main RAM that ent's guest code from addr to last_addr is
+ * in, and put ent on the lists for those pages.
+ */
+static void track_range(struct cache_entry *ent,
+                        addr32_t addr, addr32_t last_addr) {
+    addr32_t first, last;
+    if (!ram_offs(addr, &first) || !ram_offs(last_addr, &last) || last < first)
+        return;
+
+    unsigned page;
+    for (page = first >> CODE_CACHE_PAGE_SHIFT;
+         page <= last >> CODE_CACHE_PAGE_SHIFT; page++) {
+        code_cache_ram_pages[page] = 1;
+
+        // traces can cover the same page more than once
+        if (entry_on_page(ent, page))
+            continue;
+
+        struct code_cache_page_ref *ref =
+            (struct code_cache_page_ref*)malloc(sizeof(*ref));
+        if (!ref)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        ref->ent = ent;
+        ref->page = page;
+
+        ref->ent_next = ent->page_refs;
+        ent->page_refs = ref;
+
+        ref->pprev = page_blocks + page;
+        ref->next = page_blocks[page];
+        if (ref->next)
+            ref->next->pprev = &ref->next;
+        page_blocks[page] = ref;
+    }
+}
+
+void code_cache_track_block(addr32_t addr, addr32_t last_addr) {
+    struct avl_node *node = avl_find_noinsert(&tree, code_cache_key_make(addr));
+    if (!node)
+        RAISE_ERROR(ERROR_INTEGRITY);
+    struct cache_entry *ent = &AVL_DEREF(node, struct cache_entry, node);
+    ent->last_addr = last_addr;
+
+    track_range(ent, addr, last_addr);
+}
+
+/*
+ * take ent out of the tree and the page lists.  The block which is currently
+ * executing might be ent, so it gets swapped out for a fresh entry and freed
+ * later by code_cache_gc.
+ */
+static void retire_entry(struct cache_entry *ent) {
+    struct retired_node *list_node =
+        (struct retired_node*)malloc(sizeof(struct retired_node));
+    if (!list_node)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    free_page_refs(ent, true);
+
+    avl_replace_node(&tree, &ent->node, cache_entry_ctor());
+
+    unsigned hash_idx =
+        code_cache_key_addr(ent->node.key) & CODE_CACHE_HASH_TBL_MASK;
+    if (code_cache_tbl[hash_idx] == ent)
+        code_cache_tbl[hash_idx] = NULL;
+
+#ifdef ENABLE_JIT_X86_64
+    // other blocks may be linked directly to this one
+    if (native_mode)
+        native_dispatch_unlink_entry(ent);
+#endif
+
+    list_node->ent = ent;
+    list_node->next = retired;
+    retired = list_node;
+}
+
+void code_cache_invalidate_ram(addr32_t first, addr32_t last) {
+    if (last > ADDR_AREA3_MASK)
+        last = ADDR_AREA3_MASK;
+    if (first > last)
+        return;
+
+    /*
+     * everything on the written pages gets invalidated, since that's the
+     * granularity the page flags work at.
+     */
+    unsigned first_page = first >> CODE_CACHE_PAGE_SHIFT;
+    unsigned last_page = last >> CODE_CACHE_PAGE_SHIFT;
+    unsigned page, n_invalidated = 0;
+    for (page = first_page; page <= last_page; page++) {
+        code_cache_ram_pages[page] = 0;
+
+        // retire_entry takes the entry off of this list along with the others
+        while (page_blocks[page]) {
+            retire_entry(page_blocks[page]->ent);
+            n_invalidated++;
+        }
+    }
+
+    if (!n_invalidated)
+        return;
+
+    LOG_DBG("%s - invalidated %u blocks between 0x%08x and 0x%08x\n",
+            __func__, n_invalidated,
+            (unsigned)(first_page << CODE_CACHE_PAGE_SHIFT),
+            (unsigned)(((last_page + 1) << CODE_CACHE_PAGE_SHIFT) - 1));
+
+    stats.n_partial_invalidate++;
+    stats.n_blocks_invalidated += n_invalidated;
+}
+
+#ifdef ENABLE_JIT_X86_64
+void code_cache_set_tier_threshold(unsigned threshold) {
+    tier_threshold = threshold;
+}
+
+unsigned code_cache_get_tier_threshold(void) {
+    return tier_threshold;
+}
+
+static unsigned long long tier_elapsed_ns(struct timespec const *start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1000000000ull +
+        end.tv_nsec - start->tv_nsec;
+}
+
+void code_cache_set_trace_func(code_cache_trace_func func) {
+    trace_func = func;
+}
+
+bool code_cache_get_profile(code_cache_key key,
+                            struct code_cache_profile *out) {
+    if (!native_mode)
+        return false;
+
+    struct avl_node *node = avl_find_noinsert(&tree, key);
+    if (!node)
+        return false;
+
+    struct cache_entry *ent = &AVL_DEREF(node, struct cache_entry, node);
+    if (!ent->valid || !ent->tier.profile.n_execs)
+        return false;
+
+    *out = ent->tier.profile;
+    return true;
+}
+
+static void tier_profile_exit(struct code_cache_profile *prof, addr32_t pc) {
+    unsigned idx;
+
+    prof->n_execs++;
+    for (idx = 0; idx < CODE_CACHE_PROFILE_EXITS; idx++) {
+        if (!prof->exit_count[idx])
+            prof->exit_pc[idx] = pc;
+        if (prof->exit_pc[idx] == pc) {
+            prof->exit_count[idx]++;
+            return;
+        }
+    }
+}
+
+// try to build a trace starting at ent; returns false if that didn't happen
+static bool tier_build_trace(void *cpu, struct cache_entry *ent,
+                             struct il_code_block *il_blk,
+                             unsigned *cycle_count) {
+    struct code_cache_tier *tier = &ent->tier;
+    struct code_cache_trace trace;
+
+    if (!trace_func || tier->mode_change ||
+        !trace_func(cpu, ent->node.key, il_blk, &trace))
+        return false;
+
+    if (!trace.n_blocks || trace.n_blocks > CODE_CACHE_TRACE_MAX_BLOCKS)
+        RAISE_ERROR(ERROR_INTEGRITY);
+
+    tier->trace = (struct code_cache_range*)
+        malloc(trace.n_blocks * sizeof(struct code_cache_range));
+    if (!tier->trace)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    memcpy(tier->trace, trace.blocks,
+           trace.n_blocks * sizeof(struct code_cache_range));
+    tier->n_trace_blocks = trace.n_blocks;
+
+    unsigned idx;
+    for (idx = 0; idx < trace.n_blocks; idx++)
+        track_range(ent, trace.blocks[idx].first, trace.blocks[idx].last);
+
+    tier_stats.n_traces++;
+    tier_stats.n_trace_blocks += trace.n_blocks;
+
+    *cycle_count = trace.cycle_count;
+    return true;
+}
+
+static void tier_promote(void *cpu, struct cache_entry *ent,
+                         native_dispatch_compile_func compile_func) {
+    struct code_cache_tier *tier = &ent->tier;
+    struct il_code_block il_blk;
+    struct timespec start;
+    unsigned inst_no;
+    unsigned cycle_count = tier->intp.cycle_count;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    il_code_block_init(&il_blk);
+    if (!tier_build_trace(cpu, ent, &il_blk, &cycle_count)) {
+        il_code_block_cleanup(&il_blk);
+        il_code_block_init(&il_blk);
+        for (inst_no = 0; inst_no < tier->intp.inst_count; inst_no++)
+            il_code_block_push_inst(&il_blk, tier->intp.inst_list + inst_no);
+        il_blk.n_slots = tier->intp.n_slots;
+        il_blk.mode_change = tier->mode_change;
+        il_blk.n_guest_insts = tier->n_guest_insts;
+    }
+
+    // the thunk is what called us, so it has to stay around for now
+    tier->thunk = ent->blk.x86_64.native;
+    code_block_x86_64_init(&ent->blk.x86_64);
+    code_block_x86_64_compile(cpu, &ent->blk.x86_64, &il_blk, compile_func,
+                              cycle_count);
+
+    tier_stats.n_promotions++;
+    tier_stats.native_bytes += ent->blk.x86_64.bytes_used;
+    tier_stats.native_il_insts += il_blk.inst_count;
+    il_code_block_cleanup(&il_blk);
+    tier_stats.cold_il_insts -= tier->intp.inst_count;
+    tier_stats.cold_thunk_bytes -= tier->thunk_bytes;
+
+    code_block_intp_cleanup(&tier->intp);
+    code_block_intp_init(&tier->intp);
+    tier->cold = false;
+
+    tier_stats.promote_ns += tier_elapsed_ns(&start);
+}
+
+// called by a cold block's thunk
+static reg32_t tier_exec(void *cpu, void *ent_ptr,
+                         native_dispatch_compile_func compile_func) {
+    struct cache_entry *ent = (struct cache_entry*)ent_ptr;
+    reg32_t new_pc = code_block_intp_exec(cpu, &ent->tier.intp);
+
+    /*
+     * the block might have invalidated itself (or the whole cache), in which
+     * case it's going to be thrown away and there's no point in promoting it.
+     */
+    tier_profile_exit(&ent->tier.profile, new_pc);
+    if (ent->tier.profile.n_execs >= tier_threshold && ent->tier.cold &&
+        avl_find_noinsert(&tree, ent->node.key) == &ent->node)
+        tier_promote(cpu, ent, compile_func);
+
+    return new_pc;
+}
+
+void code_cache_tier_compile(void *cpu, struct cache_entry *ent,
+                             struct il_code_block const *il_blk,
+                             native_dispatch_compile_func compile_func,
+                             unsigned cycle_count) {
+    struct code_cache_tier *tier = &ent->tier;
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    code_block_intp_cleanup(&tier->intp);
+    code_block_intp_init(&tier->intp);
+    code_block_intp_compile(cpu, &tier->intp, il_blk, cycle_count);
+    tier->mode_change = il_blk->mode_change;
+    tier->n_guest_insts = il_blk->n_guest_insts;
+    memset(&tier->profile, 0, sizeof(tier->profile));
+    tier->cold = true;
+
+    code_block_x86_64_compile_thunk(cpu, &ent->blk.x86_64, tier_exec, ent,
+                                    compile_func, cycle_count);
+    tier->thunk_bytes = ent->blk.x86_64.bytes_used;
+
+    tier_stats.n_cold++;
+    tier_stats.thunk_bytes += tier->thunk_bytes;
+    tier_stats.cold_thunk_bytes += tier->thunk_bytes;
+    tier_stats.cold_il_insts += il_blk->inst_count;
+    tier_stats.cold_ns += tier_elapsed_ns(&start);
+}
+
+void code_cache_tier_get_stats(struct code_cache_tier_stats *stats_out) {
+    *stats_out = tier_stats;
+}
+
+void code_cache_tier_print_stats(struct code_cache_tier_stats const *stats) {
+    LOG_INFO("jit tiers: %llu blocks compiled for the IL interpreter, %llu "
+             "promoted to native code\n", stats->n_cold, stats->n_promotions);
+    LOG_INFO("jit tiers: %f ms compiling cold blocks, %f ms promoting hot "
+             "blocks\n", stats->cold_ns / 1000000.0,
+             stats->promote_ns / 1000000.0);
+
+    /*
+     * the blocks which were never promoted would have taken up about as much
+     * memory per IL instruction as the ones which were.
+     */
+    if (stats->native_il_insts) {
+        double bytes_per_inst =
+            (double)stats->native_bytes / (double)stats->native_il_insts;
+        double saved = stats->cold_il_insts * bytes_per_inst -
+            (double)stats->cold_thunk_bytes;
+        LOG_INFO("jit tiers: %llu bytes of thunks, %llu bytes of native code, "
+                 "about %.0f bytes of exec_mem saved\n", stats->thunk_bytes,
+                 stats->native_bytes, saved);
+    } else {
+        LOG_INFO("jit tiers: %llu bytes of thunks, nothing promoted yet\n",
+                 stats->thunk_bytes);
+    }
+
+    if (stats->n_traces) {
+        LOG_INFO("jit tiers: %llu blocks promoted as traces through %.2f "
+                 "blocks each\n", stats->n_traces,
+                 (double)stats->n_trace_blocks / (double)stats->n_traces);
+    }
+}
+#endif
+
+void code_cache_get_stats(struct code_cache_stats *stats_out) {
+    *stats_out = stats;
+}
+
+void code_cache_print_stats(struct code_cache_stats const *stats) {
+    LOG_INFO("code cache: %llu full flushes, %llu partial invalidations "
+             "(%llu blocks)\n", stats->n_full_flush,
+             stats->n_partial_invalidate, stats->n_blocks_invalidated);
+}
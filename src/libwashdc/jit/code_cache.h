@@ -23,8 +23,13 @@
 #ifndef CODE_CACHE_H_
 #define CODE_CACHE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "avl.h"
 #include "code_block.h"
+#include "mem_areas.h"
 
 #ifdef ENABLE_JIT_X86_64
 #include "x86_64/code_block_x86_64.h"
@@ -32,18 +37,125 @@
 
 #include "washdc/types.h"
 
+#ifdef ENABLE_JIT_X86_64
+/*
+ * Tiered compilation.
+ *
+ * When this is enabled (see code_cache_set_tier_threshold), new blocks aren't
+ * compiled to native code right away.  The compile handler gives the block to
+ * code_cache_tier_compile instead, which prepares it for the IL interpreter and
+ * emits a small native thunk into blk.x86_64 that runs it.  To the dispatcher
+ * the thunk looks just like any other block.  Once the block has been run
+ * threshold times, the thunk compiles the IL to native code and swaps it into
+ * blk.x86_64 in place of itself.
+ */
 /*
- * TODO: need to include FPU state in code cache, not just address.
- * Otherwise, this code will trip over anything that tries to switch
- * between single-precision and double-precision floating-point.
+ * Branch profiles.
+ *
+ * While a block is cold, every run of it is counted along with the PC it
+ * left for.  Only the first CODE_CACHE_PROFILE_EXITS distinct PCs are kept
+ * track of, which covers every direct branch; runs that leave anywhere else
+ * are still counted in n_execs.  The profile stops changing once the block
+ * gets promoted.
  */
+#define CODE_CACHE_PROFILE_EXITS 2
+
+struct code_cache_profile {
+    unsigned n_execs;
+    addr32_t exit_pc[CODE_CACHE_PROFILE_EXITS];
+    unsigned exit_count[CODE_CACHE_PROFILE_EXITS];
+};
+
+// guest address range, both ends inclusive
+struct code_cache_range {
+    addr32_t first, last;
+};
+
+struct code_cache_tier {
+    // true while blk.x86_64 is only a thunk for intp
+    bool cold;
+
+    bool mode_change;
+    unsigned n_guest_insts;
+
+    struct code_cache_profile profile;
+
+    struct code_block_intp intp;
+
+    /*
+     * if the block was promoted as a trace, this has the guest code of each
+     * block the trace runs through (including the first one).
+     */
+    struct code_cache_range *trace;
+    unsigned n_trace_blocks;
+
+    /*
+     * the thunk's executable memory.  It's still running when the block gets
+     * promoted, so it can't be freed until the entry is.
+     */
+    void *thunk;
+    unsigned thunk_bytes;
+};
+#endif
+
+struct code_cache_page_ref;
+
 struct cache_entry {
     struct avl_node node;
 
     uint8_t valid;
     union jit_code_block blk;
+
+    // address of the last byte of guest code in the block
+    addr32_t last_addr;
+
+    // the pages of main RAM this block's guest code is in
+    struct code_cache_page_ref *page_refs;
+
+#ifdef ENABLE_JIT_X86_64
+    struct code_cache_tier tier;
+
+    // links in other blocks which currently jump straight to this one
+    struct native_link *links_in;
+#endif
 };
 
+/*
+ * Blocks are keyed on the guest address and on a mode, which is the part of the
+ * CPU state that changes how instructions get translated.  For the SH4 this is
+ * the PR and SZ bits of FPSCR, since the FPU translators specialize on them.
+ *
+ * code_cache_set_mode_src tells the cache where the mode lives; the mode is
+ * sampled as (*src & mask) whenever a block is looked up.  If no source was
+ * set then the mode is always 0.  The key stores the mode in the upper 32 bits
+ * so that the lower 32 bits are the address.
+ */
+typedef avl_key_type code_cache_key;
+
+extern uint32_t const *code_cache_mode_src;
+extern uint32_t code_cache_mode_mask;
+
+void code_cache_set_mode_src(uint32_t const *src, uint32_t mask);
+
+static inline code_cache_key
+code_cache_key_make_mode(addr32_t addr, uint32_t mode) {
+    return (((code_cache_key)mode) << 32) | addr;
+}
+
+static inline code_cache_key code_cache_key_make(addr32_t addr) {
+    uint32_t mode = code_cache_mode_src ?
+        (*code_cache_mode_src & code_cache_mode_mask) : 0;
+    return code_cache_key_make_mode(addr, mode);
+}
+
+static inline addr32_t code_cache_key_addr(code_cache_key key) {
+    return (addr32_t)key;
+}
+
+static inline uint32_t code_cache_key_mode(code_cache_key key) {
+    return (uint32_t)(key >> 32);
+}
+
 /*
  * this might return a pointer to an invalid cache_entry.  If so, that means
  * the cache entry needs to be filled in by the callee.  This function will
@@ -56,12 +168,170 @@ struct cache_entry *code_cache_find(addr32_t addr);
 
 /*
  * This is like code_cache_find, but it skips the second-level hash table.
- * This function is intended for JIT code which handles that itself
+ * This function is intended for JIT code which handles that itself, so it
+ * takes a key which already includes the mode.
  */
-struct cache_entry *code_cache_find_slow(addr32_t addr);
+struct cache_entry *code_cache_find_slow(code_cache_key key);
 
 void code_cache_invalidate_all(void);
 
+/*
+ * Self-modifying code tracking.
+ *
+ * code_cache_ram_pages has one flag for each page of main RAM.  A page's flag
+ * is non-zero if there might be a block in the cache whose guest code
+ * overlaps the page.  Every write to main RAM checks this flag and invalidates
+ * only the blocks on the written page instead of flushing the whole cache.  The
+ * cache keeps a list of the blocks on each page, so that doesn't have to search
+ * the whole cache.
+ *
+ * The writes that check the flags are the memory_map_write functions for
+ * regions tagged MEMORY_MAP_REGION_RAM (which is also what the interpreter and
+ * the JIT's fallbacks use), the native JIT's inlined 32-bit stores (including
+ * fastmem), store-queue flushes and SH4 DMA.  Anything new that writes to main
+ * RAM without going through the memory_map has to call
+ * code_cache_notify_write itself.
+ */
+#define CODE_CACHE_PAGE_SHIFT 12
+#define CODE_CACHE_N_PAGES ((ADDR_AREA3_MASK + 1) >> CODE_CACHE_PAGE_SHIFT)
+extern uint32_t code_cache_ram_pages[CODE_CACHE_N_PAGES];
+
+/*
+ * compile handlers call this after the block at addr has been compiled.
+ * last_addr is the address of the last byte of guest code in the block.  The
+ * mode must not have changed since the block was looked up.
+ */
+void code_cache_track_block(addr32_t addr, addr32_t last_addr);
+
+/*
+ * invalidate every block whose guest code overlaps main RAM between the
+ * offsets first and last (inclusive).
+ */
+void code_cache_invalidate_ram(addr32_t first, addr32_t last);
+
+// call this after writing len bytes to the guest physical address addr
+static inline void code_cache_notify_write(addr32_t addr, size_t len) {
+    addr &= 0x1fffffff;
+    if (!len || addr < ADDR_AREA3_FIRST || addr > ADDR_AREA3_LAST)
+        return;
+
+    addr32_t first = addr & ADDR_AREA3_MASK;
+    addr32_t last = len - 1 > ADDR_AREA3_MASK - first ?
+        ADDR_AREA3_MASK : first + (len - 1);
+    unsigned page;
+    for (page = first >> CODE_CACHE_PAGE_SHIFT;
+         page <= last >> CODE_CACHE_PAGE_SHIFT; page++) {
+        if (code_cache_ram_pages[page]) {
+            code_cache_invalidate_ram(first, last);
+            return;
+        }
+    }
+}
+
+struct code_cache_stats {
+    // calls to code_cache_invalidate_all
+    unsigned long long n_full_flush;
+
+    // calls to code_cache_invalidate_ram which found blocks to invalidate
+    unsigned long long n_partial_invalidate;
+
+    unsigned long long n_blocks_invalidated;
+};
+
+void code_cache_get_stats(struct code_cache_stats *stats);
+void code_cache_print_stats(struct code_cache_stats const *stats);
+
+#ifdef ENABLE_JIT_X86_64
+/*
+ * number of times a block runs in the IL interpreter before it gets compiled
+ * to native code.  0 (the default) turns tiered compilation off.  This has to
+ * be set before the first block gets compiled.
+ */
+void code_cache_set_tier_threshold(unsigned threshold);
+unsigned code_cache_get_tier_threshold(void);
+
+static inline struct cache_entry *
+code_cache_entry_of_x86_64(struct code_block_x86_64 *blk) {
+    return (struct cache_entry*)(((uint8_t*)blk) -
+                                 offsetof(struct cache_entry, blk.x86_64));
+}
+
+/*
+ * compile handlers call this instead of code_block_x86_64_compile when tiered
+ * compilation is enabled.  compile_func is the compile handler itself.
+ */
+void code_cache_tier_compile(void *cpu, struct cache_entry *ent,
+                             struct il_code_block const *il_blk,
+                             native_dispatch_compile_func compile_func,
+                             unsigned cycle_count);
+
+/*
+ * Traces.
+ *
+ * When a block gets promoted, the trace function (if one was set) can build a
+ * trace instead: one stretch of IL that starts at the block and keeps going
+ * through the successors that the branch profiles say are usually taken.  The
+ * paths which leave the trace are side-exits back to the dispatcher.  The
+ * trace replaces the block's native code, and it gets invalidated along with
+ * any of the blocks it runs through.
+ *
+ * The trace function fills in il_blk and trace and returns true, or returns
+ * false if there's no trace worth building from the block at key.  il_blk
+ * has to be cleaned up either way.  trace->cycle_count is in the same units
+ * as the cycle count that compile handlers give the backend.
+ */
+#define CODE_CACHE_TRACE_MAX_BLOCKS 4
+
+struct code_cache_trace {
+    unsigned n_blocks;
+    struct code_cache_range blocks[CODE_CACHE_TRACE_MAX_BLOCKS];
+    unsigned cycle_count;
+};
+
+typedef bool(*code_cache_trace_func)(void *cpu, code_cache_key key,
+                                     struct il_code_block *il_blk,
+                                     struct code_cache_trace *trace);
+
+void code_cache_set_trace_func(code_cache_trace_func func);
+
+/*
+ * fills in out with the profile of the block at key and returns true, or
+ * returns false if that block has never run cold.
+ */
+bool code_cache_get_profile(code_cache_key key,
+                            struct code_cache_profile *out);
+
+struct code_cache_tier_stats {
+    // blocks compiled for the IL interpreter, and how many got promoted
+    unsigned long long n_cold;
+    unsigned long long n_promotions;
+
+    // host nanoseconds spent compiling cold blocks and promoting hot ones
+    unsigned long long cold_ns;
+    unsigned long long promote_ns;
+
+    // executable memory used by thunks and by promoted blocks
+    unsigned long long thunk_bytes;
+    unsigned long long native_bytes;
+
+    /*
+     * IL instructions in promoted blocks, and in blocks which have only ever
+     * been run in the interpreter.  These are used to estimate how much
+     * executable memory the cold blocks would have taken up.
+     */
+    unsigned long long native_il_insts;
+    unsigned long long cold_il_insts;
+    unsigned long long cold_thunk_bytes;
+
+    // promotions which built a trace, and the blocks those traces ran through
+    unsigned long long n_traces;
+    unsigned long long n_trace_blocks;
+};
+
+void code_cache_tier_get_stats(struct code_cache_tier_stats *stats);
+void code_cache_tier_print_stats(struct code_cache_tier_stats const *stats);
+#endif
+
 void code_cache_init(void);
 void code_cache_cleanup(void);
 
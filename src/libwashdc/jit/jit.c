@@ -26,6 +26,7 @@
 #include "x86_64/exec_mem.h"
 #include "x86_64/native_dispatch.h"
 #include "x86_64/native_mem.h"
+#include "x86_64/native_fastmem.h"
 #endif
 
 #include "jit.h"
@@ -35,6 +36,7 @@ void jit_init(struct dc_clock *clk) {
     exec_mem_init();
     native_dispatch_init(clk);
     native_mem_init();
+    native_fastmem_init();
 #endif
     code_cache_init();
 }
@@ -42,6 +44,7 @@ void jit_init(struct dc_clock *clk) {
 void jit_cleanup(void) {
     code_cache_cleanup();
 #ifdef ENABLE_JIT_X86_64
+    native_fastmem_cleanup();
     native_mem_cleanup();
     native_dispatch_cleanup();
     exec_mem_cleanup();
@@ -20,8 +20,10 @@
  *
  ******************************************************************************/
 
+#include <stdlib.h>
 #include <string.h>
 
+#include "washdc/error.h"
 #include "code_block.h"
 
 #include "jit_determ.h"
@@ -30,33 +32,171 @@
 #error this file should not be built without -DJIT_OPTIMIZE
 #endif
 
-static void update_state(struct jit_determ_state *state,
+#define DELTAS_DEFAULT_LEN 32
+#define RESETS_DEFAULT_LEN 8
+
+static bool update_state(struct jit_determ_slot *slots,
                          struct jit_inst const *op);
 
-void jit_determ_default(struct jit_determ_state *new_state) {
-    memset(new_state, 0, sizeof(*new_state));
+static void *grow_array(void *arr, unsigned *alloc, size_t elem_sz,
+                        size_t *cur_bytes) {
+    unsigned new_alloc = *alloc * 2;
+    void *new_arr = realloc(arr, new_alloc * elem_sz);
+    if (!new_arr)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    *cur_bytes += (new_alloc - *alloc) * elem_sz;
+    *alloc = new_alloc;
+    return new_arr;
 }
 
 void jit_determ_pass(struct il_code_block *block) {
-    unsigned inst_no;
+    unsigned inst_no, slot_no;
     unsigned inst_count = block->inst_count;
+    unsigned n_slots = block->n_slots;
+    struct jit_determ_state *state;
+
+    jit_determ_free(block);
+
+    state = (struct jit_determ_state*)calloc(1, sizeof(*state));
+    if (!state)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    state->n_slots = n_slots;
+    state->deltas_alloc = DELTAS_DEFAULT_LEN;
+    state->resets_alloc = RESETS_DEFAULT_LEN;
+    state->last_delta = (unsigned*)malloc(sizeof(unsigned) * (n_slots + 1));
+    state->deltas = (struct jit_determ_delta*)
+        malloc(sizeof(struct jit_determ_delta) * state->deltas_alloc);
+    state->resets = (unsigned*)malloc(sizeof(unsigned) * state->resets_alloc);
+
+    // the current value of every slot; this is only needed during the pass
+    struct jit_determ_slot *cur = (struct jit_determ_slot*)
+        calloc(n_slots + 1, sizeof(struct jit_determ_slot));
+
+    if (!state->last_delta || !state->deltas || !state->resets || !cur)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
 
-    block->determ = calloc(inst_count, sizeof(struct jit_determ_state));
+    for (slot_no = 0; slot_no < n_slots; slot_no++)
+        state->last_delta[slot_no] = JIT_DETERM_NONE;
+
+    size_t cur_bytes = sizeof(*state) +
+        sizeof(unsigned) * (n_slots + 1) +
+        sizeof(struct jit_determ_delta) * state->deltas_alloc +
+        sizeof(unsigned) * state->resets_alloc;
+    size_t scratch_bytes = sizeof(struct jit_determ_slot) * (n_slots + 1);
+
+    // first delta which has been logged since the last reset
+    unsigned live_deltas = 0;
 
-    struct jit_determ_state *state, *state_prev = NULL;
     for (inst_no = 0; inst_no < inst_count; inst_no++) {
-        state = block->determ + inst_no;
+        struct jit_inst const *op = block->inst_list + inst_no;
+        int dst = jit_inst_dst_slot(op);
+        struct jit_determ_slot old_val = { 0 };
+
+        if (dst >= 0) {
+            if ((unsigned)dst >= n_slots)
+                RAISE_ERROR(ERROR_OVERFLOW);
+            old_val = cur[dst];
+        }
+
+        if (!update_state(cur, op)) {
+            // everything that was known is now unknown
+            if (live_deltas == state->n_deltas)
+                continue; // nothing was known to begin with
+            unsigned delta_no;
+            for (delta_no = live_deltas; delta_no < state->n_deltas; delta_no++)
+                memset(cur + state->deltas[delta_no].slot_no, 0,
+                       sizeof(struct jit_determ_slot));
+            live_deltas = state->n_deltas;
+
+            if (state->n_resets >= state->resets_alloc) {
+                state->resets = grow_array(state->resets, &state->resets_alloc,
+                                           sizeof(unsigned), &cur_bytes);
+            }
+            state->resets[state->n_resets++] = inst_no;
+        } else if (dst >= 0) {
+            struct jit_determ_slot *slotp = cur + dst;
+            slotp->known_val &= slotp->known_bits;
+            if (slotp->known_bits == old_val.known_bits &&
+                slotp->known_val == old_val.known_val)
+                continue;
+
+            if (state->n_deltas >= state->deltas_alloc) {
+                state->deltas = grow_array(state->deltas, &state->deltas_alloc,
+                                           sizeof(struct jit_determ_delta),
+                                           &cur_bytes);
+            }
+
+            struct jit_determ_delta *delta = state->deltas + state->n_deltas;
+            delta->inst_no = inst_no;
+            delta->slot_no = dst;
+            delta->val = *slotp;
+            delta->prev = state->last_delta[dst];
+            state->last_delta[dst] = state->n_deltas++;
+        }
+
+        if (cur_bytes + scratch_bytes > state->peak_bytes)
+            state->peak_bytes = cur_bytes + scratch_bytes;
+    }
+
+    if (cur_bytes + scratch_bytes > state->peak_bytes)
+        state->peak_bytes = cur_bytes + scratch_bytes;
+    state->n_bytes = cur_bytes;
+
+    free(cur);
+
+    block->determ = state;
+}
+
+void jit_determ_free(struct il_code_block *block) {
+    struct jit_determ_state *state = block->determ;
+    if (state) {
+        free(state->resets);
+        free(state->deltas);
+        free(state->last_delta);
+        free(state);
+        block->determ = NULL;
+    }
+}
+
+void jit_determ_get(struct il_code_block const *block, unsigned inst_no,
+                    unsigned slot_no, struct jit_determ_slot *out) {
+    struct jit_determ_state const *state = block->determ;
+
+    out->known_bits = 0;
+    out->known_val = 0;
 
-        if (state_prev)
-            *state = *state_prev;
+    if (!state || slot_no >= state->n_slots)
+        return;
 
-        update_state(state, block->inst_list + inst_no);
+    // find the newest reset at or before inst_no
+    unsigned first = 0, last = state->n_resets;
+    while (first < last) {
+        unsigned mid = first + (last - first) / 2;
+        if (state->resets[mid] <= inst_no)
+            first = mid + 1;
+        else
+            last = mid;
+    }
 
-        state = state_prev;
+    unsigned delta_no = state->last_delta[slot_no];
+    while (delta_no != JIT_DETERM_NONE) {
+        struct jit_determ_delta const *delta = state->deltas + delta_no;
+        if (first && delta->inst_no <= state->resets[first - 1])
+            return;
+        if (delta->inst_no <= inst_no) {
+            *out = delta->val;
+            return;
+        }
+        delta_no = delta->prev;
     }
 }
 
-static void update_state(struct jit_determ_state *state,
+/*
+ * returns false if the instruction makes the value of every slot unknown, in
+ * which case slots is left for the caller to clean up.
+ */
+static bool update_state(struct jit_determ_slot *slots,
                          struct jit_inst const *op) {
     struct jit_determ_slot const *srcp;
     struct jit_determ_slot const *lhsp;
@@ -69,17 +209,17 @@ static void update_state(struct jit_determ_state *state,
 
     switch (op->op) {
     case JIT_SET_SLOT:
-        dstp = state->slots + op->immed.set_slot.slot_idx;
+        dstp = slots + op->immed.set_slot.slot_idx;
         dstp->known_bits = 0xffffffff;
         dstp->known_val = op->immed.set_slot.new_val;
         break;
     case JIT_OP_READ_16_CONSTADDR:
-        dstp = state->slots + op->immed.read_16_constaddr.slot_no;
+        dstp = slots + op->immed.read_16_constaddr.slot_no;
         dstp->known_bits = 0xffff0000;
         dstp->known_val = 0;
         break;
     case JIT_OP_SIGN_EXTEND_16:
-        dstp = state->slots + op->immed.sign_extend_16.slot_no;
+        dstp = slots + op->immed.sign_extend_16.slot_no;
         if (dstp->known_bits & (1 << 16)) {
             dstp->known_bits |= 0xffff0000;
             if (dstp->known_val & (1 << 16))
@@ -92,12 +232,12 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_READ_32_CONSTADDR:
-        dstp = state->slots + op->immed.read_32_constaddr.slot_no;
+        dstp = slots + op->immed.read_32_constaddr.slot_no;
         dstp->known_val = 0;
         dstp->known_bits = 0;
         break;
     case JIT_OP_READ_32_SLOT:
-        dstp = state->slots + op->immed.read_32_slot.dst_slot;
+        dstp = slots + op->immed.read_32_slot.dst_slot;
         dstp->known_val = 0;
         dstp->known_bits = 0;
         break;
@@ -106,7 +246,7 @@ static void update_state(struct jit_determ_state *state,
         break;
     case JIT_OP_LOAD_SLOT16:
         // the IL will zero-extend
-        dstp = state->slots + op->immed.load_slot16.slot_no;
+        dstp = slots + op->immed.load_slot16.slot_no;
         dstp->known_val = 0;
         dstp->known_bits = 0xffff0000;
         break;
@@ -116,8 +256,8 @@ static void update_state(struct jit_determ_state *state,
     case JIT_OP_ADD:
         slot_src = op->immed.add.slot_src;
         slot_dst = op->immed.add.slot_dst;
-        srcp = state->slots + op->immed.add.slot_src;
-        dstp = state->slots + op->immed.add.slot_dst;
+        srcp = slots + op->immed.add.slot_src;
+        dstp = slots + op->immed.add.slot_dst;
         if (srcp->known_bits == 0xffffffff && dstp->known_bits == 0xffffffff) {
             dstp->known_val = dstp->known_val + srcp->known_val;
             dstp->known_bits = 0xffffffff;
@@ -142,8 +282,8 @@ static void update_state(struct jit_determ_state *state,
     case JIT_OP_SUB:
         slot_src = op->immed.sub.slot_src;
         slot_dst = op->immed.sub.slot_dst;
-        srcp = state->slots + op->immed.sub.slot_src;
-        dstp = state->slots + op->immed.sub.slot_dst;
+        srcp = slots + op->immed.sub.slot_src;
+        dstp = slots + op->immed.sub.slot_dst;
         if (srcp->known_bits == 0xffffffff && dstp->known_bits == 0xffffffff) {
             dstp->known_val = dstp->known_val - srcp->known_val;
             dstp->known_bits = 0xffffffff;
@@ -168,7 +308,7 @@ static void update_state(struct jit_determ_state *state,
          */
         break;
     case JIT_OP_ADD_CONST32:
-        dstp = state->slots + op->immed.add_const32.slot_dst;
+        dstp = slots + op->immed.add_const32.slot_dst;
         const32 = op->immed.add_const32.const32;
         if (dstp->known_bits == 0xffffffff) {
             dstp->known_val += const32;
@@ -182,15 +322,15 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_DISCARD_SLOT:
-        dstp = state->slots + op->immed.discard_slot.slot_no;
+        dstp = slots + op->immed.discard_slot.slot_no;
         dstp->known_bits = 0;
         dstp->known_val = 0;
         break;
     case JIT_OP_XOR:
         slot_src = op->immed.xor.slot_src;
         slot_dst = op->immed.xor.slot_dst;
-        srcp = state->slots + slot_src;
-        dstp = state->slots + slot_dst;
+        srcp = slots + slot_src;
+        dstp = slots + slot_dst;
         if (slot_src == slot_dst) {
             dstp->known_bits = 0xffffffff;
             dstp->known_val = 0;
@@ -200,7 +340,7 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_XOR_CONST32:
-        dstp = state->slots + op->immed.xor_const32.slot_no;
+        dstp = slots + op->immed.xor_const32.slot_no;
         const32 = op->immed.xor_const32.const32;
         dstp->known_val ^=const32;
         /*
@@ -210,24 +350,24 @@ static void update_state(struct jit_determ_state *state,
          */
         break;
     case JIT_OP_MOV:
-        srcp = state->slots + op->immed.mov.slot_src;
-        dstp = state->slots + op->immed.mov.slot_dst;
+        srcp = slots + op->immed.mov.slot_src;
+        dstp = slots + op->immed.mov.slot_dst;
         dstp->known_bits = srcp->known_bits;
-        dstp->known_val = dstp->known_val;
+        dstp->known_val = srcp->known_val;
         break;
     case JIT_OP_AND:
-        srcp = state->slots + op->immed.and.slot_src;
-        dstp = state->slots + op->immed.and.slot_dst;
+        srcp = slots + op->immed.and.slot_src;
+        dstp = slots + op->immed.and.slot_dst;
         zero_bits = ((~srcp->known_val) & srcp->known_bits) |
-            ((~srcp->known_val) & srcp->known_bits);
+            ((~dstp->known_val) & dstp->known_bits);
         one_bits = (srcp->known_val & srcp->known_bits) &
-            (srcp->known_val & srcp->known_bits);
+            (dstp->known_val & dstp->known_bits);
 
         dstp->known_bits = zero_bits | one_bits;
         dstp->known_val = ((~zero_bits) | one_bits) & dstp->known_bits;
         break;
     case JIT_OP_AND_CONST32:
-        dstp = state->slots + op->immed.and_const32.slot_no;
+        dstp = slots + op->immed.and_const32.slot_no;
         const32 = op->immed.and_const32.const32;
         zero_bits = (~const32) | ((~dstp->known_val) & dstp->known_bits);
         one_bits = const32 & dstp->known_val & dstp->known_bits;
@@ -236,8 +376,8 @@ static void update_state(struct jit_determ_state *state,
         dstp->known_val = ((~zero_bits) | one_bits) & dstp->known_bits;
         break;
     case JIT_OP_OR:
-        srcp = state->slots + op->immed.or.slot_src;
-        dstp = state->slots + op->immed.or.slot_dst;
+        srcp = slots + op->immed.or.slot_src;
+        dstp = slots + op->immed.or.slot_dst;
         /*
          * we know the value of all dst-bits in which one of the two src-bits is 1
          * (in which case the dst-bit is 1) or both of the two src-bits is 0 (in
@@ -253,7 +393,7 @@ static void update_state(struct jit_determ_state *state,
         dstp->known_val = ((~zero_bits) | one_bits) & dstp->known_bits;
         break;
     case JIT_OP_OR_CONST32:
-        dstp = state->slots + op->immed.or_const32.slot_no;
+        dstp = slots + op->immed.or_const32.slot_no;
         const32 = op->immed.or_const32.const32;
         /*
          * we know the value of all dst-bits in which one of the two src-bits
@@ -267,7 +407,7 @@ static void update_state(struct jit_determ_state *state,
         dstp->known_val = ((~zero_bits) | one_bits) & dstp->known_bits;
         break;
     case JIT_OP_SLOT_TO_BOOL:
-        dstp = state->slots + op->immed.slot_to_bool.slot_no;
+        dstp = slots + op->immed.slot_to_bool.slot_no;
         // cache known values
         if (dstp->known_bits == 0xffffffff)
             dstp->known_val = dstp->known_val ? 1 : 0;
@@ -275,41 +415,47 @@ static void update_state(struct jit_determ_state *state,
             dstp->known_bits = 0;
         break;
     case JIT_OP_NOT:
-        dstp = state->slots + op->immed.not.slot_no;
+        dstp = slots + op->immed.not.slot_no;
         dstp->known_val = ~dstp->known_val;
         break;
     case JIT_OP_SHLL:
-        dstp = state->slots + op->immed.shll.slot_no;
+        dstp = slots + op->immed.shll.slot_no;
         shift_amt = op->immed.shll.shift_amt;
         // cache known values
-        dstp->known_val <<= shift_amt;
-        if (shift_amt >= 32)
+        if (shift_amt >= 32) {
             dstp->known_bits = 0xffffffff; // all are zero
-        else
-            dstp->known_bits |= (1 << shift_amt) - 1;
+            dstp->known_val = 0;
+        } else {
+            dstp->known_val <<= shift_amt;
+            dstp->known_bits =
+                (dstp->known_bits << shift_amt) | ((1u << shift_amt) - 1);
+        }
         break;
     case JIT_OP_SHAR:
-        dstp = state->slots + op->immed.shar.slot_no;
+        dstp = slots + op->immed.shar.slot_no;
         shift_amt = op->immed.shar.shift_amt;
+        if (shift_amt > 31)
+            shift_amt = 31;
+        // the sign bit gets copied, whether it's known or not
         dstp->known_val = ((int32_t)dstp->known_val) >> shift_amt;
-        if (shift_amt >= 32)
-            dstp->known_bits = 0xffffffff; // all are one
-        else
-            dstp->known_bits |= ~((1 << (31 - shift_amt)) - 1);
+        dstp->known_bits = ((int32_t)dstp->known_bits) >> shift_amt;
         break;
     case JIT_OP_SHLR:
-        dstp = state->slots + op->immed.shlr.slot_no;
+        dstp = slots + op->immed.shlr.slot_no;
         shift_amt = op->immed.shlr.shift_amt;
-        dstp->known_val >>= shift_amt;
-        if (shift_amt >= 32)
+        if (shift_amt >= 32) {
             dstp->known_bits = 0xffffffff; // all are zero
-        else
-            dstp->known_bits |= ~((1 << (31 - shift_amt)) - 1);
+            dstp->known_val = 0;
+        } else {
+            dstp->known_val >>= shift_amt;
+            dstp->known_bits = (dstp->known_bits >> shift_amt) |
+                ~(0xffffffff >> shift_amt);
+        }
         break;
     case JIT_OP_SET_GT_UNSIGNED:
-        lhsp = state->slots + op->immed.set_gt_unsigned.slot_lhs;
-        rhsp = state->slots + op->immed.set_gt_unsigned.slot_rhs;
-        dstp = state->slots + op->immed.set_gt_unsigned.slot_dst;
+        lhsp = slots + op->immed.set_gt_unsigned.slot_lhs;
+        rhsp = slots + op->immed.set_gt_unsigned.slot_rhs;
+        dstp = slots + op->immed.set_gt_unsigned.slot_dst;
         /*
          * TODO: if the upper N bits of both lhs and rhs are known and those upper
          * N bits differ then it doesn't matter that you don't know the lower
@@ -324,9 +470,9 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_SET_GT_SIGNED:
-        lhsp = state->slots + op->immed.set_gt_signed.slot_lhs;
-        rhsp = state->slots + op->immed.set_gt_signed.slot_rhs;
-        dstp = state->slots + op->immed.set_gt_signed.slot_dst;
+        lhsp = slots + op->immed.set_gt_signed.slot_lhs;
+        rhsp = slots + op->immed.set_gt_signed.slot_rhs;
+        dstp = slots + op->immed.set_gt_signed.slot_dst;
 
         /*
          * TODO: if the upper N bits of both lhs and rhs are known and those upper
@@ -342,9 +488,9 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_SET_GT_SIGNED_CONST:
-        lhsp = state->slots + op->immed.set_gt_signed_const.slot_lhs;
+        lhsp = slots + op->immed.set_gt_signed_const.slot_lhs;
         const32 = op->immed.set_gt_signed_const.imm_rhs;
-        dstp = state->slots + op->immed.set_gt_signed_const.slot_dst;
+        dstp = slots + op->immed.set_gt_signed_const.slot_dst;
         if (lhsp->known_bits == 0xffffffff &&
             (int32_t)lhsp->known_val > (int32_t)const32) {
             dstp->known_bits |= 1;
@@ -354,9 +500,9 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_SET_EQ:
-        lhsp = state->slots + op->immed.set_eq.slot_lhs;
-        rhsp = state->slots + op->immed.set_eq.slot_rhs;
-        dstp = state->slots + op->immed.set_eq.slot_dst;
+        lhsp = slots + op->immed.set_eq.slot_lhs;
+        rhsp = slots + op->immed.set_eq.slot_rhs;
+        dstp = slots + op->immed.set_eq.slot_dst;
 
         /*
          * TODO: if the upper N bits of both lhs and rhs are known and those upper
@@ -372,9 +518,9 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_SET_GE_UNSIGNED:
-        lhsp = state->slots + op->immed.set_ge_unsigned.slot_lhs;
-        rhsp = state->slots + op->immed.set_ge_unsigned.slot_rhs;
-        dstp = state->slots + op->immed.set_ge_unsigned.slot_dst;
+        lhsp = slots + op->immed.set_ge_unsigned.slot_lhs;
+        rhsp = slots + op->immed.set_ge_unsigned.slot_rhs;
+        dstp = slots + op->immed.set_ge_unsigned.slot_dst;
 
         /*
          * TODO: if the upper N bits of both lhs and rhs are known and those upper
@@ -390,9 +536,9 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_SET_GE_SIGNED:
-        lhsp = state->slots + op->immed.set_ge_signed.slot_lhs;
-        rhsp = state->slots + op->immed.set_ge_signed.slot_rhs;
-        dstp = state->slots + op->immed.set_ge_signed.slot_dst;
+        lhsp = slots + op->immed.set_ge_signed.slot_lhs;
+        rhsp = slots + op->immed.set_ge_signed.slot_rhs;
+        dstp = slots + op->immed.set_ge_signed.slot_dst;
 
         /*
          * TODO: if the upper N bits of both lhs and rhs are known and those upper
@@ -408,9 +554,9 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_SET_GE_SIGNED_CONST:
-        lhsp = state->slots + op->immed.set_ge_signed_const.slot_lhs;
+        lhsp = slots + op->immed.set_ge_signed_const.slot_lhs;
         const32 = op->immed.set_ge_signed_const.imm_rhs;
-        dstp = state->slots + op->immed.set_ge_signed_const.slot_dst;
+        dstp = slots + op->immed.set_ge_signed_const.slot_dst;
 
         if (lhsp->known_bits == 0xffffffff &&
             (int32_t)lhsp->known_val >= (int32_t)const32) {
@@ -421,9 +567,9 @@ static void update_state(struct jit_determ_state *state,
         }
         break;
     case JIT_OP_MUL_U32:
-        lhsp = state->slots + op->immed.mul_u32.slot_lhs;
-        rhsp = state->slots + op->immed.mul_u32.slot_rhs;
-        dstp = state->slots + op->immed.mul_u32.slot_dst;
+        lhsp = slots + op->immed.mul_u32.slot_lhs;
+        rhsp = slots + op->immed.mul_u32.slot_rhs;
+        dstp = slots + op->immed.mul_u32.slot_dst;
 
         /*
          * TODO: this should be possible if the lower N bits of both src and
@@ -432,6 +578,31 @@ static void update_state(struct jit_determ_state *state,
         dstp->known_bits = 0;
         dstp->known_val = 0;
         break;
+    case JIT_OP_FADD:
+    case JIT_OP_FSUB:
+    case JIT_OP_FMUL:
+    case JIT_OP_FDIV:
+    case JIT_OP_FSQRT:
+    case JIT_OP_CVT_I32_F32:
+    case JIT_OP_CVT_F32_I32:
+        // no attempt is made to track floating-point results
+        dstp = slots + jit_inst_dst_slot(op);
+        dstp->known_bits = 0;
+        dstp->known_val = 0;
+        break;
+    case JIT_OP_FSET_EQ:
+    case JIT_OP_FSET_GT:
+        dstp = slots + jit_inst_dst_slot(op);
+        dstp->known_bits &= ~1;
+        break;
+    case JIT_OP_DOT4:
+    case JIT_OP_MAT4_XFORM:
+        // these only touch memory
+        break;
+    case JIT_OP_EXIT_COND:
+    case JIT_OP_TRACE_JOIN:
+        // nothing changes if execution gets past the exit
+        break;
     case JIT_OP_CALL_FUNC:
         // touching the SR can do wild things to registers
     case JIT_OP_FALLBACK:
@@ -440,6 +611,7 @@ static void update_state(struct jit_determ_state *state,
     case JIT_JUMP_COND:
     case JIT_OP_LOAD_SLOT:
     default:
-        jit_determ_default(state);
+        return false;
     }
+    return true;
 }
@@ -2,7 +2,7 @@
  *
  *
  *    WashingtonDC Dreamcast Emulator
- *    Copyright (C) 2018 snickerbockers
+ *    Copyright (C) 2018, 2019 snickerbockers
  *
  *    This program is free software: you can redistribute it and/or modify
  *    it under the terms of the GNU General Public License as published by
@@ -23,6 +23,9 @@
 #ifndef JIT_DETERM_H_
 #define JIT_DETERM_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "jit_il.h"
 
 #ifndef JIT_OPTIMIZE
@@ -34,8 +37,14 @@
  * determine which bits of which slots are known at compile-time.  Later passes
  * can then use this information to perform compile-time optimizations.
  *
- * We do this by allocating an array for each slot which tracks the known bits
- * of that slot and the values of those bits for every instruction in the block.
+ * Most instructions only change what's known about one slot (if that), so
+ * rather than keeping a copy of every slot for every instruction, the pass
+ * logs a jit_determ_delta whenever an instruction changes a slot, and a reset
+ * whenever an instruction makes everything unknown (fallbacks, function calls,
+ * jumps, etc).  The deltas for each slot are chained together newest-first, so
+ * looking up a slot at a given instruction only walks that slot's history.
+ * Memory usage is proportional to the number of slots the block uses plus the
+ * number of changes, instead of inst_count * MAX_SLOTS.
  */
 
 struct jit_determ_slot {
@@ -67,27 +76,62 @@ struct jit_determ_slot {
     uint32_t known_val;
 };
 
+#define JIT_DETERM_NONE 0xffffffff
+
+struct jit_determ_delta {
+    // instruction which changed the slot, and the slot's value after it
+    unsigned inst_no;
+    unsigned slot_no;
+    struct jit_determ_slot val;
+
+    // index of the previous delta for the same slot, or JIT_DETERM_NONE
+    unsigned prev;
+};
+
 /*
- * there is one of these for every instruction in the block
+ * there is one of these for every code block which has been through the pass
  */
 struct jit_determ_state {
-    struct jit_determ_slot slots[MAX_SLOTS];
+    // one more than the highest slot index that can appear in the block
+    unsigned n_slots;
+
+    // index of the newest delta for each slot, or JIT_DETERM_NONE
+    unsigned *last_delta;
+
+    struct jit_determ_delta *deltas;
+    unsigned n_deltas, deltas_alloc;
+
+    /*
+     * instructions after which every slot is unknown, in ascending order.
+     * deltas from before a reset do not apply after it.
+     */
+    unsigned *resets;
+    unsigned n_resets, resets_alloc;
+
+    /*
+     * heap usage in bytes of this state, and the most heap the pass needed at
+     * once while building it (including its scratch space).
+     */
+    size_t n_bytes;
+    size_t peak_bytes;
 };
 
 struct il_code_block;
 
-/*
- * initialize the given jit_determ_state to its default value.
- * This function is called by the code_block code whenever a new
- * jit_determ_state is created.  Unlike the rest of the code in jit_determ,
- * it is not called during the determination pass.
- */
-void jit_determ_default(struct jit_determ_state *new_state);
-
 /*
  * perform the determ pass on the given code_block and fill out its determinism
  * table.
  */
 void jit_determ_pass(struct il_code_block *block);
 
+// free the block's determinism table, if it has one
+void jit_determ_free(struct il_code_block *block);
+
+/*
+ * lookup what is known about slot_no after the instruction at inst_no has
+ * executed.  The block must have been through jit_determ_pass.
+ */
+void jit_determ_get(struct il_code_block const *block, unsigned inst_no,
+                    unsigned slot_no, struct jit_determ_slot *out);
+
 #endif
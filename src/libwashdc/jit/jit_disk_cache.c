@@ -0,0 +1,665 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "log.h"
+#include "avl.h"
+#include "washdc/error.h"
+#include "jit_il.h"
+#include "jit_disk_cache.h"
+
+#define DISK_CACHE_MAGIC "WASHJITC"
+
+// bump this whenever the file layout changes
+#define DISK_CACHE_VERSION 1
+
+// most host pointers an IL instruction can have
+#define MAX_RELOCS 3
+
+/*
+ * each host pointer in a saved instruction is replaced by NULL, and a reloc
+ * that says how to get it back is saved alongside the instruction.
+ */
+enum reloc_kind {
+    RELOC_NONE,
+
+    // offset into the register file
+    RELOC_REG,
+
+    // the memory map
+    RELOC_MAP,
+
+    // index into jit_disk_cache_target's call_funcs
+    RELOC_CALL,
+
+    // interpreter function for the instruction in a JIT_OP_FALLBACK
+    RELOC_FALLBACK
+};
+
+#define RELOC_MAKE(kind, val) ((((uint32_t)(kind)) << 24) | (uint32_t)(val))
+#define RELOC_KIND(reloc) ((reloc) >> 24)
+#define RELOC_VAL(reloc) ((reloc) & 0xffffff)
+#define RELOC_VAL_MAX 0xffffff
+
+struct saved_inst {
+    struct jit_inst inst;
+    uint32_t reloc[MAX_RELOCS];
+};
+
+struct disk_cache_ent {
+    struct avl_node node;
+
+    bool valid;
+    bool mode_change;
+
+    struct jit_disk_cache_blk_info info;
+
+    unsigned n_slots;
+    unsigned inst_count;
+    struct saved_inst *insts;
+};
+
+// everything in the file is in host byte order
+struct file_header {
+    char magic[8];
+    uint32_t version;
+
+    // sizeof(struct saved_inst), for when the IL changes between builds
+    uint32_t inst_size;
+
+    uint64_t cfg_hash;
+
+    // hash of everything in the file after the header
+    uint64_t payload_hash;
+
+    uint32_t n_blocks;
+
+    // JIT_IL_VERSION of the build that wrote the file
+    uint32_t il_version;
+};
+
+// each of these is followed by inst_count saved_insts
+struct file_blk {
+    uint64_t key;
+    uint64_t code_hash;
+    uint32_t last_addr;
+    uint32_t cycle_count;
+    uint32_t n_slots;
+    uint32_t inst_count;
+    uint32_t mode_change;
+    uint32_t reserved;
+};
+
+static bool enabled;
+static char *cache_path;
+static uint64_t cache_cfg_hash;
+static struct jit_disk_cache_target tgt;
+static struct avl_tree tree;
+static struct jit_disk_cache_stats stats;
+
+static struct avl_node *disk_cache_ent_ctor(void) {
+    struct disk_cache_ent *ent = calloc(1, sizeof(struct disk_cache_ent));
+    if (!ent)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    return &ent->node;
+}
+
+static void disk_cache_ent_dtor(struct avl_node *node) {
+    struct disk_cache_ent *ent = &AVL_DEREF(node, struct disk_cache_ent, node);
+    free(ent->insts);
+    free(ent);
+}
+
+static void invalidate_ent(struct disk_cache_ent *ent) {
+    free(ent->insts);
+    ent->insts = NULL;
+    ent->inst_count = 0;
+    ent->valid = false;
+}
+
+static bool reloc_reg(void const *ptr, size_t len, uint32_t *reloc) {
+    uintptr_t base = (uintptr_t)tgt.reg_base;
+    uintptr_t addr = (uintptr_t)ptr;
+
+    if (addr < base || addr - base > tgt.reg_len ||
+        len > tgt.reg_len - (addr - base) || addr - base > RELOC_VAL_MAX)
+        return false;
+    *reloc = RELOC_MAKE(RELOC_REG, addr - base);
+    return true;
+}
+
+static bool unreloc_reg(uint32_t reloc, size_t len, void **ptr) {
+    size_t offs = RELOC_VAL(reloc);
+    if (RELOC_KIND(reloc) != RELOC_REG || offs > tgt.reg_len ||
+        len > tgt.reg_len - offs)
+        return false;
+    *ptr = (void*)(((uint8_t const*)tgt.reg_base) + offs);
+    return true;
+}
+
+static bool reloc_map(struct memory_map const *map, uint32_t *reloc) {
+    if (map != tgt.map)
+        return false;
+    *reloc = RELOC_MAKE(RELOC_MAP, 0);
+    return true;
+}
+
+static bool unreloc_map(uint32_t reloc, struct memory_map **map) {
+    if (reloc != RELOC_MAKE(RELOC_MAP, 0))
+        return false;
+    *map = tgt.map;
+    return true;
+}
+
+// returns false if the instruction has a host pointer that can't be saved
+static bool save_inst(struct saved_inst *out, struct jit_inst const *in) {
+    union jit_immed *immed = &out->inst.immed;
+    unsigned idx;
+
+    memset(out, 0, sizeof(*out));
+    out->inst.op = in->op;
+    memcpy(immed, &in->immed, sizeof(*immed));
+
+    switch (in->op) {
+    case JIT_OP_FALLBACK:
+        if (tgt.fallback_fn(in->immed.fallback.inst) !=
+            in->immed.fallback.fallback_fn)
+            return false;
+        immed->fallback.fallback_fn = NULL;
+        out->reloc[0] = RELOC_MAKE(RELOC_FALLBACK, 0);
+        return true;
+    case JIT_OP_CALL_FUNC:
+        for (idx = 0; idx < tgt.n_call_funcs; idx++)
+            if (tgt.call_funcs[idx] == in->immed.call_func.func)
+                break;
+        if (idx >= tgt.n_call_funcs)
+            return false;
+        immed->call_func.func = NULL;
+        out->reloc[0] = RELOC_MAKE(RELOC_CALL, idx);
+        return true;
+    case JIT_OP_READ_16_CONSTADDR:
+        immed->read_16_constaddr.map = NULL;
+        return reloc_map(in->immed.read_16_constaddr.map, out->reloc);
+    case JIT_OP_READ_32_CONSTADDR:
+        immed->read_32_constaddr.map = NULL;
+        return reloc_map(in->immed.read_32_constaddr.map, out->reloc);
+    case JIT_OP_READ_32_SLOT:
+        immed->read_32_slot.map = NULL;
+        return reloc_map(in->immed.read_32_slot.map, out->reloc);
+    case JIT_OP_WRITE_32_SLOT:
+        immed->write_32_slot.map = NULL;
+        return reloc_map(in->immed.write_32_slot.map, out->reloc);
+    case JIT_OP_LOAD_SLOT16:
+        immed->load_slot16.src = NULL;
+        return reloc_reg(in->immed.load_slot16.src, sizeof(uint16_t),
+                         out->reloc);
+    case JIT_OP_LOAD_SLOT:
+        immed->load_slot.src = NULL;
+        return reloc_reg(in->immed.load_slot.src, sizeof(uint32_t),
+                         out->reloc);
+    case JIT_OP_STORE_SLOT:
+        immed->store_slot.dst = NULL;
+        return reloc_reg(in->immed.store_slot.dst, sizeof(uint32_t),
+                         out->reloc);
+    case JIT_OP_DOT4:
+        immed->dot4.lhs = NULL;
+        immed->dot4.rhs = NULL;
+        immed->dot4.dst = NULL;
+        return reloc_reg(in->immed.dot4.lhs, 4 * sizeof(float),
+                         out->reloc) &&
+            reloc_reg(in->immed.dot4.rhs, 4 * sizeof(float),
+                      out->reloc + 1) &&
+            reloc_reg(in->immed.dot4.dst, sizeof(float), out->reloc + 2);
+    case JIT_OP_MAT4_XFORM:
+        immed->mat4_xform.mat = NULL;
+        immed->mat4_xform.vec = NULL;
+        return reloc_reg(in->immed.mat4_xform.mat, 16 * sizeof(float),
+                         out->reloc) &&
+            reloc_reg(in->immed.mat4_xform.vec, 4 * sizeof(float),
+                      out->reloc + 1);
+    default:
+        return true;
+    }
+}
+
+/*
+ * returns false if the saved instruction doesn't make sense, which can only
+ * happen if the file was damaged.
+ */
+static bool
+load_inst(struct jit_inst *out, struct saved_inst const *in, unsigned n_slots) {
+    union jit_immed *immed = &out->immed;
+    unsigned slots[JIT_INST_MAX_READ_SLOTS];
+    unsigned n_relocs = 0, idx, n_read;
+    void *ptr[MAX_RELOCS];
+    int dst_slot;
+
+    if ((unsigned)in->inst.op >= (unsigned)JIT_OP_COUNT)
+        return false;
+
+    *out = in->inst;
+
+    switch (out->op) {
+    case JIT_OP_FALLBACK:
+        if (in->reloc[0] != RELOC_MAKE(RELOC_FALLBACK, 0))
+            return false;
+        immed->fallback.fallback_fn = tgt.fallback_fn(immed->fallback.inst);
+        n_relocs = 1;
+        break;
+    case JIT_OP_CALL_FUNC:
+        if (RELOC_KIND(in->reloc[0]) != RELOC_CALL ||
+            RELOC_VAL(in->reloc[0]) >= tgt.n_call_funcs)
+            return false;
+        immed->call_func.func = tgt.call_funcs[RELOC_VAL(in->reloc[0])];
+        n_relocs = 1;
+        break;
+    case JIT_OP_READ_16_CONSTADDR:
+        if (!unreloc_map(in->reloc[0], &immed->read_16_constaddr.map))
+            return false;
+        n_relocs = 1;
+        break;
+    case JIT_OP_READ_32_CONSTADDR:
+        if (!unreloc_map(in->reloc[0], &immed->read_32_constaddr.map))
+            return false;
+        n_relocs = 1;
+        break;
+    case JIT_OP_READ_32_SLOT:
+        if (!unreloc_map(in->reloc[0], &immed->read_32_slot.map))
+            return false;
+        n_relocs = 1;
+        break;
+    case JIT_OP_WRITE_32_SLOT:
+        if (!unreloc_map(in->reloc[0], &immed->write_32_slot.map))
+            return false;
+        n_relocs = 1;
+        break;
+    case JIT_OP_LOAD_SLOT16:
+        if (!unreloc_reg(in->reloc[0], sizeof(uint16_t), ptr))
+            return false;
+        immed->load_slot16.src = (uint16_t const*)ptr[0];
+        n_relocs = 1;
+        break;
+    case JIT_OP_LOAD_SLOT:
+        if (!unreloc_reg(in->reloc[0], sizeof(uint32_t), ptr))
+            return false;
+        immed->load_slot.src = (uint32_t const*)ptr[0];
+        n_relocs = 1;
+        break;
+    case JIT_OP_STORE_SLOT:
+        if (!unreloc_reg(in->reloc[0], sizeof(uint32_t), ptr))
+            return false;
+        immed->store_slot.dst = (uint32_t*)ptr[0];
+        n_relocs = 1;
+        break;
+    case JIT_OP_DOT4:
+        if (!unreloc_reg(in->reloc[0], 4 * sizeof(float), ptr) ||
+            !unreloc_reg(in->reloc[1], 4 * sizeof(float), ptr + 1) ||
+            !unreloc_reg(in->reloc[2], sizeof(float), ptr + 2))
+            return false;
+        immed->dot4.lhs = (float const*)ptr[0];
+        immed->dot4.rhs = (float const*)ptr[1];
+        immed->dot4.dst = (float*)ptr[2];
+        n_relocs = 3;
+        break;
+    case JIT_OP_MAT4_XFORM:
+        if (!unreloc_reg(in->reloc[0], 16 * sizeof(float), ptr) ||
+            !unreloc_reg(in->reloc[1], 4 * sizeof(float), ptr + 1))
+            return false;
+        immed->mat4_xform.mat = (float const*)ptr[0];
+        immed->mat4_xform.vec = (float*)ptr[1];
+        n_relocs = 2;
+        break;
+    default:
+        break;
+    }
+
+    for (idx = n_relocs; idx < MAX_RELOCS; idx++)
+        if (in->reloc[idx] != RELOC_MAKE(RELOC_NONE, 0))
+            return false;
+
+    dst_slot = jit_inst_dst_slot(out);
+    if (dst_slot >= 0 && (unsigned)dst_slot >= n_slots)
+        return false;
+    n_read = jit_inst_read_slots(out, slots);
+    for (idx = 0; idx < n_read; idx++)
+        if (slots[idx] >= n_slots)
+            return false;
+
+    return true;
+}
+
+static void load_file(void) {
+    struct file_header hdr;
+    uint8_t *payload = NULL;
+    size_t payload_len, offs = 0;
+    long file_len;
+    unsigned blk_no, inst_no;
+
+    FILE *fp = fopen(cache_path, "rb");
+    if (!fp) {
+        if (errno != ENOENT)
+            LOG_WARN("%s - unable to open %s\n", __func__, cache_path);
+        else
+            LOG_INFO("%s - %s does not exist yet\n", __func__, cache_path);
+        return;
+    }
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (file_len = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET) != 0 ||
+        (size_t)file_len < sizeof(hdr) ||
+        fread(&hdr, sizeof(hdr), 1, fp) != 1)
+        goto bad_file;
+
+    if (memcmp(hdr.magic, DISK_CACHE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != DISK_CACHE_VERSION ||
+        hdr.il_version != JIT_IL_VERSION ||
+        hdr.inst_size != sizeof(struct saved_inst) ||
+        hdr.cfg_hash != cache_cfg_hash) {
+        LOG_INFO("%s - %s is from a different build or configuration; it "
+                 "will be replaced\n", __func__, cache_path);
+        fclose(fp);
+        return;
+    }
+
+    payload_len = (size_t)file_len - sizeof(hdr);
+    if (!(payload = malloc(payload_len ? payload_len : 1)))
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    if (payload_len && fread(payload, payload_len, 1, fp) != 1)
+        goto bad_file;
+    if (jit_disk_cache_hash(JIT_DISK_CACHE_HASH_INIT,
+                            payload, payload_len) != hdr.payload_hash)
+        goto bad_file;
+
+    for (blk_no = 0; blk_no < hdr.n_blocks; blk_no++) {
+        struct file_blk blk;
+        struct jit_inst inst;
+
+        if (payload_len - offs < sizeof(blk))
+            goto bad_file;
+        memcpy(&blk, payload + offs, sizeof(blk));
+        offs += sizeof(blk);
+
+        if (blk.n_slots > MAX_SLOTS ||
+            blk.inst_count > (payload_len - offs) / sizeof(struct saved_inst))
+            goto bad_file;
+
+        struct disk_cache_ent *ent =
+            &AVL_DEREF(avl_find(&tree, blk.key), struct disk_cache_ent, node);
+        invalidate_ent(ent);
+
+        ent->insts = malloc(sizeof(struct saved_inst) *
+                            (blk.inst_count ? blk.inst_count : 1));
+        if (!ent->insts)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        memcpy(ent->insts, payload + offs,
+               sizeof(struct saved_inst) * blk.inst_count);
+        offs += sizeof(struct saved_inst) * blk.inst_count;
+
+        // make sure the whole block can be loaded before accepting it
+        for (inst_no = 0; inst_no < blk.inst_count; inst_no++)
+            if (!load_inst(&inst, ent->insts + inst_no, blk.n_slots))
+                goto bad_file;
+
+        ent->info.last_addr = blk.last_addr;
+        ent->info.code_hash = blk.code_hash;
+        ent->info.cycle_count = blk.cycle_count;
+        ent->n_slots = blk.n_slots;
+        ent->inst_count = blk.inst_count;
+        ent->mode_change = blk.mode_change;
+        ent->valid = true;
+        stats.n_loaded++;
+    }
+
+    free(payload);
+    fclose(fp);
+    LOG_INFO("%s - loaded %llu blocks from %s\n",
+             __func__, stats.n_loaded, cache_path);
+    return;
+
+bad_file:
+    LOG_WARN("%s - %s is damaged; it will be replaced\n",
+             __func__, cache_path);
+    avl_cleanup(&tree);
+    avl_init(&tree, disk_cache_ent_ctor, disk_cache_ent_dtor);
+    stats.n_loaded = 0;
+    free(payload);
+    fclose(fp);
+}
+
+struct file_writer {
+    FILE *fp;
+    uint64_t hash;
+    unsigned n_blocks;
+    bool failed;
+};
+
+static void write_dat(struct file_writer *writer, void const *dat, size_t len) {
+    if (!writer->failed && len && fwrite(dat, len, 1, writer->fp) != 1)
+        writer->failed = true;
+    writer->hash = jit_disk_cache_hash(writer->hash, dat, len);
+}
+
+static void write_node(struct file_writer *writer, struct avl_node *node) {
+    if (!node)
+        return;
+
+    write_node(writer, node->left);
+
+    struct disk_cache_ent *ent = &AVL_DEREF(node, struct disk_cache_ent, node);
+    if (ent->valid) {
+        struct file_blk blk;
+        memset(&blk, 0, sizeof(blk));
+        blk.key = node->key;
+        blk.code_hash = ent->info.code_hash;
+        blk.last_addr = ent->info.last_addr;
+        blk.cycle_count = ent->info.cycle_count;
+        blk.n_slots = ent->n_slots;
+        blk.inst_count = ent->inst_count;
+        blk.mode_change = ent->mode_change;
+        write_dat(writer, &blk, sizeof(blk));
+        write_dat(writer, ent->insts,
+                  sizeof(struct saved_inst) * ent->inst_count);
+        writer->n_blocks++;
+    }
+
+    write_node(writer, node->right);
+}
+
+/*
+ * the file gets written somewhere else and then renamed over the old one so
+ * that a crash halfway through doesn't leave a damaged file behind.
+ */
+static void write_file(void) {
+    struct file_header hdr;
+    struct file_writer writer = { .hash = JIT_DISK_CACHE_HASH_INIT };
+    size_t tmp_len = strlen(cache_path) + 5;
+    char *tmp_path = malloc(tmp_len);
+    if (!tmp_path)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    snprintf(tmp_path, tmp_len, "%s.tmp", cache_path);
+
+    if (!(writer.fp = fopen(tmp_path, "wb"))) {
+        LOG_ERROR("%s - unable to open %s\n", __func__, tmp_path);
+        free(tmp_path);
+        return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    if (fwrite(&hdr, sizeof(hdr), 1, writer.fp) != 1)
+        writer.failed = true;
+
+    write_node(&writer, tree.root);
+
+    memcpy(hdr.magic, DISK_CACHE_MAGIC, sizeof(hdr.magic));
+    hdr.version = DISK_CACHE_VERSION;
+    hdr.il_version = JIT_IL_VERSION;
+    hdr.inst_size = sizeof(struct saved_inst);
+    hdr.cfg_hash = cache_cfg_hash;
+    hdr.payload_hash = writer.hash;
+    hdr.n_blocks = writer.n_blocks;
+    if (fseek(writer.fp, 0, SEEK_SET) != 0 ||
+        fwrite(&hdr, sizeof(hdr), 1, writer.fp) != 1)
+        writer.failed = true;
+
+    if (fclose(writer.fp) != 0 || writer.failed ||
+        rename(tmp_path, cache_path) != 0) {
+        LOG_ERROR("%s - unable to write %s\n", __func__, cache_path);
+        remove(tmp_path);
+    } else {
+        LOG_INFO("%s - saved %u blocks to %s\n",
+                 __func__, writer.n_blocks, cache_path);
+    }
+
+    free(tmp_path);
+}
+
+void jit_disk_cache_init(char const *path, uint64_t cfg_hash,
+                         struct jit_disk_cache_target const *target) {
+    memset(&stats, 0, sizeof(stats));
+
+    if (!(cache_path = strdup(path)))
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    tgt = *target;
+    cache_cfg_hash = jit_disk_cache_hash(cfg_hash, &tgt.reg_len,
+                                         sizeof(tgt.reg_len));
+    avl_init(&tree, disk_cache_ent_ctor, disk_cache_ent_dtor);
+    enabled = true;
+
+    load_file();
+}
+
+void jit_disk_cache_cleanup(void) {
+    if (!enabled)
+        return;
+
+    write_file();
+
+    avl_cleanup(&tree);
+    free(cache_path);
+    cache_path = NULL;
+    enabled = false;
+}
+
+bool jit_disk_cache_enabled(void) {
+    return enabled;
+}
+
+bool jit_disk_cache_fetch(code_cache_key key, struct il_code_block *blk,
+                          struct jit_disk_cache_blk_info *info,
+                          jit_disk_cache_hash_fn hash_fn, void *hash_ctx) {
+    struct disk_cache_ent *ent;
+    struct avl_node *node;
+    unsigned inst_no;
+
+    if (!enabled)
+        return false;
+
+    node = avl_find_noinsert(&tree, key);
+    if (!node)
+        goto miss;
+    ent = &AVL_DEREF(node, struct disk_cache_ent, node);
+    if (!ent->valid)
+        goto miss;
+
+    if (hash_fn(hash_ctx, code_cache_key_addr(key), ent->info.last_addr) !=
+        ent->info.code_hash) {
+        stats.n_stale++;
+        invalidate_ent(ent);
+        goto miss;
+    }
+
+    for (inst_no = 0; inst_no < ent->inst_count; inst_no++) {
+        struct jit_inst inst;
+        if (!load_inst(&inst, ent->insts + inst_no, ent->n_slots)) {
+            // this can't happen since every block was checked on the way in
+            RAISE_ERROR(ERROR_INTEGRITY);
+        }
+        il_code_block_push_inst(blk, &inst);
+    }
+    blk->n_slots = ent->n_slots;
+    blk->mode_change = ent->mode_change;
+
+    *info = ent->info;
+    stats.n_hits++;
+    return true;
+
+miss:
+    stats.n_misses++;
+    return false;
+}
+
+void jit_disk_cache_store(code_cache_key key, struct il_code_block const *blk,
+                          struct jit_disk_cache_blk_info const *info) {
+    struct saved_inst *insts;
+    unsigned inst_no;
+
+    if (!enabled)
+        return;
+
+    insts = malloc(sizeof(struct saved_inst) *
+                   (blk->inst_count ? blk->inst_count : 1));
+    if (!insts)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    for (inst_no = 0; inst_no < blk->inst_count; inst_no++) {
+        if (!save_inst(insts + inst_no, blk->inst_list + inst_no)) {
+            stats.n_uncacheable++;
+            free(insts);
+            return;
+        }
+    }
+
+    struct disk_cache_ent *ent =
+        &AVL_DEREF(avl_find(&tree, key), struct disk_cache_ent, node);
+    invalidate_ent(ent);
+    ent->insts = insts;
+    ent->inst_count = blk->inst_count;
+    ent->n_slots = blk->n_slots;
+    ent->mode_change = blk->mode_change;
+    ent->info = *info;
+    ent->valid = true;
+}
+
+void jit_disk_cache_count_miss_time(unsigned long long ns) {
+    stats.miss_ns += ns;
+}
+
+void jit_disk_cache_count_hit_time(unsigned long long ns) {
+    stats.hit_ns += ns;
+}
+
+void jit_disk_cache_get_stats(struct jit_disk_cache_stats *stats_out) {
+    *stats_out = stats;
+}
+
+void jit_disk_cache_print_stats(struct jit_disk_cache_stats const *stats) {
+    LOG_INFO("jit disk cache: %llu blocks loaded from disk\n", stats->n_loaded);
+    LOG_INFO("jit disk cache: %llu hits, %llu misses, %llu stale, "
+             "%llu uncacheable\n", stats->n_hits, stats->n_misses,
+             stats->n_stale, stats->n_uncacheable);
+    LOG_INFO("jit disk cache: %f ms translating misses, %f ms loading hits\n",
+             stats->miss_ns / 1000000.0, stats->hit_ns / 1000000.0);
+}
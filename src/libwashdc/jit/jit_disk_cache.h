@@ -0,0 +1,162 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef JIT_DISK_CACHE_H_
+#define JIT_DISK_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "washdc/types.h"
+#include "washdc/cpu.h"
+#include "code_block.h"
+#include "code_cache.h"
+
+/*
+ * Persistent translation cache.
+ *
+ * This saves the IL of compiled blocks to a file so that the next time the
+ * same program runs the frontend doesn't have to translate that code again.
+ * Blocks are keyed the same way as the code cache (guest address plus mode),
+ * and each one remembers a hash of the guest code it was translated from.
+ * When a block is fetched that guest code is hashed again, and the block is
+ * thrown away if it doesn't match.
+ *
+ * The IL is saved instead of native code because the native backend bakes host
+ * addresses into everything it emits.  The IL only has a few kinds of host
+ * pointers in it, and those get saved in a form that doesn't depend on where
+ * things happen to be in memory (see struct jit_disk_cache_target).  Blocks
+ * with pointers that can't be saved that way just don't get cached.
+ */
+
+typedef void(*jit_disk_cache_fallback_fn)(void*, cpu_inst_param);
+typedef void(*jit_disk_cache_call_fn)(void*, uint32_t);
+
+/*
+ * The host pointers that the frontend puts into its IL.  Pointers into reg_base
+ * are saved as offsets, the memory map is saved as a tag and functions called
+ * by JIT_OP_CALL_FUNC are saved as indices into call_funcs.  JIT_OP_FALLBACK
+ * functions aren't saved at all; fallback_fn looks them up again from the
+ * instruction when the block is loaded.
+ */
+struct jit_disk_cache_target {
+    void const *reg_base;
+    size_t reg_len;
+
+    struct memory_map *map;
+
+    jit_disk_cache_call_fn const *call_funcs;
+    unsigned n_call_funcs;
+
+    jit_disk_cache_fallback_fn(*fallback_fn)(cpu_inst_param);
+};
+
+// what the block was compiled from, other than its IL
+struct jit_disk_cache_blk_info {
+    // address of the last byte of guest code in the block
+    addr32_t last_addr;
+
+    // see jit_disk_cache_hash
+    uint64_t code_hash;
+
+    unsigned cycle_count;
+};
+
+/*
+ * hash the guest code from first to last inclusive.  hash_fn is given to
+ * jit_disk_cache_fetch so that the cache can check blocks before using them.
+ */
+typedef uint64_t(*jit_disk_cache_hash_fn)(void *ctx, addr32_t first,
+                                           addr32_t last);
+
+/*
+ * Open the cache file at path and load every block in it.  cfg_hash should
+ * cover anything besides the guest code and mode which changes how the
+ * frontend translates code, as well as the frontend's version.  If it doesn't
+ * match the file's then the file's blocks are dropped, and the file will be
+ * overwritten when the cache is closed.
+ */
+void jit_disk_cache_init(char const *path, uint64_t cfg_hash,
+                         struct jit_disk_cache_target const *target);
+
+// write every valid block back to the file and free the cache
+void jit_disk_cache_cleanup(void);
+
+bool jit_disk_cache_enabled(void);
+
+/*
+ * If there's a valid block at key, load its IL into blk (which must have
+ * just been initialized with il_code_block_init) and return true.
+ */
+bool jit_disk_cache_fetch(code_cache_key key, struct il_code_block *blk,
+                          struct jit_disk_cache_blk_info *info,
+                          jit_disk_cache_hash_fn hash_fn, void *hash_ctx);
+
+// save the IL of a block the frontend just compiled
+void jit_disk_cache_store(code_cache_key key, struct il_code_block const *blk,
+                          struct jit_disk_cache_blk_info const *info);
+
+// 64-bit FNV-1a
+static inline uint64_t
+jit_disk_cache_hash(uint64_t hash, void const *dat, size_t len) {
+    uint8_t const *bytes = (uint8_t const*)dat;
+    while (len--) {
+        hash ^= *bytes++;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+#define JIT_DISK_CACHE_HASH_INIT 0xcbf29ce484222325ull
+
+struct jit_disk_cache_stats {
+    // blocks read from the file when the cache was opened
+    unsigned long long n_loaded;
+
+    unsigned long long n_hits;
+    unsigned long long n_misses;
+
+    // blocks thrown away because the guest code changed
+    unsigned long long n_stale;
+
+    // blocks with host pointers that couldn't be saved
+    unsigned long long n_uncacheable;
+
+    /*
+     * host nanoseconds spent translating blocks which weren't in the cache,
+     * and loading blocks which were.  Comparing these between a run with an
+     * empty cache file and a run with a full one shows how much time the cache
+     * saves.
+     */
+    unsigned long long miss_ns;
+    unsigned long long hit_ns;
+};
+
+// the frontend calls this to report how long a miss took to translate
+void jit_disk_cache_count_miss_time(unsigned long long ns);
+void jit_disk_cache_count_hit_time(unsigned long long ns);
+
+void jit_disk_cache_get_stats(struct jit_disk_cache_stats *stats);
+void jit_disk_cache_print_stats(struct jit_disk_cache_stats const *stats);
+
+#endif
@@ -59,6 +59,33 @@ void jit_jump_cond(struct il_code_block *block,
     il_code_block_push_inst(block, &op);
 }
 
+void jit_exit_cond(struct il_code_block *block, unsigned slot_no,
+                   unsigned t_val, addr32_t exit_pc, unsigned cycle_count,
+                   unsigned n_guest_insts) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_EXIT_COND;
+    op.immed.exit_cond.slot_no = slot_no;
+    op.immed.exit_cond.t_flag = t_val;
+    op.immed.exit_cond.exit_pc = exit_pc;
+    op.immed.exit_cond.cycle_count = cycle_count;
+    op.immed.exit_cond.n_guest_insts = n_guest_insts;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_trace_join(struct il_code_block *block, addr32_t next_pc,
+                    unsigned cycle_count, unsigned n_guest_insts) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_TRACE_JOIN;
+    op.immed.trace_join.next_pc = next_pc;
+    op.immed.trace_join.cycle_count = cycle_count;
+    op.immed.trace_join.n_guest_insts = n_guest_insts;
+
+    il_code_block_push_inst(block, &op);
+}
+
 void jit_set_slot(struct il_code_block *block, unsigned slot_idx,
                   uint32_t new_val) {
     struct jit_inst op;
@@ -449,3 +476,375 @@ void jit_shad(struct il_code_block *block, unsigned slot_val,
 
     il_code_block_push_inst(block, &op);
 }
+
+void jit_fadd(struct il_code_block *block, unsigned slot_src,
+              unsigned slot_dst) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_FADD;
+    op.immed.fadd.slot_src = slot_src;
+    op.immed.fadd.slot_dst = slot_dst;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_fsub(struct il_code_block *block, unsigned slot_src,
+              unsigned slot_dst) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_FSUB;
+    op.immed.fsub.slot_src = slot_src;
+    op.immed.fsub.slot_dst = slot_dst;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_fmul(struct il_code_block *block, unsigned slot_src,
+              unsigned slot_dst) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_FMUL;
+    op.immed.fmul.slot_src = slot_src;
+    op.immed.fmul.slot_dst = slot_dst;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_fdiv(struct il_code_block *block, unsigned slot_src,
+              unsigned slot_dst) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_FDIV;
+    op.immed.fdiv.slot_src = slot_src;
+    op.immed.fdiv.slot_dst = slot_dst;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_fsqrt(struct il_code_block *block, unsigned slot_no) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_FSQRT;
+    op.immed.fsqrt.slot_no = slot_no;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_fset_eq(struct il_code_block *block, unsigned slot_lhs,
+                 unsigned slot_rhs, unsigned slot_dst) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_FSET_EQ;
+    op.immed.fset_eq.slot_lhs = slot_lhs;
+    op.immed.fset_eq.slot_rhs = slot_rhs;
+    op.immed.fset_eq.slot_dst = slot_dst;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_fset_gt(struct il_code_block *block, unsigned slot_lhs,
+                 unsigned slot_rhs, unsigned slot_dst) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_FSET_GT;
+    op.immed.fset_gt.slot_lhs = slot_lhs;
+    op.immed.fset_gt.slot_rhs = slot_rhs;
+    op.immed.fset_gt.slot_dst = slot_dst;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_cvt_i32_f32(struct il_code_block *block, unsigned slot_no) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_CVT_I32_F32;
+    op.immed.cvt_i32_f32.slot_no = slot_no;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_cvt_f32_i32(struct il_code_block *block, unsigned slot_no) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_CVT_F32_I32;
+    op.immed.cvt_f32_i32.slot_no = slot_no;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_dot4(struct il_code_block *block, float const *lhs,
+              float const *rhs, float *dst) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_DOT4;
+    op.immed.dot4.lhs = lhs;
+    op.immed.dot4.rhs = rhs;
+    op.immed.dot4.dst = dst;
+
+    il_code_block_push_inst(block, &op);
+}
+
+void jit_mat4_xform(struct il_code_block *block, float const *mat,
+                    float *vec) {
+    struct jit_inst op;
+
+    op.op = JIT_OP_MAT4_XFORM;
+    op.immed.mat4_xform.mat = mat;
+    op.immed.mat4_xform.vec = vec;
+
+    il_code_block_push_inst(block, &op);
+}
+
+int jit_inst_dst_slot(struct jit_inst const *inst) {
+    union jit_immed const *immed = &inst->immed;
+
+    switch (inst->op) {
+    case JIT_SET_SLOT:
+        return immed->set_slot.slot_idx;
+    case JIT_OP_READ_16_CONSTADDR:
+        return immed->read_16_constaddr.slot_no;
+    case JIT_OP_SIGN_EXTEND_16:
+        return immed->sign_extend_16.slot_no;
+    case JIT_OP_READ_32_CONSTADDR:
+        return immed->read_32_constaddr.slot_no;
+    case JIT_OP_READ_32_SLOT:
+        return immed->read_32_slot.dst_slot;
+    case JIT_OP_LOAD_SLOT16:
+        return immed->load_slot16.slot_no;
+    case JIT_OP_LOAD_SLOT:
+        return immed->load_slot.slot_no;
+    case JIT_OP_ADD:
+        return immed->add.slot_dst;
+    case JIT_OP_SUB:
+        return immed->sub.slot_dst;
+    case JIT_OP_ADD_CONST32:
+        return immed->add_const32.slot_dst;
+    case JIT_OP_XOR:
+        return immed->xor.slot_dst;
+    case JIT_OP_XOR_CONST32:
+        return immed->xor_const32.slot_no;
+    case JIT_OP_MOV:
+        return immed->mov.slot_dst;
+    case JIT_OP_AND:
+        return immed->and.slot_dst;
+    case JIT_OP_AND_CONST32:
+        return immed->and_const32.slot_no;
+    case JIT_OP_OR:
+        return immed->or.slot_dst;
+    case JIT_OP_OR_CONST32:
+        return immed->or_const32.slot_no;
+    case JIT_OP_SLOT_TO_BOOL:
+        return immed->slot_to_bool.slot_no;
+    case JIT_OP_NOT:
+        return immed->not.slot_no;
+    case JIT_OP_SHLL:
+        return immed->shll.slot_no;
+    case JIT_OP_SHAR:
+        return immed->shar.slot_no;
+    case JIT_OP_SHLR:
+        return immed->shlr.slot_no;
+    case JIT_OP_SHAD:
+        return immed->shad.slot_val;
+    case JIT_OP_SET_GT_UNSIGNED:
+        return immed->set_gt_unsigned.slot_dst;
+    case JIT_OP_SET_GT_SIGNED:
+        return immed->set_gt_signed.slot_dst;
+    case JIT_OP_SET_GT_SIGNED_CONST:
+        return immed->set_gt_signed_const.slot_dst;
+    case JIT_OP_SET_EQ:
+        return immed->set_eq.slot_dst;
+    case JIT_OP_SET_GE_UNSIGNED:
+        return immed->set_ge_unsigned.slot_dst;
+    case JIT_OP_SET_GE_SIGNED:
+        return immed->set_ge_signed.slot_dst;
+    case JIT_OP_SET_GE_SIGNED_CONST:
+        return immed->set_ge_signed_const.slot_dst;
+    case JIT_OP_MUL_U32:
+        return immed->mul_u32.slot_dst;
+    case JIT_OP_FADD:
+        return immed->fadd.slot_dst;
+    case JIT_OP_FSUB:
+        return immed->fsub.slot_dst;
+    case JIT_OP_FMUL:
+        return immed->fmul.slot_dst;
+    case JIT_OP_FDIV:
+        return immed->fdiv.slot_dst;
+    case JIT_OP_FSQRT:
+        return immed->fsqrt.slot_no;
+    case JIT_OP_FSET_EQ:
+        return immed->fset_eq.slot_dst;
+    case JIT_OP_FSET_GT:
+        return immed->fset_gt.slot_dst;
+    case JIT_OP_CVT_I32_F32:
+        return immed->cvt_i32_f32.slot_no;
+    case JIT_OP_CVT_F32_I32:
+        return immed->cvt_f32_i32.slot_no;
+    case JIT_OP_DISCARD_SLOT:
+        return immed->discard_slot.slot_no;
+    default:
+        return -1;
+    }
+}
+
+unsigned jit_inst_read_slots(struct jit_inst const *inst,
+                             unsigned slots[JIT_INST_MAX_READ_SLOTS]) {
+    union jit_immed const *immed = &inst->immed;
+
+    switch (inst->op) {
+    case JIT_OP_JUMP:
+        slots[0] = immed->jump.slot_no;
+        return 1;
+    case JIT_JUMP_COND:
+        slots[0] = immed->jump_cond.slot_no;
+        slots[1] = immed->jump_cond.jmp_addr_slot;
+        slots[2] = immed->jump_cond.alt_jmp_addr_slot;
+        return 3;
+    case JIT_OP_EXIT_COND:
+        slots[0] = immed->exit_cond.slot_no;
+        return 1;
+    case JIT_OP_CALL_FUNC:
+        slots[0] = immed->call_func.slot_no;
+        return 1;
+    case JIT_OP_SIGN_EXTEND_16:
+        slots[0] = immed->sign_extend_16.slot_no;
+        return 1;
+    case JIT_OP_READ_32_SLOT:
+        slots[0] = immed->read_32_slot.addr_slot;
+        return 1;
+    case JIT_OP_WRITE_32_SLOT:
+        slots[0] = immed->write_32_slot.src_slot;
+        slots[1] = immed->write_32_slot.addr_slot;
+        return 2;
+    case JIT_OP_STORE_SLOT:
+        slots[0] = immed->store_slot.slot_no;
+        return 1;
+    case JIT_OP_ADD:
+        slots[0] = immed->add.slot_src;
+        slots[1] = immed->add.slot_dst;
+        return 2;
+    case JIT_OP_SUB:
+        slots[0] = immed->sub.slot_src;
+        slots[1] = immed->sub.slot_dst;
+        return 2;
+    case JIT_OP_ADD_CONST32:
+        slots[0] = immed->add_const32.slot_dst;
+        return 1;
+    case JIT_OP_XOR:
+        slots[0] = immed->xor.slot_src;
+        slots[1] = immed->xor.slot_dst;
+        return 2;
+    case JIT_OP_XOR_CONST32:
+        slots[0] = immed->xor_const32.slot_no;
+        return 1;
+    case JIT_OP_MOV:
+        slots[0] = immed->mov.slot_src;
+        return 1;
+    case JIT_OP_AND:
+        slots[0] = immed->and.slot_src;
+        slots[1] = immed->and.slot_dst;
+        return 2;
+    case JIT_OP_AND_CONST32:
+        slots[0] = immed->and_const32.slot_no;
+        return 1;
+    case JIT_OP_OR:
+        slots[0] = immed->or.slot_src;
+        slots[1] = immed->or.slot_dst;
+        return 2;
+    case JIT_OP_OR_CONST32:
+        slots[0] = immed->or_const32.slot_no;
+        return 1;
+    case JIT_OP_SLOT_TO_BOOL:
+        slots[0] = immed->slot_to_bool.slot_no;
+        return 1;
+    case JIT_OP_NOT:
+        slots[0] = immed->not.slot_no;
+        return 1;
+    case JIT_OP_SHLL:
+        slots[0] = immed->shll.slot_no;
+        return 1;
+    case JIT_OP_SHAR:
+        slots[0] = immed->shar.slot_no;
+        return 1;
+    case JIT_OP_SHLR:
+        slots[0] = immed->shlr.slot_no;
+        return 1;
+    case JIT_OP_SHAD:
+        slots[0] = immed->shad.slot_val;
+        slots[1] = immed->shad.slot_shift_amt;
+        return 2;
+    case JIT_OP_SET_GT_UNSIGNED:
+        slots[0] = immed->set_gt_unsigned.slot_lhs;
+        slots[1] = immed->set_gt_unsigned.slot_rhs;
+        slots[2] = immed->set_gt_unsigned.slot_dst;
+        return 3;
+    case JIT_OP_SET_GT_SIGNED:
+        slots[0] = immed->set_gt_signed.slot_lhs;
+        slots[1] = immed->set_gt_signed.slot_rhs;
+        slots[2] = immed->set_gt_signed.slot_dst;
+        return 3;
+    case JIT_OP_SET_GT_SIGNED_CONST:
+        slots[0] = immed->set_gt_signed_const.slot_lhs;
+        slots[1] = immed->set_gt_signed_const.slot_dst;
+        return 2;
+    case JIT_OP_SET_EQ:
+        slots[0] = immed->set_eq.slot_lhs;
+        slots[1] = immed->set_eq.slot_rhs;
+        slots[2] = immed->set_eq.slot_dst;
+        return 3;
+    case JIT_OP_SET_GE_UNSIGNED:
+        slots[0] = immed->set_ge_unsigned.slot_lhs;
+        slots[1] = immed->set_ge_unsigned.slot_rhs;
+        slots[2] = immed->set_ge_unsigned.slot_dst;
+        return 3;
+    case JIT_OP_SET_GE_SIGNED:
+        slots[0] = immed->set_ge_signed.slot_lhs;
+        slots[1] = immed->set_ge_signed.slot_rhs;
+        slots[2] = immed->set_ge_signed.slot_dst;
+        return 3;
+    case JIT_OP_SET_GE_SIGNED_CONST:
+        slots[0] = immed->set_ge_signed_const.slot_lhs;
+        slots[1] = immed->set_ge_signed_const.slot_dst;
+        return 2;
+    case JIT_OP_MUL_U32:
+        slots[0] = immed->mul_u32.slot_lhs;
+        slots[1] = immed->mul_u32.slot_rhs;
+        return 2;
+    case JIT_OP_FADD:
+        slots[0] = immed->fadd.slot_src;
+        slots[1] = immed->fadd.slot_dst;
+        return 2;
+    case JIT_OP_FSUB:
+        slots[0] = immed->fsub.slot_src;
+        slots[1] = immed->fsub.slot_dst;
+        return 2;
+    case JIT_OP_FMUL:
+        slots[0] = immed->fmul.slot_src;
+        slots[1] = immed->fmul.slot_dst;
+        return 2;
+    case JIT_OP_FDIV:
+        slots[0] = immed->fdiv.slot_src;
+        slots[1] = immed->fdiv.slot_dst;
+        return 2;
+    case JIT_OP_FSQRT:
+        slots[0] = immed->fsqrt.slot_no;
+        return 1;
+    case JIT_OP_FSET_EQ:
+        slots[0] = immed->fset_eq.slot_lhs;
+        slots[1] = immed->fset_eq.slot_rhs;
+        slots[2] = immed->fset_eq.slot_dst;
+        return 3;
+    case JIT_OP_FSET_GT:
+        slots[0] = immed->fset_gt.slot_lhs;
+        slots[1] = immed->fset_gt.slot_rhs;
+        slots[2] = immed->fset_gt.slot_dst;
+        return 3;
+    case JIT_OP_CVT_I32_F32:
+        slots[0] = immed->cvt_i32_f32.slot_no;
+        return 1;
+    case JIT_OP_CVT_F32_I32:
+        slots[0] = immed->cvt_f32_i32.slot_no;
+        return 1;
+    default:
+        return 0;
+    }
+}
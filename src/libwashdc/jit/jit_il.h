@@ -34,6 +34,13 @@
  */
 #define MAX_SLOTS (8 * 1024)
 
+/*
+ * version of the IL itself.  IL saved by an older build (see jit_disk_cache.c)
+ * only gets used if this matches, so bump it whenever an opcode is added,
+ * removed or changes meaning, or the layout of an immediate changes.
+ */
+#define JIT_IL_VERSION 1
+
 enum jit_opcode {
     // this opcode calls an interpreter function
     JIT_OP_FALLBACK,
@@ -152,11 +159,87 @@ enum jit_opcode {
      */
     JIT_OP_MUL_U32,
 
+    /*
+     * Single-precision floating-point.  There are no dedicated float slots;
+     * these operate on the binary representation of 32-bit IEEE754 floats
+     * held in ordinary slots, the same way the SH4 keeps them in its register
+     * file.  Moves, negation and absolute value don't need their own ops since
+     * they are just integer operations on the bit pattern.
+     *
+     * FADD, FSUB, FMUL and FDIV take two slots and leave the result in
+     * slot_dst (slot_dst = slot_dst <op> slot_src).
+     */
+    JIT_OP_FADD,
+    JIT_OP_FSUB,
+    JIT_OP_FMUL,
+    JIT_OP_FDIV,
+
+    // replaces a slot with its square root
+    JIT_OP_FSQRT,
+
+    /*
+     * Like JIT_OP_SET_EQ and JIT_OP_SET_GT_*, these OR the third slot with 1
+     * if the comparison of the first two slots is true.  Comparisons involving
+     * NaN are always false.
+     */
+    JIT_OP_FSET_EQ,
+    JIT_OP_FSET_GT,
+
+    // convert a signed 32-bit integer in a slot to a float in the same slot
+    JIT_OP_CVT_I32_F32,
+
+    /*
+     * convert a float in a slot to a signed 32-bit integer in the same slot,
+     * rounding towards zero.  NaN and values which are out of range become
+     * 0x80000000.
+     */
+    JIT_OP_CVT_F32_I32,
+
+    /*
+     * The vector ops operate directly on arrays of four floats in memory
+     * instead of on slots.  The frontend is responsible for making sure none
+     * of those floats are cached in slots.
+     *
+     * DOT4 computes the dot product of lhs and rhs and stores it in *dst.
+     * The products are summed from first to last.
+     */
+    JIT_OP_DOT4,
+
+    /*
+     * MAT4_XFORM multiplies vec by the 4x4 matrix mat and stores the result
+     * back into vec.  mat is 16 floats in column-major order, so element i of
+     * the result is the sum of vec[j] * mat[4 * j + i] for j from 0 to 3,
+     * summed in that order.
+     */
+    JIT_OP_MAT4_XFORM,
+
     /*
      * This tells the backend that a given slot is no longer needed and its
      * value does not need to be preserved.
      */
-    JIT_OP_DISCARD_SLOT
+    JIT_OP_DISCARD_SLOT,
+
+    /*
+     * side-exit from the middle of a block.  If bit 0 of the given slot
+     * matches the expected value, this leaves the block for a constant PC as
+     * if the block had ended there; otherwise execution continues with the
+     * next instruction.  Everything the rest of the program needs has to be
+     * written back before this.  The SH4 frontend only emits these in traces
+     * that get compiled to native code (see sh4_jit_trace).
+     */
+    JIT_OP_EXIT_COND,
+
+    /*
+     * the point in a trace where one guest block ends and the next one
+     * begins.  If it's time for the scheduler to run, this leaves for a
+     * constant PC the same way JIT_OP_EXIT_COND does, so that events happen
+     * at the same point they would have if the blocks had been compiled
+     * separately.  Everything has to be written back before this, too.
+     */
+    JIT_OP_TRACE_JOIN,
+
+    // not an opcode, this is the number of opcodes
+    JIT_OP_COUNT
 };
 
 struct jit_fallback_immed {
@@ -187,6 +270,30 @@ struct jump_cond_immed {
     unsigned t_flag;
 };
 
+struct exit_cond_immed {
+    unsigned slot_no;
+    unsigned t_flag;
+
+    addr32_t exit_pc;
+
+    /*
+     * cycles and guest instructions which have run by the time the block
+     * leaves through this exit.  The cycle count is in the same units as the
+     * cycle count the backend gets for the whole block.
+     */
+    unsigned cycle_count;
+    unsigned n_guest_insts;
+};
+
+struct trace_join_immed {
+    // where the trace goes next; this is also where it leaves for
+    addr32_t next_pc;
+
+    // same as in exit_cond_immed
+    unsigned cycle_count;
+    unsigned n_guest_insts;
+};
+
 struct set_slot_immed {
     unsigned slot_idx;
     uint32_t new_val;
@@ -365,10 +472,60 @@ struct mul_u32_immed {
     unsigned slot_dst;
 };
 
+struct fadd_immed {
+    unsigned slot_src, slot_dst;
+};
+
+struct fsub_immed {
+    unsigned slot_src, slot_dst;
+};
+
+struct fmul_immed {
+    unsigned slot_src, slot_dst;
+};
+
+struct fdiv_immed {
+    unsigned slot_src, slot_dst;
+};
+
+struct fsqrt_immed {
+    unsigned slot_no;
+};
+
+struct fset_eq_immed {
+    unsigned slot_lhs, slot_rhs;
+    unsigned slot_dst;
+};
+
+struct fset_gt_immed {
+    unsigned slot_lhs, slot_rhs;
+    unsigned slot_dst;
+};
+
+struct cvt_i32_f32_immed {
+    unsigned slot_no;
+};
+
+struct cvt_f32_i32_immed {
+    unsigned slot_no;
+};
+
+struct dot4_immed {
+    float const *lhs, *rhs;
+    float *dst;
+};
+
+struct mat4_xform_immed {
+    float const *mat;
+    float *vec;
+};
+
 union jit_immed {
     struct jit_fallback_immed fallback;
     struct jump_immed jump;
     struct jump_cond_immed jump_cond;
+    struct exit_cond_immed exit_cond;
+    struct trace_join_immed trace_join;
     struct set_slot_immed set_slot;
     struct call_func_immed call_func;
     struct read_16_constaddr_immed read_16_constaddr;
@@ -404,6 +561,17 @@ union jit_immed {
     struct set_ge_signed_immed set_ge_signed;
     struct set_ge_signed_const_immed set_ge_signed_const;
     struct mul_u32_immed mul_u32;
+    struct fadd_immed fadd;
+    struct fsub_immed fsub;
+    struct fmul_immed fmul;
+    struct fdiv_immed fdiv;
+    struct fsqrt_immed fsqrt;
+    struct fset_eq_immed fset_eq;
+    struct fset_gt_immed fset_gt;
+    struct cvt_i32_f32_immed cvt_i32_f32;
+    struct cvt_f32_i32_immed cvt_f32_i32;
+    struct dot4_immed dot4;
+    struct mat4_xform_immed mat4_xform;
 };
 
 struct jit_inst {
@@ -419,6 +587,11 @@ void jit_jump(struct il_code_block *block, unsigned slot_no);
 void jit_jump_cond(struct il_code_block *block,
                    unsigned slot_no, unsigned jmp_addr_slot,
                    unsigned alt_jmp_addr_slot, unsigned t_val);
+void jit_exit_cond(struct il_code_block *block, unsigned slot_no,
+                   unsigned t_val, addr32_t exit_pc, unsigned cycle_count,
+                   unsigned n_guest_insts);
+void jit_trace_join(struct il_code_block *block, addr32_t next_pc,
+                    unsigned cycle_count, unsigned n_guest_insts);
 void jit_set_slot(struct il_code_block *block, unsigned slot_idx,
                   uint32_t new_val);
 void jit_call_func(struct il_code_block *block,
@@ -485,5 +658,42 @@ void jit_set_ge_signed_const(struct il_code_block *block, unsigned slot_lhs,
                              unsigned imm_rhs, unsigned slot_dst);
 void jit_mul_u32(struct il_code_block *block, unsigned slot_lhs,
                  unsigned slot_rhs, unsigned slot_dst);
+void jit_fadd(struct il_code_block *block, unsigned slot_src,
+              unsigned slot_dst);
+void jit_fsub(struct il_code_block *block, unsigned slot_src,
+              unsigned slot_dst);
+void jit_fmul(struct il_code_block *block, unsigned slot_src,
+              unsigned slot_dst);
+void jit_fdiv(struct il_code_block *block, unsigned slot_src,
+              unsigned slot_dst);
+void jit_fsqrt(struct il_code_block *block, unsigned slot_no);
+void jit_fset_eq(struct il_code_block *block, unsigned slot_lhs,
+                 unsigned slot_rhs, unsigned slot_dst);
+void jit_fset_gt(struct il_code_block *block, unsigned slot_lhs,
+                 unsigned slot_rhs, unsigned slot_dst);
+void jit_cvt_i32_f32(struct il_code_block *block, unsigned slot_no);
+void jit_cvt_f32_i32(struct il_code_block *block, unsigned slot_no);
+void jit_dot4(struct il_code_block *block, float const *lhs,
+              float const *rhs, float *dst);
+void jit_mat4_xform(struct il_code_block *block, float const *mat,
+                    float *vec);
+
+/*
+ * returns the index of the slot whose value is changed by the given
+ * instruction, or -1 if the instruction doesn't change any slots.
+ * JIT_OP_DISCARD_SLOT counts as changing the slot it discards.
+ */
+int jit_inst_dst_slot(struct jit_inst const *inst);
+
+#define JIT_INST_MAX_READ_SLOTS 3
+
+/*
+ * fills in slots with the indices of the slots whose values are read by the
+ * given instruction and returns how many there are.  Instructions which modify
+ * a slot in-place (such as JIT_OP_ADD_CONST32) count as reading it.
+ * JIT_OP_DISCARD_SLOT does not count as reading the slot it discards.
+ */
+unsigned jit_inst_read_slots(struct jit_inst const *inst,
+                             unsigned slots[JIT_INST_MAX_READ_SLOTS]);
 
 #endif
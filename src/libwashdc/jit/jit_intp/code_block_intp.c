@@ -20,6 +20,7 @@
  *
  ******************************************************************************/
 
+#include <math.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -30,6 +31,40 @@
 
 #include "code_block_intp.h"
 
+static inline float intp_fget(struct code_block_intp const *block,
+                              unsigned slot_no) {
+    float val;
+    memcpy(&val, block->slots + slot_no, sizeof(val));
+    return val;
+}
+
+static inline void intp_fset(struct code_block_intp const *block,
+                             unsigned slot_no, float val) {
+    memcpy(block->slots + slot_no, &val, sizeof(val));
+}
+
+/*
+ * the x86_64 backend uses cvttss2si, which returns 0x80000000 for anything
+ * that can't be represented.  Casting those values in C is undefined, so
+ * check the range explicitly to get the same result.
+ */
+static inline uint32_t intp_ftrc(float val) {
+    if (!(val >= -2147483648.0f && val < 2147483648.0f))
+        return 0x80000000;
+    return (uint32_t)(int32_t)val;
+}
+
+static void intp_mat4_xform(float const *mat, float *vec) {
+    float out[4];
+    unsigned idx;
+
+    for (idx = 0; idx < 4; idx++) {
+        out[idx] = vec[0] * mat[idx] + vec[1] * mat[4 + idx] +
+            vec[2] * mat[8 + idx] + vec[3] * mat[12 + idx];
+    }
+    memcpy(vec, out, sizeof(out));
+}
+
 void code_block_intp_init(struct code_block_intp *block) {
     memset(block, 0, sizeof(*block));
 }
@@ -86,6 +121,15 @@ reg32_t code_block_intp_exec(void *cpu, struct code_block_intp const *block) {
                 return block->slots[inst->immed.jump_cond.jmp_addr_slot];
             }
             return block->slots[inst->immed.jump_cond.alt_jmp_addr_slot];
+        case JIT_OP_EXIT_COND:
+        case JIT_OP_TRACE_JOIN:
+            /*
+             * the interpreter charges every block's full cycle count, so it
+             * has no way to leave early.  Traces are only built for native
+             * code, so this should never come up.
+             */
+            error_set_feature("side-exits in the IL interpreter");
+            RAISE_ERROR(ERROR_UNIMPLEMENTED);
         case JIT_SET_SLOT:
             block->slots[inst->immed.set_slot.slot_idx] =
                 inst->immed.set_slot.new_val;
@@ -272,6 +316,71 @@ reg32_t code_block_intp_exec(void *cpu, struct code_block_intp const *block) {
                 block->slots[inst->immed.mul_u32.slot_rhs];
             inst++;
             break;
+        case JIT_OP_FADD:
+            intp_fset(block, inst->immed.fadd.slot_dst,
+                      intp_fget(block, inst->immed.fadd.slot_dst) +
+                      intp_fget(block, inst->immed.fadd.slot_src));
+            inst++;
+            break;
+        case JIT_OP_FSUB:
+            intp_fset(block, inst->immed.fsub.slot_dst,
+                      intp_fget(block, inst->immed.fsub.slot_dst) -
+                      intp_fget(block, inst->immed.fsub.slot_src));
+            inst++;
+            break;
+        case JIT_OP_FMUL:
+            intp_fset(block, inst->immed.fmul.slot_dst,
+                      intp_fget(block, inst->immed.fmul.slot_dst) *
+                      intp_fget(block, inst->immed.fmul.slot_src));
+            inst++;
+            break;
+        case JIT_OP_FDIV:
+            intp_fset(block, inst->immed.fdiv.slot_dst,
+                      intp_fget(block, inst->immed.fdiv.slot_dst) /
+                      intp_fget(block, inst->immed.fdiv.slot_src));
+            inst++;
+            break;
+        case JIT_OP_FSQRT:
+            intp_fset(block, inst->immed.fsqrt.slot_no,
+                      sqrtf(intp_fget(block, inst->immed.fsqrt.slot_no)));
+            inst++;
+            break;
+        case JIT_OP_FSET_EQ:
+            if (intp_fget(block, inst->immed.fset_eq.slot_lhs) ==
+                intp_fget(block, inst->immed.fset_eq.slot_rhs))
+                block->slots[inst->immed.fset_eq.slot_dst] |= 1;
+            inst++;
+            break;
+        case JIT_OP_FSET_GT:
+            if (intp_fget(block, inst->immed.fset_gt.slot_lhs) >
+                intp_fget(block, inst->immed.fset_gt.slot_rhs))
+                block->slots[inst->immed.fset_gt.slot_dst] |= 1;
+            inst++;
+            break;
+        case JIT_OP_CVT_I32_F32:
+            intp_fset(block, inst->immed.cvt_i32_f32.slot_no,
+                      (float)(int32_t)
+                      block->slots[inst->immed.cvt_i32_f32.slot_no]);
+            inst++;
+            break;
+        case JIT_OP_CVT_F32_I32:
+            block->slots[inst->immed.cvt_f32_i32.slot_no] =
+                intp_ftrc(intp_fget(block, inst->immed.cvt_f32_i32.slot_no));
+            inst++;
+            break;
+        case JIT_OP_DOT4:
+            *inst->immed.dot4.dst =
+                inst->immed.dot4.lhs[0] * inst->immed.dot4.rhs[0] +
+                inst->immed.dot4.lhs[1] * inst->immed.dot4.rhs[1] +
+                inst->immed.dot4.lhs[2] * inst->immed.dot4.rhs[2] +
+                inst->immed.dot4.lhs[3] * inst->immed.dot4.rhs[3];
+            inst++;
+            break;
+        case JIT_OP_MAT4_XFORM:
+            intp_mat4_xform(inst->immed.mat4_xform.mat,
+                            inst->immed.mat4_xform.vec);
+            inst++;
+            break;
         case JIT_OP_SHAD:
             if ((int32_t)block->slots[inst->immed.shad.slot_shift_amt] >= 0) {
                 block->slots[inst->immed.shad.slot_val] <<=
@@ -283,6 +392,8 @@ reg32_t code_block_intp_exec(void *cpu, struct code_block_intp const *block) {
             }
             inst++;
             break;
+        case JIT_OP_COUNT:
+            RAISE_ERROR(ERROR_INTEGRITY);
         }
     }
 
@@ -0,0 +1,614 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "washdc/error.h"
+#include "log.h"
+#include "code_block.h"
+#include "jit_il.h"
+#include "jit_determ.h"
+
+#include "jit_opt.h"
+
+// upper limit on the number of host addresses redundant-load keeps track of
+#define MAX_MIRRORS 32
+
+static char const *pass_names[JIT_OPT_PASS_COUNT] = {
+    [JIT_OPT_REDUNDANT_LOAD] = "redundant-load",
+    [JIT_OPT_CONST_PROP] = "const-prop",
+    [JIT_OPT_DEAD_SLOT] = "dead-slot"
+};
+
+static bool pass_enabled[JIT_OPT_PASS_COUNT] = {
+    [JIT_OPT_REDUNDANT_LOAD] = true,
+    [JIT_OPT_CONST_PROP] = true,
+    [JIT_OPT_DEAD_SLOT] = true
+};
+
+struct const_slot {
+    bool known;
+    uint32_t val;
+};
+
+// a slot which is known to hold the same value as *addr
+struct mirror {
+    uint32_t const *addr;
+    unsigned slot_no;
+};
+
+char const *jit_opt_pass_name(enum jit_opt_pass pass) {
+    if (pass >= JIT_OPT_PASS_COUNT)
+        RAISE_ERROR(ERROR_INVALID_PARAM);
+    return pass_names[pass];
+}
+
+void jit_opt_set_pass_enabled(enum jit_opt_pass pass, bool enable) {
+    if (pass >= JIT_OPT_PASS_COUNT)
+        RAISE_ERROR(ERROR_INVALID_PARAM);
+    pass_enabled[pass] = enable;
+}
+
+bool jit_opt_get_pass_enabled(enum jit_opt_pass pass) {
+    if (pass >= JIT_OPT_PASS_COUNT)
+        RAISE_ERROR(ERROR_INVALID_PARAM);
+    return pass_enabled[pass];
+}
+
+// remove every instruction whose entry in dead is true
+static void remove_insts(struct il_code_block *block, bool const *dead) {
+    unsigned src, dst = 0;
+    for (src = 0; src < block->inst_count; src++)
+        if (!dead[src])
+            block->inst_list[dst++] = block->inst_list[src];
+    block->inst_count = dst;
+}
+
+static bool *alloc_dead_list(struct il_code_block const *block) {
+    bool *dead = (bool*)calloc(block->inst_count + 1, sizeof(bool));
+    if (!dead)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    return dead;
+}
+
+/*
+ * returns true for instructions whose only effect is on the slot returned by
+ * jit_inst_dst_slot.
+ */
+static bool inst_is_pure(struct jit_inst const *inst) {
+    switch (inst->op) {
+    case JIT_SET_SLOT:
+    case JIT_OP_SIGN_EXTEND_16:
+    case JIT_OP_LOAD_SLOT16:
+    case JIT_OP_LOAD_SLOT:
+    case JIT_OP_ADD:
+    case JIT_OP_SUB:
+    case JIT_OP_ADD_CONST32:
+    case JIT_OP_XOR:
+    case JIT_OP_XOR_CONST32:
+    case JIT_OP_MOV:
+    case JIT_OP_AND:
+    case JIT_OP_AND_CONST32:
+    case JIT_OP_OR:
+    case JIT_OP_OR_CONST32:
+    case JIT_OP_SLOT_TO_BOOL:
+    case JIT_OP_NOT:
+    case JIT_OP_SHLL:
+    case JIT_OP_SHAR:
+    case JIT_OP_SHLR:
+    case JIT_OP_SHAD:
+    case JIT_OP_SET_GT_UNSIGNED:
+    case JIT_OP_SET_GT_SIGNED:
+    case JIT_OP_SET_GT_SIGNED_CONST:
+    case JIT_OP_SET_EQ:
+    case JIT_OP_SET_GE_UNSIGNED:
+    case JIT_OP_SET_GE_SIGNED:
+    case JIT_OP_SET_GE_SIGNED_CONST:
+    case JIT_OP_MUL_U32:
+    case JIT_OP_FADD:
+    case JIT_OP_FSUB:
+    case JIT_OP_FMUL:
+    case JIT_OP_FDIV:
+    case JIT_OP_FSQRT:
+    case JIT_OP_FSET_EQ:
+    case JIT_OP_FSET_GT:
+    case JIT_OP_CVT_I32_F32:
+    case JIT_OP_CVT_F32_I32:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * returns true for instructions which can read or write host memory other
+ * than through JIT_OP_LOAD_SLOT, JIT_OP_LOAD_SLOT16 and JIT_OP_STORE_SLOT.
+ */
+static bool inst_is_mem_barrier(struct jit_inst const *inst) {
+    switch (inst->op) {
+    case JIT_OP_FALLBACK:
+    case JIT_OP_JUMP:
+    case JIT_JUMP_COND:
+    case JIT_OP_CALL_FUNC:
+    case JIT_OP_READ_16_CONSTADDR:
+    case JIT_OP_READ_32_CONSTADDR:
+    case JIT_OP_READ_32_SLOT:
+    case JIT_OP_WRITE_32_SLOT:
+    case JIT_OP_DOT4:
+    case JIT_OP_MAT4_XFORM:
+    case JIT_OP_EXIT_COND:
+    case JIT_OP_TRACE_JOIN:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void opt_redundant_load(struct il_code_block *block,
+                               struct jit_opt_stats *stats) {
+    struct mirror mirrors[MAX_MIRRORS];
+    unsigned n_mirrors = 0;
+    unsigned inst_no, idx;
+    bool *dead = alloc_dead_list(block);
+    unsigned n_dead = 0;
+
+    for (inst_no = 0; inst_no < block->inst_count; inst_no++) {
+        struct jit_inst *inst = block->inst_list + inst_no;
+
+        if (inst_is_mem_barrier(inst)) {
+            n_mirrors = 0;
+            continue;
+        }
+
+        uint32_t const *addr = NULL;
+        unsigned slot_no = 0;
+        struct mirror *match = NULL;
+        if (inst->op == JIT_OP_LOAD_SLOT) {
+            addr = inst->immed.load_slot.src;
+            slot_no = inst->immed.load_slot.slot_no;
+        } else if (inst->op == JIT_OP_STORE_SLOT) {
+            addr = inst->immed.store_slot.dst;
+            slot_no = inst->immed.store_slot.slot_no;
+        }
+
+        if (addr) {
+            for (idx = 0; idx < n_mirrors; idx++)
+                if (mirrors[idx].addr == addr)
+                    match = mirrors + idx;
+        }
+
+        if (inst->op == JIT_OP_STORE_SLOT) {
+            if (match && match->slot_no == slot_no) {
+                // memory already holds this value
+                dead[inst_no] = true;
+                n_dead++;
+                if (stats)
+                    stats->n_stores_removed++;
+            } else if (match) {
+                match->slot_no = slot_no;
+            } else if (n_mirrors < MAX_MIRRORS) {
+                mirrors[n_mirrors].addr = addr;
+                mirrors[n_mirrors].slot_no = slot_no;
+                n_mirrors++;
+            }
+            continue;
+        }
+
+        if (inst->op == JIT_OP_LOAD_SLOT && match) {
+            inst->op = JIT_OP_MOV;
+            inst->immed.mov.slot_src = match->slot_no;
+            inst->immed.mov.slot_dst = slot_no;
+            if (stats)
+                stats->n_loads_removed++;
+            if (match->slot_no == slot_no) {
+                // the load would have replaced the slot with itself
+                dead[inst_no] = true;
+                n_dead++;
+            }
+            continue;
+        }
+
+        // forget about any addresses mirrored by the slot this overwrites
+        int dst_slot = jit_inst_dst_slot(inst);
+        if (dst_slot >= 0) {
+            idx = 0;
+            while (idx < n_mirrors) {
+                if (mirrors[idx].slot_no == (unsigned)dst_slot)
+                    mirrors[idx] = mirrors[--n_mirrors];
+                else
+                    idx++;
+            }
+        }
+
+        if (inst->op == JIT_OP_LOAD_SLOT && n_mirrors < MAX_MIRRORS) {
+            mirrors[n_mirrors].addr = addr;
+            mirrors[n_mirrors].slot_no = slot_no;
+            n_mirrors++;
+        }
+    }
+
+    if (n_dead)
+        remove_insts(block, dead);
+    free(dead);
+}
+
+static void fold_to_const(struct jit_inst *inst, unsigned slot_no,
+                          uint32_t val) {
+    inst->op = JIT_SET_SLOT;
+    inst->immed.set_slot.slot_idx = slot_no;
+    inst->immed.set_slot.new_val = val;
+}
+
+/*
+ * rewrite inst based on the slots in tbl which are known to be constant.
+ * Returns true if anything changed.
+ */
+static bool fold_inst(struct jit_inst *inst, struct const_slot const *tbl) {
+    union jit_immed *immed = &inst->immed;
+    unsigned src, dst, lhs, rhs;
+    uint32_t val;
+    int32_t shift;
+
+    switch (inst->op) {
+    case JIT_OP_MOV:
+        src = immed->mov.slot_src;
+        dst = immed->mov.slot_dst;
+        if (!tbl[src].known)
+            return false;
+        fold_to_const(inst, dst, tbl[src].val);
+        return true;
+    case JIT_OP_ADD:
+    case JIT_OP_SUB:
+    case JIT_OP_AND:
+    case JIT_OP_OR:
+    case JIT_OP_XOR:
+        // these all share the same layout
+        src = immed->add.slot_src;
+        dst = immed->add.slot_dst;
+        if (!tbl[src].known)
+            return false;
+        val = tbl[src].val;
+        if (tbl[dst].known) {
+            uint32_t dst_val = tbl[dst].val;
+            switch (inst->op) {
+            case JIT_OP_ADD:
+                dst_val += val;
+                break;
+            case JIT_OP_SUB:
+                dst_val -= val;
+                break;
+            case JIT_OP_AND:
+                dst_val &= val;
+                break;
+            case JIT_OP_OR:
+                dst_val |= val;
+                break;
+            default:
+                dst_val ^= val;
+                break;
+            }
+            fold_to_const(inst, dst, dst_val);
+            return true;
+        }
+        switch (inst->op) {
+        case JIT_OP_ADD:
+        case JIT_OP_SUB:
+            if (inst->op == JIT_OP_SUB)
+                val = -val;
+            inst->op = JIT_OP_ADD_CONST32;
+            immed->add_const32.slot_dst = dst;
+            immed->add_const32.const32 = val;
+            break;
+        case JIT_OP_AND:
+            inst->op = JIT_OP_AND_CONST32;
+            immed->and_const32.slot_no = dst;
+            immed->and_const32.const32 = val;
+            break;
+        case JIT_OP_OR:
+            inst->op = JIT_OP_OR_CONST32;
+            immed->or_const32.slot_no = dst;
+            immed->or_const32.const32 = val;
+            break;
+        default:
+            inst->op = JIT_OP_XOR_CONST32;
+            immed->xor_const32.slot_no = dst;
+            immed->xor_const32.const32 = val;
+            break;
+        }
+        return true;
+    case JIT_OP_ADD_CONST32:
+        dst = immed->add_const32.slot_dst;
+        if (!tbl[dst].known)
+            return false;
+        fold_to_const(inst, dst, tbl[dst].val + immed->add_const32.const32);
+        return true;
+    case JIT_OP_XOR_CONST32:
+        dst = immed->xor_const32.slot_no;
+        if (!tbl[dst].known)
+            return false;
+        fold_to_const(inst, dst, tbl[dst].val ^ immed->xor_const32.const32);
+        return true;
+    case JIT_OP_AND_CONST32:
+        dst = immed->and_const32.slot_no;
+        if (!tbl[dst].known)
+            return false;
+        fold_to_const(inst, dst, tbl[dst].val & immed->and_const32.const32);
+        return true;
+    case JIT_OP_OR_CONST32:
+        dst = immed->or_const32.slot_no;
+        if (!tbl[dst].known)
+            return false;
+        fold_to_const(inst, dst, tbl[dst].val | immed->or_const32.const32);
+        return true;
+    case JIT_OP_NOT:
+        dst = immed->not.slot_no;
+        if (!tbl[dst].known)
+            return false;
+        fold_to_const(inst, dst, ~tbl[dst].val);
+        return true;
+    case JIT_OP_SLOT_TO_BOOL:
+        dst = immed->slot_to_bool.slot_no;
+        if (!tbl[dst].known)
+            return false;
+        fold_to_const(inst, dst, tbl[dst].val ? 1 : 0);
+        return true;
+    case JIT_OP_SIGN_EXTEND_16:
+        dst = immed->sign_extend_16.slot_no;
+        if (!tbl[dst].known)
+            return false;
+        fold_to_const(inst, dst, (int32_t)(int16_t)tbl[dst].val);
+        return true;
+    case JIT_OP_SHLL:
+    case JIT_OP_SHAR:
+    case JIT_OP_SHLR:
+        // these all share the same layout
+        dst = immed->shll.slot_no;
+        if (!tbl[dst].known || immed->shll.shift_amt >= 32)
+            return false;
+        val = tbl[dst].val;
+        if (inst->op == JIT_OP_SHLL)
+            val <<= immed->shll.shift_amt;
+        else if (inst->op == JIT_OP_SHAR)
+            val = ((int32_t)val) >> immed->shll.shift_amt;
+        else
+            val >>= immed->shll.shift_amt;
+        fold_to_const(inst, dst, val);
+        return true;
+    case JIT_OP_SHAD:
+        dst = immed->shad.slot_val;
+        src = immed->shad.slot_shift_amt;
+        if (!tbl[src].known)
+            return false;
+        shift = tbl[src].val;
+        if (shift <= -32 || shift >= 32)
+            return false;
+        if (tbl[dst].known) {
+            val = tbl[dst].val;
+            if (shift >= 0)
+                val <<= shift;
+            else
+                val = ((int32_t)val) >> -shift;
+            fold_to_const(inst, dst, val);
+        } else if (shift >= 0) {
+            inst->op = JIT_OP_SHLL;
+            immed->shll.slot_no = dst;
+            immed->shll.shift_amt = shift;
+        } else {
+            inst->op = JIT_OP_SHAR;
+            immed->shar.slot_no = dst;
+            immed->shar.shift_amt = -shift;
+        }
+        return true;
+    case JIT_OP_MUL_U32:
+        lhs = immed->mul_u32.slot_lhs;
+        rhs = immed->mul_u32.slot_rhs;
+        dst = immed->mul_u32.slot_dst;
+        if (!tbl[lhs].known || !tbl[rhs].known)
+            return false;
+        fold_to_const(inst, dst, tbl[lhs].val * tbl[rhs].val);
+        return true;
+    case JIT_OP_SET_GT_UNSIGNED:
+    case JIT_OP_SET_GT_SIGNED:
+    case JIT_OP_SET_EQ:
+    case JIT_OP_SET_GE_UNSIGNED:
+    case JIT_OP_SET_GE_SIGNED:
+        // these all share the same layout
+        lhs = immed->set_gt_unsigned.slot_lhs;
+        rhs = immed->set_gt_unsigned.slot_rhs;
+        dst = immed->set_gt_unsigned.slot_dst;
+        if (!tbl[lhs].known || !tbl[rhs].known || !tbl[dst].known)
+            return false;
+        {
+            uint32_t l = tbl[lhs].val, r = tbl[rhs].val;
+            bool cond;
+            if (inst->op == JIT_OP_SET_GT_UNSIGNED)
+                cond = l > r;
+            else if (inst->op == JIT_OP_SET_GT_SIGNED)
+                cond = (int32_t)l > (int32_t)r;
+            else if (inst->op == JIT_OP_SET_EQ)
+                cond = l == r;
+            else if (inst->op == JIT_OP_SET_GE_UNSIGNED)
+                cond = l >= r;
+            else
+                cond = (int32_t)l >= (int32_t)r;
+            fold_to_const(inst, dst, tbl[dst].val | (cond ? 1 : 0));
+        }
+        return true;
+    case JIT_OP_SET_GT_SIGNED_CONST:
+    case JIT_OP_SET_GE_SIGNED_CONST:
+        // these share the same layout
+        lhs = immed->set_gt_signed_const.slot_lhs;
+        dst = immed->set_gt_signed_const.slot_dst;
+        if (!tbl[lhs].known || !tbl[dst].known)
+            return false;
+        {
+            int32_t l = tbl[lhs].val;
+            int32_t r = immed->set_gt_signed_const.imm_rhs;
+            bool cond = inst->op == JIT_OP_SET_GT_SIGNED_CONST ?
+                l > r : l >= r;
+            fold_to_const(inst, dst, tbl[dst].val | (cond ? 1 : 0));
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void opt_const_prop(struct il_code_block *block,
+                           struct jit_opt_stats *stats) {
+    unsigned inst_no;
+    struct const_slot *tbl =
+        (struct const_slot*)calloc(block->n_slots + 1, sizeof(*tbl));
+    if (!tbl)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    for (inst_no = 0; inst_no < block->inst_count; inst_no++) {
+        struct jit_inst *inst = block->inst_list + inst_no;
+
+        if (fold_inst(inst, tbl) && stats)
+            stats->n_folded++;
+
+        int dst_slot = jit_inst_dst_slot(inst);
+        if (dst_slot < 0)
+            continue;
+        if ((unsigned)dst_slot >= block->n_slots)
+            RAISE_ERROR(ERROR_OVERFLOW);
+
+        if (inst->op == JIT_SET_SLOT) {
+            tbl[dst_slot].known = true;
+            tbl[dst_slot].val = inst->immed.set_slot.new_val;
+        } else {
+            tbl[dst_slot].known = false;
+        }
+    }
+
+    free(tbl);
+}
+
+static void opt_dead_slot(struct il_code_block *block,
+                          struct jit_opt_stats *stats) {
+    unsigned inst_no, idx;
+    unsigned read_slots[JIT_INST_MAX_READ_SLOTS];
+    bool *dead = alloc_dead_list(block);
+    unsigned n_dead = 0;
+
+    // slots whose current values are read later on
+    bool *live = (bool*)calloc(block->n_slots + 1, sizeof(bool));
+    if (!live)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+
+    inst_no = block->inst_count;
+    while (inst_no--) {
+        struct jit_inst const *inst = block->inst_list + inst_no;
+        int dst_slot = jit_inst_dst_slot(inst);
+
+        if (dst_slot >= 0 && (unsigned)dst_slot >= block->n_slots)
+            RAISE_ERROR(ERROR_OVERFLOW);
+
+        if (inst->op == JIT_OP_DISCARD_SLOT) {
+            live[dst_slot] = false;
+            continue;
+        }
+
+        if (dst_slot >= 0 && !live[dst_slot] && inst_is_pure(inst)) {
+            dead[inst_no] = true;
+            n_dead++;
+            continue;
+        }
+
+        if (dst_slot >= 0)
+            live[dst_slot] = false;
+
+        unsigned n_read = jit_inst_read_slots(inst, read_slots);
+        for (idx = 0; idx < n_read; idx++)
+            live[read_slots[idx]] = true;
+    }
+
+    /*
+     * The backend doesn't allow a slot to be discarded if nothing was ever
+     * written to it, so take out discards for slots whose writes are all gone.
+     * live gets reused here to mean that the slot has been written to.
+     */
+    memset(live, 0, sizeof(bool) * (block->n_slots + 1));
+    for (inst_no = 0; inst_no < block->inst_count; inst_no++) {
+        struct jit_inst const *inst = block->inst_list + inst_no;
+        if (dead[inst_no])
+            continue;
+        int dst_slot = jit_inst_dst_slot(inst);
+        if (dst_slot < 0)
+            continue;
+        if (inst->op == JIT_OP_DISCARD_SLOT) {
+            if (!live[dst_slot]) {
+                dead[inst_no] = true;
+                n_dead++;
+            }
+            live[dst_slot] = false;
+        } else {
+            live[dst_slot] = true;
+        }
+    }
+
+    if (n_dead) {
+        remove_insts(block, dead);
+        if (stats)
+            stats->n_dead_removed += n_dead;
+    }
+
+    free(live);
+    free(dead);
+}
+
+void jit_opt_run(struct il_code_block *block, unsigned n_guest_insts,
+                 struct jit_opt_stats *stats) {
+    unsigned n_il_insts_in = block->inst_count;
+
+    if (pass_enabled[JIT_OPT_REDUNDANT_LOAD])
+        opt_redundant_load(block, stats);
+    if (pass_enabled[JIT_OPT_CONST_PROP])
+        opt_const_prop(block, stats);
+    if (pass_enabled[JIT_OPT_DEAD_SLOT])
+        opt_dead_slot(block, stats);
+
+    jit_determ_pass(block);
+
+    if (stats) {
+        stats->n_blocks++;
+        stats->n_guest_insts += n_guest_insts;
+        stats->n_il_insts_in += n_il_insts_in;
+        stats->n_il_insts_out += block->inst_count;
+    }
+}
+
+void jit_opt_print_stats(char const *cpu_name,
+                         struct jit_opt_stats const *stats) {
+    if (!stats->n_guest_insts)
+        return;
+    LOG_INFO("%s jit_opt: %.2f IL instructions per guest instruction before "
+             "optimization, %.2f after\n", cpu_name,
+             (double)stats->n_il_insts_in / stats->n_guest_insts,
+             (double)stats->n_il_insts_out / stats->n_guest_insts);
+    LOG_INFO("%s jit_opt: %llu folded, %llu dead instructions removed, %llu "
+             "loads and %llu stores removed\n", cpu_name, stats->n_folded,
+             stats->n_dead_removed, stats->n_loads_removed,
+             stats->n_stores_removed);
+}
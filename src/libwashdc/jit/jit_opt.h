@@ -0,0 +1,98 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#ifndef JIT_OPT_H_
+#define JIT_OPT_H_
+
+#include <stdbool.h>
+
+#ifndef JIT_OPTIMIZE
+#error this file should not be built without -DJIT_OPTIMIZE
+#endif
+
+/*
+ * Optimization passes which run over jit_il between the frontend and the
+ * backend, so the IL interpreter and the x86_64 backend both get the benefit.
+ * Each pass can be turned on or off on its own (see the jit.opt.* settings in
+ * wash.cfg).  jit_determ_pass always runs last.
+ *
+ * const-prop: tracks which slots hold compile-time constants.  Operations with
+ * a constant source slot get turned into their *_CONST32 forms (or shifts,
+ * in the case of SHAD), and operations whose result is fully known get turned
+ * into JIT_SET_SLOT.
+ *
+ * dead-slot: removes side-effect-free instructions whose results are never
+ * read before the slot is overwritten, discarded or the block ends, and then
+ * removes any JIT_OP_DISCARD_SLOT left without a write to discard.
+ *
+ * redundant-load: a JIT_OP_LOAD_SLOT from a host address which a slot is
+ * already known to mirror (because it was loaded from or stored to that
+ * address and nothing has happened since that could change either) becomes a
+ * JIT_OP_MOV, and a JIT_OP_STORE_SLOT which would write back the value that
+ * is already there gets removed.  Fallbacks, function calls and memory-map
+ * accesses can change anything, so nothing is remembered across them.
+ */
+
+struct il_code_block;
+
+enum jit_opt_pass {
+    JIT_OPT_REDUNDANT_LOAD,
+    JIT_OPT_CONST_PROP,
+    JIT_OPT_DEAD_SLOT,
+
+    JIT_OPT_PASS_COUNT
+};
+
+struct jit_opt_stats {
+    unsigned long long n_blocks;
+
+    // guest instructions and IL instructions before and after optimization
+    unsigned long long n_guest_insts;
+    unsigned long long n_il_insts_in;
+    unsigned long long n_il_insts_out;
+
+    unsigned long long n_folded;
+    unsigned long long n_dead_removed;
+    unsigned long long n_loads_removed;
+    unsigned long long n_stores_removed;
+};
+
+// name of the pass in wash.cfg, minus the jit.opt. prefix
+char const *jit_opt_pass_name(enum jit_opt_pass pass);
+
+/*
+ * All passes are enabled by default.  These are not thread-safe, so only call
+ * them before any code gets compiled.
+ */
+void jit_opt_set_pass_enabled(enum jit_opt_pass pass, bool enable);
+bool jit_opt_get_pass_enabled(enum jit_opt_pass pass);
+
+/*
+ * run every enabled pass over block, followed by jit_determ_pass.
+ * n_guest_insts is the number of guest instructions the block was translated
+ * from; it is only used for stats, which can be NULL.
+ */
+void jit_opt_run(struct il_code_block *block, unsigned n_guest_insts,
+                 struct jit_opt_stats *stats);
+
+void jit_opt_print_stats(char const *cpu_name,
+                         struct jit_opt_stats const *stats);
+
+#endif
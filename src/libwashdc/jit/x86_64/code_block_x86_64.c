@@ -26,16 +26,20 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include "log.h"
 #include "washdc/error.h"
 #include "jit/code_block.h"
+#include "jit/code_cache.h"
 #include "jit/jit_il.h"
 #include "exec_mem.h"
 #include "emit_x86_64.h"
 #include "dreamcast.h"
 #include "native_dispatch.h"
 #include "native_mem.h"
+#include "native_fastmem.h"
 #include "abi.h"
 #include "config.h"
 #include "washdc/cpu.h"
@@ -160,8 +164,38 @@ struct slot {
     // if true, reg_no is valid and the slot resides in an x86 register
     // if false, rbp_offs is valid and the slot resides on the call-stack
     bool in_reg;
+
+    // if true, the slot was last written by JIT_SET_SLOT with const_val
+    bool is_const;
+    uint32_t const_val;
+
+    /*
+     * if has_hint is true, hint_reg is the register the linear scan picked
+     * for the slot's current live range (see alloc_pass).
+     */
+    bool has_hint;
+    unsigned hint_reg;
+
+    // index of the last IL instruction which needs the slot's current value
+    unsigned live_end;
+
+    /*
+     * if true, the slot was freed by retire_slot after its last use and the
+     * JIT_OP_DISCARD_SLOT for it (if any) hasn't been seen yet.
+     */
+    bool retired;
 } slots[MAX_SLOTS];
 
+/*
+ * PCs the block can exit to, if they are all known at compile-time.  These
+ * get turned into links to the successor blocks by native_link_emit.
+ */
+static addr32_t exit_pcs[NATIVE_DISPATCH_MAX_LINKS];
+static unsigned n_exit_pcs;
+
+// where side-exits jump to (see emit_exit_cond)
+static void *side_exit_check;
+
 /*
  * offset of the next push onto the stack.
  *
@@ -173,6 +207,11 @@ struct slot {
  */
 static int rsp_offs; // offset from base pointer to stack pointer
 
+// spills, reloads and moves in the block currently being compiled
+static unsigned n_spills, n_reloads, n_moves;
+
+static struct code_block_x86_64_stats alloc_stats;
+
 static void grab_register(unsigned reg_no);
 static void ungrab_register(unsigned reg_no);
 
@@ -188,6 +227,9 @@ static void reset_slots(void) {
     }
 
     rsp_offs = 0;
+    n_spills = 0;
+    n_reloads = 0;
+    n_moves = 0;
 }
 
 /*
@@ -198,6 +240,11 @@ static void discard_slot(unsigned slot_no) {
     if (slot_no >= MAX_SLOTS)
         RAISE_ERROR(ERROR_TOO_BIG);
     struct slot *slot = slots + slot_no;
+    if (!slot->in_use && slot->retired) {
+        // already freed after its last use
+        slot->retired = false;
+        return;
+    }
     if (!slot->in_use)
         RAISE_ERROR(ERROR_INTEGRITY);
     slot->in_use = false;
@@ -299,6 +346,7 @@ static void move_slot_to_stack(unsigned slot_no) {
         RAISE_ERROR(ERROR_INTEGRITY);
 
     x86asm_pushq_reg64(slot->reg_no);
+    n_spills++;
 
     slot->in_reg = false;
     rsp_offs -= 8;
@@ -332,6 +380,7 @@ static void move_slot_to_reg(unsigned slot_no, unsigned reg_no) {
         struct reg_stat *reg_src = regs + src_reg;
 
         x86asm_mov_reg32_reg32(src_reg, reg_no);
+        n_moves++;
 
         reg_src->in_use = false;
         reg_dst->in_use = true;
@@ -361,6 +410,7 @@ static void move_slot_to_reg(unsigned slot_no, unsigned reg_no) {
         else
             x86asm_movq_disp8_reg_reg(slot->rbp_offs, RBP, reg_no);
     }
+    n_reloads++;
 
     reg_dst->in_use = true;
     reg_dst->slot_no = slot_no;
@@ -368,6 +418,32 @@ static void move_slot_to_reg(unsigned slot_no, unsigned reg_no) {
     slot->in_reg = true;
 }
 
+/*
+ * copy the given slot's value into the given register without moving the slot
+ * out of wherever it is.  This is for passing slots to functions, so the
+ * register should already have been grabbed by prefunc; that also guarantees
+ * that the slot isn't in it.
+ */
+static void copy_slot_to_reg(unsigned slot_no, unsigned reg_no) {
+    if (slot_no >= MAX_SLOTS)
+        RAISE_ERROR(ERROR_TOO_BIG);
+    struct slot const *slot = slots + slot_no;
+    if (!slot->in_use || !regs[reg_no].grabbed)
+        RAISE_ERROR(ERROR_INTEGRITY);
+
+    if (slot->in_reg) {
+        if (slot->reg_no == reg_no)
+            RAISE_ERROR(ERROR_INTEGRITY);
+        x86asm_mov_reg32_reg32(slot->reg_no, reg_no);
+    } else {
+        if (slot->rbp_offs > 127 || slot->rbp_offs < -128)
+            x86asm_movq_disp32_reg_reg(slot->rbp_offs, RBP, reg_no);
+        else
+            x86asm_movq_disp8_reg_reg(slot->rbp_offs, RBP, reg_no);
+        n_reloads++;
+    }
+}
+
 /*
  * This function will pick an unused register to use.  This doesn't change the
  * state of the register.  If there are no unused registers available, this
@@ -403,7 +479,7 @@ static int pick_unused_reg(void) {
 static unsigned pick_reg(void) {
     unsigned reg_no;
     unsigned best_reg = 0;
-    int best_prio;
+    int best_prio = 0;
     bool found_one = false;
 
     // first pass: try to find one that's not in use
@@ -412,15 +488,21 @@ static unsigned pick_reg(void) {
         return (unsigned)unused_reg;
 
     /*
-     * second pass: they're all in use so just pick one that is not locked or
-     * grabbed.
+     * second pass: they're all in use so pick one that is not locked or
+     * grabbed.  The one whose slot won't be needed again for the longest time
+     * goes first since that's the spill which is least likely to get reloaded
+     * right away.
      */
+    unsigned best_end = 0;
     for (reg_no = 0; reg_no < N_REGS; reg_no++) {
         struct reg_stat const *reg = regs + reg_no;
         if (!reg->locked && !reg->grabbed) {
-            if (!found_one || reg->prio > best_prio) {
+            unsigned end = slots[reg->slot_no].live_end;
+            if (!found_one || end > best_end ||
+                (end == best_end && reg->prio > best_prio)) {
                 found_one = true;
                 best_prio = reg->prio;
+                best_end = end;
                 best_reg = reg_no;
             }
         }
@@ -454,6 +536,21 @@ static void evict_register(unsigned reg_no) {
     reg->in_use = false;
 }
 
+/*
+ * pick a register for the given slot to go into.  This is the slot's hint from
+ * the linear scan if it has one and that register can be had; otherwise it's
+ * whatever pick_reg comes up with.  If the hinted register holds some other
+ * slot then that slot gets evicted from it.
+ */
+static unsigned pick_slot_reg(unsigned slot_no) {
+    struct slot const *slot = slots + slot_no;
+    if (slot->has_hint && !regs[slot->hint_reg].grabbed) {
+        evict_register(slot->hint_reg);
+        return slot->hint_reg;
+    }
+    return pick_reg();
+}
+
 /*
  * If the slot is in a register, then mark that register as grabbed.
  *
@@ -478,17 +575,18 @@ static void grab_slot(unsigned slot_no) {
                 goto mark_grabbed;
         }
 
-        unsigned reg_no = pick_reg();
+        unsigned reg_no = pick_slot_reg(slot_no);
         move_slot_to_reg(slot_no, reg_no);
         goto mark_grabbed;
     } else {
-        unsigned reg_no = pick_reg();
+        unsigned reg_no = pick_slot_reg(slot_no);
         struct reg_stat *reg = regs + reg_no;
         if (reg->in_use)
             move_slot_to_stack(reg->slot_no);
         reg->in_use = true;
         reg->slot_no = slot_no;
         slot->in_use = true;
+        slot->retired = false;
         slot->reg_no = reg_no;
         slot->in_reg = true;
         goto mark_grabbed;
@@ -528,12 +626,336 @@ static void ungrab_register(unsigned reg_no) {
     regs[reg_no].grabbed = false;
 }
 
+/*
+ * Register allocation.
+ *
+ * The allocator above works on demand: slots get a register when an
+ * instruction grabs them and they only go back to the stack when something
+ * else needs that register.  Before a block gets compiled, alloc_pass walks
+ * the IL backwards to find out where each slot's value dies and which values
+ * stay live across a function call, and then does a linear scan over those
+ * live ranges to give each one a register hint.  Ranges which cross a call get
+ * callee-saved registers so that prefunc never has to evict them; the rest get
+ * the volatile registers that aren't needed as scratch space.  When there
+ * aren't enough registers, the range that ends last goes without a hint.
+ *
+ * While the block is compiled, slots are retired right after their last use so
+ * that dead values never get spilled.
+ */
+static unsigned const callee_saved_regs[] = {
+#if defined(ABI_UNIX)
+    RBX, R12, R13, R14, R15
+#elif defined(ABI_MICROSOFT)
+    RBX, RSI, RDI, R12, R13, R14, R15
+#endif
+};
+
+/*
+ * RAX, RCX, RDX and REG_VOL1 are left out because so many of the emit_
+ * functions evict them for their own use.
+ */
+static unsigned const caller_saved_regs[] = {
+#if defined(ABI_UNIX)
+    RSI, RDI, R8, R9, R10
+#elif defined(ABI_MICROSOFT)
+    R8, R9, R10
+#endif
+};
+
+#define N_CALLEE_SAVED_REGS \
+    (sizeof(callee_saved_regs) / sizeof(callee_saved_regs[0]))
+#define N_CALLER_SAVED_REGS \
+    (sizeof(caller_saved_regs) / sizeof(caller_saved_regs[0]))
+#define N_HINT_REGS (N_CALLEE_SAVED_REGS + N_CALLER_SAVED_REGS)
+
+#define MAX_DEAD_SLOTS (JIT_INST_MAX_READ_SLOTS + 1)
+
+struct inst_alloc {
+    // slots whose values are dead after this instruction
+    unsigned n_dead;
+    unsigned dead[MAX_DEAD_SLOTS];
+
+    /*
+     * range_start is true for instructions which write a new value to a slot
+     * without reading the old one.  The rest of these are only valid if it is
+     * set, and they are the slot's hint for the live range that starts here and
+     * the index of the last instruction in that range.
+     */
+    bool range_start;
+    bool has_hint;
+    unsigned hint_reg;
+    unsigned live_end;
+};
+
+struct live_range {
+    unsigned start, end;
+    bool crosses_call;
+
+    // index into hint_regs, or -1
+    int reg_idx;
+};
+
+static struct inst_alloc *inst_alloc;
+static struct live_range *live_ranges;
+static unsigned *n_calls_before;
+static unsigned alloc_len;
+
+// these are only used by alloc_pass
+static bool slot_live[MAX_SLOTS];
+static unsigned slot_end[MAX_SLOTS];
+
+// true if the given IL instruction can call out of the block
+static bool inst_is_call(struct jit_inst const *inst) {
+    switch (inst->op) {
+    case JIT_OP_FALLBACK:
+    case JIT_OP_CALL_FUNC:
+    case JIT_OP_READ_16_CONSTADDR:
+    case JIT_OP_READ_32_CONSTADDR:
+    case JIT_OP_READ_32_SLOT:
+    case JIT_OP_WRITE_32_SLOT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void alloc_grow(unsigned inst_count) {
+    if (inst_count <= alloc_len)
+        return;
+
+    void *new_inst_alloc =
+        realloc(inst_alloc, inst_count * sizeof(struct inst_alloc));
+    if (!new_inst_alloc)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    inst_alloc = (struct inst_alloc*)new_inst_alloc;
+
+    void *new_live_ranges =
+        realloc(live_ranges, inst_count * sizeof(struct live_range));
+    if (!new_live_ranges)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    live_ranges = (struct live_range*)new_live_ranges;
+
+    void *new_n_calls_before =
+        realloc(n_calls_before, (inst_count + 1) * sizeof(unsigned));
+    if (!new_n_calls_before)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    n_calls_before = (unsigned*)new_n_calls_before;
+
+    alloc_len = inst_count;
+}
+
+static void check_slot_no(struct il_code_block const *il_blk,
+                          unsigned slot_no) {
+    if (slot_no >= il_blk->n_slots) {
+        error_set_index(slot_no);
+        error_set_max_val(il_blk->n_slots);
+        RAISE_ERROR(ERROR_INTEGRITY);
+    }
+}
+
+// fills in inst_alloc for every instruction in il_blk
+static void alloc_pass(struct il_code_block const *il_blk) {
+    struct jit_inst const *insts = il_blk->inst_list;
+    unsigned inst_count = il_blk->inst_count;
+    unsigned n_ranges = 0;
+    unsigned idx, slot_no;
+
+    alloc_grow(inst_count);
+
+    for (slot_no = 0; slot_no < il_blk->n_slots && slot_no < MAX_SLOTS;
+         slot_no++)
+        slot_live[slot_no] = false;
+
+    n_calls_before[0] = 0;
+    for (idx = 0; idx < inst_count; idx++) {
+        n_calls_before[idx + 1] =
+            n_calls_before[idx] + (inst_is_call(insts + idx) ? 1 : 0);
+    }
+
+    // liveness, last instruction first
+    for (idx = inst_count; idx-- > 0;) {
+        struct jit_inst const *inst = insts + idx;
+        struct inst_alloc *alloc = inst_alloc + idx;
+        unsigned reads[JIT_INST_MAX_READ_SLOTS];
+        unsigned n_reads, read_no, dead_no;
+        bool dst_read = false;
+
+        alloc->n_dead = 0;
+        alloc->range_start = false;
+        alloc->has_hint = false;
+
+        if (inst->op == JIT_OP_DISCARD_SLOT)
+            continue;
+
+        n_reads = jit_inst_read_slots(inst, reads);
+        int dst_slot = jit_inst_dst_slot(inst);
+
+        // anything this instruction touches which isn't live afterwards dies
+        for (read_no = 0; read_no <= n_reads; read_no++) {
+            int slot;
+            if (read_no < n_reads)
+                slot = reads[read_no];
+            else
+                slot = dst_slot;
+            if (slot < 0)
+                continue;
+            check_slot_no(il_blk, slot);
+            if (slot_live[slot])
+                continue;
+
+            for (dead_no = 0; dead_no < alloc->n_dead; dead_no++)
+                if (alloc->dead[dead_no] == (unsigned)slot)
+                    break;
+            if (dead_no == alloc->n_dead) {
+                alloc->dead[alloc->n_dead++] = slot;
+                slot_end[slot] = idx;
+            }
+        }
+
+        for (read_no = 0; read_no < n_reads; read_no++)
+            if ((int)reads[read_no] == dst_slot)
+                dst_read = true;
+
+        /*
+         * a write that doesn't depend on the slot's old value is where the
+         * live range begins.
+         */
+        if (dst_slot >= 0 && !dst_read) {
+            struct live_range *range = live_ranges + n_ranges++;
+            range->start = idx;
+            range->end = slot_end[dst_slot];
+            /*
+             * a call at the end of the range counts too since prefunc evicts
+             * the volatile registers before it moves the arguments into place
+             */
+            range->crosses_call =
+                n_calls_before[range->end + 1] - n_calls_before[idx + 1] > 0;
+            range->reg_idx = -1;
+            alloc->range_start = true;
+            alloc->live_end = range->end;
+            slot_live[dst_slot] = false;
+        }
+
+        for (read_no = 0; read_no < n_reads; read_no++)
+            slot_live[reads[read_no]] = true;
+    }
+
+    /*
+     * linear scan.  live_ranges is in reverse order of where the ranges start,
+     * so walk it backwards.  active holds the ranges which currently have a
+     * register.
+     */
+    unsigned active[N_HINT_REGS];
+    unsigned n_active = 0;
+    bool reg_taken[N_HINT_REGS] = { false };
+
+    for (idx = n_ranges; idx-- > 0;) {
+        struct live_range *range = live_ranges + idx;
+        unsigned active_no, reg_idx;
+
+        // expire ranges which ended before this one started
+        for (active_no = 0; active_no < n_active;) {
+            struct live_range *other = live_ranges + active[active_no];
+            if (other->end < range->start) {
+                reg_taken[other->reg_idx] = false;
+                active[active_no] = active[--n_active];
+            } else {
+                active_no++;
+            }
+        }
+
+        /*
+         * callee-saved registers first for ranges that cross a call,
+         * caller-saved registers first for everything else.
+         */
+        int found = -1;
+        for (reg_idx = 0; reg_idx < N_HINT_REGS && found < 0; reg_idx++) {
+            unsigned which = range->crosses_call ? reg_idx :
+                (reg_idx + N_CALLEE_SAVED_REGS) % N_HINT_REGS;
+            if (range->crosses_call && which >= N_CALLEE_SAVED_REGS)
+                break;
+            if (!reg_taken[which])
+                found = which;
+        }
+
+        if (found < 0) {
+            /*
+             * Steal the register of whichever active range ends last, if that
+             * is later than this one ends.  Ranges that cross a call can only
+             * steal callee-saved registers.
+             */
+            int victim = -1;
+            for (active_no = 0; active_no < n_active; active_no++) {
+                struct live_range *other = live_ranges + active[active_no];
+                if (range->crosses_call &&
+                    (unsigned)other->reg_idx >= N_CALLEE_SAVED_REGS)
+                    continue;
+                if (other->end > range->end &&
+                    (victim < 0 ||
+                     other->end > live_ranges[active[victim]].end))
+                    victim = active_no;
+            }
+            if (victim < 0)
+                continue;
+            struct live_range *other = live_ranges + active[victim];
+            found = other->reg_idx;
+            other->reg_idx = -1;
+            active[victim] = active[--n_active];
+        }
+
+        range->reg_idx = found;
+        reg_taken[found] = true;
+        active[n_active++] = idx;
+    }
+
+    for (idx = 0; idx < n_ranges; idx++) {
+        struct live_range const *range = live_ranges + idx;
+        struct inst_alloc *alloc = inst_alloc + range->start;
+        if (range->reg_idx >= 0) {
+            alloc->has_hint = true;
+            alloc->hint_reg = range->reg_idx < (int)N_CALLEE_SAVED_REGS ?
+                callee_saved_regs[range->reg_idx] :
+                caller_saved_regs[range->reg_idx - N_CALLEE_SAVED_REGS];
+        }
+    }
+}
+
+// free the slot and whatever register it's in after its last use
+static void retire_slot(unsigned slot_no) {
+    struct slot *slot = slots + slot_no;
+    if (!slot->in_use)
+        return;
+    slot->in_use = false;
+    slot->retired = true;
+    if (slot->in_reg)
+        regs[slot->reg_no].in_use = false;
+}
+
+void code_block_x86_64_get_stats(struct code_block_x86_64_stats *stats) {
+    *stats = alloc_stats;
+}
+
+void
+code_block_x86_64_print_stats(struct code_block_x86_64_stats const *stats) {
+    double n_blocks = stats->n_blocks ? (double)stats->n_blocks : 1.0;
+    LOG_INFO("x86_64 regalloc: %llu blocks compiled\n", stats->n_blocks);
+    LOG_INFO("x86_64 regalloc: %llu spills (%.2f per block, at most %u)\n",
+             stats->n_spills, stats->n_spills / n_blocks, stats->max_spills);
+    LOG_INFO("x86_64 regalloc: %llu reloads (%.2f per block, at most %u)\n",
+             stats->n_reloads, stats->n_reloads / n_blocks, stats->max_reloads);
+    LOG_INFO("x86_64 regalloc: %llu register-to-register moves (%.2f per "
+             "block)\n", stats->n_moves, stats->n_moves / n_blocks);
+}
+
 #define X86_64_ALLOC_SIZE 32
 
 void code_block_x86_64_init(struct code_block_x86_64 *blk) {
     void *native = exec_mem_alloc(X86_64_ALLOC_SIZE);
     blk->cycle_count = 0;
     blk->bytes_used = 0;
+    blk->fastmem_sites = NULL;
+    blk->n_fastmem_sites = 0;
+    blk->n_links = 0;
 
     if (!native) {
         error_set_errno_val(errno);
@@ -543,7 +965,25 @@ void code_block_x86_64_init(struct code_block_x86_64 *blk) {
     blk->native = native;
 }
 
+static void remove_fastmem_sites(struct code_block_x86_64 *blk) {
+    unsigned idx;
+    for (idx = 0; idx < blk->n_fastmem_sites; idx++)
+        native_fastmem_remove_site(blk->fastmem_sites + idx);
+    free(blk->fastmem_sites);
+    blk->fastmem_sites = NULL;
+    blk->n_fastmem_sites = 0;
+}
+
+static void remove_links(struct code_block_x86_64 *blk) {
+    unsigned idx;
+    for (idx = 0; idx < blk->n_links; idx++)
+        native_link_remove(blk->links + idx);
+    blk->n_links = 0;
+}
+
 void code_block_x86_64_cleanup(struct code_block_x86_64 *blk) {
+    remove_links(blk);
+    remove_fastmem_sites(blk);
     exec_mem_free(blk->native);
     memset(blk, 0, sizeof(*blk));
 }
@@ -595,6 +1035,13 @@ static void emit_jump(void *cpu, struct jit_inst const *inst) {
     x86asm_mov_reg32_reg32(slots[slot_no].reg_no, REG_RET);
 
     ungrab_slot(slot_no);
+
+    if (slots[slot_no].is_const) {
+        exit_pcs[0] = slots[slot_no].const_val;
+        n_exit_pcs = 1;
+    } else {
+        n_exit_pcs = 0;
+    }
 }
 
 // JIT_JUMP_COND implementation
@@ -638,6 +1085,74 @@ static void emit_jump_cond(void *cpu, struct jit_inst const *inst) {
     ungrab_register(REG_RET); // not that it matters at this point...
 
     x86asm_lbl8_cleanup(&lbl);
+
+    if (slots[jmp_addr_slot].is_const && slots[alt_jmp_addr_slot].is_const) {
+        exit_pcs[0] = slots[jmp_addr_slot].const_val;
+        exit_pcs[1] = slots[alt_jmp_addr_slot].const_val;
+        n_exit_pcs = exit_pcs[0] == exit_pcs[1] ? 1 : 2;
+    } else {
+        n_exit_pcs = 0;
+    }
+}
+
+/*
+ * leave the block for exit_pc through side_exit_check.  This path never comes
+ * back, so it can clobber whatever it wants without telling the register
+ * allocator.
+ */
+static void emit_side_exit(addr32_t exit_pc, unsigned cycle_count,
+                           unsigned n_guest_insts) {
+    x86asm_mov_imm32_reg32(cycle_count, REG_ARG0);
+    x86asm_mov_imm32_reg32(exit_pc, REG_ARG1);
+    native_count_exit_emit(n_guest_insts, true);
+    emit_stack_frame_close();
+    x86asm_mov_imm64_reg64((uintptr_t)side_exit_check, REG_RET);
+    x86asm_jmpq_reg64(REG_RET);
+}
+
+// JIT_OP_EXIT_COND implementation
+static void emit_exit_cond(void *cpu, struct jit_inst const *inst) {
+    struct exit_cond_immed const *immed = &inst->immed.exit_cond;
+    unsigned flag_slot = immed->slot_no;
+
+    struct x86asm_lbl8 stay;
+    x86asm_lbl8_init(&stay);
+
+    grab_slot(flag_slot);
+    x86asm_testl_imm32_reg32(1, slots[flag_slot].reg_no);
+    ungrab_slot(flag_slot);
+
+    if (immed->t_flag)
+        x86asm_jz_lbl8(&stay);
+    else
+        x86asm_jnz_lbl8(&stay);
+
+    emit_side_exit(immed->exit_pc, immed->cycle_count, immed->n_guest_insts);
+
+    x86asm_lbl8_define(&stay);
+    x86asm_lbl8_cleanup(&stay);
+}
+
+// JIT_OP_TRACE_JOIN implementation
+static void emit_trace_join(void *cpu, struct jit_inst const *inst) {
+    struct trace_join_immed const *immed = &inst->immed.trace_join;
+
+    struct x86asm_lbl8 stay;
+    x86asm_lbl8_init(&stay);
+
+    evict_register(REG_VOL0);
+    grab_register(REG_VOL0);
+    evict_register(REG_VOL1);
+    grab_register(REG_VOL1);
+
+    native_cycles_left_emit(immed->cycle_count, REG_VOL0, REG_VOL1, &stay);
+    emit_side_exit(immed->next_pc, immed->cycle_count, immed->n_guest_insts);
+
+    x86asm_lbl8_define(&stay);
+    x86asm_lbl8_cleanup(&stay);
+
+    ungrab_register(REG_VOL1);
+    ungrab_register(REG_VOL0);
 }
 
 // JIT_SET_REG implementation
@@ -648,6 +1163,9 @@ static void emit_set_slot(void *cpu, struct jit_inst const *inst) {
     grab_slot(slot_idx);
     x86asm_mov_imm32_reg32(new_val, slots[slot_idx].reg_no);
     ungrab_slot(slot_idx);
+
+    slots[slot_idx].is_const = true;
+    slots[slot_idx].const_val = new_val;
 }
 
 // JIT_OP_CALL_FUNC implementation
@@ -656,9 +1174,7 @@ static void emit_call_func(void *cpu, struct jit_inst const *inst) {
 
     // now call sh4_on_sr_change(cpu, old_sr)
     x86asm_mov_imm64_reg64((uint64_t)(uintptr_t)cpu, REG_ARG0);
-    move_slot_to_reg(inst->immed.call_func.slot_no, REG_ARG1);
-
-    evict_register(REG_ARG1); // TODO: is this necessary ?
+    copy_slot_to_reg(inst->immed.call_func.slot_no, REG_ARG1);
 
     ms_shadow_open();
     x86_64_align_stack();
@@ -669,12 +1185,183 @@ static void emit_call_func(void *cpu, struct jit_inst const *inst) {
     ungrab_register(REG_RET);
 }
 
+/*
+ * Memory accesses which go through the fastmem arena get recorded here while
+ * the block is being compiled.  The slow-path stubs for them all get emitted
+ * after the end of the block (see emit_fastmem_stubs).
+ */
+enum fastmem_access {
+    FASTMEM_READ_32,
+    FASTMEM_WRITE_32
+};
+
+struct fastmem_pending {
+    enum fastmem_access tp;
+    struct memory_map const *map;
+
+    void *patch_addr, *fault_addr, *resume_addr;
+
+    /*
+     * writes only: jmp rel32 which is taken when the written page may contain
+     * compiled code.  It gets pointed at a stub which calls
+     * code_cache_invalidate_ram.
+     */
+    void *smc_jmp;
+
+    unsigned addr_reg;
+
+    // destination register for reads, source register for writes
+    unsigned val_reg;
+
+    // value of rsp_offs at the time of the access
+    int rsp_offs;
+};
+
+#define MAX_FASTMEM_PENDING 256
+
+static struct fastmem_pending fastmem_pending[MAX_FASTMEM_PENDING];
+static unsigned n_fastmem_pending;
+
+/*
+ * If the given map has a fastmem arena, emit a direct load from it and return
+ * true.  Otherwise return false and emit nothing.
+ */
+static bool
+emit_fastmem_read_32(struct memory_map const *map,
+                     unsigned addr_slot, unsigned dst_slot) {
+    void *arena = native_fastmem_base(map);
+    if (!arena || n_fastmem_pending >= MAX_FASTMEM_PENDING)
+        return false;
+
+    // REG_RET holds the base of the arena
+    evict_register(REG_RET);
+    grab_register(REG_RET);
+
+    grab_slot(addr_slot);
+    if (dst_slot != addr_slot)
+        grab_slot(dst_slot);
+
+    struct fastmem_pending *site = fastmem_pending + n_fastmem_pending++;
+    site->tp = FASTMEM_READ_32;
+    site->map = map;
+    site->addr_reg = slots[addr_slot].reg_no;
+    site->val_reg = slots[dst_slot].reg_no;
+    site->rsp_offs = rsp_offs;
+
+    // zero-extend the address into the upper 32 bits
+    x86asm_mov_reg32_reg32(site->addr_reg, site->addr_reg);
+
+    site->patch_addr = x86asm_get_outp();
+    x86asm_mov_imm64_reg64((uintptr_t)arena, REG_RET);
+    site->fault_addr = x86asm_get_outp();
+    x86asm_movl_sib_reg(REG_RET, 1, site->addr_reg, site->val_reg);
+    site->resume_addr = x86asm_get_outp();
+
+    if (dst_slot != addr_slot)
+        ungrab_slot(dst_slot);
+    ungrab_slot(addr_slot);
+    ungrab_register(REG_RET);
+
+    return true;
+}
+
+// write counterpart to emit_fastmem_read_32
+static bool
+emit_fastmem_write_32(struct memory_map const *map,
+                      unsigned addr_slot, unsigned src_slot) {
+    void *arena = native_fastmem_base(map);
+    if (!arena || n_fastmem_pending >= MAX_FASTMEM_PENDING)
+        return false;
+
+    struct x86asm_lbl8 no_code;
+    x86asm_lbl8_init(&no_code);
+
+    // REG_VOL1 is for checking code_cache_ram_pages after the store
+    evict_register(REG_RET);
+    grab_register(REG_RET);
+    evict_register(REG_VOL1);
+    grab_register(REG_VOL1);
+
+    grab_slot(addr_slot);
+    if (src_slot != addr_slot)
+        grab_slot(src_slot);
+
+    struct fastmem_pending *site = fastmem_pending + n_fastmem_pending++;
+    site->tp = FASTMEM_WRITE_32;
+    site->map = map;
+    site->addr_reg = slots[addr_slot].reg_no;
+    site->val_reg = slots[src_slot].reg_no;
+    site->rsp_offs = rsp_offs;
+
+    x86asm_mov_reg32_reg32(site->addr_reg, site->addr_reg);
+
+    site->patch_addr = x86asm_get_outp();
+    x86asm_mov_imm64_reg64((uintptr_t)arena, REG_RET);
+    site->fault_addr = x86asm_get_outp();
+    x86asm_movl_reg_sib(site->val_reg, REG_RET, 1, site->addr_reg);
+
+    /*
+     * The store didn't fault, so the address is in main RAM.  The slow-path
+     * stub resumes after this check since it doesn't know that.
+     */
+    x86asm_mov_reg32_reg32(site->addr_reg, REG_RET);
+    x86asm_andl_imm32_reg32(ADDR_AREA3_MASK, REG_RET);
+    x86asm_shrl_imm8_reg32(CODE_CACHE_PAGE_SHIFT, REG_RET);
+    x86asm_mov_imm64_reg64((uintptr_t)code_cache_ram_pages, REG_VOL1);
+    x86asm_movl_sib_reg(REG_VOL1, 4, REG_RET, REG_RET);
+    x86asm_testl_reg32_reg32(REG_RET, REG_RET);
+    x86asm_jz_lbl8(&no_code);
+    site->smc_jmp = x86asm_get_outp();
+    x86asm_jmp_rel32(site->smc_jmp); // placeholder, see emit_fastmem_stubs
+    x86asm_lbl8_define(&no_code);
+
+    site->resume_addr = x86asm_get_outp();
+
+    if (src_slot != addr_slot)
+        ungrab_slot(src_slot);
+    ungrab_slot(addr_slot);
+    ungrab_register(REG_VOL1);
+    ungrab_register(REG_RET);
+
+    x86asm_lbl8_cleanup(&no_code);
+
+    return true;
+}
+
+/*
+ * If fastmem is available for the given map and addr is backed by system
+ * memory then there's no need to go through the arena at all because the host
+ * address is already known.  This returns NULL if that isn't the case.
+ */
+static void const *
+fastmem_const_host_ptr(struct memory_map const *map, addr32_t addr,
+                       unsigned len) {
+    if (!native_fastmem_base(map))
+        return NULL;
+
+    struct memory_map_page const *page =
+        memory_map_get_page(map, addr, addr + (len - 1));
+    if (!page || !page->host)
+        return NULL;
+    return page->host + (addr & MEMORY_MAP_PAGE_MASK);
+}
+
 // JIT_OP_READ_16_CONSTADDR implementation
 static void emit_read_16_constaddr(void *cpu, struct jit_inst const *inst) {
     addr32_t vaddr = inst->immed.read_16_constaddr.addr;
     unsigned slot_no = inst->immed.read_16_constaddr.slot_no;
     struct memory_map const *map = inst->immed.read_16_constaddr.map;
 
+    void const *host = fastmem_const_host_ptr(map, vaddr, 2);
+    if (host) {
+        grab_slot(slot_no);
+        unsigned reg_no = slots[slot_no].reg_no;
+        x86asm_mov_imm64_reg64((uintptr_t)host, reg_no);
+        x86asm_movzxw_indreg_reg(reg_no, reg_no);
+        ungrab_slot(slot_no);
+        return;
+    }
+
     // call memory_map_read_16(vaddr)
     prefunc();
 
@@ -717,6 +1404,16 @@ static void emit_read_32_constaddr(void *cpu, struct jit_inst const *inst) {
     unsigned slot_no = inst->immed.read_32_constaddr.slot_no;
     struct memory_map const *map = inst->immed.read_32_constaddr.map;
 
+    void const *host = fastmem_const_host_ptr(map, vaddr, 4);
+    if (host) {
+        grab_slot(slot_no);
+        unsigned reg_no = slots[slot_no].reg_no;
+        x86asm_mov_imm64_reg64((uintptr_t)host, reg_no);
+        x86asm_mov_indreg32_reg32(reg_no, reg_no);
+        ungrab_slot(slot_no);
+        return;
+    }
+
     // call memory_map_read_32(vaddr)
 
     prefunc();
@@ -748,17 +1445,18 @@ static void emit_read_32_slot(void *cpu, struct jit_inst const *inst) {
     unsigned addr_slot = inst->immed.read_32_slot.addr_slot;
     struct memory_map const *map = inst->immed.read_32_slot.map;
 
+    if (emit_fastmem_read_32(map, addr_slot, dst_slot))
+        return;
+
     // call memory_map_read_32(*addr_slot)
     prefunc();
 
     if (config_get_inline_mem()) {
-        move_slot_to_reg(addr_slot, REG_ARG0);
-        evict_register(REG_ARG0);
+        copy_slot_to_reg(addr_slot, REG_ARG0);
         native_mem_read_32(map);
     } else {
         x86asm_mov_imm64_reg64((uint64_t)map, REG_ARG0);
-        move_slot_to_reg(addr_slot, REG_ARG1);
-        evict_register(REG_ARG1);
+        copy_slot_to_reg(addr_slot, REG_ARG1);
         ms_shadow_open();
         x86_64_align_stack();
         x86asm_call_ptr(memory_map_read_32);
@@ -780,22 +1478,19 @@ static void emit_write_32_slot(void *cpu, struct jit_inst const *inst) {
     unsigned addr_slot = inst->immed.write_32_slot.addr_slot;
     struct memory_map const *map = inst->immed.write_32_slot.map;
 
+    if (emit_fastmem_write_32(map, addr_slot, src_slot))
+        return;
+
     prefunc();
 
     if (config_get_inline_mem()) {
-        move_slot_to_reg(addr_slot, REG_ARG0);
-        move_slot_to_reg(src_slot, REG_ARG1);
-
-        evict_register(REG_ARG0);
-        evict_register(REG_ARG1);
+        copy_slot_to_reg(addr_slot, REG_ARG0);
+        copy_slot_to_reg(src_slot, REG_ARG1);
 
         native_mem_write_32(map);
     } else {
-        move_slot_to_reg(addr_slot, REG_ARG1);
-        move_slot_to_reg(src_slot, REG_ARG2);
-
-        evict_register(REG_ARG1);
-        evict_register(REG_ARG2);
+        copy_slot_to_reg(addr_slot, REG_ARG1);
+        copy_slot_to_reg(src_slot, REG_ARG2);
 
         x86asm_mov_imm64_reg64((uint64_t)map, REG_ARG0);
         ms_shadow_open();
@@ -1280,6 +1975,204 @@ static void emit_mul_u32(void *cpu, struct jit_inst const *inst) {
     ungrab_register(REG_RET);
 }
 
+/*
+ * Scalar float ops.  The operands live in general-purpose registers like
+ * everything else, so they get moved into XMM0/XMM1 for the duration of the
+ * operation and then moved back.
+ */
+static void emit_float_binop(unsigned slot_src, unsigned slot_dst,
+                             void(*op)(unsigned, unsigned)) {
+    grab_slot(slot_src);
+    grab_slot(slot_dst);
+
+    x86asm_movd_reg32_xmm(slots[slot_dst].reg_no, XMM0);
+    x86asm_movd_reg32_xmm(slots[slot_src].reg_no, XMM1);
+    op(XMM1, XMM0);
+    x86asm_movd_xmm_reg32(XMM0, slots[slot_dst].reg_no);
+
+    ungrab_slot(slot_dst);
+    if (slot_src != slot_dst)
+        ungrab_slot(slot_src);
+}
+
+static void emit_fadd(void *cpu, struct jit_inst const *inst) {
+    emit_float_binop(inst->immed.fadd.slot_src, inst->immed.fadd.slot_dst,
+                     x86asm_addss_xmm_xmm);
+}
+
+static void emit_fsub(void *cpu, struct jit_inst const *inst) {
+    emit_float_binop(inst->immed.fsub.slot_src, inst->immed.fsub.slot_dst,
+                     x86asm_subss_xmm_xmm);
+}
+
+static void emit_fmul(void *cpu, struct jit_inst const *inst) {
+    emit_float_binop(inst->immed.fmul.slot_src, inst->immed.fmul.slot_dst,
+                     x86asm_mulss_xmm_xmm);
+}
+
+static void emit_fdiv(void *cpu, struct jit_inst const *inst) {
+    emit_float_binop(inst->immed.fdiv.slot_src, inst->immed.fdiv.slot_dst,
+                     x86asm_divss_xmm_xmm);
+}
+
+static void emit_fsqrt(void *cpu, struct jit_inst const *inst) {
+    unsigned slot_no = inst->immed.fsqrt.slot_no;
+
+    grab_slot(slot_no);
+
+    x86asm_movd_reg32_xmm(slots[slot_no].reg_no, XMM0);
+    x86asm_sqrtss_xmm_xmm(XMM0, XMM0);
+    x86asm_movd_xmm_reg32(XMM0, slots[slot_no].reg_no);
+
+    ungrab_slot(slot_no);
+}
+
+static void emit_fset_eq(void *cpu, struct jit_inst const *inst) {
+    unsigned slot_lhs = inst->immed.fset_eq.slot_lhs;
+    unsigned slot_rhs = inst->immed.fset_eq.slot_rhs;
+    unsigned slot_dst = inst->immed.fset_eq.slot_dst;
+
+    struct x86asm_lbl8 lbl;
+    x86asm_lbl8_init(&lbl);
+
+    grab_slot(slot_lhs);
+    grab_slot(slot_rhs);
+    grab_slot(slot_dst);
+
+    x86asm_movd_reg32_xmm(slots[slot_lhs].reg_no, XMM0);
+    x86asm_movd_reg32_xmm(slots[slot_rhs].reg_no, XMM1);
+    x86asm_ucomiss_xmm_xmm(XMM1, XMM0);
+
+    // ZF is also set when the comparison is unordered
+    x86asm_jp_lbl8(&lbl);
+    x86asm_jnz_lbl8(&lbl);
+    x86asm_orl_imm32_reg32(1, slots[slot_dst].reg_no);
+    x86asm_lbl8_define(&lbl);
+
+    ungrab_slot(slot_dst);
+    if (slot_rhs != slot_dst)
+        ungrab_slot(slot_rhs);
+    if (slot_lhs != slot_rhs && slot_lhs != slot_dst)
+        ungrab_slot(slot_lhs);
+
+    x86asm_lbl8_cleanup(&lbl);
+}
+
+static void emit_fset_gt(void *cpu, struct jit_inst const *inst) {
+    unsigned slot_lhs = inst->immed.fset_gt.slot_lhs;
+    unsigned slot_rhs = inst->immed.fset_gt.slot_rhs;
+    unsigned slot_dst = inst->immed.fset_gt.slot_dst;
+
+    struct x86asm_lbl8 lbl;
+    x86asm_lbl8_init(&lbl);
+
+    grab_slot(slot_lhs);
+    grab_slot(slot_rhs);
+    grab_slot(slot_dst);
+
+    x86asm_movd_reg32_xmm(slots[slot_lhs].reg_no, XMM0);
+    x86asm_movd_reg32_xmm(slots[slot_rhs].reg_no, XMM1);
+    x86asm_ucomiss_xmm_xmm(XMM1, XMM0);
+
+    // unordered sets CF and ZF, so jbe also catches NaN
+    x86asm_jbe_lbl8(&lbl);
+    x86asm_orl_imm32_reg32(1, slots[slot_dst].reg_no);
+    x86asm_lbl8_define(&lbl);
+
+    ungrab_slot(slot_dst);
+    if (slot_rhs != slot_dst)
+        ungrab_slot(slot_rhs);
+    if (slot_lhs != slot_rhs && slot_lhs != slot_dst)
+        ungrab_slot(slot_lhs);
+
+    x86asm_lbl8_cleanup(&lbl);
+}
+
+static void emit_cvt_i32_f32(void *cpu, struct jit_inst const *inst) {
+    unsigned slot_no = inst->immed.cvt_i32_f32.slot_no;
+
+    grab_slot(slot_no);
+
+    x86asm_cvtsi2ssl_reg32_xmm(slots[slot_no].reg_no, XMM0);
+    x86asm_movd_xmm_reg32(XMM0, slots[slot_no].reg_no);
+
+    ungrab_slot(slot_no);
+}
+
+static void emit_cvt_f32_i32(void *cpu, struct jit_inst const *inst) {
+    unsigned slot_no = inst->immed.cvt_f32_i32.slot_no;
+
+    grab_slot(slot_no);
+
+    x86asm_movd_reg32_xmm(slots[slot_no].reg_no, XMM0);
+    x86asm_cvttss2sil_xmm_reg32(XMM0, slots[slot_no].reg_no);
+
+    ungrab_slot(slot_no);
+}
+
+static void emit_dot4(void *cpu, struct jit_inst const *inst) {
+    evict_register(REG_RET);
+    grab_register(REG_RET);
+
+    x86asm_mov_imm64_reg64((uintptr_t)inst->immed.dot4.lhs, REG_RET);
+    x86asm_movups_indreg_xmm(REG_RET, XMM0);
+    x86asm_mov_imm64_reg64((uintptr_t)inst->immed.dot4.rhs, REG_RET);
+    x86asm_movups_indreg_xmm(REG_RET, XMM1);
+    x86asm_mulps_xmm_xmm(XMM1, XMM0);
+
+    /*
+     * sum the products from first to last so that the result matches the
+     * interpreter bit-for-bit.  A horizontal add would be faster but it would
+     * add them up in a different order.
+     */
+    x86asm_movaps_xmm_xmm(XMM0, XMM2);
+    x86asm_movaps_xmm_xmm(XMM2, XMM1);
+    x86asm_shufps_imm8_xmm_xmm(0x55, XMM1, XMM1);
+    x86asm_addss_xmm_xmm(XMM1, XMM0);
+    x86asm_movaps_xmm_xmm(XMM2, XMM1);
+    x86asm_shufps_imm8_xmm_xmm(0xaa, XMM1, XMM1);
+    x86asm_addss_xmm_xmm(XMM1, XMM0);
+    x86asm_movaps_xmm_xmm(XMM2, XMM1);
+    x86asm_shufps_imm8_xmm_xmm(0xff, XMM1, XMM1);
+    x86asm_addss_xmm_xmm(XMM1, XMM0);
+
+    x86asm_mov_imm64_reg64((uintptr_t)inst->immed.dot4.dst, REG_RET);
+    x86asm_movss_xmm_indreg(XMM0, REG_RET);
+
+    ungrab_register(REG_RET);
+}
+
+static void emit_mat4_xform(void *cpu, struct jit_inst const *inst) {
+    static unsigned const bcast[4] = { 0x00, 0x55, 0xaa, 0xff };
+    unsigned col;
+
+    evict_register(REG_RET);
+    grab_register(REG_RET);
+    evict_register(EDX);
+    grab_register(EDX);
+
+    x86asm_mov_imm64_reg64((uintptr_t)inst->immed.mat4_xform.vec, EDX);
+    x86asm_mov_imm64_reg64((uintptr_t)inst->immed.mat4_xform.mat, REG_RET);
+
+    // XMM2 is the vector, XMM0 is the accumulator and XMM1 is scratch
+    x86asm_movups_indreg_xmm(EDX, XMM2);
+    for (col = 0; col < 4; col++) {
+        unsigned dst = col ? XMM1 : XMM0;
+        x86asm_movaps_xmm_xmm(XMM2, dst);
+        x86asm_shufps_imm8_xmm_xmm(bcast[col], dst, dst);
+        x86asm_movups_indreg_xmm(REG_RET, XMM3);
+        x86asm_mulps_xmm_xmm(XMM3, dst);
+        if (col)
+            x86asm_addps_xmm_xmm(XMM1, XMM0);
+        if (col != 3)
+            x86asm_addq_imm8_reg(4 * sizeof(float), REG_RET);
+    }
+    x86asm_movups_xmm_indreg(XMM0, EDX);
+
+    ungrab_register(EDX);
+    ungrab_register(REG_RET);
+}
+
 static void emit_shad(void *cpu, struct jit_inst const *inst) {
     unsigned slot_val = inst->immed.shad.slot_val;
     unsigned slot_shift_amt = inst->immed.shad.slot_shift_amt;
@@ -1362,21 +2255,208 @@ void ms_shadow_close(void) {
 #endif
 }
 
+/*
+ * emit the slow-path for a fastmem access.  This saves every volatile register
+ * which might be live at the access (except for the destination of a read),
+ * calls into the memory_map, restores everything and jumps back to the
+ * instruction after the access.
+ *
+ * If smc is true, this instead emits the stub which a write jumps to after
+ * storing to a page that may contain compiled code.
+ */
+static void emit_fastmem_stub(struct fastmem_pending const *site, bool smc) {
+    static unsigned const vol_regs[] = {
+#if defined(ABI_UNIX)
+        RAX, RCX, RDX, RSI, RDI, R8, R9, R10, R11
+#elif defined(ABI_MICROSOFT)
+        RAX, RCX, RDX, R8, R9, R10, R11
+#endif
+    };
+    unsigned const n_vol_regs = sizeof(vol_regs) / sizeof(vol_regs[0]);
+    bool is_read = !smc && site->tp == FASTMEM_READ_32;
+    unsigned idx;
+
+    // x86_64_align_stack and ms_shadow_* work off of rsp_offs
+    int rsp_offs_orig = rsp_offs;
+    rsp_offs = site->rsp_offs;
+
+    for (idx = 0; idx < n_vol_regs; idx++) {
+        if (!is_read || vol_regs[idx] != site->val_reg) {
+            x86asm_pushq_reg64(vol_regs[idx]);
+            rsp_offs -= 8;
+        }
+    }
+
+    int rsp_offs_saved = rsp_offs;
+
+    if (smc) {
+        x86asm_mov_reg32_reg32(site->addr_reg, REG_ARG0);
+        x86asm_andl_imm32_reg32(ADDR_AREA3_MASK, REG_ARG0);
+        x86asm_mov_reg32_reg32(REG_ARG0, REG_ARG1);
+        x86asm_addq_imm8_reg(sizeof(uint32_t) - 1, REG_ARG1);
+    } else if (is_read) {
+        x86asm_mov_reg32_reg32(site->addr_reg, REG_ARG1);
+    } else {
+        /*
+         * REG_RET was the arena base so it doesn't hold either of the
+         * operands; that makes it safe to use here to keep the source value
+         * from getting clobbered if it happens to be in REG_ARG1.
+         */
+        x86asm_mov_reg32_reg32(site->val_reg, REG_RET);
+        x86asm_mov_reg32_reg32(site->addr_reg, REG_ARG1);
+        x86asm_mov_reg32_reg32(REG_RET, REG_ARG2);
+    }
+    if (!smc)
+        x86asm_mov_imm64_reg64((uintptr_t)site->map, REG_ARG0);
+
+    ms_shadow_open();
+    x86_64_align_stack();
+    if (smc)
+        x86asm_call_ptr(code_cache_invalidate_ram);
+    else if (is_read)
+        x86asm_call_ptr(memory_map_read_32);
+    else
+        x86asm_call_ptr(memory_map_write_32);
+    ms_shadow_close();
+
+    if (is_read)
+        x86asm_mov_reg32_reg32(REG_RET, site->val_reg);
+
+    if (rsp_offs != rsp_offs_saved)
+        x86asm_addq_imm8_reg(rsp_offs_saved - rsp_offs, RSP);
+
+    for (idx = n_vol_regs; idx > 0; idx--) {
+        if (!is_read || vol_regs[idx - 1] != site->val_reg)
+            x86asm_popq_reg64(vol_regs[idx - 1]);
+    }
+
+    x86asm_jmp_rel32(site->resume_addr);
+
+    rsp_offs = rsp_offs_orig;
+}
+
+// point the jmp rel32 instruction at site to dst
+static void patch_jmp_rel32(void *site, void const *dst) {
+    intptr_t disp = (uint8_t const*)dst - ((uint8_t*)site + 5);
+    if (disp < INT32_MIN || disp > INT32_MAX)
+        RAISE_ERROR(ERROR_OVERFLOW);
+    int32_t disp32 = disp;
+    memcpy((uint8_t*)site + 1, &disp32, sizeof(disp32));
+}
+
+/*
+ * emit slow-paths for all the fastmem accesses in the block and register them
+ * with the fault handler.
+ */
+static void emit_fastmem_stubs(struct code_block_x86_64 *blk) {
+    unsigned idx;
+
+    if (!n_fastmem_pending)
+        return;
+
+    blk->fastmem_sites = (struct native_fastmem_site*)
+        calloc(n_fastmem_pending, sizeof(struct native_fastmem_site));
+    if (!blk->fastmem_sites)
+        RAISE_ERROR(ERROR_FAILED_ALLOC);
+    blk->n_fastmem_sites = n_fastmem_pending;
+
+    for (idx = 0; idx < n_fastmem_pending; idx++) {
+        struct fastmem_pending const *pending = fastmem_pending + idx;
+        struct native_fastmem_site *site = blk->fastmem_sites + idx;
+
+        site->fault_addr = pending->fault_addr;
+        site->patch_addr = pending->patch_addr;
+        site->stub = x86asm_get_outp();
+
+        emit_fastmem_stub(pending, false);
+        native_fastmem_add_site(site);
+
+        if (pending->tp == FASTMEM_WRITE_32) {
+            patch_jmp_rel32(pending->smc_jmp, x86asm_get_outp());
+            emit_fastmem_stub(pending, true);
+        }
+    }
+
+    n_fastmem_pending = 0;
+}
+
+/*
+ * returns native_check_cycles_shared's copy of the cycle check.  This has to be
+ * called before anything is emitted into out.
+ */
+static void *shared_check_cycles(void *cpu, struct code_block_x86_64 *out,
+                                 native_dispatch_compile_func compile_func) {
+    void *check_cycles = native_check_cycles_shared(cpu, compile_func);
+
+    /*
+     * the emitter grows its allocation in place, which won't work if the
+     * shared cycle check was just put right after it.
+     */
+    if ((uint8_t*)check_cycles > (uint8_t*)out->native) {
+        void *native = exec_mem_alloc(X86_64_ALLOC_SIZE);
+        if (!native) {
+            error_set_errno_val(errno);
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+        }
+        exec_mem_free(out->native);
+        out->native = native;
+    }
+
+    return check_cycles;
+}
+
+static bool has_side_exits(struct il_code_block const *il_blk) {
+    unsigned inst_no;
+    for (inst_no = 0; inst_no < il_blk->inst_count; inst_no++)
+        if (il_blk->inst_list[inst_no].op == JIT_OP_EXIT_COND ||
+            il_blk->inst_list[inst_no].op == JIT_OP_TRACE_JOIN)
+            return true;
+    return false;
+}
+
 void code_block_x86_64_compile(void *cpu, struct code_block_x86_64 *out,
                                struct il_code_block const *il_blk,
                                native_dispatch_compile_func compile_func,
                                unsigned cycle_count) {
     struct jit_inst const* inst = il_blk->inst_list;
     unsigned inst_count = il_blk->inst_count;
+    unsigned inst_no, dead_no;
     out->cycle_count = cycle_count;
 
+    remove_links(out);
+    remove_fastmem_sites(out);
+    n_fastmem_pending = 0;
+    n_exit_pcs = 0;
+
+    side_exit_check = NULL;
+    if (has_side_exits(il_blk)) {
+        if (!compile_func) {
+            // there's no way to tell the caller how many cycles ran
+            error_set_feature("side-exits in standalone blocks");
+            RAISE_ERROR(ERROR_UNIMPLEMENTED);
+        }
+        side_exit_check = shared_check_cycles(cpu, out, compile_func);
+    }
+
     x86asm_set_dst(out->native, X86_64_ALLOC_SIZE);
 
     reset_slots();
+    alloc_pass(il_blk);
 
     emit_stack_frame_open();
 
-    while (inst_count--) {
+    for (inst_no = 0; inst_no < inst_count; inst_no++) {
+        struct inst_alloc const *alloc = inst_alloc + inst_no;
+        int dst_slot = jit_inst_dst_slot(inst);
+        if (dst_slot >= 0)
+            slots[dst_slot].is_const = false;
+
+        if (alloc->range_start) {
+            slots[dst_slot].has_hint = alloc->has_hint;
+            slots[dst_slot].hint_reg = alloc->hint_reg;
+            slots[dst_slot].live_end = alloc->live_end;
+        }
+
         switch (inst->op) {
         case JIT_OP_FALLBACK:
             emit_fallback(cpu, inst);
@@ -1387,6 +2467,12 @@ void code_block_x86_64_compile(void *cpu, struct code_block_x86_64 *out,
         case JIT_JUMP_COND:
             emit_jump_cond(cpu, inst);
             break;
+        case JIT_OP_EXIT_COND:
+            emit_exit_cond(cpu, inst);
+            break;
+        case JIT_OP_TRACE_JOIN:
+            emit_trace_join(cpu, inst);
+            break;
         case JIT_SET_SLOT:
             emit_set_slot(cpu, inst);
             break;
@@ -1489,15 +2575,116 @@ void code_block_x86_64_compile(void *cpu, struct code_block_x86_64 *out,
         case JIT_OP_MUL_U32:
             emit_mul_u32(cpu, inst);
             break;
+        case JIT_OP_FADD:
+            emit_fadd(cpu, inst);
+            break;
+        case JIT_OP_FSUB:
+            emit_fsub(cpu, inst);
+            break;
+        case JIT_OP_FMUL:
+            emit_fmul(cpu, inst);
+            break;
+        case JIT_OP_FDIV:
+            emit_fdiv(cpu, inst);
+            break;
+        case JIT_OP_FSQRT:
+            emit_fsqrt(cpu, inst);
+            break;
+        case JIT_OP_FSET_EQ:
+            emit_fset_eq(cpu, inst);
+            break;
+        case JIT_OP_FSET_GT:
+            emit_fset_gt(cpu, inst);
+            break;
+        case JIT_OP_CVT_I32_F32:
+            emit_cvt_i32_f32(cpu, inst);
+            break;
+        case JIT_OP_CVT_F32_I32:
+            emit_cvt_f32_i32(cpu, inst);
+            break;
+        case JIT_OP_DOT4:
+            emit_dot4(cpu, inst);
+            break;
+        case JIT_OP_MAT4_XFORM:
+            emit_mat4_xform(cpu, inst);
+            break;
         case JIT_OP_SHAD:
             emit_shad(cpu, inst);
             break;
+        case JIT_OP_COUNT:
+            RAISE_ERROR(ERROR_INTEGRITY);
         }
+
+        for (dead_no = 0; dead_no < alloc->n_dead; dead_no++)
+            retire_slot(alloc->dead[dead_no]);
+
         inst++;
     }
 
+    alloc_stats.n_blocks++;
+    alloc_stats.n_spills += n_spills;
+    alloc_stats.n_reloads += n_reloads;
+    alloc_stats.n_moves += n_moves;
+    if (n_spills > alloc_stats.max_spills)
+        alloc_stats.max_spills = n_spills;
+    if (n_reloads > alloc_stats.max_reloads)
+        alloc_stats.max_reloads = n_reloads;
+
     x86asm_mov_imm32_reg32(out->cycle_count, REG_ARG0);
     x86asm_mov_reg32_reg32(REG_RET, REG_ARG1);
+    if (compile_func)
+        native_count_exit_emit(il_blk->n_guest_insts, false);
     emit_stack_frame_close();
-    native_check_cycles_emit(cpu, compile_func);
+
+    if (!compile_func) {
+        // standalone block (see native_dispatch_call_create)
+        x86asm_ret();
+    } else if (n_exit_pcs && !il_blk->mode_change) {
+        unsigned idx;
+        for (idx = 0; idx < n_exit_pcs; idx++)
+            out->links[idx].pc = exit_pcs[idx];
+        out->n_links = n_exit_pcs;
+        native_link_emit(cpu, compile_func, out->links, out->n_links);
+    } else {
+        native_check_cycles_emit(cpu, compile_func);
+    }
+
+    emit_fastmem_stubs(out);
+
+    out->bytes_used = (uint8_t*)x86asm_get_outp() - (uint8_t*)out->native;
+}
+
+void code_block_x86_64_compile_thunk(void *cpu,
+                                     struct code_block_x86_64 *out,
+                                     code_block_x86_64_thunk_func exec_fn,
+                                     void *arg,
+                                     native_dispatch_compile_func compile_func,
+                                     unsigned cycle_count) {
+    void *check_cycles = shared_check_cycles(cpu, out, compile_func);
+
+    out->cycle_count = cycle_count;
+
+    remove_links(out);
+    remove_fastmem_sites(out);
+
+    x86asm_set_dst(out->native, X86_64_ALLOC_SIZE);
+
+    /*
+     * the stack is 16-byte aligned on entry to a block, so there's no need to
+     * open a stack frame just to make one call.
+     */
+    x86asm_mov_imm64_reg64((uintptr_t)cpu, REG_ARG0);
+    x86asm_mov_imm64_reg64((uintptr_t)arg, REG_ARG1);
+    x86asm_mov_imm64_reg64((uintptr_t)(void*)compile_func, REG_ARG2);
+    x86asm_mov_imm64_reg64((uintptr_t)(void*)exec_fn, REG_RET);
+    x86asm_addq_imm8_reg(-32, RSP);
+    x86asm_call_reg(REG_RET);
+    x86asm_addq_imm8_reg(32, RSP);
+
+    x86asm_mov_imm32_reg32(cycle_count, REG_ARG0);
+    x86asm_mov_reg32_reg32(REG_RET, REG_ARG1);
+    x86asm_mov_imm64_reg64((uintptr_t)check_cycles, REG_RET);
+    x86asm_jmpq_reg64(REG_RET);
+
+    out->bytes_used = (uint8_t*)x86asm_get_outp() - (uint8_t*)out->native;
 }
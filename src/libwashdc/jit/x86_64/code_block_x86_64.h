@@ -26,6 +26,7 @@
 #include <stdint.h>
 
 #include "native_dispatch.h"
+#include "native_fastmem.h"
 
 #ifndef ENABLE_JIT_X86_64
 #error this file should not be built when the x86_64 JIT backend is disabled
@@ -38,17 +39,66 @@ struct code_block_x86_64 {
     void *native;
     uint32_t cycle_count;
     unsigned bytes_used;
+
+    // memory accesses in native which go through the fastmem arena
+    struct native_fastmem_site *fastmem_sites;
+    unsigned n_fastmem_sites;
+
+    // jumps to successor blocks whose addresses were known at compile-time
+    struct native_link links[NATIVE_DISPATCH_MAX_LINKS];
+    unsigned n_links;
+};
+
+/*
+ * register allocator statistics, summed over every block compiled so far.
+ * These count slots which had to be pushed onto the stack (spills), loaded
+ * back off of it (reloads) and moved from one register to another to make
+ * room for something else (moves).
+ */
+struct code_block_x86_64_stats {
+    unsigned long long n_blocks;
+    unsigned long long n_spills;
+    unsigned long long n_reloads;
+    unsigned long long n_moves;
+
+    // the most spills and reloads in any one block
+    unsigned max_spills;
+    unsigned max_reloads;
 };
 
+void code_block_x86_64_get_stats(struct code_block_x86_64_stats *stats);
+void
+code_block_x86_64_print_stats(struct code_block_x86_64_stats const *stats);
+
 void code_block_x86_64_init(struct code_block_x86_64 *blk);
 void code_block_x86_64_cleanup(struct code_block_x86_64 *blk);
 
+/*
+ * If compile_func is NULL then the block returns to its caller when it ends
+ * instead of jumping into the dispatcher.  See native_dispatch_call_create.
+ */
 void code_block_x86_64_compile(void *cpu,
                                struct code_block_x86_64 *out,
                                struct il_code_block const *il_blk,
                                native_dispatch_compile_func compile_func,
                                unsigned cycle_count);
 
+typedef reg32_t(*code_block_x86_64_thunk_func)(void *cpu, void *arg,
+                                               native_dispatch_compile_func);
+
+/*
+ * emit a stand-in for a block that hasn't been compiled to native code.  It
+ * calls exec_fn(cpu, arg, compile_func), which runs the block some other way
+ * and returns the new PC, and then it goes through the same cycle check and
+ * dispatch that a compiled block would (see native_check_cycles_shared).
+ */
+void code_block_x86_64_compile_thunk(void *cpu,
+                                     struct code_block_x86_64 *out,
+                                     code_block_x86_64_thunk_func exec_fn,
+                                     void *arg,
+                                     native_dispatch_compile_func compile_func,
+                                     unsigned cycle_count);
+
 /*
  * if the stack is not 16-byte aligned, make it 16-byte aligned.
  * This way, when the CALL instruction is issued the stack will be off from
@@ -25,6 +25,7 @@
 #endif
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <limits.h>
@@ -364,6 +365,17 @@ void x86asm_call(void *dst) {
     put32(offs);
 }
 
+void x86asm_jmp_rel32(void const *dst) {
+    put8(0xe9);
+
+    // the displacement is relative to the end of the instruction
+    ptrdiff_t offs = (uint8_t const*)dst - (outp + 4);
+    if (offs > INT32_MAX || offs < INT32_MIN)
+        RAISE_ERROR(ERROR_OVERFLOW);
+
+    put32((uint32_t)(int32_t)offs);
+}
+
 void x86asm_call_ptr(void *ptr) {
     x86asm_mov_imm64_reg64((uint64_t)(uintptr_t)ptr, R10);
     x86asm_call_reg(R10);
@@ -991,6 +1003,12 @@ void x86asm_addq_imm8_reg(uint8_t imm8, unsigned reg) {
     put8(imm8);
 }
 
+// addq $imm32, %<reg>
+void x86asm_addq_imm32_reg64(uint32_t imm32, unsigned reg) {
+    emit_mod_reg_rm(REX_W, 0x81, 3, 0, reg);
+    put32(imm32);
+}
+
 // movzxw (%<reg_src>), %<reg_dst>
 void x86asm_movzxw_indreg_reg(unsigned reg_src, unsigned reg_dst) {
     emit_mod_reg_rm_2(0, 0x0f, 0xb7, 0, reg_dst, reg_src);
@@ -1013,6 +1031,17 @@ void x86asm_incl_reg32(unsigned reg_no) {
     emit_mod_reg_rm(0, 0xff, 3, 0, reg_no);
 }
 
+// incq (%<reg_no>)
+void x86asm_incq_indreg64(unsigned reg_no) {
+    emit_mod_reg_rm(REX_W, 0xff, 0, 0, reg_no);
+}
+
+// addq $<imm32>, (%<reg_no>)
+void x86asm_addq_imm32_indreg64(uint32_t imm32, unsigned reg_no) {
+    emit_mod_reg_rm(REX_W, 0x81, 0, 0, reg_no);
+    put32(imm32);
+}
+
 // shll $<imm8>, %reg_no
 void x86asm_shll_imm8_reg32(unsigned imm8, unsigned reg_no) {
     emit_mod_reg_rm(0, 0xc1, 3, 4, reg_no);
@@ -1142,3 +1171,104 @@ void x86asm_setnzl_reg32(unsigned reg_no) {
 void x86asm_negl_reg32(unsigned reg_no) {
     emit_mod_reg_rm(0, 0xf7, 3, 3, reg_no);
 }
+
+void x86asm_jp_lbl8(struct x86asm_lbl8 *lbl) {
+    struct lbl_jmp_pt pt;
+    put8(0x7a);
+
+    pt.offs = (int8_t*)outp;
+    pt.rel_pos = outp + 1;
+
+    put8(0); // temporary placeholder for the offset value
+    x86asm_lbl8_push_jmp_pt(lbl, &pt);
+}
+
+/*
+ * SSE instructions.  The mandatory prefix (0x66 or 0xf3) has to go before the
+ * REX prefix, so it gets emitted ahead of emit_mod_reg_rm_2.
+ */
+
+// movd %<reg_src>, %<xmm_dst>
+void x86asm_movd_reg32_xmm(unsigned reg_src, unsigned xmm_dst) {
+    put8(0x66);
+    emit_mod_reg_rm_2(0, 0x0f, 0x6e, 3, xmm_dst, reg_src);
+}
+
+// movd %<xmm_src>, %<reg_dst>
+void x86asm_movd_xmm_reg32(unsigned xmm_src, unsigned reg_dst) {
+    put8(0x66);
+    emit_mod_reg_rm_2(0, 0x0f, 0x7e, 3, xmm_src, reg_dst);
+}
+
+void x86asm_addss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst) {
+    put8(0xf3);
+    emit_mod_reg_rm_2(0, 0x0f, 0x58, 3, xmm_dst, xmm_src);
+}
+
+void x86asm_subss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst) {
+    put8(0xf3);
+    emit_mod_reg_rm_2(0, 0x0f, 0x5c, 3, xmm_dst, xmm_src);
+}
+
+void x86asm_mulss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst) {
+    put8(0xf3);
+    emit_mod_reg_rm_2(0, 0x0f, 0x59, 3, xmm_dst, xmm_src);
+}
+
+void x86asm_divss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst) {
+    put8(0xf3);
+    emit_mod_reg_rm_2(0, 0x0f, 0x5e, 3, xmm_dst, xmm_src);
+}
+
+void x86asm_sqrtss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst) {
+    put8(0xf3);
+    emit_mod_reg_rm_2(0, 0x0f, 0x51, 3, xmm_dst, xmm_src);
+}
+
+void x86asm_ucomiss_xmm_xmm(unsigned xmm_rhs, unsigned xmm_lhs) {
+    emit_mod_reg_rm_2(0, 0x0f, 0x2e, 3, xmm_lhs, xmm_rhs);
+}
+
+void x86asm_cvtsi2ssl_reg32_xmm(unsigned reg_src, unsigned xmm_dst) {
+    put8(0xf3);
+    emit_mod_reg_rm_2(0, 0x0f, 0x2a, 3, xmm_dst, reg_src);
+}
+
+void x86asm_cvttss2sil_xmm_reg32(unsigned xmm_src, unsigned reg_dst) {
+    put8(0xf3);
+    emit_mod_reg_rm_2(0, 0x0f, 0x2c, 3, reg_dst, xmm_src);
+}
+
+void x86asm_movaps_xmm_xmm(unsigned xmm_src, unsigned xmm_dst) {
+    emit_mod_reg_rm_2(0, 0x0f, 0x28, 3, xmm_dst, xmm_src);
+}
+
+// movups (%<reg_src>), %<xmm_dst>
+void x86asm_movups_indreg_xmm(unsigned reg_src, unsigned xmm_dst) {
+    emit_mod_reg_rm_2(0, 0x0f, 0x10, 0, xmm_dst, reg_src);
+}
+
+// movups %<xmm_src>, (%<reg_dst>)
+void x86asm_movups_xmm_indreg(unsigned xmm_src, unsigned reg_dst) {
+    emit_mod_reg_rm_2(0, 0x0f, 0x11, 0, xmm_src, reg_dst);
+}
+
+// movss %<xmm_src>, (%<reg_dst>)
+void x86asm_movss_xmm_indreg(unsigned xmm_src, unsigned reg_dst) {
+    put8(0xf3);
+    emit_mod_reg_rm_2(0, 0x0f, 0x11, 0, xmm_src, reg_dst);
+}
+
+void x86asm_addps_xmm_xmm(unsigned xmm_src, unsigned xmm_dst) {
+    emit_mod_reg_rm_2(0, 0x0f, 0x58, 3, xmm_dst, xmm_src);
+}
+
+void x86asm_mulps_xmm_xmm(unsigned xmm_src, unsigned xmm_dst) {
+    emit_mod_reg_rm_2(0, 0x0f, 0x59, 3, xmm_dst, xmm_src);
+}
+
+void x86asm_shufps_imm8_xmm_xmm(unsigned imm8, unsigned xmm_src,
+                                unsigned xmm_dst) {
+    emit_mod_reg_rm_2(0, 0x0f, 0xc6, 3, xmm_dst, xmm_src);
+    put8(imm8);
+}
@@ -80,6 +80,23 @@
 #define R14W R14
 #define R15W R15
 
+#define XMM0  0
+#define XMM1  1
+#define XMM2  2
+#define XMM3  3
+#define XMM4  4
+#define XMM5  5
+#define XMM6  6
+#define XMM7  7
+#define XMM8  8
+#define XMM9  9
+#define XMM10 10
+#define XMM11 11
+#define XMM12 12
+#define XMM13 13
+#define XMM14 14
+#define XMM15 15
+
 #define SIB 4
 #define RIPREL 5
 
@@ -126,6 +143,9 @@ void x86asm_call_reg(unsigned reg_no);
 // call a given function.  dst must be within 2^32 bytes from the PC
 void x86asm_call(void *dst);
 
+// jmp to a given address.  dst must be within 2^31 bytes from the PC
+void x86asm_jmp_rel32(void const *dst);
+
 // move a 16-bit immediate into a general-purpose register
 void x86asm_mov_imm16_reg(unsigned imm16, unsigned reg_no);
 
@@ -235,6 +255,7 @@ void x86asm_add_imm32_eax(unsigned imm32);
 
 // addq $imm8, %<reg>
 void x86asm_addq_imm8_reg(uint8_t imm8, unsigned reg);
+void x86asm_addq_imm32_reg64(uint32_t imm32, unsigned reg);
 
 void x86asm_addq_reg64_reg64(unsigned reg_src, unsigned reg_dst);
 
@@ -391,6 +412,12 @@ void x86asm_xorl_imm32_reg32(unsigned imm32, unsigned reg_no);
 // incl %<reg_no>
 void x86asm_incl_reg32(unsigned reg_no);
 
+// incq (%<reg_no>)
+void x86asm_incq_indreg64(unsigned reg_no);
+
+// addq $<imm32>, (%<reg_no>)
+void x86asm_addq_imm32_indreg64(uint32_t imm32, unsigned reg_no);
+
 // shll $<imm8>, %reg_no
 void x86asm_shll_imm8_reg32(unsigned imm8, unsigned reg_no);
 
@@ -459,4 +486,75 @@ void x86asm_movb_reg_disp8_reg(unsigned reg_src, int disp8, unsigned reg_dst);
 void x86asm_jmp_disp8(int disp8);
 void x86asm_jmp_lbl8(struct x86asm_lbl8 *lbl);
 
+/*
+ * jp (pc+disp8)
+ *
+ * jump if the parity flag is set.  After a ucomiss, this means that one of
+ * the operands was NaN.
+ */
+void x86asm_jp_lbl8(struct x86asm_lbl8 *lbl);
+
+/*
+ * SSE.  These only ever operate on single-precision floats.  The XMM registers
+ * are not tracked by the register allocator, so JIT code must not expect their
+ * contents to survive beyond the IL operation which uses them.
+ */
+
+// movd %<reg_src>, %<xmm_dst>
+void x86asm_movd_reg32_xmm(unsigned reg_src, unsigned xmm_dst);
+
+// movd %<xmm_src>, %<reg_dst>
+void x86asm_movd_xmm_reg32(unsigned xmm_src, unsigned reg_dst);
+
+// addss %<xmm_src>, %<xmm_dst>
+void x86asm_addss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst);
+
+// subss %<xmm_src>, %<xmm_dst>
+void x86asm_subss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst);
+
+// mulss %<xmm_src>, %<xmm_dst>
+void x86asm_mulss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst);
+
+// divss %<xmm_src>, %<xmm_dst>
+void x86asm_divss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst);
+
+// sqrtss %<xmm_src>, %<xmm_dst>
+void x86asm_sqrtss_xmm_xmm(unsigned xmm_src, unsigned xmm_dst);
+
+/*
+ * ucomiss %<xmm_rhs>, %<xmm_lhs>
+ *
+ * unordered compare.  Like cmpl, the lhs goes on the right.  ZF, PF and CF
+ * are all set if either operand is NaN.
+ */
+void x86asm_ucomiss_xmm_xmm(unsigned xmm_rhs, unsigned xmm_lhs);
+
+// cvtsi2ssl %<reg_src>, %<xmm_dst>
+void x86asm_cvtsi2ssl_reg32_xmm(unsigned reg_src, unsigned xmm_dst);
+
+// cvttss2sil %<xmm_src>, %<reg_dst>
+void x86asm_cvttss2sil_xmm_reg32(unsigned xmm_src, unsigned reg_dst);
+
+// movaps %<xmm_src>, %<xmm_dst>
+void x86asm_movaps_xmm_xmm(unsigned xmm_src, unsigned xmm_dst);
+
+// movups (%<reg_src>), %<xmm_dst>
+void x86asm_movups_indreg_xmm(unsigned reg_src, unsigned xmm_dst);
+
+// movups %<xmm_src>, (%<reg_dst>)
+void x86asm_movups_xmm_indreg(unsigned xmm_src, unsigned reg_dst);
+
+// movss %<xmm_src>, (%<reg_dst>)
+void x86asm_movss_xmm_indreg(unsigned xmm_src, unsigned reg_dst);
+
+// addps %<xmm_src>, %<xmm_dst>
+void x86asm_addps_xmm_xmm(unsigned xmm_src, unsigned xmm_dst);
+
+// mulps %<xmm_src>, %<xmm_dst>
+void x86asm_mulps_xmm_xmm(unsigned xmm_src, unsigned xmm_dst);
+
+// shufps $<imm8>, %<xmm_src>, %<xmm_dst>
+void x86asm_shufps_imm8_xmm_xmm(unsigned imm8, unsigned xmm_src,
+                                unsigned xmm_dst);
+
 #endif
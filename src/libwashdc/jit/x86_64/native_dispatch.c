@@ -23,8 +23,11 @@
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "washdc/error.h"
+#include "log.h"
 #include "dc_sched.h"
 #include "exec_mem.h"
 #include "emit_x86_64.h"
@@ -40,9 +43,41 @@ static dc_cycle_stamp_t *sched_tgt;
 static dc_cycle_stamp_t *cycle_stamp;
 static struct dc_clock *native_dispatch_clk;
 
+/*
+ * transition counters.  These get incremented from JIT code, so they live in
+ * executable memory where they can be reached with a single mov/inc pair.
+ */
+struct native_dispatch_counters {
+    uint64_t n_static;     // block exits to a PC that was known at compile-time
+    uint64_t n_dispatched; // block exits that went through the hash table
+
+    // see native_count_exit_emit
+    uint64_t n_native_runs;
+    uint64_t n_guest_insts;
+    uint64_t n_side_exits;
+};
+static struct native_dispatch_counters *counters;
+
+// number of times a link had to be (re)established by native_link_resolve
+static uint64_t n_link_resolves;
+
+// every link that belongs to a compiled block, linked or not
+static struct native_link *link_list;
+
+// see native_check_cycles_shared
+static void *shared_check;
+static void *shared_check_ctx;
+static native_dispatch_compile_func shared_check_handler;
+
 static void native_dispatch_emit(void *ctx_ptr,
                                  native_dispatch_compile_func compile_handler);
 
+static void emit_cycle_check(struct x86asm_lbl8 *dont_return);
+static void emit_count(uint64_t *counter);
+static void native_link_set_target(struct native_link *link, void const *dst);
+static void *native_link_resolve(struct native_link *link, void *ctx_ptr,
+                                 native_dispatch_compile_func compile_handler);
+
 static void load_quad_into_reg(void *qptr, unsigned reg_no);
 static void store_quad_from_reg(void *qptr, unsigned reg_no,
                                 unsigned clobber_reg);
@@ -51,6 +86,9 @@ void native_dispatch_init(struct dc_clock *clk) {
     native_dispatch_clk = clk;
     sched_tgt = exec_mem_alloc(sizeof(*sched_tgt));
     cycle_stamp = exec_mem_alloc(sizeof(*cycle_stamp));
+    counters = exec_mem_alloc(sizeof(*counters));
+    memset(counters, 0, sizeof(*counters));
+    n_link_resolves = 0;
 
     clock_set_target_pointer(clk, sched_tgt);
     clock_set_cycle_stamp_pointer(clk, cycle_stamp);
@@ -59,6 +97,10 @@ void native_dispatch_init(struct dc_clock *clk) {
 void native_dispatch_cleanup(void) {
     // TODO: free all executable memory pointers
     clock_set_target_pointer(native_dispatch_clk, NULL);
+    if (shared_check)
+        exec_mem_free(shared_check);
+    shared_check = NULL;
+    exec_mem_free(counters);
     exec_mem_free(cycle_stamp);
     exec_mem_free(sched_tgt);
 }
@@ -121,6 +163,64 @@ native_dispatch_entry_create(void *ctx_ptr,
     return entry;
 }
 
+native_dispatch_call_func native_dispatch_call_create(void) {
+    void *entry = exec_mem_alloc(BASIC_ALLOC);
+    x86asm_set_dst(entry, BASIC_ALLOC);
+
+#if defined(ABI_UNIX)
+    x86asm_pushq_reg64(RBP);
+    x86asm_mov_reg64_reg64(RSP, RBP);
+    x86asm_pushq_reg64(RBX);
+    x86asm_pushq_reg64(R12);
+    x86asm_pushq_reg64(R13);
+    x86asm_pushq_reg64(R14);
+    x86asm_pushq_reg64(R15);
+#elif defined(ABI_MICROSOFT)
+    x86asm_pushq_reg64(RBP);
+    x86asm_mov_reg64_reg64(RSP, RBP);
+    x86asm_pushq_reg64(RBX);
+    x86asm_pushq_reg64(RDI);
+    x86asm_pushq_reg64(RSI);
+    x86asm_pushq_reg64(R12);
+    x86asm_pushq_reg64(R13);
+    x86asm_pushq_reg64(R14);
+    x86asm_pushq_reg64(R15);
+#else
+#error unknown abi
+#endif
+
+    /*
+     * The stack is 8 bytes off from a 16-byte boundary here (see the comment
+     * in native_dispatch_entry_create).  The CALL pushes another 8 bytes, so
+     * the code block starts out perfectly aligned like it expects to.
+     */
+    x86asm_call_reg(REG_ARG0);
+
+#if defined(ABI_UNIX)
+    x86asm_popq_reg64(R15);
+    x86asm_popq_reg64(R14);
+    x86asm_popq_reg64(R13);
+    x86asm_popq_reg64(R12);
+    x86asm_popq_reg64(RBX);
+    x86asm_popq_reg64(RBP);
+#elif defined(ABI_MICROSOFT)
+    x86asm_popq_reg64(R15);
+    x86asm_popq_reg64(R14);
+    x86asm_popq_reg64(R13);
+    x86asm_popq_reg64(R12);
+    x86asm_popq_reg64(RSI);
+    x86asm_popq_reg64(RDI);
+    x86asm_popq_reg64(RBX);
+    x86asm_popq_reg64(RBP);
+#else
+#error unknown abi
+#endif
+
+    x86asm_ret();
+
+    return (native_dispatch_call_func)entry;
+}
+
 static void native_dispatch_emit(void *ctx_ptr,
                                  native_dispatch_compile_func compile_handler) {
     struct x86asm_lbl8 check_valid_bit, code_cache_slow_path, have_valid_ent,
@@ -133,14 +233,15 @@ static void native_dispatch_emit(void *ctx_ptr,
      *
      * REGISTER ALLOCATION:
      *    RBX points to the struct cache_entry
-     *    EDI holds the 32-bit SH4 PC address
+     *    RDI holds the 64-bit code cache key (the SH4 PC in the lower 32 bits
+     *        and the mode in the upper 32 bits)
      *    ECX holds the index into the code_cache_tbl
      *
      *    All other registers are considered to be "temporary" registers whose
      *    values change often.
      */
 
-    // 32-bit SH4 PC address
+    // 32-bit SH4 PC address, which gets turned into the code cache key
     static unsigned const pc_reg = REG_ARG0;
     static unsigned const cachep_reg = REG_NONVOL0;
     static unsigned const tmp_reg_1 = REG_NONVOL1;
@@ -155,6 +256,17 @@ static void native_dispatch_emit(void *ctx_ptr,
     x86asm_lbl8_init(&have_valid_ent);
     x86asm_lbl8_init(&compile);
 
+    // zero-extend the PC and OR in the mode (see code_cache_key_make)
+    x86asm_mov_reg32_reg32(pc_reg, pc_reg);
+    if (code_cache_mode_src) {
+        x86asm_mov_imm64_reg64((uintptr_t)(void*)code_cache_mode_src,
+                               tmp_reg_1);
+        x86asm_mov_indreg32_reg32(tmp_reg_1, tmp_reg_1);
+        x86asm_andl_imm32_reg32(code_cache_mode_mask, tmp_reg_1);
+        x86asm_sal_imm8_reg64(32, tmp_reg_1);
+        x86asm_or_reg64_reg64(tmp_reg_1, pc_reg);
+    }
+
     x86asm_mov_imm64_reg64((uintptr_t)(void*)code_cache_tbl, code_cache_tbl_ptr_reg);
 
     x86asm_mov_reg32_reg32(pc_reg, code_hash_reg);
@@ -166,12 +278,14 @@ static void native_dispatch_emit(void *ctx_ptr,
     x86asm_testq_reg64_reg64(cachep_reg, cachep_reg);
     x86asm_jz_lbl8(&code_cache_slow_path);
 
-    // now check the address against the one that's still in pc_reg
+    // now check the key against the one that's still in pc_reg
+    static_assert(sizeof(code_cache_key) == 8,
+                  "code_cache_key is not a quadword!");
     size_t const addr_offs = offsetof(struct cache_entry, node.key);
     if (addr_offs >= 256)
         RAISE_ERROR(ERROR_INTEGRITY); // this will never happen
-    x86asm_movl_disp8_reg_reg(addr_offs, cachep_reg, tmp_reg_1);
-    x86asm_cmpl_reg32_reg32(tmp_reg_1, pc_reg);
+    x86asm_movq_disp8_reg_reg(addr_offs, cachep_reg, tmp_reg_1);
+    x86asm_cmpq_reg64_reg64(tmp_reg_1, pc_reg);
     x86asm_jnz_lbl8(&code_cache_slow_path);// not equal
 
     x86asm_lbl8_define(&check_valid_bit);
@@ -184,7 +298,7 @@ static void native_dispatch_emit(void *ctx_ptr,
     x86asm_lbl8_define(&compile);
 
     /*
-     * the PC should still be in pc_reg.
+     * the key should still be in pc_reg; its lower 32 bits are the PC.
      * this is the last time we'll need it so there's no need to store it
      * anywhere
      */
@@ -218,12 +332,12 @@ static void native_dispatch_emit(void *ctx_ptr,
 
     // call code_cache_find_slow
     x86asm_mov_imm64_reg64((uintptr_t)(void*)&code_cache_find_slow, func_reg);
-    x86asm_mov_reg32_reg32(pc_reg, tmp_reg_1);
+    x86asm_mov_reg64_reg64(pc_reg, tmp_reg_1);
     x86asm_mov_reg64_reg64(code_hash_reg, tmp_reg_2);
     x86asm_addq_imm8_reg(-32, RSP);
     x86asm_call_reg(func_reg);
     x86asm_addq_imm8_reg(32, RSP);
-    x86asm_mov_reg32_reg32(tmp_reg_1, pc_reg);
+    x86asm_mov_reg64_reg64(tmp_reg_1, pc_reg);
     x86asm_mov_reg64_reg64(tmp_reg_2, code_hash_reg);
     x86asm_mov_reg64_reg64(ret_reg, cachep_reg);
 
@@ -239,25 +353,34 @@ static void native_dispatch_emit(void *ctx_ptr,
     x86asm_lbl8_cleanup(&check_valid_bit);
 }
 
-void native_check_cycles_emit(void *ctx_ptr,
-                              native_dispatch_compile_func compile_handler) {
-    struct x86asm_lbl8 dont_return;
-    x86asm_lbl8_init(&dont_return);
-
+/*
+ * register usage for the cycle-check that runs at the end of every code block.
+ * On entry cycle_count_reg holds the cycle count of the block that just ran
+ * and jump_reg holds the new PC.
+ */
+static unsigned const sched_tgt_reg = REG_NONVOL0;
+static unsigned const cycle_count_reg = REG_ARG0;
+static unsigned const jump_reg = REG_ARG1;
+static unsigned const cycle_stamp_reg = REG_RET;
+
+/*
+ * emit the part of the cycle-check which is common to native_check_cycles_emit
+ * and native_link_emit.  If it's time to run an event handler then the
+ * emitted code returns the new PC to native_dispatch_entry's caller.
+ * Otherwise it jumps to dont_return with the new cycle stamp in
+ * cycle_count_reg.
+ */
+static void emit_cycle_check(struct x86asm_lbl8 *dont_return) {
     static_assert(sizeof(dc_cycle_stamp_t) == 8,
                   "dc_cycle_stamp_t is not a quadword!");
 
-    static unsigned const sched_tgt_reg = REG_NONVOL0;
-    static unsigned const cycle_count_reg = REG_ARG0;
-    static unsigned const jump_reg = REG_ARG1;
-    static unsigned const cycle_stamp_reg = REG_RET;
     static unsigned const ret_reg = REG_RET;
 
     load_quad_into_reg(sched_tgt, sched_tgt_reg);
     load_quad_into_reg(cycle_stamp, cycle_stamp_reg);
     x86asm_addq_reg64_reg64(cycle_stamp_reg, cycle_count_reg);
     x86asm_cmpq_reg64_reg64(sched_tgt_reg, cycle_count_reg);
-    x86asm_jb_lbl8(&dont_return);
+    x86asm_jb_lbl8(dont_return);
 
     // return PC
     x86asm_mov_reg32_reg32(jump_reg, ret_reg);
@@ -289,11 +412,26 @@ void native_check_cycles_emit(void *ctx_ptr,
 #endif
 
     x86asm_ret();
+}
+
+// increment a 64-bit counter.  This clobbers REG_VOL1.
+static void emit_count(uint64_t *counter) {
+    x86asm_mov_imm64_reg64((uintptr_t)(void*)counter, REG_VOL1);
+    x86asm_incq_indreg64(REG_VOL1);
+}
+
+void native_check_cycles_emit(void *ctx_ptr,
+                              native_dispatch_compile_func compile_handler) {
+    struct x86asm_lbl8 dont_return;
+    x86asm_lbl8_init(&dont_return);
+
+    emit_cycle_check(&dont_return);
 
     // continue
     x86asm_lbl8_define(&dont_return);
 
     store_quad_from_reg(cycle_stamp, cycle_count_reg, REG_VOL1);
+    emit_count(&counters->n_dispatched);
 
     // call native_dispatch
     x86asm_mov_reg32_reg32(jump_reg, REG_ARG0);
@@ -302,6 +440,242 @@ void native_check_cycles_emit(void *ctx_ptr,
     x86asm_lbl8_cleanup(&dont_return);
 }
 
+void native_count_exit_emit(unsigned n_guest_insts, bool side_exit) {
+    emit_count(&counters->n_native_runs);
+    if (side_exit)
+        emit_count(&counters->n_side_exits);
+    if (n_guest_insts) {
+        x86asm_mov_imm64_reg64((uintptr_t)(void*)&counters->n_guest_insts,
+                               REG_VOL1);
+        x86asm_addq_imm32_indreg64(n_guest_insts, REG_VOL1);
+    }
+}
+
+void native_cycles_left_emit(unsigned cycle_count, unsigned reg_tgt,
+                             unsigned reg_stamp, struct x86asm_lbl8 *have_time) {
+    load_quad_into_reg(sched_tgt, reg_tgt);
+    load_quad_into_reg(cycle_stamp, reg_stamp);
+    x86asm_addq_imm32_reg64(cycle_count, reg_stamp);
+    x86asm_cmpq_reg64_reg64(reg_tgt, reg_stamp);
+    x86asm_jb_lbl8(have_time);
+}
+
+void *native_check_cycles_shared(void *ctx_ptr,
+                                 native_dispatch_compile_func compile_handler) {
+    if (shared_check && shared_check_ctx == ctx_ptr &&
+        shared_check_handler == compile_handler)
+        return shared_check;
+
+    /*
+     * the old copy can't be freed since there might still be code that jumps
+     * to it.
+     */
+    shared_check = exec_mem_alloc(BASIC_ALLOC);
+    shared_check_ctx = ctx_ptr;
+    shared_check_handler = compile_handler;
+    x86asm_set_dst(shared_check, BASIC_ALLOC);
+    native_check_cycles_emit(ctx_ptr, compile_handler);
+
+    return shared_check;
+}
+
+void native_link_emit(void *ctx_ptr,
+                      native_dispatch_compile_func compile_handler,
+                      struct native_link *links, unsigned n_links) {
+    struct x86asm_lbl8 dont_return;
+    unsigned idx;
+
+    if (!n_links || n_links > NATIVE_DISPATCH_MAX_LINKS)
+        RAISE_ERROR(ERROR_INTEGRITY);
+
+    x86asm_lbl8_init(&dont_return);
+
+    emit_cycle_check(&dont_return);
+
+    x86asm_lbl8_define(&dont_return);
+
+    store_quad_from_reg(cycle_stamp, cycle_count_reg, REG_VOL1);
+    emit_count(&counters->n_static);
+
+    /*
+     * pick the link whose PC matches jump_reg.  The last link is taken
+     * unconditionally since the caller guarantees that the new PC is one of
+     * the links' PCs.
+     */
+    for (idx = 0; idx < n_links; idx++) {
+        struct x86asm_lbl8 next_link;
+        bool last = (idx == n_links - 1);
+
+        x86asm_lbl8_init(&next_link);
+
+        if (!last) {
+            x86asm_cmpl_imm32_reg32(links[idx].pc, jump_reg);
+            x86asm_jnz_lbl8(&next_link);
+        }
+
+        // placeholder, this gets pointed at the unlinked path below
+        links[idx].jmp_site = x86asm_get_outp();
+        x86asm_jmp_rel32(links[idx].jmp_site);
+
+        if (!last)
+            x86asm_lbl8_define(&next_link);
+        x86asm_lbl8_cleanup(&next_link);
+    }
+
+    /*
+     * unlinked path: ask native_link_resolve to find (or compile) the
+     * destination block, patch the link and then jump to the block.
+     */
+    for (idx = 0; idx < n_links; idx++) {
+        struct native_link *link = links + idx;
+
+        link->unlinked = x86asm_get_outp();
+        x86asm_mov_imm64_reg64((uintptr_t)(void*)link, REG_ARG0);
+        x86asm_mov_imm64_reg64((uintptr_t)ctx_ptr, REG_ARG1);
+        x86asm_mov_imm64_reg64((uintptr_t)(void*)compile_handler, REG_ARG2);
+        x86asm_mov_imm64_reg64((uintptr_t)(void*)native_link_resolve, REG_RET);
+        x86asm_addq_imm8_reg(-32, RSP);
+        x86asm_call_reg(REG_RET);
+        x86asm_addq_imm8_reg(32, RSP);
+        x86asm_jmpq_reg64(REG_RET);
+
+        native_link_set_target(link, link->unlinked);
+        link->linked = false;
+        link->in_next = NULL;
+        link->in_pprev = NULL;
+
+        link->pprev = &link_list;
+        link->next = link_list;
+        if (link_list)
+            link_list->pprev = &link->next;
+        link_list = link;
+    }
+
+    x86asm_lbl8_cleanup(&dont_return);
+}
+
+static void native_link_set_target(struct native_link *link, void const *dst) {
+    uint8_t *site = (uint8_t*)link->jmp_site;
+    intptr_t disp = (uint8_t const*)dst - (site + 5);
+    if (disp < INT32_MIN || disp > INT32_MAX)
+        RAISE_ERROR(ERROR_OVERFLOW);
+    int32_t disp32 = disp;
+    memcpy(site + 1, &disp32, sizeof(disp32));
+}
+
+static void *native_link_resolve(struct native_link *link, void *ctx_ptr,
+                                 native_dispatch_compile_func compile_handler) {
+    struct cache_entry *entry = code_cache_find(link->pc);
+
+    if (!entry->valid) {
+        compile_handler(ctx_ptr, &entry->blk.x86_64, link->pc);
+        entry->valid = 1;
+    }
+
+    void *native = entry->blk.x86_64.native;
+    n_link_resolves++;
+
+    /*
+     * cold blocks are only thunks that will be replaced once the block gets
+     * promoted (see struct code_cache_tier), so they don't get linked to.
+     */
+    if (entry->tier.cold)
+        return native;
+
+    native_link_set_target(link, native);
+    link->linked = true;
+
+    link->in_pprev = &entry->links_in;
+    link->in_next = entry->links_in;
+    if (entry->links_in)
+        entry->links_in->in_pprev = &link->in_next;
+    entry->links_in = link;
+
+    return native;
+}
+
+static void native_link_remove_in(struct native_link *link) {
+    if (!link->in_pprev)
+        return;
+    *link->in_pprev = link->in_next;
+    if (link->in_next)
+        link->in_next->in_pprev = link->in_pprev;
+    link->in_next = NULL;
+    link->in_pprev = NULL;
+}
+
+static void native_link_unlink(struct native_link *link) {
+    if (link->linked) {
+        native_link_set_target(link, link->unlinked);
+        link->linked = false;
+    }
+    native_link_remove_in(link);
+}
+
+void native_link_remove(struct native_link *link) {
+    native_link_remove_in(link);
+
+    if (!link->pprev)
+        return;
+    *link->pprev = link->next;
+    if (link->next)
+        link->next->pprev = link->pprev;
+    link->next = NULL;
+    link->pprev = NULL;
+}
+
+void native_dispatch_unlink_all(void) {
+    struct native_link *link;
+    for (link = link_list; link; link = link->next)
+        native_link_unlink(link);
+}
+
+void native_dispatch_unlink_entry(struct cache_entry *ent) {
+    while (ent->links_in)
+        native_link_unlink(ent->links_in);
+}
+
+void native_dispatch_get_stats(struct native_dispatch_stats *stats) {
+    struct native_link *link;
+
+    memset(stats, 0, sizeof(*stats));
+
+    /*
+     * every static transition which didn't need native_link_resolve went
+     * straight through a link.  Resolving is a lookup like any other, so it
+     * counts as dispatched.
+     */
+    stats->n_linked = counters->n_static - n_link_resolves;
+    stats->n_dispatched = counters->n_dispatched + n_link_resolves;
+    stats->n_link_resolves = n_link_resolves;
+    stats->n_native_runs = counters->n_native_runs;
+    stats->n_guest_insts = counters->n_guest_insts;
+    stats->n_side_exits = counters->n_side_exits;
+
+    for (link = link_list; link; link = link->next) {
+        stats->n_links++;
+        if (link->linked)
+            stats->n_links_active++;
+    }
+}
+
+void native_dispatch_print_stats(struct native_dispatch_stats const *stats) {
+    LOG_INFO("native dispatch: %llu linked transitions, %llu dispatched "
+             "transitions\n", (unsigned long long)stats->n_linked,
+             (unsigned long long)stats->n_dispatched);
+    LOG_INFO("native dispatch: %llu links resolved, %u of %u links currently "
+             "established\n", (unsigned long long)stats->n_link_resolves,
+             stats->n_links_active, stats->n_links);
+
+    if (stats->n_native_runs) {
+        LOG_INFO("native dispatch: %.2f guest instructions per native entry "
+                 "over %llu entries, %llu side-exits taken\n",
+                 (double)stats->n_guest_insts / (double)stats->n_native_runs,
+                 (unsigned long long)stats->n_native_runs,
+                 (unsigned long long)stats->n_side_exits);
+    }
+}
+
 static void load_quad_into_reg(void *qptr, unsigned reg_no) {
     intptr_t qaddr = (uintptr_t)qptr;
     intptr_t rip = (uintptr_t)x86asm_get_outp() + 7;
@@ -23,6 +23,7 @@
 #ifndef NATIVE_DISPATCH_H_
 #define NATIVE_DISPATCH_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "washdc/types.h"
@@ -34,6 +35,7 @@ void native_dispatch_cleanup(void);
 typedef uint32_t(*native_dispatch_entry_func)(uint32_t);
 
 struct il_code_block;
+struct x86asm_lbl8;
 typedef void(*native_dispatch_compile_func)(void*,void*,addr32_t);
 
 /*
@@ -52,6 +54,92 @@ typedef void(*native_dispatch_compile_func)(void*,void*,addr32_t);
 void native_check_cycles_emit(void *ctx_ptr,
                               native_dispatch_compile_func compile_handler);
 
+/*
+ * returns a shared copy of the code native_check_cycles_emit emits, which can
+ * be jumped to with the same inputs.  This is for code that is too small for
+ * it to make sense to inline the dispatcher into it.  Only one copy is kept,
+ * so it gets regenerated if ctx_ptr or compile_handler change.  This must not
+ * be called while other code is being emitted.
+ */
+void *native_check_cycles_shared(void *ctx_ptr,
+                                 native_dispatch_compile_func compile_handler);
+
+/*
+ * emit code that counts one run of a native block which executed
+ * n_guest_insts guest instructions.  Blocks emit this at every point where they
+ * leave, and side_exit is true for the ones in the middle of a trace.  This
+ * clobbers REG_VOL1.
+ */
+void native_count_exit_emit(unsigned n_guest_insts, bool side_exit);
+
+/*
+ * emit code that jumps to have_time if the scheduler's next event is still
+ * more than cycle_count cycles away.  Otherwise it falls through.  reg_tgt and
+ * reg_stamp get clobbered.
+ */
+void native_cycles_left_emit(unsigned cycle_count, unsigned reg_tgt,
+                             unsigned reg_stamp, struct x86asm_lbl8 *have_time);
+
+/*
+ * A link is the jump at the end of a code block to a successor whose address
+ * was already known when the block was compiled (BRA, BSR, BT/BF and
+ * fall-through).  Links start out pointing at a stub which looks up the
+ * successor in the code cache and then patches the jump so that subsequent
+ * transitions go straight to the successor without touching the dispatcher.
+ * native_dispatch_unlink_all points every link back at its stub; it must be
+ * called whenever the whole code cache is invalidated.  An established link is
+ * also kept on its successor's links_in list so that native_dispatch_unlink_entry
+ * can undo only the links that go to one cache entry when it gets replaced.
+ *
+ * The cycle check still runs before every link is taken.
+ */
+#define NATIVE_DISPATCH_MAX_LINKS 2
+
+struct native_link {
+    void *jmp_site; // the jmp rel32 instruction which gets patched
+    void *unlinked; // where jmp_site points while the link isn't established
+    addr32_t pc;
+    bool linked;
+
+    struct native_link *next, **pprev;
+
+    // links_in list of the cache entry this link currently jumps to
+    struct native_link *in_next, **in_pprev;
+};
+
+/*
+ * This is the linking equivalent of native_check_cycles_emit.  It expects the
+ * same inputs, and the new PC in ESI must be the pc of one of the links.
+ */
+void native_link_emit(void *ctx_ptr,
+                      native_dispatch_compile_func compile_handler,
+                      struct native_link *links, unsigned n_links);
+
+// must be called before the code containing link is freed
+void native_link_remove(struct native_link *link);
+
+void native_dispatch_unlink_all(void);
+
+struct cache_entry;
+
+// unlink every link which currently jumps to ent
+void native_dispatch_unlink_entry(struct cache_entry *ent);
+
+struct native_dispatch_stats {
+    uint64_t n_linked;     // block transitions through an established link
+    uint64_t n_dispatched; // block transitions which looked up the code cache
+    uint64_t n_link_resolves;
+    unsigned n_links, n_links_active;
+
+    // runs of native blocks, and how many guest instructions they executed
+    uint64_t n_native_runs;
+    uint64_t n_guest_insts;
+    uint64_t n_side_exits;
+};
+
+void native_dispatch_get_stats(struct native_dispatch_stats *stats);
+void native_dispatch_print_stats(struct native_dispatch_stats const *stats);
+
 /*
  * native_dispatch_entry is a generated function which saves all call-stack
  * registers which ought to be saved, calls native_dispatch, and then returns
@@ -62,4 +150,16 @@ native_dispatch_entry_func
 native_dispatch_entry_create(void *ctx_ptr,
                              native_dispatch_compile_func compile_handler);
 
+/*
+ * Code blocks which were compiled without a compile_handler (see
+ * code_block_x86_64_compile) return to their caller instead of going through
+ * the dispatcher.  native_dispatch_call_create generates a function that
+ * C code can use to run one of those blocks.  It takes the block's native
+ * pointer and returns the new PC.  This is how CPUs other than the SH4 (which
+ * owns the dispatcher and the code cache) run their blocks.
+ */
+typedef uint32_t(*native_dispatch_call_func)(void*);
+
+native_dispatch_call_func native_dispatch_call_create(void);
+
 #endif
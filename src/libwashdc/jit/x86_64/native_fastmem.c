@@ -0,0 +1,282 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef ENABLE_JIT_X86_64
+#error this file should not be built when the x86_64 JIT backend is disabled
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+
+#include "log.h"
+#include "config.h"
+#include "memory.h"
+#include "washdc/error.h"
+
+#include "native_fastmem.h"
+
+#if defined(__linux__)
+#define FASTMEM_CTX_PC(ctx) ((ctx)->uc_mcontext.gregs[REG_RIP])
+#elif defined(__FreeBSD__)
+#define FASTMEM_CTX_PC(ctx) ((ctx)->uc_mcontext.mc_rip)
+#endif
+
+#define FASTMEM_ARENA_LEN (((uint64_t)1) << 32)
+
+#define SITE_TBL_SHIFT 12
+#define SITE_TBL_LEN (1 << SITE_TBL_SHIFT)
+#define SITE_TBL_MASK (SITE_TBL_LEN - 1)
+
+// base of the arena, or NULL if there isn't one
+static uint8_t *arena;
+static struct memory_map const *arena_map;
+
+static struct native_fastmem_site *site_tbl[SITE_TBL_LEN];
+
+static unsigned n_sites;
+static unsigned volatile n_patched;
+
+#ifdef FASTMEM_CTX_PC
+static bool handler_installed;
+static struct sigaction old_segv_act;
+#endif
+
+static unsigned site_hash(void const *fault_addr) {
+    uintptr_t val = (uintptr_t)fault_addr;
+    return (val ^ (val >> SITE_TBL_SHIFT)) & SITE_TBL_MASK;
+}
+
+/*
+ * overwrite the start of the access sequence with a jmp to the slow-path.
+ * exec_mem is always writable so there's no need to mprotect here.
+ */
+static void patch_site(struct native_fastmem_site *site) {
+    uint8_t *patch = (uint8_t*)site->patch_addr;
+    int32_t disp = (int32_t)((uint8_t const*)site->stub - (patch + 5));
+
+    memcpy(patch + 1, &disp, sizeof(disp));
+    patch[0] = 0xe9;
+
+    n_patched++;
+}
+
+#ifdef FASTMEM_CTX_PC
+static void fastmem_on_segv(int sig, siginfo_t *info, void *ctx_ptr) {
+    ucontext_t *ctx = (ucontext_t*)ctx_ptr;
+    uintptr_t fault = (uintptr_t)info->si_addr;
+
+    if (arena && fault >= (uintptr_t)arena &&
+        fault - (uintptr_t)arena < FASTMEM_ARENA_LEN) {
+        void const *pc = (void const*)(uintptr_t)FASTMEM_CTX_PC(ctx);
+        struct native_fastmem_site *site;
+        for (site = site_tbl[site_hash(pc)]; site; site = site->next) {
+            if (site->fault_addr == pc) {
+                patch_site(site);
+                FASTMEM_CTX_PC(ctx) = (uintptr_t)site->stub;
+                return;
+            }
+        }
+    }
+
+    /*
+     * This isn't ours, so hand it off to whatever was there before.  If that
+     * was the default action then restoring it and returning will re-execute
+     * the faulting instruction and crash the same way it would have if fastmem
+     * wasn't around.
+     */
+    if (old_segv_act.sa_flags & SA_SIGINFO) {
+        old_segv_act.sa_sigaction(sig, info, ctx_ptr);
+    } else if (old_segv_act.sa_handler == SIG_DFL ||
+               old_segv_act.sa_handler == SIG_IGN) {
+        signal(sig, SIG_DFL);
+    } else {
+        old_segv_act.sa_handler(sig);
+    }
+}
+#endif
+
+void native_fastmem_init(void) {
+    memset(site_tbl, 0, sizeof(site_tbl));
+    n_sites = 0;
+    n_patched = 0;
+    arena = NULL;
+    arena_map = NULL;
+
+    if (!config_get_fastmem())
+        return;
+
+#ifdef FASTMEM_CTX_PC
+    struct sigaction act;
+    memset(&act, 0, sizeof(act));
+    act.sa_sigaction = fastmem_on_segv;
+    act.sa_flags = SA_SIGINFO;
+    sigemptyset(&act.sa_mask);
+
+    if (sigaction(SIGSEGV, &act, &old_segv_act) == 0)
+        handler_installed = true;
+    else
+        LOG_ERROR("fastmem: unable to install SIGSEGV handler\n");
+#else
+    LOG_WARN("fastmem is not supported on this platform\n");
+#endif
+}
+
+void native_fastmem_cleanup(void) {
+    if (arena)
+        munmap(arena, FASTMEM_ARENA_LEN);
+    arena = NULL;
+    arena_map = NULL;
+
+#ifdef FASTMEM_CTX_PC
+    if (handler_installed)
+        sigaction(SIGSEGV, &old_segv_act, NULL);
+    handler_installed = false;
+#endif
+}
+
+/*
+ * returns the system memory backing the given page, or NULL if the page isn't
+ * backed by something that can be mapped into the arena.
+ */
+static struct Memory const *page_ram(struct memory_map_page const *page) {
+    if (page->subpages || !page->host || !page->region ||
+        page->region->id != MEMORY_MAP_REGION_RAM)
+        return NULL;
+
+    struct Memory const *mem = (struct Memory const*)page->region->ctxt;
+    if (mem->fd < 0)
+        return NULL;
+    return mem;
+}
+
+void native_fastmem_register(struct memory_map const *map) {
+#ifdef FASTMEM_CTX_PC
+    if (!handler_installed)
+        return;
+
+    if (arena) {
+        error_set_feature("more than one fastmem arena");
+        RAISE_ERROR(ERROR_UNIMPLEMENTED);
+    }
+
+    uint8_t *base = mmap(NULL, FASTMEM_ARENA_LEN, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        LOG_ERROR("fastmem: unable to reserve host address space\n");
+        return;
+    }
+
+    /*
+     * walk the memory_map's page table and map every run of pages which
+     * resolves to contiguous system memory with a single mmap.
+     */
+    unsigned n_runs = 0;
+    unsigned page_no = 0;
+    while (page_no < MEMORY_MAP_N_PAGES) {
+        struct memory_map_page const *page = map->pages + page_no;
+        struct Memory const *mem = page_ram(page);
+
+        if (!mem) {
+            page_no++;
+            continue;
+        }
+
+        unsigned n_pages = 1;
+        while (page_no + n_pages < MEMORY_MAP_N_PAGES) {
+            struct memory_map_page const *next = page + n_pages;
+            if (page_ram(next) != mem ||
+                next->host != page->host + n_pages * MEMORY_MAP_PAGE_SIZE)
+                break;
+            n_pages++;
+        }
+
+        size_t len = (size_t)n_pages * MEMORY_MAP_PAGE_SIZE;
+        off_t offs = page->host - mem->mem;
+        uint8_t *dst = base + (uint64_t)page_no * MEMORY_MAP_PAGE_SIZE;
+        if (mmap(dst, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                 mem->fd, offs) == MAP_FAILED) {
+            LOG_ERROR("fastmem: unable to map system memory at guest address "
+                      "0x%08x\n", (unsigned)page_no << MEMORY_MAP_PAGE_SHIFT);
+            munmap(base, FASTMEM_ARENA_LEN);
+            return;
+        }
+
+        n_runs++;
+        page_no += n_pages;
+    }
+
+    if (!n_runs) {
+        LOG_WARN("fastmem: nothing to map; the arena will not be used\n");
+        munmap(base, FASTMEM_ARENA_LEN);
+        return;
+    }
+
+    LOG_INFO("fastmem: arena at %p (%u mappings)\n", base, n_runs);
+
+    arena = base;
+    arena_map = map;
+#endif
+}
+
+void *native_fastmem_base(struct memory_map const *map) {
+    if (arena && map == arena_map)
+        return arena;
+    return NULL;
+}
+
+void native_fastmem_add_site(struct native_fastmem_site *site) {
+    struct native_fastmem_site **bucket = site_tbl + site_hash(site->fault_addr);
+    site->next = *bucket;
+    *bucket = site;
+    n_sites++;
+}
+
+void native_fastmem_remove_site(struct native_fastmem_site *site) {
+    struct native_fastmem_site **pprev = site_tbl + site_hash(site->fault_addr);
+    while (*pprev) {
+        if (*pprev == site) {
+            *pprev = site->next;
+            site->next = NULL;
+            n_sites--;
+            return;
+        }
+        pprev = &(*pprev)->next;
+    }
+    RAISE_ERROR(ERROR_INTEGRITY);
+}
+
+void native_fastmem_get_stats(struct native_fastmem_stats *stats) {
+    stats->n_sites = n_sites;
+    stats->n_patched = n_patched;
+}
+
+void native_fastmem_print_stats(struct native_fastmem_stats const *stats) {
+    if (!arena)
+        return;
+
+    LOG_INFO("fastmem: %u active access sites\n", stats->n_sites);
+    LOG_INFO("fastmem: %u access sites patched to the slow path\n",
+             stats->n_patched);
+}
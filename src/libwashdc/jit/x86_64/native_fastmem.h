@@ -0,0 +1,93 @@
+/*******************************************************************************
+ *
+ *
+ *    WashingtonDC Dreamcast Emulator
+ *    Copyright (C) 2019 snickerbockers
+ *
+ *    This program is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *
+ ******************************************************************************/
+
+#ifndef NATIVE_FASTMEM_H_
+#define NATIVE_FASTMEM_H_
+
+#include <stdbool.h>
+
+#include "washdc/MemoryMap.h"
+
+#ifndef ENABLE_JIT_X86_64
+#error this file should not be built when the x86_64 JIT backend is disabled
+#endif
+
+/*
+ * fastmem reserves a 4GB region of the host's address space and maps system
+ * memory into it at every guest address where the memory_map would route an
+ * access to system memory.  Everything else in the arena is left inaccessible.
+ *
+ * This lets the native backend emit a plain host load/store against
+ * (arena + guest_addr) instead of calling into the memory_map.  When one of
+ * those accesses lands on something that isn't system memory (MMIO, texture
+ * memory, etc) the host raises SIGSEGV.  The signal handler looks up the
+ * faulting instruction, patches the start of the access sequence into a jump to
+ * an out-of-line slow path that calls the memory_map, and resumes execution in
+ * that slow path.  Subsequent executions of that access skip the fault and
+ * jump directly to the slow path.
+ */
+
+/*
+ * One of these is created for every memory access the native backend emits
+ * through the fastmem arena.
+ */
+struct native_fastmem_site {
+    // the load/store instruction which accesses the arena
+    void const *fault_addr;
+
+    /*
+     * start of the access sequence.  This must be at least five bytes long
+     * because it gets overwritten with a jump to stub.
+     */
+    void *patch_addr;
+
+    // slow-path which performs the access through the memory_map
+    void const *stub;
+
+    struct native_fastmem_site *next;
+};
+
+struct native_fastmem_stats {
+    unsigned n_sites;
+    unsigned n_patched;
+};
+
+void native_fastmem_init(void);
+void native_fastmem_cleanup(void);
+
+/*
+ * build the arena for the given map.  Only one map can own the arena at a time.
+ * It's not an error for this to fail; the native backend just won't use the
+ * arena.
+ */
+void native_fastmem_register(struct memory_map const *map);
+
+// returns the base of the arena if it is usable for map, else NULL.
+void *native_fastmem_base(struct memory_map const *map);
+
+void native_fastmem_add_site(struct native_fastmem_site *site);
+void native_fastmem_remove_site(struct native_fastmem_site *site);
+
+void native_fastmem_get_stats(struct native_fastmem_stats *stats);
+void native_fastmem_print_stats(struct native_fastmem_stats const *stats);
+
+#endif
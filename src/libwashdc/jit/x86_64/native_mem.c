@@ -34,6 +34,7 @@
 #include "washdc/MemoryMap.h"
 #include "exec_mem.h"
 #include "dreamcast.h"
+#include "jit/code_cache.h"
 #include "abi.h"
 
 #include "native_mem.h"
@@ -322,6 +323,29 @@ emit_ram_write_32(struct memory_map_region const *region, void *ctxt) {
     x86asm_andl_imm32_reg32(region->mask, REG_ARG0);
     x86asm_mov_imm64_reg64((uintptr_t)mem->mem, REG_RET);
     x86asm_movl_reg_sib(REG_ARG1, REG_RET, 1, REG_ARG0);
+
+    /*
+     * if the page may contain compiled code then tail-call
+     * code_cache_invalidate_ram.  The offset into RAM is still in EDI.
+     */
+    struct x86asm_lbl8 no_code;
+    x86asm_lbl8_init(&no_code);
+
+    x86asm_mov_reg32_reg32(REG_ARG0, REG_RET);
+    x86asm_shrl_imm8_reg32(CODE_CACHE_PAGE_SHIFT, REG_RET);
+    x86asm_mov_imm64_reg64((uintptr_t)code_cache_ram_pages, REG_ARG2);
+    x86asm_movl_sib_reg(REG_ARG2, 4, REG_RET, REG_RET);
+    x86asm_testl_reg32_reg32(REG_RET, REG_RET);
+    x86asm_jz_lbl8(&no_code);
+
+    x86asm_mov_reg32_reg32(REG_ARG0, REG_ARG1);
+    x86asm_addq_imm8_reg(sizeof(uint32_t) - 1, REG_ARG1);
+    x86asm_mov_imm64_reg64((uintptr_t)(void*)code_cache_invalidate_ram,
+                           REG_ARG3);
+    x86asm_jmpq_reg64(REG_ARG3);
+
+    x86asm_lbl8_define(&no_code);
+    x86asm_lbl8_cleanup(&no_code);
 }
 
 static struct native_mem_map *mem_map_impl(struct memory_map const *map) {
@@ -22,14 +22,53 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "log.h"
 
 #include "memory.h"
 
 void memory_init(struct Memory *mem) {
+    mem->fd = -1;
+    mem->mem = MAP_FAILED;
+
+#ifdef __linux__
+    /*
+     * back system memory with a memfd so that it can be mapped into more than
+     * one place in the host's address space.  If that doesn't work then fall
+     * back to anonymous memory; the only thing that loses is fastmem.
+     */
+    int fd = memfd_create("washdc_ram", 0);
+    if (fd >= 0) {
+        if (ftruncate(fd, MEMORY_SIZE) == 0) {
+            mem->mem = mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+        }
+        if (mem->mem == MAP_FAILED)
+            close(fd);
+        else
+            mem->fd = fd;
+    }
+#endif
+
+    if (mem->mem == MAP_FAILED) {
+        LOG_WARN("Unable to create shared-memory backing for system memory\n");
+        mem->mem = mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem->mem == MAP_FAILED)
+            RAISE_ERROR(ERROR_FAILED_ALLOC);
+    }
+
     memory_clear(mem);
 }
 
 void memory_cleanup(struct Memory *mem) {
+    munmap(mem->mem, MEMORY_SIZE);
+    if (mem->fd >= 0)
+        close(mem->fd);
+    mem->mem = NULL;
+    mem->fd = -1;
 }
 
 void memory_clear(struct Memory *mem) {
@@ -35,7 +35,14 @@
 #define MEMORY_SIZE (1 << MEMORY_SIZE_SHIFT)
 
 struct Memory {
-    uint8_t mem[MEMORY_SIZE];
+    uint8_t *mem;
+
+    /*
+     * file descriptor of the shared-memory object backing mem, or -1 if mem is
+     * anonymous.  This is what lets the x86_64 JIT's fastmem arena map system
+     * memory at all of its mirrors.
+     */
+    int fd;
 };
 
 void memory_init(struct Memory *mem);
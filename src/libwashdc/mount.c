@@ -21,15 +21,70 @@
  ******************************************************************************/
 
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
 
 #include "washdc/error.h"
 #include "cdrom.h"
+#include "log.h"
 
 #include "mount.h"
 
+// number of 2048-byte sectors held in the sector cache
+#define MOUNT_CACHE_LEN 2048
+
+// number of buckets in the sector cache's hash index (must be a power of two)
+#define MOUNT_CACHE_HASH_LEN 4096
+
+/*
+ * after every read, the read-ahead thread prefetches this many of the sectors
+ * which follow it (or until the end of the track, whichever comes first).
+ * It reads MOUNT_READAHEAD_CHUNK sectors at a time.
+ */
+#define MOUNT_READAHEAD_LEN 256
+#define MOUNT_READAHEAD_CHUNK 32
+
 static bool mounted;
 static struct mount img;
 
+/*
+ * the sector cache.  Every entry is always on the LRU list (invalid entries
+ * are only ever at the head), and valid entries are also on their hash
+ * bucket's chain.  Everything here is protected by cache_lock because the
+ * read-ahead thread fills the cache in the background.
+ */
+struct sector_cache_ent {
+    unsigned fad;
+    int hash_next, lru_prev, lru_next;
+    bool valid;
+};
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sector_cache_ent cache_ents[MOUNT_CACHE_LEN];
+static uint8_t cache_dat[MOUNT_CACHE_LEN][CDROM_FRAME_DATA_SIZE];
+static int cache_hash[MOUNT_CACHE_HASH_LEN];
+static int lru_head, lru_tail;
+
+static struct sector_cache_stat {
+    unsigned long hits, misses, prefetched;
+} cache_stat;
+
+/*
+ * read-ahead state.  ra_fad is the next sector to prefetch and ra_end is one
+ * past the last; the thread goes to sleep on ra_cond when they're equal.
+ * ra_gen gets incremented for every new request so the thread can tell
+ * whether the window moved while it wasn't holding cache_lock.
+ */
+static pthread_t ra_thread;
+static pthread_cond_t ra_cond = PTHREAD_COND_INITIALIZER;
+static bool ra_running, ra_exit;
+static unsigned ra_fad, ra_end, ra_gen;
+
+static void cache_init(void);
+static void readahead_start(void);
+static void readahead_stop(void);
+static void readahead_request(unsigned fad);
+
 void mount_insert(struct mount_ops const *ops, void *ptr) {
     if (img.state)
         mount_eject();
@@ -37,9 +92,18 @@ void mount_insert(struct mount_ops const *ops, void *ptr) {
     img.ops = ops;
     img.state = ptr;
     mounted = true;
+
+    cache_init();
+    if (ops->read_sectors)
+        readahead_start();
 }
 
 void mount_eject(void) {
+    readahead_stop();
+
+    LOG_INFO("sector cache: %lu hits, %lu misses, %lu sectors prefetched\n",
+             cache_stat.hits, cache_stat.misses, cache_stat.prefetched);
+
     if (img.ops->cleanup)
         img.ops->cleanup(&img);
 
@@ -73,22 +137,232 @@ int mount_read_toc(struct mount_toc* out, unsigned session) {
     }
 }
 
+static void cache_lru_unlink(int idx) {
+    struct sector_cache_ent *ent = cache_ents + idx;
+
+    if (ent->lru_prev >= 0)
+        cache_ents[ent->lru_prev].lru_next = ent->lru_next;
+    else
+        lru_head = ent->lru_next;
+
+    if (ent->lru_next >= 0)
+        cache_ents[ent->lru_next].lru_prev = ent->lru_prev;
+    else
+        lru_tail = ent->lru_prev;
+}
+
+static void cache_lru_append(int idx) {
+    struct sector_cache_ent *ent = cache_ents + idx;
+
+    ent->lru_next = -1;
+    ent->lru_prev = lru_tail;
+    if (lru_tail >= 0)
+        cache_ents[lru_tail].lru_next = idx;
+    else
+        lru_head = idx;
+    lru_tail = idx;
+}
+
+static void cache_init(void) {
+    pthread_mutex_lock(&cache_lock);
+
+    unsigned idx;
+    for (idx = 0; idx < MOUNT_CACHE_HASH_LEN; idx++)
+        cache_hash[idx] = -1;
+
+    lru_head = lru_tail = -1;
+    for (idx = 0; idx < MOUNT_CACHE_LEN; idx++) {
+        cache_ents[idx].valid = false;
+        cache_ents[idx].hash_next = -1;
+        cache_lru_append(idx);
+    }
+
+    memset(&cache_stat, 0, sizeof(cache_stat));
+
+    pthread_mutex_unlock(&cache_lock);
+}
+
+// cache_lock must be held
+static int cache_find(unsigned fad) {
+    int idx = cache_hash[fad & (MOUNT_CACHE_HASH_LEN - 1)];
+    while (idx >= 0 && cache_ents[idx].fad != fad)
+        idx = cache_ents[idx].hash_next;
+    return idx;
+}
+
+// cache_lock must be held
+static void cache_insert(unsigned fad, void const *dat) {
+    if (cache_find(fad) >= 0)
+        return;
+
+    // recycle the least-recently used entry
+    int idx = lru_head;
+    struct sector_cache_ent *ent = cache_ents + idx;
+
+    if (ent->valid) {
+        int *link = cache_hash + (ent->fad & (MOUNT_CACHE_HASH_LEN - 1));
+        while (*link != idx)
+            link = &cache_ents[*link].hash_next;
+        *link = ent->hash_next;
+    }
+
+    int *bucket = cache_hash + (fad & (MOUNT_CACHE_HASH_LEN - 1));
+    ent->fad = fad;
+    ent->valid = true;
+    ent->hash_next = *bucket;
+    *bucket = idx;
+    memcpy(cache_dat[idx], dat, CDROM_FRAME_DATA_SIZE);
+
+    cache_lru_unlink(idx);
+    cache_lru_append(idx);
+}
+
+/*
+ * read up to count sectors straight from the image without going through the
+ * cache.  Returns the number of sectors read (which may be less than count if
+ * the read crosses the end of a track), or a value less than or equal to zero
+ * on error.
+ */
+static int mount_read_direct(void *buf_out, unsigned fad, unsigned count) {
+    if (img.ops->read_sectors)
+        return img.ops->read_sectors(&img, buf_out, fad, count);
+    if (img.ops->read_sector(&img, buf_out, fad) != 0)
+        return -1;
+    return 1;
+}
+
 int mount_read_sectors(void *buf_out, unsigned fad_start,
                        unsigned sector_count) {
-    if (!mount_check() || !img.ops->read_sector)
+    if (!mount_check() || (!img.ops->read_sector && !img.ops->read_sectors))
         return -1;
 
-    unsigned fad;
-    for (fad = fad_start; fad < (fad_start + sector_count); fad++) {
-        void *where = ((uint8_t*)buf_out) +
-            CDROM_FRAME_DATA_SIZE * (fad - fad_start);
-        if (img.ops->read_sector(&img, where, fad) != 0)
+    uint8_t *buf8 = (uint8_t*)buf_out;
+    unsigned n_done = 0;
+    while (n_done < sector_count) {
+        unsigned run_len = 0;
+
+        pthread_mutex_lock(&cache_lock);
+        while (n_done < sector_count) {
+            int idx = cache_find(fad_start + n_done);
+            if (idx < 0)
+                break;
+            memcpy(buf8 + n_done * CDROM_FRAME_DATA_SIZE, cache_dat[idx],
+                   CDROM_FRAME_DATA_SIZE);
+            cache_lru_unlink(idx);
+            cache_lru_append(idx);
+            cache_stat.hits++;
+            n_done++;
+        }
+
+        // coalesce every consecutive miss into a single read
+        while (n_done + run_len < sector_count &&
+               cache_find(fad_start + n_done + run_len) < 0)
+            run_len++;
+        pthread_mutex_unlock(&cache_lock);
+
+        if (!run_len)
+            continue;
+
+        void *run_buf = buf8 + n_done * CDROM_FRAME_DATA_SIZE;
+        int n_read = mount_read_direct(run_buf, fad_start + n_done, run_len);
+        if (n_read <= 0)
             return -1;
+
+        pthread_mutex_lock(&cache_lock);
+        int sector_no;
+        for (sector_no = 0; sector_no < n_read; sector_no++) {
+            cache_insert(fad_start + n_done + sector_no,
+                         (uint8_t*)run_buf +
+                         sector_no * CDROM_FRAME_DATA_SIZE);
+        }
+        cache_stat.misses += n_read;
+        pthread_mutex_unlock(&cache_lock);
+
+        n_done += n_read;
     }
 
+    readahead_request(fad_start + sector_count);
+
     return 0;
 }
 
+static void *readahead_main(void *arg) {
+    static uint8_t buf[MOUNT_READAHEAD_CHUNK * CDROM_FRAME_DATA_SIZE];
+
+    pthread_mutex_lock(&cache_lock);
+    while (!ra_exit) {
+        while (ra_fad < ra_end && cache_find(ra_fad) >= 0)
+            ra_fad++;
+
+        if (ra_fad >= ra_end) {
+            pthread_cond_wait(&ra_cond, &cache_lock);
+            continue;
+        }
+
+        unsigned fad = ra_fad, gen = ra_gen;
+        unsigned count = ra_end - fad;
+        if (count > MOUNT_READAHEAD_CHUNK)
+            count = MOUNT_READAHEAD_CHUNK;
+
+        pthread_mutex_unlock(&cache_lock);
+        int n_read = img.ops->read_sectors(&img, buf, fad, count);
+        pthread_mutex_lock(&cache_lock);
+
+        if (n_read > 0) {
+            int sector_no;
+            for (sector_no = 0; sector_no < n_read; sector_no++)
+                cache_insert(fad + sector_no,
+                             buf + sector_no * CDROM_FRAME_DATA_SIZE);
+            cache_stat.prefetched += n_read;
+        }
+
+        if (gen == ra_gen) {
+            // stop at the end of the track (or on error)
+            if (n_read < (int)count)
+                ra_end = fad + (n_read > 0 ? n_read : 0);
+            ra_fad = fad + (n_read > 0 ? n_read : 0);
+        }
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    return NULL;
+}
+
+static void readahead_start(void) {
+    ra_exit = false;
+    ra_fad = ra_end = 0;
+    if (pthread_create(&ra_thread, NULL, readahead_main, NULL) != 0) {
+        LOG_ERROR("unable to launch the GD-ROM read-ahead thread\n");
+        return;
+    }
+    ra_running = true;
+}
+
+static void readahead_stop(void) {
+    if (!ra_running)
+        return;
+
+    pthread_mutex_lock(&cache_lock);
+    ra_exit = true;
+    pthread_cond_signal(&ra_cond);
+    pthread_mutex_unlock(&cache_lock);
+
+    pthread_join(ra_thread, NULL);
+    ra_running = false;
+}
+
+static void readahead_request(unsigned fad) {
+    if (!ra_running)
+        return;
+
+    pthread_mutex_lock(&cache_lock);
+    ra_fad = fad;
+    ra_end = fad + MOUNT_READAHEAD_LEN;
+    ra_gen++;
+    pthread_cond_signal(&ra_cond);
+    pthread_mutex_unlock(&cache_lock);
+}
+
 void const* mount_encode_toc(struct mount_toc const *toc) {
     static uint8_t toc_out[CDROM_TOC_SIZE];
 
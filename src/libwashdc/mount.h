@@ -107,6 +107,18 @@ struct mount_ops {
 
     int(*read_sector)(struct mount*, void*, unsigned);
 
+    /*
+     * read up to count consecutive sectors starting at the given FAD, stopping
+     * early at the end of that FAD's track.  Returns the number of sectors
+     * read, or a value less than or equal to zero on error.
+     *
+     * This is optional, but the read-ahead thread is only used for mounts
+     * which implement it.  It will be called from the read-ahead thread
+     * concurrently with the emulation thread's calls, so it cannot depend on
+     * any state shared between calls (like a stdio stream's file position).
+     */
+    int (*read_sectors)(struct mount*, void*, unsigned, unsigned);
+
     // release resources held by the mount
     void (*cleanup)(struct mount*);
 
@@ -127,6 +139,11 @@ unsigned mount_session_count(void);
 
 int mount_read_toc(struct mount_toc* out, unsigned session);
 
+/*
+ * read sector_count consecutive sectors into buf_out.  This goes through a
+ * cache of recently-read sectors, and it also asks the read-ahead thread to
+ * start prefetching the sectors which come after the ones that were read.
+ */
 int mount_read_sectors(void *buf_out, unsigned fad, unsigned sector_count);
 
 int mount_get_meta(struct mount_meta *meta);
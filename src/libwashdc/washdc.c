@@ -31,6 +31,7 @@
 #include "title.h"
 #include "washdc/win.h"
 #include "hw/pvr2/pvr2.h"
+#include "hw/sh4/sh4_jit.h"
 #include "log.h"
 
 static uint32_t trans_bind_washdc_to_maple(uint32_t wash);
@@ -57,16 +58,24 @@ washdc_init(struct washdc_launch_settings const *settings) {
     config_set_washdbg_enable(settings->washdbg_enable);
 #endif
     config_set_inline_mem(settings->inline_mem);
+    config_set_jit_idle_skip(settings->jit_idle_skip);
     config_set_jit(settings->enable_jit);
 #ifdef ENABLE_JIT_X86_64
     config_set_native_jit(settings->enable_native_jit);
+    config_set_fastmem(settings->fastmem);
 #endif
+    config_set_arm7_jit(settings->enable_arm7_jit);
+    config_set_arm7_jit_lockstep(settings->arm7_jit_lockstep);
     config_set_boot_mode(translate_boot_mode(settings->boot_mode));
     config_set_ip_bin_path(settings->path_ip_bin);
     config_set_exec_bin_path(settings->path_1st_read_bin);
     config_set_syscall_path(settings->path_syscalls_bin);
     config_set_dc_bios_path(settings->path_dc_bios);
     config_set_dc_flash_path(settings->path_dc_flash);
+    config_set_sched_trace_path(settings->path_sched_trace);
+    config_set_threaded_render(settings->threaded_render);
+    config_set_arm7_thread(settings->arm7_thread);
+    config_set_arm7_skew_limit(settings->arm7_skew_limit);
     config_set_ser_srv_enable(settings->enable_serial);
 
     win_set_intf(settings->win_intf);
@@ -208,6 +217,47 @@ void washdc_get_pvr2_stat(struct washdc_pvr2_stat *stat) {
         src.poly_count[DISPLAY_LIST_TRANS_MOD];
     stat->poly_count[WASHDC_PVR2_POLY_GROUP_PUNCH_THROUGH] =
         src.poly_count[DISPLAY_LIST_PUNCH_THROUGH];
+
+    struct pvr2_tex_cache_stat tex_src;
+    dc_get_tex_cache_stats(&tex_src);
+
+    stat->tex_lookups = tex_src.lookups;
+    stat->tex_hits = tex_src.hits;
+    stat->tex_evictions = tex_src.evictions;
+    stat->tex_uploads = tex_src.uploads;
+
+    struct pvr2_ta_batch_stat batch_src;
+    dc_get_ta_batch_stats(&batch_src);
+
+    stat->batch_draws_in = batch_src.draws_in;
+    stat->batch_draws_out = batch_src.draws_out;
+    stat->batch_verts_copied = batch_src.verts_copied;
+}
+
+void washdc_get_gfx_stat(struct washdc_gfx_stat *stat) {
+    struct gfx_stat src;
+    gfx_get_stat(&src);
+
+    stat->threaded = src.threaded;
+    stat->ring_len = src.ring_len;
+    stat->ring_cap = src.ring_cap;
+    stat->ring_peak = src.ring_peak;
+    stat->arena_len = src.arena_len;
+    stat->arena_cap = src.arena_cap;
+    stat->producer_stalls = src.producer_stalls;
+    stat->sync_waits = src.sync_waits;
+    stat->rend_draw_calls = src.rend_draw_calls;
+    stat->rend_upload_bytes = src.rend_upload_bytes;
+    stat->rend_persistent_map = src.rend_persistent_map;
+}
+
+void washdc_get_idle_stat(struct washdc_idle_stat *stat) {
+    struct sh4_jit_idle_stats src;
+    dc_get_idle_stats(&src);
+
+    stat->cycles_skipped_last_frame = src.cycles_skipped_last_frame;
+    stat->cycles_skipped = src.cycles_skipped;
+    stat->n_loops = src.n_loops;
 }
 
 void washdc_pause(void) {
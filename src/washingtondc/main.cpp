@@ -69,7 +69,18 @@ static void print_usage(char const *cmd) {
             "\t-l\t\tdump logs to stdout\n"
             "\t-m\t\tmount the given image in the GD-ROM drive\n"
             "\t-n\t\tdon't inline memory reads/writes into the jit\n"
+            "\t-i\t\tdon't let the jit fast-forward through idle loops\n"
+            "\t-F\t\tmap system memory into the host address space for the "
+            "native jit (fastmem)\n"
             "\t-p\t\tdisable the dynarec and enable the interpreter instead\n"
+            "\t-r <path>\trecord a scheduler event trace to the given path\n"
+            "\t-R\t\trender graphics on a dedicated thread\n"
+            "\t-a\t\trun the ARM7 on the dynamic recompiler\n"
+            "\t-A\t\tlike -a, but check every ARM7 block against the "
+            "interpreter\n"
+            "\t-T\t\trun the ARM7 and AICA on a dedicated thread\n"
+            "\t-k <usec>\thow far the ARM7 and SH4 may drift apart in -T "
+            "mode\n"
             "\t-j\t\tenable dynamic recompiler (as opposed to interpreter)\n"
             "\t-v\t\tenable verbose logging\n"
             "\t-x\t\tenable native x86_64 dynamic recompiler backend "
@@ -90,13 +101,19 @@ int main(int argc, char **argv) {
     char *path_1st_read_bin = NULL, *path_ip_bin = NULL;
     char *path_syscalls_bin = NULL;
     char *path_gdi = NULL;
+    char *path_sched_trace = NULL;
     bool enable_serial = false;
     bool enable_jit = false, enable_native_jit = false,
-        enable_interpreter = false, inline_mem = true;
+        enable_interpreter = false, inline_mem = true, fastmem = false;
+    bool jit_idle_skip = true;
+    bool threaded_render = false;
+    bool enable_arm7_jit = false, arm7_jit_lockstep = false;
+    bool arm7_thread = false;
+    int arm7_skew_limit = 0;
     bool log_stdout = false, log_verbose = false;
     struct washdc_launch_settings settings = { };
 
-    while ((opt = getopt(argc, argv, "b:f:s:m:d:u:ghtjxpnwlv")) != -1) {
+    while ((opt = getopt(argc, argv, "b:f:s:m:d:u:r:k:ghtjxpniwlvFRaAT")) != -1) {
         switch (opt) {
         case 'b':
             bios_path = optarg;
@@ -127,6 +144,25 @@ int main(int argc, char **argv) {
         case 'm':
             path_gdi = optarg;
             break;
+        case 'r':
+            path_sched_trace = optarg;
+            break;
+        case 'R':
+            threaded_render = true;
+            break;
+        case 'a':
+            enable_arm7_jit = true;
+            break;
+        case 'A':
+            enable_arm7_jit = true;
+            arm7_jit_lockstep = true;
+            break;
+        case 'T':
+            arm7_thread = true;
+            break;
+        case 'k':
+            arm7_skew_limit = atoi(optarg);
+            break;
         case 'h':
             print_usage(cmd);
             exit(0);
@@ -142,6 +178,12 @@ int main(int argc, char **argv) {
         case 'n':
             inline_mem = false;
             break;
+        case 'i':
+            jit_idle_skip = false;
+            break;
+        case 'F':
+            fastmem = true;
+            break;
         case 'l':
             log_stdout = true;
             break;
@@ -210,10 +252,12 @@ int main(int argc, char **argv) {
     }
 
     settings.inline_mem = inline_mem;
+    settings.jit_idle_skip = jit_idle_skip;
     settings.enable_jit = enable_jit || enable_native_jit;
 
     if (washdc_have_x86_64_jit()) {
         settings.enable_native_jit = enable_native_jit;
+        settings.fastmem = fastmem;
     } else {
         if (enable_native_jit) {
             fprintf(stderr, "ERROR: the native x86_64 jit backend was not enabled "
@@ -222,6 +266,11 @@ int main(int argc, char **argv) {
                     "the native x86_64 jit backend.\n");
             exit(1);
         }
+        if (fastmem) {
+            fprintf(stderr, "ERROR: fastmem requires the native x86_64 jit "
+                    "backend.\n");
+            exit(1);
+        }
     }
 
     if (skip_ip_bin) {
@@ -259,6 +308,12 @@ int main(int argc, char **argv) {
     settings.path_dc_flash = flash_path;
     settings.enable_serial = enable_serial;
     settings.path_gdi = path_gdi;
+    settings.path_sched_trace = path_sched_trace;
+    settings.threaded_render = threaded_render;
+    settings.enable_arm7_jit = enable_arm7_jit;
+    settings.arm7_jit_lockstep = arm7_jit_lockstep;
+    settings.arm7_thread = arm7_thread;
+    settings.arm7_skew_limit = arm7_skew_limit;
     settings.win_intf = get_win_intf_glfw();
 
 #ifdef ENABLE_TCP_SERIAL
@@ -270,6 +325,7 @@ int main(int argc, char **argv) {
     overlay_intf.overlay_draw = overlay::draw;
     overlay_intf.overlay_set_fps = overlay::set_fps;
     overlay_intf.overlay_set_virt_fps = overlay::set_virt_fps;
+    overlay_intf.overlay_cleanup_gfx = overlay::cleanup_gfx;
 
     settings.overlay_intf = &overlay_intf;
 
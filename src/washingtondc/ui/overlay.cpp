@@ -169,6 +169,14 @@ void overlay::draw() {
         sound::mute(do_mute_audio);
 
     ImGui::Render();
+
+    /*
+     * the renderer gets created here instead of in overlay::init because
+     * this is the only place that's guaranteed to be on the thread that owns
+     * the OpenGL context.
+     */
+    if (!ui_renderer)
+        ui_renderer = std::make_unique<renderer>();
     ui_renderer->do_render(ImGui::GetDrawData());
 }
 
@@ -224,6 +232,33 @@ static void overlay::show_perf_win(void) {
                 stat.poly_count[WASHDC_PVR2_POLY_GROUP_TRANS_MOD]);
     ImGui::Text("%u punch-through polygons",
                 stat.poly_count[WASHDC_PVR2_POLY_GROUP_PUNCH_THROUGH]);
+    ImGui::Text("texture cache: %u / %u hits, %u evictions, %u uploads",
+                stat.tex_hits, stat.tex_lookups, stat.tex_evictions,
+                stat.tex_uploads);
+    ImGui::Text("draw batching: %u draws -> %u, %u vertices copied",
+                stat.batch_draws_in, stat.batch_draws_out,
+                stat.batch_verts_copied);
+
+    struct washdc_idle_stat idle_stat;
+    washdc_get_idle_stat(&idle_stat);
+    ImGui::Text("idle loops: %llu SH4 cycles skipped last frame "
+                "(%llu loops found)", idle_stat.cycles_skipped_last_frame,
+                idle_stat.n_loops);
+
+    struct washdc_gfx_stat gfx_stat;
+    washdc_get_gfx_stat(&gfx_stat);
+    if (gfx_stat.threaded) {
+        ImGui::Text("render ring: %u / %u commands (peak %u)",
+                    gfx_stat.ring_len, gfx_stat.ring_cap, gfx_stat.ring_peak);
+        ImGui::Text("render arena: %zu / %zu KB", gfx_stat.arena_len / 1024,
+                    gfx_stat.arena_cap / 1024);
+        ImGui::Text("%llu producer stalls, %llu sync waits",
+                    gfx_stat.producer_stalls, gfx_stat.sync_waits);
+    }
+    ImGui::Text("renderer: %u draw calls, %llu KB of vertices (%s)",
+                gfx_stat.rend_draw_calls, gfx_stat.rend_upload_bytes / 1024,
+                gfx_stat.rend_persistent_map ?
+                "persistent mapping" : "glBufferSubData");
     ImGui::End();
 }
 
@@ -293,18 +328,18 @@ void overlay::init(bool enable_debugger) {
     have_debugger = enable_debugger;
 
     ImGui::CreateContext();
-
-    ui_renderer = std::make_unique<renderer>();
 }
 
 void overlay::cleanup() {
-    ui_renderer.reset();
-
     ImGui::DestroyContext();
 
     delete[] sndchan_mute;
 }
 
+void overlay::cleanup_gfx() {
+    ui_renderer.reset();
+}
+
 void overlay::update() {
     ui_renderer->update();
 }
@@ -33,6 +33,12 @@
 namespace overlay {
     void init(bool enabled_debugger);
     void cleanup();
+
+    /*
+     * this releases the overlay's OpenGL resources.  It gets called from the
+     * thread that owns the OpenGL context.
+     */
+    void cleanup_gfx();
     void draw();
     void update();
     void show(bool do_show);